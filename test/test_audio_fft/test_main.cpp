@@ -0,0 +1,178 @@
+/*
+ * AudioFFT on the host: float and fixed point results against a reference DFT, and time per frame.
+ * The input is a WAV file built in memory and read through PcmReader, like FileSource plays it on the device.
+ *
+ * pio test -e native -f test_audio_fft -v   (-v shows the accuracy and timing report)
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include <chrono>
+
+#include "audio_pcm.h"
+#include "audio_dsp.h"
+
+#define SAMPLE_RATE 22050
+#define N 512
+
+struct MemStream {
+  std::vector<uint8_t> data;
+  size_t pos = 0;
+  size_t read(uint8_t* buf, size_t len) {
+    if (pos + len > data.size()) len = data.size() - pos;
+    memcpy(buf, data.data() + pos, len);
+    pos += len;
+    return len;
+  }
+  bool seek(uint32_t p) { if (p > data.size()) return false; pos = p; return true; }
+};
+
+struct Tone { float freq, amp; };
+
+// 16 bit WAV with a mix of tones and a little noise; channels > 1 get the same signal with a different noise
+static void makeWav(MemStream& s, uint32_t rate, uint16_t channels, uint32_t frames, const Tone* tones, uint8_t numTones) {
+  s.data.assign(PCM_WAV_HEADER_SIZE + frames * channels * 2, 0);
+  makeWavHeader(s.data.data(), rate, frames * channels);
+  pcmPutLE16(s.data.data() + 22, channels);
+  pcmPutLE32(s.data.data() + 28, rate * 2 * channels);
+  pcmPutLE16(s.data.data() + 32, 2 * channels);
+  uint32_t seed = 1;
+  uint8_t* p = s.data.data() + PCM_WAV_HEADER_SIZE;
+  for (uint32_t i = 0; i < frames; i++) {
+    double v = 300.0;  // DC offset, as from a microphone
+    for (uint8_t t = 0; t < numTones; t++) v += tones[t].amp * sin(2.0 * M_PI * tones[t].freq * i / rate);
+    for (uint16_t c = 0; c < channels; c++) {
+      seed = seed * 1103515245 + 12345;
+      pcmPutLE16(p, (uint16_t)(int16_t)lrint(v + (int)((seed >> 16) & 63) - 32));
+      p += 2;
+    }
+  }
+  s.pos = 0;
+}
+
+// unscaled DFT of the DC free, flat-top windowed input in double precision
+static void referenceDFT(const float* in, double* mag) {
+  double mean = 0.0, x[N];
+  for (uint16_t i = 0; i < N; i++) mean += in[i];
+  mean /= N;
+  for (uint16_t i = 0; i < N; i++) {
+    uint16_t h = i < N/2 ? i : N-1-i;
+    double ratio = (double)h / (N - 1);
+    x[i] = (in[i] - mean) * (0.2810639 - 0.5208972 * cos(2.0 * M_PI * ratio) + 0.1980399 * cos(4.0 * M_PI * ratio));
+  }
+  for (uint16_t k = 0; k < N/2; k++) {
+    double re = 0.0, im = 0.0;
+    for (uint16_t i = 0; i < N; i++) {
+      double a = 2.0 * M_PI * (double)((uint32_t)k * i % N) / N;
+      re += x[i] * cos(a);
+      im -= x[i] * sin(a);
+    }
+    mag[k] = sqrt(re * re + im * im);
+  }
+}
+
+static const Tone tones[] = { {440.0f, 8000.0f}, {2500.0f, 2000.0f}, {6000.0f, 500.0f} };
+
+static AudioFFT<float, N>   fftFloat;
+static AudioFFT<int32_t, N> fftFixed;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// largest error of all bins relative to the strongest bin, over all frames of the file
+template<typename T> static float maxError(AudioFFT<T, N>& fft, uint32_t inRate, uint16_t channels) {
+  MemStream file;
+  makeWav(file, inRate, channels, inRate, tones, 3);   // one second
+  PcmReader<MemStream> reader;
+  if (!reader.begin(&file, SAMPLE_RATE, false)) return 1e9f;
+  float in[N], mag[N/2];
+  double ref[N/2];
+  float worst = 0.0f;
+  while (reader.read(in, N) == N) {
+    fft.compute(in, mag);
+    referenceDFT(in, ref);
+    double peak = 0.0, err = 0.0;
+    for (uint16_t k = 0; k < N/2; k++) {
+      if (ref[k] > peak) peak = ref[k];
+      if (fabs(mag[k] - ref[k]) > err) err = fabs(mag[k] - ref[k]);
+    }
+    if (err / peak > worst) worst = err / peak;
+  }
+  return worst;
+}
+
+template<typename T> static float microsPerFrame(AudioFFT<T, N>& fft) {
+  float in[N], mag[N/2];
+  for (uint16_t i = 0; i < N; i++) in[i] = 8000.0f * sinf(2.0f * (float)M_PI * 440.0f * i / SAMPLE_RATE);
+  const int runs = 2000;
+  volatile float sink = 0.0f;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < runs; r++) {
+    in[r % N] += 1.0f;
+    fft.compute(in, mag);
+    sink = sink + mag[10];
+  }
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  return (float)us / runs;
+}
+
+static void report(const char* what, float value, const char* unit) {
+  char msg[96];
+  snprintf(msg, sizeof(msg), "%s: %.3g %s", what, value, unit);
+  TEST_MESSAGE(msg);
+}
+
+void test_float_matches_dft(void) {
+  float err = maxError(fftFloat, SAMPLE_RATE, 1);
+  report("float, max error", err * 100.0f, "% of peak");
+  TEST_ASSERT_TRUE(err < 1e-5f);
+}
+
+void test_fixed_matches_dft(void) {
+  float err = maxError(fftFixed, SAMPLE_RATE, 1);
+  report("int32_t, max error", err * 100.0f, "% of peak");
+  TEST_ASSERT_TRUE(err < 2e-3f);
+}
+
+// 44.1kHz stereo file as recorded by a PC: mixed down and converted by PcmReader before the FFT
+void test_resampled_wav(void) {
+  float err = maxError(fftFloat, 44100, 2);
+  report("float, 44.1kHz stereo input, max error", err * 100.0f, "% of peak");
+  TEST_ASSERT_TRUE(err < 1e-5f);
+}
+
+void test_major_peak(void) {
+  MemStream file;
+  makeWav(file, SAMPLE_RATE, 1, N, tones, 3);
+  PcmReader<MemStream> reader;
+  TEST_ASSERT_TRUE(reader.begin(&file, SAMPLE_RATE, false));
+  float in[N], mag[N/2], freq, magnitude, freqFixed, magnitudeFixed;
+  TEST_ASSERT_EQUAL(N, reader.read(in, N));
+  fftFloat.compute(in, mag);
+  AudioFFT<float, N>::majorPeak(mag, N/2, SAMPLE_RATE, freq, magnitude);
+  fftFixed.compute(in, mag);
+  AudioFFT<int32_t, N>::majorPeak(mag, N/2, SAMPLE_RATE, freqFixed, magnitudeFixed);
+  report("major peak (float)", freq, "Hz");
+  report("major peak (int32_t)", freqFixed, "Hz");
+  const float binHz = (float)SAMPLE_RATE / N;
+  TEST_ASSERT_FLOAT_WITHIN(binHz / 2, 440.0f, freq);
+  TEST_ASSERT_FLOAT_WITHIN(binHz / 2, 440.0f, freqFixed);
+  TEST_ASSERT_FLOAT_WITHIN(magnitude * 0.01f, magnitude, magnitudeFixed);
+}
+
+void test_timing(void) {
+  report("float, time per frame", microsPerFrame(fftFloat), "us");
+  report("int32_t, time per frame", microsPerFrame(fftFixed), "us");
+}
+
+int main(int argc, char** argv) {
+  fftFloat.init();
+  fftFixed.init();
+  UNITY_BEGIN();
+  RUN_TEST(test_float_matches_dft);
+  RUN_TEST(test_fixed_matches_dft);
+  RUN_TEST(test_resampled_wav);
+  RUN_TEST(test_major_peak);
+  RUN_TEST(test_timing);
+  return UNITY_END();
+}
@@ -0,0 +1,136 @@
+/*
+ * BeatTracker on the host, fed from a WAV fixture through PcmReader and AudioFFT like the audioreactive FFT task.
+ *
+ * test/fixtures/beat_120bpm.wav: 2 seconds (one bar, looped) of 8kHz mono 16 bit. A kick drum (120Hz to 50Hz
+ * sweep, 60ms decay, 240ms long) on every beat at 120 BPM, a short noise burst (hi-hat, 15ms decay) on every off
+ * beat and a steady 330Hz tone underneath. The hi-hats make the onset strength periodic at 250ms, with the beat
+ * period of 21.5 frames the tracker has to find 120 BPM between 80 (32.3 frames) and 60 BPM (43.1 frames).
+ *
+ * pio test -e native -f test_beat_tracker
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+
+#include "audio_pcm.h"
+#include "audio_dsp.h"
+
+#define SAMPLE_RATE 22050
+#define N 512
+#define KICK_PERIOD 500   // ms
+
+struct FileStream {
+  FILE* f = nullptr;
+  size_t read(uint8_t* buf, size_t len) { return fread(buf, 1, len, f); }
+  bool seek(uint32_t p) { return fseek(f, p, SEEK_SET) == 0; }
+};
+
+static std::string fixture(const char* name) {
+  std::string path(__FILE__);
+  return path.substr(0, path.find_last_of("/\\") + 1) + "../fixtures/" + name;
+}
+
+static AudioFFT<float, N> fft;
+static BeatTracker tracker;
+static FileStream file;
+static PcmReader<FileStream> reader;
+
+// frame times, the first frame ends at N samples
+static inline uint32_t frameTime(uint32_t frame) { return (uint64_t)(frame + 1) * N * 1000 / SAMPLE_RATE; }
+
+// distance of t to the closest multiple of period (ms)
+static inline uint32_t gridDistance(uint32_t t, uint32_t period) {
+  uint32_t r = t % period;
+  return r < period - r ? r : period - r;
+}
+
+void setUp(void) {
+  file.f = fopen(fixture("beat_120bpm.wav").c_str(), "rb");
+  TEST_ASSERT_NOT_NULL(file.f);
+  TEST_ASSERT_TRUE(reader.begin(&file, SAMPLE_RATE, true));
+  tracker.init((float)SAMPLE_RATE / N, (float)SAMPLE_RATE / N);
+}
+
+void tearDown(void) {
+  if (file.f) fclose(file.f);
+  file.f = nullptr;
+}
+
+// runs the tracker over seconds of audio, calls check(time) after every frame
+template<typename F> static void run(uint32_t seconds, F check) {
+  float in[N], mag[N/2];
+  uint32_t frames = (uint64_t)seconds * SAMPLE_RATE / N;
+  for (uint32_t i = 0; i < frames; i++) {
+    TEST_ASSERT_EQUAL(N, reader.read(in, N));
+    fft.compute(in, mag);
+    tracker.process(mag, N/2, frameTime(i));
+    check(frameTime(i));
+  }
+}
+
+// every onset is on a kick or a hi-hat, and all kicks are found
+void test_onsets(void) {
+  uint32_t onsets = 0, offGrid = 0, kicks = 0;
+  run(10, [&](uint32_t t) {
+    if (!tracker.onset) return;
+    onsets++;
+    // reported in the frame that contains the attack or up to 3 frames later
+    uint32_t d = t % (KICK_PERIOD/2);
+    if (d > 75) offGrid++;
+    if (gridDistance(t, KICK_PERIOD) < 80) kicks++;
+  });
+  char msg[80];
+  snprintf(msg, sizeof(msg), "%u onsets, %u on kicks, %u off the grid", onsets, kicks, offGrid);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL(0, offGrid);
+  TEST_ASSERT_TRUE(kicks >= 19);           // 20 kicks in 10 seconds, the first one has no history
+  TEST_ASSERT_TRUE(onsets <= 40);          // kicks and hi-hats only
+}
+
+// tempo locks to 120 BPM (not 60 or 240) once the history is filled, and beats fall on the kicks
+void test_tempo_and_beats(void) {
+  uint32_t beats = 0, beatsOnKick = 0, lockedAt = 0, lastBeat = 0, maxGap = 0;
+  run(20, [&](uint32_t t) {
+    if (!lockedAt && tracker.bpm > 0.0f && fabsf(tracker.bpm - 120.0f) < 2.0f) lockedAt = t;
+    if (t < 10000 || !tracker.beat) return;
+    beats++;
+    if (gridDistance(t, KICK_PERIOD) < 60) beatsOnKick++;
+    if (lastBeat && t - lastBeat > maxGap) maxGap = t - lastBeat;
+    lastBeat = t;
+  });
+  char msg[100];
+  snprintf(msg, sizeof(msg), "%.2f BPM (locked after %ums), confidence %u, %u beats in 10s, %u on kicks, max gap %ums",
+           tracker.bpm, lockedAt, tracker.confidence, beats, beatsOnKick, maxGap);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_FLOAT_WITHIN(2.0f, 120.0f, tracker.bpm);
+  TEST_ASSERT_TRUE(lockedAt > 0 && lockedAt < 10000);
+  TEST_ASSERT_TRUE(tracker.confidence >= 40);
+  TEST_ASSERT_TRUE(beats >= 19 && beats <= 21);
+  TEST_ASSERT_TRUE(beatsOnKick >= beats - 1);
+  TEST_ASSERT_TRUE(maxGap < KICK_PERIOD + 60);
+}
+
+// the bass envelope follows the kicks: high right after a kick, low before the next one
+void test_bass_envelope(void) {
+  uint32_t high = 0, low = 0;
+  run(6, [&](uint32_t t) {
+    if (t < 2000) return;
+    uint32_t r = t % KICK_PERIOD;
+    if (r < 100 && tracker.envelope[0] > 150) high++;
+    if (r > 400 && tracker.envelope[0] < 100) low++;
+  });
+  char msg[64];
+  snprintf(msg, sizeof(msg), "bass envelope: %u frames high after kicks, %u low", high, low);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(high >= 8);
+  TEST_ASSERT_TRUE(low >= 8);
+}
+
+int main(int argc, char** argv) {
+  fft.init();
+  UNITY_BEGIN();
+  RUN_TEST(test_onsets);
+  RUN_TEST(test_tempo_and_beats);
+  RUN_TEST(test_bass_envelope);
+  return UNITY_END();
+}
@@ -0,0 +1,155 @@
+/*
+ * Replay of recorded audio on the host: the same steps FileSource::getSamples() and FFTcode() run on the device
+ * (PcmReader with loop, sample scaling, AudioFFT, majorPeak, GEQ bands, BeatTracker) on test/fixtures/beat_120bpm.wav.
+ * A replay has to give the same results every time, from a WAV file as well as from raw PCM.
+ *
+ * pio test -e native -f test_file_replay
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "audio_pcm.h"
+#include "audio_dsp.h"
+
+#define SAMPLE_RATE 22050
+#define N 512
+
+struct FileStream {
+  FILE* f = nullptr;
+  size_t read(uint8_t* buf, size_t len) { return fread(buf, 1, len, f); }
+  bool seek(uint32_t p) { return fseek(f, p, SEEK_SET) == 0; }
+};
+
+static std::string fixture(const char* name) {
+  std::string path(__FILE__);
+  return path.substr(0, path.find_last_of("/\\") + 1) + "../fixtures/" + name;
+}
+
+// what FFTcode() publishes per batch (fftFrame), without the timestamps
+struct Result {
+  float   majorPeak, magnitude;
+  float   geq[4];
+  bool    onset, beat;
+  float   bpm;
+  uint8_t envelope[BeatTracker::BANDS];
+  bool operator==(const Result& o) const {
+    return majorPeak == o.majorPeak && magnitude == o.magnitude && !memcmp(geq, o.geq, sizeof(geq)) && onset == o.onset
+        && beat == o.beat && bpm == o.bpm && !memcmp(envelope, o.envelope, sizeof(envelope));
+  }
+};
+
+static const geq_band_t bands[4] = {
+  {  1,   5, 1.0f/5 },    // < 250Hz
+  {  6,  23, 1.0f/18 },   // < 1kHz
+  { 24,  92, 1.0f/69 },   // < 4kHz
+  { 93, 255, 1.0f/163 },
+};
+
+static AudioFFT<float, N> fft;
+static BeatTracker tracker;
+
+// FileSource::getSamples(): a short read (end of a file without loop) is padded with silence
+static void getSamples(PcmReader<FileStream>& reader, float* buffer, float sampleScale) {
+  size_t n = reader.read(buffer, N);
+  for (size_t i = 0; i < N; i++) buffer[i] = (i < n) ? buffer[i] * sampleScale : 0.0f;
+}
+
+static std::vector<Result> replay(FILE* f, uint32_t frames, bool loop) {
+  std::vector<Result> results;
+  FileStream file;
+  file.f = f;
+  PcmReader<FileStream> reader;
+  if (!f || !reader.begin(&file, SAMPLE_RATE, loop)) return results;
+  tracker.init((float)SAMPLE_RATE / N, (float)SAMPLE_RATE / N);
+  float in[N], mag[N/2];
+  for (uint32_t i = 0; i < frames; i++) {
+    Result r;
+    getSamples(reader, in, 1.0f);
+    fft.compute(in, mag);
+    AudioFFT<float, N>::majorPeak(mag, N/2, SAMPLE_RATE, r.majorPeak, r.magnitude);
+    mapGEQBands(bands, 4, mag, r.geq);
+    tracker.process(mag, N/2, (uint64_t)(i + 1) * N * 1000 / SAMPLE_RATE);
+    r.onset = tracker.onset;
+    r.beat = tracker.beat;
+    r.bpm = tracker.bpm;
+    memcpy(r.envelope, tracker.envelope, sizeof(r.envelope));
+    results.push_back(r);
+  }
+  return results;
+}
+
+static std::vector<Result> replayFixture(uint32_t frames) {
+  FILE* f = fopen(fixture("beat_120bpm.wav").c_str(), "rb");
+  std::vector<Result> results = replay(f, frames, true);
+  if (f) fclose(f);
+  return results;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// a looped replay runs without gaps and gives the same results every time
+void test_replay_is_repeatable(void) {
+  const uint32_t frames = 10 * SAMPLE_RATE / N;  // 5 loops of the file
+  std::vector<Result> a = replayFixture(frames);
+  std::vector<Result> b = replayFixture(frames);
+  TEST_ASSERT_EQUAL(frames, a.size());
+  TEST_ASSERT_EQUAL(frames, b.size());
+  uint32_t beats = 0, silent = 0;
+  for (uint32_t i = 0; i < frames; i++) {
+    TEST_ASSERT_TRUE(a[i] == b[i]);
+    if (a[i].beat) beats++;
+    if (a[i].magnitude == 0.0f) silent++;
+  }
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%u frames, %u beats, %u without peak", frames, beats, silent);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(beats >= 18);
+  TEST_ASSERT_EQUAL(0, silent);
+}
+
+// raw 16 bit PCM at the sample rate (no header) plays exactly like a WAV file with the same samples
+void test_raw_pcm_equals_wav(void) {
+  const uint32_t samples = 4 * SAMPLE_RATE;
+  std::vector<int16_t> pcm(samples);
+  {
+    FileStream file;
+    file.f = fopen(fixture("beat_120bpm.wav").c_str(), "rb");
+    TEST_ASSERT_NOT_NULL(file.f);
+    PcmReader<FileStream> reader;
+    TEST_ASSERT_TRUE(reader.begin(&file, SAMPLE_RATE, true));
+    std::vector<float> s(samples);
+    TEST_ASSERT_EQUAL(samples, reader.read(s.data(), samples));
+    fclose(file.f);
+    for (uint32_t i = 0; i < samples; i++) pcm[i] = (int16_t)lrintf(s[i]);
+  }
+  uint8_t header[PCM_WAV_HEADER_SIZE];
+  makeWavHeader(header, SAMPLE_RATE, samples);
+  FILE* wav = tmpfile();
+  FILE* raw = tmpfile();
+  TEST_ASSERT_NOT_NULL(wav);
+  TEST_ASSERT_NOT_NULL(raw);
+  fwrite(header, 1, sizeof(header), wav);
+  fwrite(pcm.data(), 2, samples, wav);          // little endian host
+  fwrite(pcm.data(), 2, samples, raw);
+
+  const uint32_t frames = samples / N + 10;     // past the end: the tail is padded with silence
+  std::vector<Result> a = replay(wav, frames, false);
+  std::vector<Result> b = replay(raw, frames, false);
+  fclose(wav);
+  fclose(raw);
+  TEST_ASSERT_EQUAL(frames, a.size());
+  TEST_ASSERT_EQUAL(frames, b.size());
+  for (uint32_t i = 0; i < frames; i++) TEST_ASSERT_TRUE(a[i] == b[i]);
+  TEST_ASSERT_TRUE(a[frames - 1].magnitude == 0.0f && a[frames - 1].geq[0] == 0.0f);
+}
+
+int main(int argc, char** argv) {
+  fft.init();
+  UNITY_BEGIN();
+  RUN_TEST(test_replay_is_repeatable);
+  RUN_TEST(test_raw_pcm_equals_wav);
+  return UNITY_END();
+}
@@ -0,0 +1,129 @@
+/*
+ * FrameHandoff with real threads: a renderer, an output task and a loop that pauses the output to change the
+ * bus configuration. The slot and the configuration are plain memory, so run it under ThreadSanitizer as well:
+ *
+ * pio test -e native -f test_frame_handoff
+ * pio test -e native_tsan
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <thread>
+
+#include "frame_handoff.h"
+
+#define SLOT_SIZE 64
+#define FRAMES    200000
+#define PAUSES    2000
+
+static FrameHandoff handoff;
+static uint32_t slot[SLOT_SIZE];          // handoff buffer, written by the renderer and read by the output
+static struct { uint32_t a, b; } config;  // changed by the loop while paused, used by the output (b == 2a)
+static std::atomic<bool> rendering{true};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void renderer() {
+  for (uint32_t f = 1; f <= FRAMES; f++) {
+    handoff.beginWrite();
+    for (uint16_t i = 0; i < SLOT_SIZE; i++) slot[i] = f + i;
+    handoff.commit();
+    std::this_thread::yield();          // rendering the next frame takes a while
+  }
+  rendering = false;
+}
+
+struct OutputStats {
+  uint32_t received = 0, torn = 0, outOfOrder = 0, badConfig = 0, paused = 0, last = 0;
+};
+
+static void output(OutputStats& s) {
+  uint32_t copy[SLOT_SIZE];
+  for (;;) {
+    bool done = !rendering;             // read before the last check of the slot
+    if (!handoff.enter()) {
+      s.paused++;
+      std::this_thread::yield();
+      continue;
+    }
+    if (config.b != 2 * config.a) s.badConfig++;
+    bool got = handoff.beginRead();
+    if (got) {
+      memcpy(copy, slot, sizeof(copy));
+      handoff.endRead();
+    }
+    handoff.leave();
+    if (got) {
+      s.received++;
+      for (uint16_t i = 1; i < SLOT_SIZE; i++) if (copy[i] != copy[0] + i) { s.torn++; break; }
+      if (copy[0] <= s.last) s.outOfOrder++;
+      s.last = copy[0];
+    } else if (done) break;
+    else std::this_thread::yield();
+  }
+}
+
+// every committed frame is either sent or counted as dropped, sent frames are complete and in order,
+// and the output never sees the configuration half changed
+void test_handoff_and_pause(void) {
+  OutputStats stats;
+  config.a = 1;
+  config.b = 2;
+  std::thread out(output, std::ref(stats));
+  std::thread render(renderer);
+
+  uint32_t pauses = 0;
+  while (rendering || pauses < PAUSES) {
+    handoff.pause();
+    handoff.pause();                    // nested, as from a reconfiguration inside a state change
+    config.a++;
+    std::this_thread::yield();
+    config.b = 2 * config.a;
+    handoff.resume();
+    handoff.resume();
+    pauses++;
+    std::this_thread::yield();
+  }
+  render.join();
+  out.join();
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "%u frames, %u sent, %u dropped, %u pauses, output paused %u times",
+           handoff.frames, stats.received, handoff.dropped, pauses, stats.paused);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL(FRAMES, handoff.frames);
+  TEST_ASSERT_TRUE(stats.received > FRAMES / 100); // the threads did run interleaved
+  TEST_ASSERT_EQUAL(FRAMES, stats.received + handoff.dropped);
+  TEST_ASSERT_EQUAL(FRAMES, stats.last);            // the newest frame always gets out
+  TEST_ASSERT_EQUAL(0, stats.torn);
+  TEST_ASSERT_EQUAL(0, stats.outOfOrder);
+  TEST_ASSERT_EQUAL(0, stats.badConfig);
+  TEST_ASSERT_FALSE(handoff.pending());
+}
+
+// a paused output does not touch the slot: frames pile up as dropped and the newest is sent after resume()
+void test_paused_output_skips(void) {
+  FrameHandoff h;
+  h.pause();
+  TEST_ASSERT_FALSE(h.enter());
+  for (uint8_t i = 0; i < 3; i++) {
+    h.beginWrite();
+    h.commit();
+  }
+  TEST_ASSERT_TRUE(h.pending());
+  TEST_ASSERT_EQUAL(2, h.dropped);
+  h.resume();
+  TEST_ASSERT_TRUE(h.enter());
+  TEST_ASSERT_TRUE(h.beginRead());
+  TEST_ASSERT_FALSE(h.beginRead());
+  h.endRead();
+  h.leave();
+  TEST_ASSERT_FALSE(h.pending());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_paused_output_skips);
+  RUN_TEST(test_handoff_and_pause);
+  return UNITY_END();
+}
@@ -380,6 +380,27 @@ class MyExampleUsermod : public Usermod {
       return USERMOD_ID_EXAMPLE;
     }
 
+
+    /*
+     * getHooks() tells the usermod manager which methods this usermod implements (UM_HOOK_* flags, see const.h).
+     * Only those are called, which saves time in the main loop and when rendering. Without it all methods are called.
+     * Setup, config, connected() and onUpdateBegin() are always called.
+     * The hooks are read when the usermod is added and again after setup(), so they can depend on the configuration.
+     */
+    uint16_t getHooks()
+    {
+      return UM_HOOK_LOOP | UM_HOOK_OVERLAY | UM_HOOK_BUTTON | UM_HOOK_JSON_STATE | UM_HOOK_JSON_INFO | UM_HOOK_MQTT | UM_HOOK_STATE;
+    }
+
+    /*
+     * getLoopInterval() sets the minimum time between two loop() calls in milliseconds (default 0: every main loop).
+     * Time spent in loop() and handleOverlayDraw() is shown per usermod in /json/info ("umt").
+     */
+    uint16_t getLoopInterval()
+    {
+      return 0;
+    }
+
    //More methods can be added in the future, this example will then be extended.
    //Your usermod will remain compatible as it does not need to implement all methods from the Usermod base class!
 };
@@ -393,6 +393,17 @@ class UsermodTemperature : public Usermod {
     {
       return USERMOD_ID_TEMPERATURE;
     }
+
+    uint16_t getHooks()
+    {
+      return UM_HOOK_LOOP | UM_HOOK_JSON_INFO | UM_HOOK_MQTT;
+    }
+
+    // readings are seconds apart, no need to check on every loop
+    uint16_t getLoopInterval()
+    {
+      return 50;
+    }
 };
 
 // strings to reduce flash memory usage (used more than twice)
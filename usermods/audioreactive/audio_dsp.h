@@ -0,0 +1,547 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+
+/*
+ * Audio DSP engine for the audioreactive usermod
+ *
+ * AudioFFT<float> / AudioFFT<int32_t>: real FFT of N (power of 4 times 2) samples, computed as an N/2 point complex
+ * radix-4 FFT (decimation in frequency) followed by a split step. Window, twiddles and digit reversal are tables
+ * computed once by init(). Real and imaginary parts are kept in separate arrays so all butterfly loops run over
+ * contiguous memory. The int32_t variant works in fixed point (Q15 twiddles and window, each radix-4 stage scaled
+ * by 1/4) for MCUs without FPU like ESP32-S2 and -C3.
+ *
+ * GEQBand: mapping of FFT bins to GEQ channels as a table of (first bin, last bin, weight) - a sparse matrix with
+ * one run of equal weights per row.
+ *
+ * BeatTracker: onsets, tempo and beat phase from consecutive FFT frames.
+ *
+ * AudioFrameRing: lock free history of timestamped result frames between the audio task and the render loop.
+ *
+ * This header has no Arduino dependencies, it can be compiled on a host to check results and timing.
+ */
+
+template<typename T> struct AudioFFTMath;
+
+template<> struct AudioFFTMath<float> {
+  typedef float coef_t;
+  static coef_t  coef(float c)             { return c; }
+  static float   mul(float a, coef_t c)    { return a * c; }
+  static float   stage(float a)            { return a; }           // no scaling needed
+  static float   in(float x)               { return x; }
+  static float   out(float x)              { return x; }
+  static constexpr float coefScale = 1.0f;
+  static constexpr float inScale   = 1.0f;
+  static constexpr float stageGain = 1.0f;
+};
+
+template<> struct AudioFFTMath<int32_t> {
+  typedef int16_t coef_t;
+  static coef_t  coef(float c)             { return (int16_t)lrintf(fminf(fmaxf(c, -1.0f), 1.0f) * 32767.0f); }
+  static int32_t mul(int32_t a, coef_t c)  { return (int32_t)(((int64_t)a * c) >> 15); }
+  static int32_t stage(int32_t a)          { return a >> 2; }      // 1/4 per radix-4 stage keeps the headroom constant
+  static int32_t in(float x)               { return (int32_t)lrintf(fminf(fmaxf(x, -32768.0f), 32767.0f) * 16.0f); } // 4 fractional bits
+  static float   out(int32_t x)            { return (float)x; }
+  static constexpr float coefScale = 1.0f/32767.0f;
+  static constexpr float inScale   = 16.0f;
+  static constexpr float stageGain = 4.0f;
+};
+
+template<typename T, uint16_t N = 512>
+class AudioFFT {
+  static_assert(N >= 8 && ((N/2) & (N/2 - 1)) == 0 && ((N/2) & 0x5555) != 0, "N/2 must be a power of 4");
+  typedef AudioFFTMath<T> M;
+  typedef typename M::coef_t coef_t;
+
+  public:
+    static constexpr uint16_t size = N;
+    static constexpr uint16_t bins = N/2;
+
+    // Flat-Top window, same as arduinoFFT FFT_WIN_TYP_FLT_TOP so the GEQ scaling stays valid
+    void init() {
+      for (uint16_t i = 0; i < N/2; i++) {
+        float ratio = (float)i / (float)(N - 1);
+        window[i] = M::coef(0.2810639f - 0.5208972f * cosf(2.0f * (float)M_PI * ratio) + 0.1980399f * cosf(4.0f * (float)M_PI * ratio));
+      }
+      for (uint16_t i = 0; i < N; i++) cosTable[i] = M::coef(cosf(2.0f * (float)M_PI * i / N));
+      // base 4 digit reversal of the complex FFT output index
+      for (uint16_t i = 0; i < C; i++) {
+        uint16_t r = 0;
+        for (uint16_t k = 1, j = i; k < C; k <<= 2, j >>= 2) r = (r << 2) | (j & 3);
+        digitRev[i] = r;
+      }
+    }
+
+    // in[N] time domain samples (not modified) -> mag[N/2] magnitudes, bin k is k * sample rate / N
+    // removes DC and applies the window; magnitudes are equal to those of an unscaled full complex DFT
+    void compute(const float* in, float* mag) {
+      float mean = 0.0f;
+      for (uint16_t i = 0; i < N; i++) mean += in[i];
+      mean /= N;
+      // even samples become the real, odd ones the imaginary parts
+      for (uint16_t i = 0; i < C; i++) {
+        uint16_t e = 2*i, o = 2*i + 1;
+        re[i] = M::mul(M::in(in[e] - mean), window[e < N/2 ? e : N-1-e]);
+        im[i] = M::mul(M::in(in[o] - mean), window[o < N/2 ? o : N-1-o]);
+      }
+      radix4();
+      split(mag);
+    }
+
+    // strongest frequency with parabolic interpolation (as arduinoFFT MajorPeak())
+    static void majorPeak(const float* mag, uint16_t numBins, float sampleRate, float& freq, float& magnitude) {
+      float maxY = 0.0f;
+      uint16_t peak = 0;
+      for (uint16_t i = 1; i < numBins - 1; i++) {
+        if (mag[i-1] < mag[i] && mag[i] > mag[i+1] && mag[i] > maxY) {
+          maxY = mag[i];
+          peak = i;
+        }
+      }
+      if (!peak) {
+        freq = 0.0f;
+        magnitude = 0.0f;
+        return;
+      }
+      float d = mag[peak-1] - 2.0f * mag[peak] + mag[peak+1];
+      float delta = (d != 0.0f) ? 0.5f * (mag[peak-1] - mag[peak+1]) / d : 0.0f;
+      freq = (peak + delta) * sampleRate / N;
+      magnitude = fabsf(d);
+    }
+
+  private:
+    static constexpr uint16_t C = N/2; // complex FFT points
+
+    coef_t   window[N/2];   // first half, the window is symmetric
+    coef_t   cosTable[N];   // cos(2 pi i / N), sin is read a quarter turn later
+    uint16_t digitRev[C];
+    T re[C], im[C];
+
+    // W_N^k = cos(2 pi k/N) - i sin(2 pi k/N)
+    inline coef_t wcos(uint16_t k) const { return cosTable[k & (N-1)]; }
+    inline coef_t wsin(uint16_t k) const { return cosTable[(k + 3*N/4) & (N-1)]; }
+
+    // in place complex FFT of re[]/im[], output in digit reversed order
+    void radix4() {
+      for (uint16_t len = C, stride = 2; len >= 4; len >>= 2, stride <<= 2) { // stride: twiddle step in cosTable (N/len)
+        uint16_t q = len >> 2;
+        for (uint16_t g = 0; g < C; g += len) {
+          for (uint16_t j = 0; j < q; j++) {
+            uint16_t i0 = g + j, i1 = i0 + q, i2 = i1 + q, i3 = i2 + q;
+            T ar = M::stage(re[i0]), ai = M::stage(im[i0]);
+            T br = M::stage(re[i1]), bi = M::stage(im[i1]);
+            T cr = M::stage(re[i2]), ci = M::stage(im[i2]);
+            T dr = M::stage(re[i3]), di = M::stage(im[i3]);
+            T t0r = ar + cr, t0i = ai + ci;
+            T t1r = ar - cr, t1i = ai - ci;
+            T t2r = br + dr, t2i = bi + di;
+            T t3r = br - dr, t3i = bi - di;
+            re[i0] = t0r + t2r;  im[i0] = t0i + t2i;
+            // y1 = t1 - i*t3, y2 = t0 - t2, y3 = t1 + i*t3, each rotated by W^(r*j*stride)
+            rotate(t1r + t3i, t1i - t3r,   j*stride, re[i1], im[i1]);
+            rotate(t0r - t2r, t0i - t2i, 2*j*stride, re[i2], im[i2]);
+            rotate(t1r - t3i, t1i + t3r, 3*j*stride, re[i3], im[i3]);
+          }
+        }
+      }
+    }
+
+    inline void rotate(T xr, T xi, uint16_t k, T& outR, T& outI) const {
+      if (!k) { outR = xr; outI = xi; return; }
+      coef_t c = wcos(k), s = wsin(k);
+      outR = M::mul(xr, c) + M::mul(xi, s);
+      outI = M::mul(xi, c) - M::mul(xr, s);
+    }
+
+    // X[k] = (Z[k] + Z*[C-k])/2 - i W_N^k (Z[k] - Z*[C-k])/2
+    void split(float* mag) {
+      const float scale = outScale();
+      for (uint16_t k = 0; k < C; k++) {
+        uint16_t a = digitRev[k], b = digitRev[(C - k) & (C - 1)];
+        float zr = M::out(re[a]), zi = M::out(im[a]);
+        float cr = M::out(re[b]), ci = -M::out(im[b]);
+        float er = zr + cr, ei = zi + ci; // 2 * even part
+        float orr = zr - cr, oi = zi - ci; // 2 * odd part (times i)
+        float c = (float)wcos(k) * M::coefScale, s = (float)wsin(k) * M::coefScale;
+        float wr = c * orr + s * oi;
+        float wi = c * oi - s * orr;
+        float xr = 0.5f * (er + wi);
+        float xi = 0.5f * (ei - wr);
+        mag[k] = sqrtf(xr*xr + xi*xi) * scale;
+      }
+    }
+
+    // undoes input and per stage scaling of the fixed point variant
+    static float outScale() {
+      float s = 1.0f / M::inScale;
+      for (uint16_t len = C; len >= 4; len >>= 2) s *= M::stageGain;
+      return s;
+    }
+};
+
+// one GEQ channel: average of bins [from, to] times weight
+typedef struct GEQBand {
+  uint8_t from;
+  uint8_t to;
+  float   weight; // damping / number of bins
+} geq_band_t;
+
+// GEQ channels from FFT bin magnitudes
+static inline void mapGEQBands(const geq_band_t* bands, uint8_t numBands, const float* mag, float* out) {
+  for (uint8_t i = 0; i < numBands; i++) {
+    float sum = 0.0f;
+    for (uint16_t b = bands[i].from; b <= bands[i].to; b++) sum += mag[b];
+    out[i] = sum * bands[i].weight;
+  }
+}
+
+/*
+ * BeatTracker: onset detection, tempo and beat phase from consecutive FFT frames
+ *
+ * - onset: half-wave rectified spectral flux of log compressed magnitudes, compared against an adaptive threshold
+ *   (running mean + deviation). Detected on the rising edge, with a short refractory time.
+ * - tempo: autocorrelation of the (smoothed) onset strength history (~3 seconds), evaluated a few times per second over
+ *   60..200 BPM and weighted with a log-normal prior around 120 BPM against octave errors.
+ * - phase: beats are predicted from the last beat and the tempo; onsets close to a predicted beat pull the phase
+ *   (PLL). Without a reliable tempo every onset is a beat.
+ * - envelopes: attack/release followers of the energy in 4 bands (bass, low mid, high mid, treble), normalized
+ *   against a slowly decaying maximum.
+ */
+class BeatTracker {
+  public:
+    static constexpr uint16_t HISTORY = 256;     // onset strength frames used for tempo estimation
+    static constexpr uint16_t FLUX_BINS = 128;   // bins taken into account for spectral flux
+    static constexpr uint8_t  BANDS = 4;         // energy envelopes
+    static constexpr float    MIN_BPM = 60.0f;
+    static constexpr float    MAX_BPM = 200.0f;
+
+    // results of the last process() call
+    bool     onset = false;
+    bool     beat = false;
+    float    bpm = 0.0f;          // 0: unknown
+    uint8_t  confidence = 0;      // periodicity of the onset strength, 0..255
+    uint32_t lastBeat = 0;        // time of the last beat (ms)
+    uint8_t  envelope[BANDS] = {0};
+
+    // frameRate: process() calls per second; binHz: width of one FFT bin
+    void init(float frameRate, float binHz) {
+      fps = frameRate;
+      memset(prevMag, 0, sizeof(prevMag));
+      memset(history, 0, sizeof(history));
+      memset(envelope, 0, sizeof(envelope));
+      memset(envLevel, 0, sizeof(envLevel));
+      for (uint8_t i = 0; i < BANDS; i++) envMax[i] = 1.0f;
+      fluxAvg = fluxDev = lastFlux = 0.0f;
+      head = frames = 0;
+      onset = beat = false;
+      bpm = 0.0f;
+      confidence = 0;
+      lastBeat = lastOnset = nextBeat = 0;
+      candidate = 0.0f;
+      candidateHits = gridMisses = 0;
+      // band edges in bins: <250Hz, <1kHz, <4kHz, rest
+      const float edgeHz[BANDS] = {250.0f, 1000.0f, 4000.0f, 1e9f};
+      for (uint8_t i = 0; i < BANDS; i++) bandEnd[i] = (uint16_t)fminf(edgeHz[i] / binHz, 255.0f);
+      attack  = follower(0.010f);
+      release = follower(0.150f);
+      maxFall = follower(5.0f);
+      avgRate = follower(0.300f);
+    }
+
+    // mag[numBins]: FFT magnitudes of one frame, now: frame time in ms
+    void process(const float* mag, uint16_t numBins, uint32_t now) {
+      onset = beat = false;
+      if (fps <= 0.0f) return;
+
+      // spectral flux
+      uint16_t n = numBins < FLUX_BINS ? numBins : FLUX_BINS;
+      // the few bass bins weigh as much as all others: kick drums carry the beat, hi-hats often the off beats
+      float bassFlux = 0.0f, flux = 0.0f;
+      for (uint16_t i = 1; i < n; i++) {
+        float c = log1pf(mag[i]);
+        float d = c - prevMag[i];
+        if (d > 0.0f) {
+          if (i <= bandEnd[0]) bassFlux += d;
+          else flux += d;
+        }
+        prevMag[i] = c;
+      }
+      flux = 0.5f * (n - 1) * (bassFlux / bandEnd[0] + flux / (n - 1 - bandEnd[0]));
+
+      // adaptive threshold
+      float threshold = fluxAvg + 1.5f * fluxDev + 0.5f;
+      if (flux > threshold && flux > lastFlux && now - lastOnset > MIN_ONSET_GAP) {
+        onset = true;
+        lastOnset = now;
+      }
+      fluxDev += avgRate * (fabsf(flux - fluxAvg) - fluxDev);
+      fluxAvg += avgRate * (flux - fluxAvg);
+      lastFlux = flux;
+
+      history[head] = fmaxf(flux - fluxAvg, 0.0f);
+      head = (head + 1) % HISTORY;
+      if (frames < HISTORY) frames++;
+      if (head % TEMPO_INTERVAL == 0 && frames == HISTORY) estimateTempo(now);
+
+      trackPhase(now);
+      updateEnvelopes(mag, numBins);
+    }
+
+    // position within the current beat, 0..255
+    uint8_t phase(uint32_t now) const { return phase(bpm, lastBeat, now); }
+
+    static uint8_t phase(float bpm, uint32_t lastBeat, uint32_t now) {
+      if (bpm <= 0.0f) return 0;
+      uint32_t period = 60000.0f / bpm;
+      int32_t t = now - lastBeat;
+      if (t <= 0) return 0;
+      if ((uint32_t)t >= 2 * period) return 255;   // no beat for a while
+      return (((uint32_t)t % period) << 8) / period; // may be ahead of the last beat when asked for a future time
+    }
+
+  private:
+    static constexpr uint32_t MIN_ONSET_GAP  = 100;  // ms
+    static constexpr uint16_t TEMPO_INTERVAL = 32;   // frames between tempo estimates
+    static constexpr uint8_t  MIN_CONFIDENCE = 40;   // below: beats follow onsets
+
+    float    fps = 0.0f;
+    float    prevMag[FLUX_BINS];
+    float    history[HISTORY];     // onset strength ring buffer
+    uint16_t head, frames;
+    float    fluxAvg, fluxDev, lastFlux;
+    uint32_t lastOnset, nextBeat;
+    float    candidate;            // tempo that differs from bpm, must be confirmed before switching
+    uint8_t  candidateHits;
+    uint8_t  gridMisses;
+    uint16_t bandEnd[BANDS];
+    float    envLevel[BANDS], envMax[BANDS];
+    float    attack, release, maxFall, avgRate;
+
+    // per frame coefficient of a one pole filter with time constant tau (seconds)
+    float follower(float tau) const { return 1.0f - expf(-1.0f / (fps * tau)); }
+
+    inline float hist(uint16_t age) const { return history[(head + HISTORY - 1 - age) % HISTORY]; }
+
+    void estimateTempo(uint32_t now) {
+      // onset strength by age, smoothed over 3 frames: a beat period that is not a whole number of frames would
+      // split its correlation between two lags and lose against twice the period
+      float s[HISTORY];
+      for (uint16_t i = 0; i < HISTORY; i++) s[i] = 0.5f * hist(i) + 0.25f * (hist(i ? i - 1 : i) + hist(i < HISTORY - 1 ? i + 1 : i));
+      float mean = 0.0f;
+      for (uint16_t i = 0; i < HISTORY; i++) mean += s[i];
+      mean /= HISTORY;
+      float energy = 0.0f;
+      for (uint16_t i = 0; i < HISTORY; i++) energy += (s[i] - mean) * (s[i] - mean);
+      if (energy <= 1e-6f) {
+        confidence = 0;
+        return;
+      }
+
+      uint16_t minLag = fps * 60.0f / MAX_BPM;
+      uint16_t maxLag = fps * 60.0f / MIN_BPM + 1;
+      if (maxLag >= HISTORY / 2) maxLag = HISTORY / 2 - 1;
+      if (minLag < 2) minLag = 2;
+      float acf[3] = {0};            // acf at best-1, best, best+1 for interpolation
+      float bestScore = 0.0f, bestAcf = 0.0f, prevAcf = 0.0f;
+      uint16_t best = 0;
+      for (uint16_t lag = minLag - 1; lag <= maxLag + 1; lag++) {
+        float sum = 0.0f;
+        for (uint16_t i = 0; i + lag < HISTORY; i++) sum += (s[i] - mean) * (s[i + lag] - mean);
+        sum /= (HISTORY - lag);
+        if (lag >= minLag && lag <= maxLag) {
+          float l = log2f(60.0f * fps / lag / 120.0f) / 0.9f;
+          float score = sum * expf(-0.5f * l * l);
+          if (score > bestScore) {
+            bestScore = score;
+            bestAcf = sum;
+            best = lag;
+            acf[0] = prevAcf;
+            acf[1] = sum;
+            acf[2] = 0.0f;
+          }
+        }
+        if (best && lag == best + 1) acf[2] = sum;
+        prevAcf = sum;
+      }
+      float c = bestAcf / (energy / HISTORY);
+      confidence = c <= 0.0f ? 0 : c >= 1.0f ? 255 : c * 255.0f;
+      if (!best || confidence < MIN_CONFIDENCE) return;
+
+      float d = acf[0] - 2.0f * acf[1] + acf[2];
+      float lag = best + ((d < 0.0f) ? fminf(fmaxf(0.5f * (acf[0] - acf[2]) / d, -0.5f), 0.5f) : 0.0f);
+      float tempo = 60.0f * fps / lag;
+      if (bpm <= 0.0f || fabsf(tempo - bpm) < 0.08f * bpm) {
+        bpm = bpm <= 0.0f ? tempo : bpm + 0.25f * (tempo - bpm);
+        candidateHits = 0;
+      } else if (candidateHits && fabsf(tempo - candidate) < 0.05f * candidate) {
+        if (++candidateHits >= 3) {   // stable for ~1 second: switch
+          bpm = tempo;
+          candidateHits = 0;
+        }
+      } else {
+        candidate = tempo;
+        candidateHits = 1;
+      }
+      alignPhase(now);
+    }
+
+    // comb filter over the history: the beat grid with the most onset strength wins over the PLL if they disagree
+    void alignPhase(uint32_t now) {
+      float lag = 60.0f * fps / bpm;
+      uint16_t steps = lag + 0.5f;
+      float bestSum = 0.0f;
+      uint16_t bestAge = 0;
+      for (uint16_t a = 0; a < steps; a++) {
+        float sum = 0.0f;
+        for (float age = a; age < HISTORY; age += lag) sum += hist((uint16_t)age);
+        if (sum > bestSum) {
+          bestSum = sum;
+          bestAge = a;
+        }
+      }
+      if (!nextBeat) return;
+      uint32_t period = 60000.0f / bpm;
+      uint32_t gridBeat = now - (uint32_t)(bestAge * 1000.0f / fps);
+      int32_t offset = (int32_t)((nextBeat - gridBeat) % period);
+      if (offset > (int32_t)period / 2) offset -= period;
+      if (offset > (int32_t)period / 4 || offset < -(int32_t)period / 4) {
+        if (++gridMisses >= 2) {    // disagreement confirmed by the next estimate
+          nextBeat -= offset;
+          if ((int32_t)(now - nextBeat) > 0) nextBeat += period;
+          gridMisses = 0;
+        }
+      } else gridMisses = 0;
+    }
+
+    void trackPhase(uint32_t now) {
+      if (bpm <= 0.0f || confidence < MIN_CONFIDENCE) {
+        if (onset) {
+          beat = true;
+          lastBeat = now;
+        }
+        nextBeat = 0;
+        return;
+      }
+      uint32_t period = 60000.0f / bpm;
+      if (!nextBeat || (int32_t)(now - nextBeat) > (int32_t)period) {
+        // (re)start the prediction from the last onset
+        nextBeat = lastOnset + period;
+        if ((int32_t)(now - nextBeat) > 0) nextBeat += ((now - nextBeat) / period + 1) * period;
+      }
+      int32_t early = nextBeat - now;  // > 0: predicted beat is still ahead
+      if (onset) {
+        int32_t late = now - lastBeat;
+        if (early >= 0 && early < (int32_t)period / 8) {
+          // onset just before the prediction: take it as the beat, keep part of the predicted phase
+          beat = true;
+          lastBeat = now;
+          nextBeat = now + (early >> 1) + period;
+          return;
+        }
+        if (late > 0 && late < (int32_t)period / 8) {
+          // onset shortly after the last beat: the prediction was early, shift the phase
+          nextBeat += late >> 1;
+          early = nextBeat - now;
+        }
+      }
+      if (early <= 0) {
+        beat = now - lastBeat > period / 2;  // no double beat after a phase jump
+        if (beat) lastBeat = now;
+        nextBeat += period;
+      }
+    }
+
+    void updateEnvelopes(const float* mag, uint16_t numBins) {
+      uint16_t from = 1;
+      for (uint8_t b = 0; b < BANDS; b++) {
+        uint16_t to = bandEnd[b] < numBins ? bandEnd[b] : numBins - 1;
+        float sum = 0.0f;
+        for (uint16_t i = from; i <= to; i++) sum += mag[i];
+        from = to + 1;
+        envLevel[b] += (sum > envLevel[b] ? attack : release) * (sum - envLevel[b]);
+        envMax[b] = fmaxf(envMax[b] - maxFall * envMax[b], fmaxf(envLevel[b], 1.0f));
+        envelope[b] = fminf(envLevel[b] / envMax[b] * 255.0f, 255.0f);
+      }
+    }
+};
+
+/*
+ * AudioFrameRing: the last N-1 frames written by one producer task, readable from another task without locks.
+ * F needs a "uint32_t time" member. Every slot carries a sequence number that is odd while the slot is written
+ * (seqlock); a reader that was overtaken by the writer sees a changed number and retries. push() never waits.
+ */
+template<typename F, uint8_t N = 32>
+class AudioFrameRing {
+  static_assert(N >= 4 && (N & (N - 1)) == 0, "N must be a power of 2");
+
+  public:
+    // producer only
+    void push(const F& frame) {
+      uint32_t n = written.load(std::memory_order_relaxed);
+      Slot& s = slots[n & (N - 1)];
+      uint32_t seq = s.seq.load(std::memory_order_relaxed);
+      s.seq.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      s.frame = frame;
+      s.seq.store(seq + 2, std::memory_order_release);
+      written.store(n + 1, std::memory_order_release);
+    }
+
+    // number of frames written so far
+    uint32_t count() const { return written.load(std::memory_order_acquire); }
+
+    // newest frame with time <= t, or the oldest available one if all are newer; false if nothing was written yet
+    bool readAt(uint32_t t, F& out) const {
+      for (uint8_t retry = 0; retry < 4; retry++) {
+        uint32_t n = count();
+        if (!n) return false;
+        uint32_t avail = n < N - 1 ? n : N - 1; // the slot after the newest one may be in use by the writer
+        uint32_t k = 0;
+        for (; k < avail - 1; k++) {
+          uint32_t time;
+          if (!readTime(n - 1 - k, time)) break;
+          if ((int32_t)(t - time) >= 0) break;
+        }
+        if (read(n - 1 - k, out)) return true;
+      }
+      return false;
+    }
+
+    bool readLatest(F& out) const {
+      for (uint8_t retry = 0; retry < 4; retry++) {
+        uint32_t n = count();
+        if (!n) return false;
+        if (read(n - 1, out)) return true;
+      }
+      return false;
+    }
+
+  private:
+    struct Slot {
+      std::atomic<uint32_t> seq{0};
+      F frame;
+    };
+    Slot slots[N];
+    std::atomic<uint32_t> written{0};
+
+    bool read(uint32_t index, F& out) const {
+      const Slot& s = slots[index & (N - 1)];
+      uint32_t seq = s.seq.load(std::memory_order_acquire);
+      if (seq & 1) return false;
+      out = s.frame;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return s.seq.load(std::memory_order_relaxed) == seq;
+    }
+
+    bool readTime(uint32_t index, uint32_t& time) const {
+      const Slot& s = slots[index & (N - 1)];
+      uint32_t seq = s.seq.load(std::memory_order_acquire);
+      if (seq & 1) return false;
+      time = s.frame.time;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return s.seq.load(std::memory_order_relaxed) == seq;
+    }
+};
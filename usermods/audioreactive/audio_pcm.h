@@ -0,0 +1,210 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+/*
+ * Recorded audio for FileSource (playback) and microphone capture
+ *
+ * - parseWavHeader() / makeWavHeader(): RIFF WAVE headers, 16 bit PCM only
+ * - PcmReader: reads 16 bit PCM from a stream (WAV, or raw mono PCM at the output rate), mixes it down to mono,
+ *   converts the sample rate (linear interpolation) and optionally loops at the end of the file
+ * - PcmRing: single producer / single consumer buffer that moves captured samples from the audio task to the loop
+ *
+ * The stream type only needs size_t read(uint8_t*, size_t) and bool seek(uint32_t), like the Arduino File class.
+ * This header has no Arduino dependencies, it can be compiled on a host to feed the same recordings into audio_dsp.h.
+ */
+
+#define PCM_WAV_HEADER_SIZE 44
+
+typedef struct PcmFormat {
+  uint32_t sampleRate;
+  uint16_t channels;
+  uint16_t bits;
+  uint32_t dataOffset;   // start of the samples in the file
+  uint32_t dataSize;     // bytes
+} pcm_format_t;
+
+static inline uint16_t pcmLE16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static inline uint32_t pcmLE32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static inline void pcmPutLE16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static inline void pcmPutLE32(uint8_t* p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+// returns false if buf (the start of the file) is not a 16 bit PCM WAV file, or its data chunk is not within len bytes
+static bool parseWavHeader(const uint8_t* buf, size_t len, pcm_format_t& fmt) {
+  if (len < 12 || memcmp(buf, "RIFF", 4) || memcmp(buf + 8, "WAVE", 4)) return false;
+  bool haveFmt = false;
+  size_t pos = 12;
+  while (pos + 8 <= len) {
+    const uint8_t* chunk = buf + pos;
+    uint32_t size = pcmLE32(chunk + 4);
+    if (!memcmp(chunk, "fmt ", 4)) {
+      if (size < 16 || pos + 8 + 16 > len) return false;
+      if (pcmLE16(chunk + 8) != 1) return false;           // not PCM
+      fmt.channels   = pcmLE16(chunk + 10);
+      fmt.sampleRate = pcmLE32(chunk + 12);
+      fmt.bits       = pcmLE16(chunk + 22);
+      if (fmt.bits != 16 || fmt.channels == 0 || fmt.sampleRate == 0) return false;
+      haveFmt = true;
+    } else if (!memcmp(chunk, "data", 4)) {
+      if (!haveFmt) return false;
+      fmt.dataOffset = pos + 8;
+      fmt.dataSize   = size;
+      return true;
+    }
+    pos += 8 + size + (size & 1);                            // chunks are word aligned
+  }
+  return false;
+}
+
+// header for a mono 16 bit file with numSamples samples
+static void makeWavHeader(uint8_t* buf, uint32_t sampleRate, uint32_t numSamples) {
+  uint32_t dataSize = numSamples * 2;
+  memcpy(buf, "RIFF", 4);      pcmPutLE32(buf + 4, 36 + dataSize);
+  memcpy(buf + 8, "WAVEfmt ", 8);
+  pcmPutLE32(buf + 16, 16);    // fmt chunk size
+  pcmPutLE16(buf + 20, 1);     // PCM
+  pcmPutLE16(buf + 22, 1);     // mono
+  pcmPutLE32(buf + 24, sampleRate);
+  pcmPutLE32(buf + 28, sampleRate * 2);
+  pcmPutLE16(buf + 32, 2);     // bytes per frame
+  pcmPutLE16(buf + 34, 16);    // bits per sample
+  memcpy(buf + 36, "data", 4); pcmPutLE32(buf + 40, dataSize);
+}
+
+template<class S> class PcmReader {
+  public:
+    // files without a WAV header are taken as raw 16 bit mono PCM at outRate
+    bool begin(S* stream, uint32_t outRate, bool loop) {
+      _stream = stream;
+      _loop = loop;
+      _ended = false;
+      _fill = _used = 0;
+      _frames = 0;
+      uint8_t hdr[128];
+      if (!_stream || !_stream->seek(0)) return false;
+      size_t len = _stream->read(hdr, sizeof(hdr));
+      if (!parseWavHeader(hdr, len, _fmt)) {
+        if (len >= 4 && !memcmp(hdr, "RIFF", 4)) return false;  // WAV, but not 16 bit PCM (or a very long header)
+        _fmt.sampleRate = outRate;
+        _fmt.channels   = 1;
+        _fmt.bits       = 16;
+        _fmt.dataOffset = 0;
+        _fmt.dataSize   = 0xFFFFFFFF;  // until the end of the file
+      }
+      _frameSize = 2 * _fmt.channels;
+      if (_frameSize > sizeof(_buf)) return false;
+      _step = (float)_fmt.sampleRate / (float)outRate;
+      _direct = (_fmt.sampleRate == outRate);
+      if (!rewind()) return false;
+      if (!_direct) {
+        if (!nextFrame(_prev)) return false;
+        if (!nextFrame(_cur)) _cur = _prev;          // single frame file
+        _frac = 0.0f;
+      }
+      return true;
+    }
+
+    // fills up to n samples (16 bit range), returns the number of samples; less than n only at the end of the file
+    size_t read(float* out, size_t n) {
+      size_t i = 0;
+      if (_direct) {
+        while (i < n && nextFrame(out[i])) i++;
+        return i;
+      }
+      while (i < n) {
+        while (_frac >= 1.0f) {
+          _prev = _cur;
+          if (!nextFrame(_cur)) return i;
+          _frac -= 1.0f;
+        }
+        out[i++] = _prev + (_cur - _prev) * _frac;
+        _frac += _step;
+      }
+      return i;
+    }
+
+    bool ended() const { return _ended; }
+    uint32_t position() const { return _frames; }    // source frames since the start of the file
+    const pcm_format_t& format() const { return _fmt; }
+
+  private:
+    bool rewind() {
+      _fill = _used = 0;
+      _frames = 0;
+      _left = _fmt.dataSize;
+      return _stream->seek(_fmt.dataOffset);
+    }
+
+    bool nextFrame(float& s) {
+      if (_used + _frameSize > _fill) {
+        if (!refill()) {
+          if (!_loop || !_frames || !rewind() || !refill()) { _ended = true; return false; }
+        }
+      }
+      int32_t sum = 0;
+      for (uint16_t c = 0; c < _fmt.channels; c++) sum += (int16_t)pcmLE16(_buf + _used + 2*c);
+      _used += _frameSize;
+      _frames++;
+      s = (float)sum / _fmt.channels;
+      return true;
+    }
+
+    bool refill() {
+      size_t keep = _fill - _used;                  // partial frame
+      memmove(_buf, _buf + _used, keep);
+      size_t want = sizeof(_buf) - keep;
+      if (want > _left) want = _left;
+      size_t got = want ? _stream->read(_buf + keep, want) : 0;
+      _left -= got;
+      _fill = keep + got;
+      _used = 0;
+      return _fill >= _frameSize;
+    }
+
+    S*       _stream = nullptr;
+    pcm_format_t _fmt = {};
+    uint8_t  _buf[512];
+    size_t   _fill = 0, _used = 0;
+    uint32_t _left = 0;            // data bytes not yet read
+    uint32_t _frames = 0;
+    uint16_t _frameSize = 2;
+    bool     _loop = false, _ended = false, _direct = true;
+    float    _step = 1.0f, _frac = 0.0f, _prev = 0.0f, _cur = 0.0f;
+};
+
+// capture buffer: the audio task pushes whole batches (or drops them if the writer falls behind), the loop pops them
+template<uint16_t N> class PcmRing {
+  static_assert((N & (N - 1)) == 0, "N must be a power of 2");
+  public:
+    // samples are rounded to 16 bit; returns false if the batch was dropped
+    bool push(const float* s, uint16_t n) {
+      uint32_t head = _head.load(std::memory_order_relaxed);
+      if (N - (head - _tail.load(std::memory_order_acquire)) < n) { dropped++; return false; }
+      for (uint16_t i = 0; i < n; i++) {
+        float v = s[i] + (s[i] < 0 ? -0.5f : 0.5f);
+        _buf[(head + i) & (N - 1)] = v > 32767.0f ? 32767 : (v < -32768.0f ? -32768 : (int16_t)v);
+      }
+      _head.store(head + n, std::memory_order_release);
+      return true;
+    }
+
+    size_t available() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed); }
+
+    size_t pop(int16_t* out, size_t max) {
+      uint32_t tail = _tail.load(std::memory_order_relaxed);
+      size_t n = _head.load(std::memory_order_acquire) - tail;
+      if (n > max) n = max;
+      for (size_t i = 0; i < n; i++) out[i] = _buf[(tail + i) & (N - 1)];
+      _tail.store(tail + n, std::memory_order_release);
+      return n;
+    }
+
+    uint32_t dropped = 0;          // batches, written by the producer only
+
+  private:
+    int16_t _buf[N];
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+};
@@ -70,6 +70,8 @@ static bool udpSyncConnected = false;         // UDP connection status -> true i
 static bool limiterOn = true;                 // bool: enable / disable dynamics limiter
 static uint16_t attackTime =  80;             // int: attack time in milliseconds. Default 0.08sec
 static uint16_t decayTime = 1400;             // int: decay time in milliseconds.  Default 1.40sec
+static uint16_t audioDelay = 0;               // int: effects see audio this many milliseconds late - for speakers that lag behind the audio input
+#define AUDIO_DELAY_MAX 250                   // limited by the number of frames kept in audioFrames
 // user settable options for FFTResult scaling
 static uint8_t FFTScalingMode = 3;            // 0 none; 1 optimized logarithmic; 2 optimized linear; 3 optimized sqare root
 
@@ -118,7 +120,6 @@ static void autoResetPeak(void);     // peak auto-reset function
 
 // some prototypes, to ensure consistent interfaces
 static float mapf(float x, float in_min, float in_max, float out_min, float out_max); // map function for float
-static float fftAddAvg(int from, int to);   // average of several FFT result bins
 void FFTcode(void * parameter);      // audio processing task: read samples, run FFT, fill GEQ channels from FFT results
 static void runMicFilter(uint16_t numSamples, float *sampleBuffer);          // pre-filtering of raw samples (band-pass)
 static void postProcessFFTResults(bool noiseGateOpen, int numberOfChannels); // post-processing and post-amp of GEQ channels
@@ -151,42 +152,121 @@ constexpr SRate_t SAMPLE_RATE = 22050;        // Base sample rate in Hz - 22Khz
 //constexpr SRate_t SAMPLE_RATE = 16000;        // 16kHz - use if FFTtask takes more than 20ms. Physical sample time -> 32ms
 //constexpr SRate_t SAMPLE_RATE = 20480;        // Base sample rate in Hz - 20Khz is experimental.    Physical sample time -> 25ms
 //constexpr SRate_t SAMPLE_RATE = 10240;        // Base sample rate in Hz - previous default.         Physical sample time -> 50ms
+#ifndef SR_NO_FFT_OVERLAP
+#define FFT_OVERLAP                           // 50% overlapping windows: every FFT batch has half new samples, results come twice as often
+#define FFT_MIN_CYCLE 11                      // minimum time before FFT task is repeated. Use with 22Khz sampling
+#else
 #define FFT_MIN_CYCLE 21                      // minimum time before FFT task is repeated. Use with 22Khz sampling
 //#define FFT_MIN_CYCLE 30                      // Use with 16Khz sampling
 //#define FFT_MIN_CYCLE 23                      // minimum time before FFT task is repeated. Use with 20Khz sampling
 //#define FFT_MIN_CYCLE 46                      // minimum time before FFT task is repeated. Use with 10Khz sampling
+#endif
 
 // FFT Constants
 constexpr uint16_t samplesFFT = 512;            // Samples in an FFT batch - This value MUST ALWAYS be a power of 2
 constexpr uint16_t samplesFFT_2 = 256;          // meaningfull part of FFT results - only the "lower half" contains useful information.
+#ifdef FFT_OVERLAP
+constexpr uint16_t samplesNew = samplesFFT_2;   // new samples per FFT batch
+#else
+constexpr uint16_t samplesNew = samplesFFT;
+#endif
 // the following are observed values, supported by a bit of "educated guessing"
 //#define FFT_DOWNSCALE 0.65f                             // 20kHz - downscaling factor for FFT results - "Flat-Top" window @20Khz, old freq channels 
 #define FFT_DOWNSCALE 0.46f                             // downscaling factor for FFT results - for "Flat-Top" window @22Khz, new freq channels
 #define LOG_256  5.54517744f                            // log(256)
 
-// These are the input and output vectors.  Input vectors receive computed results from FFT.
-static float vReal[samplesFFT] = {0.0f};       // FFT sample inputs / freq output -  these are our raw result bins
-static float vImag[samplesFFT] = {0.0f};       // imaginary parts
-#ifdef UM_AUDIOREACTIVE_USE_NEW_FFT
-static float windowWeighingFactors[samplesFFT] = {0.0f};
-#endif
+// These are the input and output vectors.
+static float vSamples[samplesFFT] = {0.0f};    // FFT sample inputs, the oldest sample first
+static float vReal[samplesFFT_2] = {0.0f};     // FFT magnitudes - these are our raw result bins
 
-// Create FFT object
-#ifdef UM_AUDIOREACTIVE_USE_NEW_FFT
-// lib_deps += https://github.com/kosme/arduinoFFT#develop @ 1.9.2
-#define FFT_SPEED_OVER_PRECISION     // enables use of reciprocals (1/x etc), and an a few other speedups
-#define FFT_SQRT_APPROXIMATION       // enables "quake3" style inverse sqrt
-#define sqrt(x) sqrtf(x)             // little hack that reduces FFT time by 50% on ESP32 (as alternative to FFT_SQRT_APPROXIMATION)
+// FFT engine, fixed point on MCUs without FPU (use -D SR_FFT_FIXED or -D SR_FFT_FLOAT to override)
+#include "audio_dsp.h"
+#include "audio_sync.h"
+#if defined(SR_FFT_FIXED) || (!defined(SR_FFT_FLOAT) && (defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32C3)))
+static AudioFFT<int32_t, samplesFFT> FFT;
 #else
-// lib_deps += https://github.com/blazoncek/arduinoFFT.git
+static AudioFFT<float, samplesFFT> FFT;
 #endif
-#include <arduinoFFT.h>
 
-#ifdef UM_AUDIOREACTIVE_USE_NEW_FFT
-static ArduinoFFT<float> FFT = ArduinoFFT<float>( vReal, vImag, samplesFFT, SAMPLE_RATE, windowWeighingFactors);
-#else
-static arduinoFFT FFT = arduinoFFT(vReal, vImag, samplesFFT, SAMPLE_RATE);
-#endif
+// beat tracking - onsets from spectral flux, tempo and beat phase (needs scaled FFT results in vReal[])
+static BeatTracker beatTracker;
+static bool    beatFlag = false;         // beat (predicted from tempo, or onset while tempo is unknown) - used in effects. Auto-reset like samplePeak
+static bool    onsetFlag = false;        // onset (sudden rise of spectral energy). Auto-reset like samplePeak
+static float   beatBPM = 0.0f;           // tempo in beats per minute, 0 = unknown
+static uint8_t beatPhase = 0;            // position within the current beat 0..255 - updated in loop()
+static uint8_t beatConfidence = 0;       // how regular the onsets are 0..255; tempo is only used above ~40
+static uint8_t bandEnvelope[BeatTracker::BANDS] = {0}; // energy envelopes: bass, low mid, high mid, treble
+static unsigned long timeOfBeat = 0;     // time of last beat / onset, for auto-reset
+static unsigned long timeOfOnset = 0;
+static void detectBeat(void);            // beat tracking function, called once per FFT cycle
+
+// results of one FFT cycle. The FFT task publishes them through a lock free ring of frames, the usermod loop picks the
+// frame that matches the LED output time and copies it into the variables shared with effects (see readAudioFrame()),
+// so effects never see half updated results.
+typedef struct AudioFrame {
+  uint32_t time;                              // millis() when the newest samples of the batch were read
+  uint8_t  fftResult[NUM_GEQ_CHANNELS];
+  float    majorPeak;
+  float    magnitude;
+  float    bpm;
+  uint32_t lastBeat;
+  uint8_t  confidence;
+  uint8_t  envelope[BeatTracker::BANDS];
+  uint8_t  peaks, beats, onsets;              // event counters - a changed value means an event happened since the previous frame
+} audio_frame_t;
+
+static AudioFrameRing<audio_frame_t> audioFrames; // 31 frames: ~360ms with overlapping batches, ~720ms without
+static audio_frame_t fftFrame = {0};              // FFT task: frame being assembled
+static uint16_t audioFrameAge = 0;                // age of the audio data at LED output time in milliseconds - used in effects
+
+// recording of the sound input, for playback with FileSource. The FFT task copies each batch into captureRing,
+// the usermod loop writes it to the file (see writeCapture()). The ring is allocated with the first recording.
+#define AUDIO_CAPTURE_MAX 60                      // seconds, also limited by free filesystem space
+static PcmRing<8192> *captureRing = nullptr;      // ~370ms of samples
+static volatile bool capturing = false;
+
+// mapping of FFT result bins to frequency channels: average of bins from-to, with damping
+// new mapping, optimized for 22050 Hz by softhack007
+#define GEQ_BAND(from, to, damping) { from, to, (damping) / float((to) - (from) + 1) }
+static const geq_band_t geqBands[NUM_GEQ_CHANNELS] = {
+                                  // bins frequency  range
+  GEQ_BAND(  1,   2, 1.0f),       // 1    43 - 86   sub-bass
+  GEQ_BAND(  2,   3, 1.0f),       // 1    86 - 129  bass
+  GEQ_BAND(  3,   5, 1.0f),       // 2   129 - 216  bass
+  GEQ_BAND(  5,   7, 1.0f),       // 2   216 - 301  bass + midrange
+  GEQ_BAND(  7,  10, 1.0f),       // 3   301 - 430  midrange
+  GEQ_BAND( 10,  13, 1.0f),       // 3   430 - 560  midrange
+  GEQ_BAND( 13,  19, 1.0f),       // 5   560 - 818  midrange
+  GEQ_BAND( 19,  26, 1.0f),       // 7   818 - 1120 midrange -- 1Khz should always be the center !
+  GEQ_BAND( 26,  33, 1.0f),       // 7  1120 - 1421 midrange
+  GEQ_BAND( 33,  44, 1.0f),       // 9  1421 - 1895 midrange
+  GEQ_BAND( 44,  56, 1.0f),       // 12 1895 - 2412 midrange + high mid
+  GEQ_BAND( 56,  70, 1.0f),       // 14 2412 - 3015 high mid
+  GEQ_BAND( 70,  86, 1.0f),       // 16 3015 - 3704 high mid
+  GEQ_BAND( 86, 104, 1.0f),       // 18 3704 - 4479 high mid
+  GEQ_BAND(104, 165, 0.88f),      // 61 4479 - 7106 high mid + high  -- with slight damping
+  GEQ_BAND(165, 215, 0.70f)       // 50 7106 - 9259 high             -- with some damping
+                                  // don't use the last bins from 216 to 255. They are usually contaminated by aliasing (aka noise)
+};
+// with band pass filter: skip frequencies below 100hz, don't use the last bins from 206 to 255
+static const geq_band_t geqBandsBandPass[NUM_GEQ_CHANNELS] = {
+  GEQ_BAND(  3,   4, 0.8f),
+  GEQ_BAND(  4,   5, 0.9f),
+  GEQ_BAND(  5,   6, 1.0f),
+  GEQ_BAND(  6,   7, 1.0f),
+  GEQ_BAND(  7,  10, 1.0f),
+  GEQ_BAND( 10,  13, 1.0f),
+  GEQ_BAND( 13,  19, 1.0f),
+  GEQ_BAND( 19,  26, 1.0f),
+  GEQ_BAND( 26,  33, 1.0f),
+  GEQ_BAND( 33,  44, 1.0f),
+  GEQ_BAND( 44,  56, 1.0f),
+  GEQ_BAND( 56,  70, 1.0f),
+  GEQ_BAND( 70,  86, 1.0f),
+  GEQ_BAND( 86, 104, 1.0f),
+  GEQ_BAND(104, 165, 0.88f),
+  GEQ_BAND(165, 205, 0.75f)
+};
 
 // Helper functions
 
@@ -195,14 +275,16 @@ static float mapf(float x, float in_min, float in_max, float out_min, float out_
   return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
 }
 
-// compute average of several FFT resut bins
-static float fftAddAvg(int from, int to) {
-  float result = 0.0f;
-  for (int i = from; i <= to; i++) {
-    result += vReal[i];
-  }
-  return result / float(to - from + 1);
-}
+// smoothing factors per FFT cycle, with overlapping windows adjusted to give the same time constants at twice the rate (1 - sqrt(1 - f))
+#ifdef FFT_OVERLAP
+#define FFT_GATE_DECAY 0.922f
+static const float fftRise = 0.5f;
+static const float fftFall[4] = { 0.117f, 0.089f, 0.073f, 0.051f };
+#else
+#define FFT_GATE_DECAY 0.85f
+static const float fftRise = 0.75f;
+static const float fftFall[4] = { 0.22f, 0.17f, 0.14f, 0.1f };
+#endif
 
 //
 // FFT main task
@@ -231,7 +313,11 @@ void FFTcode(void * parameter)
 #endif
 
     // get a fresh batch of samples from I2S
-    if (audioSource) audioSource->getSamples(vReal, samplesFFT);
+    // with overlapping windows the older half of the batch is kept from the previous cycle
+    float *newSamples = vSamples + (samplesFFT - samplesNew);
+    if (samplesNew < samplesFFT) memmove(vSamples, vSamples + samplesNew, (samplesFFT - samplesNew) * sizeof(float));
+    if (audioSource) audioSource->getSamples(newSamples, samplesNew);
+    fftFrame.time = millis();
 
 #if defined(WLED_DEBUG) || defined(SR_DEBUG)
     if (start < esp_timer_get_time()) { // filter out overflows
@@ -245,16 +331,16 @@ void FFTcode(void * parameter)
 
     // band pass filter - can reduce noise floor by a factor of 50
     // downside: frequencies below 100Hz will be ignored
-    if (useBandPassFilter) runMicFilter(samplesFFT, vReal);
+    // the filter keeps state between calls, so each sample must pass it only once
+    if (capturing && captureRing) captureRing->push(newSamples, samplesNew);  // record unfiltered, playback runs through the filter again
+    if (useBandPassFilter) runMicFilter(samplesNew, newSamples);
 
     // find highest sample in the batch
-    float maxSample = 0.0f;                         // max sample from FFT batch
-    for (int i=0; i < samplesFFT; i++) {
-	    // set imaginary parts to 0
-      vImag[i] = 0;
-	    // pick our  our current mic sample - we take the max value from all samples that go into FFT
-	    if ((vReal[i] <= (INT16_MAX - 1024)) && (vReal[i] >= (INT16_MIN + 1024)))  //skip extreme values - normally these are artefacts
-        if (fabsf((float)vReal[i]) > maxSample) maxSample = fabsf((float)vReal[i]);
+    float maxSample = 0.0f;                         // max sample from new samples
+    for (int i=0; i < samplesNew; i++) {
+	    // pick our  our current mic sample - we take the max value from all new samples
+	    if ((newSamples[i] <= (INT16_MAX - 1024)) && (newSamples[i] >= (INT16_MIN + 1024)))  //skip extreme values - normally these are artefacts
+        if (fabsf(newSamples[i]) > maxSample) maxSample = fabsf(newSamples[i]);
     }
     // release highest sample to volume reactive effects early - not strictly necessary here - could also be done at the end of the function
     // early release allows the filters (getSample() and agcAvg()) to work with fresh values - we will have matching gain and noise gate values when we want to process the FFT results.
@@ -266,30 +352,10 @@ void FFTcode(void * parameter)
     if (sampleAvg > 0.25f) { // noise gate open means that FFT results will be used. Don't run FFT if results are not needed.
 #endif
 
-      // run FFT (takes 3-5ms on ESP32, ~12ms on ESP32-S2)
-#ifdef UM_AUDIOREACTIVE_USE_NEW_FFT
-      FFT.dcRemoval();                                            // remove DC offset
-      FFT.windowing( FFTWindow::Flat_top, FFTDirection::Forward); // Weigh data using "Flat Top" function - better amplitude accuracy
-      //FFT.windowing(FFTWindow::Blackman_Harris, FFTDirection::Forward);  // Weigh data using "Blackman- Harris" window - sharp peaks due to excellent sideband rejection
-      FFT.compute( FFTDirection::Forward );                       // Compute FFT
-      FFT.complexToMagnitude();                                   // Compute magnitudes
-#else
-      FFT.DCRemoval(); // let FFT lib remove DC component, so we don't need to care about this in getSamples()
-
-      //FFT.Windowing( FFT_WIN_TYP_HAMMING, FFT_FORWARD );        // Weigh data - standard Hamming window
-      //FFT.Windowing( FFT_WIN_TYP_BLACKMAN, FFT_FORWARD );       // Blackman window - better side freq rejection
-      //FFT.Windowing( FFT_WIN_TYP_BLACKMAN_HARRIS, FFT_FORWARD );// Blackman-Harris - excellent sideband rejection
-      FFT.Windowing( FFT_WIN_TYP_FLT_TOP, FFT_FORWARD );          // Flat Top Window - better amplitude accuracy
-      FFT.Compute( FFT_FORWARD );                             // Compute FFT
-      FFT.ComplexToMagnitude();                               // Compute magnitudes
-#endif
-
-#ifdef UM_AUDIOREACTIVE_USE_NEW_FFT
-      FFT.majorPeak(FFT_MajorPeak, FFT_Magnitude);                // let the effects know which freq was most dominant
-#else
-      FFT.MajorPeak(&FFT_MajorPeak, &FFT_Magnitude);              // let the effects know which freq was most dominant
-#endif
-      FFT_MajorPeak = constrain(FFT_MajorPeak, 1.0f, 11025.0f);   // restrict value to range expected by effects
+      // run FFT: DC removal, "Flat Top" window (better amplitude accuracy), magnitudes
+      FFT.compute(vSamples, vReal);
+      FFT.majorPeak(vReal, samplesFFT_2, SAMPLE_RATE, fftFrame.majorPeak, fftFrame.magnitude); // let the effects know which freq was most dominant
+      fftFrame.majorPeak = constrain(fftFrame.majorPeak, 1.0f, 11025.0f);   // restrict value to range expected by effects
 
 #if defined(WLED_DEBUG) || defined(SR_DEBUG)
       haveDoneFFT = true;
@@ -297,77 +363,20 @@ void FFTcode(void * parameter)
 
     } else { // noise gate closed - only clear results as FFT was skipped. MIC samples are still valid when we do this.
       memset(vReal, 0, sizeof(vReal));
-      FFT_MajorPeak = 1;
-      FFT_Magnitude = 0.001;
+      fftFrame.majorPeak = 1;
+      fftFrame.magnitude = 0.001;
     }
 
-    for (int i = 0; i < samplesFFT; i++) {
-      float t = fabsf(vReal[i]);                      // just to be sure - values in fft bins should be positive any way
-      vReal[i] = t / 16.0f;                           // Reduce magnitude. Want end result to be scaled linear and ~4096 max.
+    for (int i = 0; i < samplesFFT_2; i++) {
+      vReal[i] /= 16.0f;                              // Reduce magnitude. Want end result to be scaled linear and ~4096 max.
     } // for()
 
     // mapping of FFT result bins to frequency channels
     if (fabsf(sampleAvg) > 0.5f) { // noise gate open
-#if 0
-    /* This FFT post processing is a DIY endeavour. What we really need is someone with sound engineering expertise to do a great job here AND most importantly, that the animations look GREAT as a result.
-    *
-    * Andrew's updated mapping of 256 bins down to the 16 result bins with Sample Freq = 10240, samplesFFT = 512 and some overlap.
-    * Based on testing, the lowest/Start frequency is 60 Hz (with bin 3) and a highest/End frequency of 5120 Hz in bin 255.
-    * Now, Take the 60Hz and multiply by 1.320367784 to get the next frequency and so on until the end. Then detetermine the bins.
-    * End frequency = Start frequency * multiplier ^ 16
-    * Multiplier = (End frequency/ Start frequency) ^ 1/16
-    * Multiplier = 1.320367784
-    */                                    //  Range
-      fftCalc[ 0] = fftAddAvg(2,4);       // 60 - 100
-      fftCalc[ 1] = fftAddAvg(4,5);       // 80 - 120
-      fftCalc[ 2] = fftAddAvg(5,7);       // 100 - 160
-      fftCalc[ 3] = fftAddAvg(7,9);       // 140 - 200
-      fftCalc[ 4] = fftAddAvg(9,12);      // 180 - 260
-      fftCalc[ 5] = fftAddAvg(12,16);     // 240 - 340
-      fftCalc[ 6] = fftAddAvg(16,21);     // 320 - 440
-      fftCalc[ 7] = fftAddAvg(21,29);     // 420 - 600
-      fftCalc[ 8] = fftAddAvg(29,37);     // 580 - 760
-      fftCalc[ 9] = fftAddAvg(37,48);     // 740 - 980
-      fftCalc[10] = fftAddAvg(48,64);     // 960 - 1300
-      fftCalc[11] = fftAddAvg(64,84);     // 1280 - 1700
-      fftCalc[12] = fftAddAvg(84,111);    // 1680 - 2240
-      fftCalc[13] = fftAddAvg(111,147);   // 2220 - 2960
-      fftCalc[14] = fftAddAvg(147,194);   // 2940 - 3900
-      fftCalc[15] = fftAddAvg(194,250);   // 3880 - 5000 // avoid the last 5 bins, which are usually inaccurate
-#else
-      /* new mapping, optimized for 22050 Hz by softhack007 */
-                                                    // bins frequency  range
-      if (useBandPassFilter) {
-        // skip frequencies below 100hz
-        fftCalc[ 0] = 0.8f * fftAddAvg(3,4);
-        fftCalc[ 1] = 0.9f * fftAddAvg(4,5);
-        fftCalc[ 2] = fftAddAvg(5,6);
-        fftCalc[ 3] = fftAddAvg(6,7);
-        // don't use the last bins from 206 to 255. 
-        fftCalc[15] = fftAddAvg(165,205) * 0.75f;   // 40 7106 - 8828 high             -- with some damping
-      } else {
-        fftCalc[ 0] = fftAddAvg(1,2);               // 1    43 - 86   sub-bass
-        fftCalc[ 1] = fftAddAvg(2,3);               // 1    86 - 129  bass
-        fftCalc[ 2] = fftAddAvg(3,5);               // 2   129 - 216  bass
-        fftCalc[ 3] = fftAddAvg(5,7);               // 2   216 - 301  bass + midrange
-        // don't use the last bins from 216 to 255. They are usually contaminated by aliasing (aka noise) 
-        fftCalc[15] = fftAddAvg(165,215) * 0.70f;   // 50 7106 - 9259 high             -- with some damping
-      }
-      fftCalc[ 4] = fftAddAvg(7,10);                // 3   301 - 430  midrange
-      fftCalc[ 5] = fftAddAvg(10,13);               // 3   430 - 560  midrange
-      fftCalc[ 6] = fftAddAvg(13,19);               // 5   560 - 818  midrange
-      fftCalc[ 7] = fftAddAvg(19,26);               // 7   818 - 1120 midrange -- 1Khz should always be the center !
-      fftCalc[ 8] = fftAddAvg(26,33);               // 7  1120 - 1421 midrange
-      fftCalc[ 9] = fftAddAvg(33,44);               // 9  1421 - 1895 midrange
-      fftCalc[10] = fftAddAvg(44,56);               // 12 1895 - 2412 midrange + high mid
-      fftCalc[11] = fftAddAvg(56,70);               // 14 2412 - 3015 high mid
-      fftCalc[12] = fftAddAvg(70,86);               // 16 3015 - 3704 high mid
-      fftCalc[13] = fftAddAvg(86,104);              // 18 3704 - 4479 high mid
-      fftCalc[14] = fftAddAvg(104,165) * 0.88f;     // 61 4479 - 7106 high mid + high  -- with slight damping
-#endif
+      mapGEQBands(useBandPassFilter ? geqBandsBandPass : geqBands, NUM_GEQ_CHANNELS, vReal, fftCalc);
     } else {  // noise gate closed - just decay old values
       for (int i=0; i < NUM_GEQ_CHANNELS; i++) {
-        fftCalc[i] *= 0.85f;  // decay to zero
+        fftCalc[i] *= FFT_GATE_DECAY;  // decay to zero
         if (fftCalc[i] < 4.0f) fftCalc[i] = 0.0f;
       }
     }
@@ -381,13 +390,15 @@ void FFTcode(void * parameter)
       fftTime  = (fftTimeInMillis*3 + fftTime*7)/10; // smooth
     }
 #endif
-    // run peak detection
-    autoResetPeak();
+    // run peak detection and beat tracking, then hand the results over to effects
     detectSamplePeak();
+    detectBeat();
+    audioFrames.push(fftFrame);
     
     #if !defined(I2S_GRAB_ADC1_COMPLETELY)    
     if ((audioSource == nullptr) || (audioSource->getType() != AudioSource::Type_I2SAdc))  // the "delay trick" does not help for analog ADC
     #endif
+    if ((audioSource == nullptr) || (audioSource->getType() != AudioSource::Type_File))    // file playback paces itself
       vTaskDelayUntil( &xLastWakeTime, xFrequency);        // release CPU, and let I2S fill its buffers
 
   } // for(;;)ever
@@ -444,12 +455,14 @@ static void postProcessFFTResults(bool noiseGateOpen, int numberOfChannels) // p
 
       // smooth results - rise fast, fall slower
       if(fftCalc[i] > fftAvg[i])   // rise fast 
-        fftAvg[i] = fftCalc[i] *0.75f + 0.25f*fftAvg[i];  // will need approx 2 cycles (50ms) for converging against fftCalc[i]
+        fftAvg[i] = fftCalc[i]*fftRise + (1.0f-fftRise)*fftAvg[i];  // will need approx 50ms for converging against fftCalc[i]
       else {                       // fall slow
-        if (decayTime < 1000) fftAvg[i] = fftCalc[i]*0.22f + 0.78f*fftAvg[i];       // approx  5 cycles (225ms) for falling to zero
-        else if (decayTime < 2000) fftAvg[i] = fftCalc[i]*0.17f + 0.83f*fftAvg[i];  // default - approx  9 cycles (225ms) for falling to zero
-        else if (decayTime < 3000) fftAvg[i] = fftCalc[i]*0.14f + 0.86f*fftAvg[i];  // approx 14 cycles (350ms) for falling to zero
-        else fftAvg[i] = fftCalc[i]*0.1f  + 0.9f*fftAvg[i];                         // approx 20 cycles (500ms) for falling to zero
+        float f;
+        if (decayTime < 1000) f = fftFall[0];       // approx 225ms for falling to zero
+        else if (decayTime < 2000) f = fftFall[1];  // default - approx 225ms for falling to zero
+        else if (decayTime < 3000) f = fftFall[2];  // approx 350ms for falling to zero
+        else f = fftFall[3];                        // approx 500ms for falling to zero
+        fftAvg[i] = fftCalc[i]*f + (1.0f-f)*fftAvg[i];
       }
       // constrain internal vars - just to be sure
       fftCalc[i] = constrain(fftCalc[i], 0.0f, 1023.0f);
@@ -501,7 +514,7 @@ static void postProcessFFTResults(bool noiseGateOpen, int numberOfChannels) // p
         if (post_gain < 1.0f) post_gain = ((post_gain -1.0f) * 0.8f) +1.0f;
         currentResult *= post_gain;
       }
-      fftResult[i] = constrain((int)currentResult, 0, 255);
+      fftFrame.fftResult[i] = constrain((int)currentResult, 0, 255);
     }
 }
 ////////////////////
@@ -510,28 +523,41 @@ static void postProcessFFTResults(bool noiseGateOpen, int numberOfChannels) // p
 
 // peak detection is called from FFT task when vReal[] contains valid FFT results
 static void detectSamplePeak(void) {
+  static unsigned long lastPeak = 0;
   bool havePeak = false;
 
   // Poor man's beat detection by seeing if sample > Average + some value.
   // This goes through ALL of the 255 bins - but ignores stupid settings
   // Then we got a peak, else we don't. The peak has to time out on its own in order to support UDP sound sync.
-  if ((sampleAvg > 1) && (maxVol > 0) && (binNum > 1) && (vReal[binNum] > maxVol) && ((millis() - timeOfPeak) > 100)) {
+  if ((sampleAvg > 1) && (maxVol > 0) && (binNum > 1) && (vReal[binNum] > maxVol) && ((millis() - lastPeak) > 100)) {
     havePeak = true;
   }
 
   if (havePeak) {
-    samplePeak    = true;
-    timeOfPeak    = millis();
-    udpSamplePeak = true;
+    fftFrame.peaks++;     // samplePeak is set by the usermod loop when it reads this frame
+    lastPeak = millis();
   }
 }
 
+// beat tracking is called from FFT task after detectSamplePeak(); vReal[] holds the scaled FFT results (zero when the noise gate is closed)
+static void detectBeat(void) {
+  beatTracker.process(vReal, samplesFFT_2, fftFrame.time);
+  if (beatTracker.beat)  fftFrame.beats++;
+  if (beatTracker.onset) fftFrame.onsets++;
+  fftFrame.bpm        = beatTracker.bpm;
+  fftFrame.lastBeat   = beatTracker.lastBeat;
+  fftFrame.confidence = beatTracker.confidence;
+  memcpy(fftFrame.envelope, beatTracker.envelope, sizeof(fftFrame.envelope));
+}
+
 static void autoResetPeak(void) {
   uint16_t MinShowDelay = MAX(50, strip.getMinShowDelay());  // Fixes private class variable compiler error. Unsure if this is the correct way of fixing the root problem. -THATDONFC
   if (millis() - timeOfPeak > MinShowDelay) {          // Auto-reset of samplePeak after a complete frame has passed.
     samplePeak = false;
     if (audioSyncEnabled == 0) udpSamplePeak = false;  // this is normally reset by transmitAudioData
   }
+  if (millis() - timeOfBeat  > MinShowDelay) beatFlag  = false;
+  if (millis() - timeOfOnset > MinShowDelay) onsetFlag = false;
 }
 
 
@@ -597,6 +623,25 @@ class AudioReactive : public Usermod {
       float  FFT_MajorPeak;   //  04 Bytes
     };
 
+    // "V3" audiosync struct - 48 Bytes, packed. Numbered and timestamped with the (toki) time the audio was captured, so
+    // receivers can put packets back in order and play them at the same moment. Values are sent as fixed point.
+    struct __attribute__ ((packed)) audioSyncPacket_v3 {
+      char     header[6];     //  06 Bytes
+      uint16_t seq;           //  02 Bytes  - sequence number
+      uint32_t timeSec;       //  04 Bytes  - capture time, toki seconds
+      uint16_t timeMs;        //  02 Bytes  - capture time, toki milliseconds
+      uint8_t  flags;         //  01 Bytes  - AUDIOSYNC_PEAK, AUDIOSYNC_BEAT, AUDIOSYNC_ONSET, AUDIOSYNC_SYNCED (sender clock)
+      uint8_t  confidence;    //  01 Bytes  - beat tracking confidence
+      uint16_t sampleRaw;     //  02 Bytes  - x 64
+      uint16_t sampleSmth;    //  02 Bytes  - x 64
+      uint16_t magnitude;     //  02 Bytes  - log2(FFT_Magnitude + 1) x 2048
+      uint16_t majorPeak;     //  02 Bytes  - FFT_MajorPeak in Hz
+      uint16_t bpm;           //  02 Bytes  - x 100
+      uint16_t beatAge;       //  02 Bytes  - milliseconds from the last beat to the capture time, 0xFFFF = no beat
+      uint8_t  fftResult[16]; //  16 Bytes
+      uint8_t  envelope[4];   //  04 Bytes
+    };
+
     // old "V1" audiosync struct - 83 Bytes - for backwards compatibility
     struct audioSyncPacket_v1 {
       char header[6];         //  06 Bytes
@@ -619,6 +664,30 @@ class AudioReactive : public Usermod {
     unsigned long lastTime = 0;   // last time of running UDP Microphone Sync
     const uint16_t delayMs = 10;  // I don't want to sample too often and overload WLED
     uint16_t audioSyncPort= 11988;// default port for UDP sound sync
+    uint16_t audioSyncDelay = 80; // receive: play received audio this many milliseconds after it was captured (jitter buffer)
+    bool     audioSyncV2 = true;  // send: also send V2 packets for older receivers
+    #define AUDIOSYNC_DELAY_MAX 250
+
+    // UDP sound sync V3
+    AudioSyncBuffer syncBuffer;        // receive: jitter buffer
+    uint16_t syncSeq = 0;              // send: sequence number
+    uint32_t syncFrameTime = 0;        // send: capture time of the audio frame in use (millis)
+    uint32_t syncLastBeat = 0;         // send: last beat of that frame (millis)
+    bool     udpBeat = false;          // send: beat / onset since the last packet
+    bool     udpOnset = false;
+    int32_t  syncOffset = 0;           // receive: sender clock to millis() offset, if clocks are not synced
+    bool     syncOffsetValid = false;
+    uint8_t  syncOffsetCreep = 0;
+    bool     syncClockShared = false;  // receive: last packet was timed with the shared (NTP) clock
+    unsigned long last_v3Time = 0;     // receive: time of last V3 packet - V1/V2 packets are ignored while V3 is received
+
+    // recorded audio: playback (dmType 6) and recording of the sound input
+    String   audioFile = "/audio.wav";
+    uint16_t audioFileSpeed = 100;     // playback speed in percent, 0 = as fast as possible
+    File     captureFile;
+    uint32_t captureSamples = 0;       // samples written to captureFile
+    uint32_t captureLimit = 0;         // samples to record
+    volatile int captureRequest = -1;  // seconds to record, 0 stops; set by readFromJsonState(), handled in loop()
 
     // used for AGC
     int      last_soundAgc = -1;   // used to detect AGC mode change (for resetting AGC internal error buffers)
@@ -640,7 +709,7 @@ class AudioReactive : public Usermod {
 
     // used to feed "Info" Page
     unsigned long last_UDPTime = 0;    // time of last valid UDP sound sync datapacket
-    int receivedFormat = 0;            // last received UDP sound sync format - 0=none, 1=v1 (0.13.x), 2=v2 (0.14.x)
+    int receivedFormat = 0;            // last received UDP sound sync format - 0=none, 1=v1 (0.13.x), 2=v2 (0.14.x), 3=v3
     float maxSample5sec = 0.0f;        // max sample (after AGC) in last 5 seconds 
     unsigned long sampleMaxTimer = 0;  // last time maxSample5sec was reset
     #define CYCLE_SAMPLEMAX 3500       // time window for merasuring
@@ -653,6 +722,7 @@ class AudioReactive : public Usermod {
     static const char _digitalmic[];
     static const char UDP_SYNC_HEADER[];
     static const char UDP_SYNC_HEADER_v1[];
+    static const char UDP_SYNC_HEADER_v3[];
 
     // private methods
 
@@ -933,6 +1003,111 @@ class AudioReactive : public Usermod {
     }
 
 
+    // time until the LEDs show what is rendered now: sending the longest digital bus (~30us per LED)
+    uint16_t getOutputLatency(void) {
+      uint32_t maxLen = 0;
+      for (uint8_t i = 0; i < busses.getNumBusses(); i++) {
+        Bus *bus = busses.getBus(i);
+        if (bus && IS_DIGITAL(bus->getType()) && bus->getLength() > maxLen) maxLen = bus->getLength();
+      }
+      return (maxLen * 30 + 999) / 1000;
+    }
+
+    /* Copies the FFT task results that belong to the LED output time (minus audioDelay) into the variables used by effects.
+     * Events (peaks, beats, onsets) are taken from the frame counters, so none is lost if frames were skipped.
+     * The beat phase is extrapolated to the output time.
+    */
+    void readAudioFrame(void) {
+      static audio_frame_t frame;
+      static uint8_t lastPeaks = 0, lastBeats = 0, lastOnsets = 0;
+      unsigned long now = millis();
+      uint32_t outputTime = now + getOutputLatency();
+      uint32_t audioTime = outputTime - audioDelay;  // the moment of the music the LEDs will show
+
+      if (!audioFrames.readAt(audioTime, frame)) return;
+
+      memcpy(fftResult, frame.fftResult, sizeof(fftResult));
+      FFT_MajorPeak  = frame.majorPeak;
+      FFT_Magnitude  = frame.magnitude;
+      beatBPM        = frame.bpm;
+      beatConfidence = frame.confidence;
+      memcpy(bandEnvelope, frame.envelope, sizeof(bandEnvelope));
+      beatPhase      = BeatTracker::phase(frame.bpm, frame.lastBeat, audioTime);
+      audioFrameAge  = constrain((int32_t)(outputTime - frame.time), 0, UINT16_MAX);
+      syncFrameTime  = frame.time;
+      syncLastBeat   = frame.lastBeat;
+
+      if (frame.peaks != lastPeaks) {
+        samplePeak    = true;
+        timeOfPeak    = now;
+        udpSamplePeak = true;
+      }
+      if (frame.beats  != lastBeats)  { beatFlag  = true; timeOfBeat  = now; udpBeat  = true; }
+      if (frame.onsets != lastOnsets) { onsetFlag = true; timeOfOnset = now; udpOnset = true; }
+      lastPeaks  = frame.peaks;
+      lastBeats  = frame.beats;
+      lastOnsets = frame.onsets;
+    }
+
+
+    ///////////////////////
+    // Sound recording   //
+    ///////////////////////
+
+    // record the sound input to audioFile (WAV, 16bit mono); replaces an existing file
+    bool startCapture(unsigned seconds) {
+      if (captureFile) stopCapture();
+      if (!audioSource || !audioSource->isInitialized() || audioSource->getType() == AudioSource::Type_File) return false;
+
+      size_t freeBytes = WLED_FS.totalBytes() - WLED_FS.usedBytes();
+      if (WLED_FS.exists(audioFile)) freeBytes += WLED_FS.open(audioFile, "r").size();
+      if (freeBytes < 16384) return false;                 // leave some room for presets and config
+      captureLimit = min(min(seconds, (unsigned)AUDIO_CAPTURE_MAX) * SAMPLE_RATE, (freeBytes - 16384) / 2);
+      if (captureLimit == 0) return false;
+
+      if (!captureRing) captureRing = new(std::nothrow) PcmRing<8192>;
+      if (!captureRing) return false;
+      captureFile = WLED_FS.open(audioFile, "w");
+      if (!captureFile) return false;
+      uint8_t header[PCM_WAV_HEADER_SIZE];
+      makeWavHeader(header, SAMPLE_RATE, 0);               // sizes are filled in by stopCapture()
+      captureFile.write(header, sizeof(header));
+
+      int16_t discard[256];
+      while (captureRing->pop(discard, 256));              // left over from the previous recording
+      captureRing->dropped = 0;
+      captureSamples = 0;
+      capturing = true;
+      DEBUGSR_PRINTF("AR: recording %u samples to %s\n", captureLimit, audioFile.c_str());
+      return true;
+    }
+
+    void stopCapture(void) {
+      capturing = false;
+      if (!captureFile) return;
+      uint8_t header[PCM_WAV_HEADER_SIZE];
+      makeWavHeader(header, SAMPLE_RATE, captureSamples);
+      captureFile.seek(0);
+      captureFile.write(header, sizeof(header));
+      captureFile.close();
+      DEBUGSR_PRINTF("AR: recorded %u samples, %u batches dropped\n", captureSamples, captureRing ? captureRing->dropped : 0);
+    }
+
+    // called from loop(): move recorded samples to the file, in chunks to keep flash writes efficient
+    void writeCapture(void) {
+      if (!captureFile) return;
+      if (disableSoundProcessing && capturing) { stopCapture(); return; }  // input stopped
+      int16_t buf[256];
+      for (uint8_t i = 0; i < 4 && captureRing->available() >= 256; i++) {
+        size_t n = captureRing->pop(buf, min((uint32_t)256, captureLimit - captureSamples));
+        captureFile.write((uint8_t*)buf, n * sizeof(int16_t));
+        captureSamples += n;
+        if (captureSamples >= captureLimit) break;
+      }
+      if (captureSamples >= captureLimit) stopCapture();
+    }
+
+
     //////////////////////
     // UDP Sound Sync   //
     //////////////////////
@@ -958,6 +1133,12 @@ class AudioReactive : public Usermod {
       if (!udpSyncConnected) return;
       //DEBUGSR_PRINTLN("Transmitting UDP Mic Packet");
 
+      transmitAudioData_v3();
+      if (!audioSyncV2) {
+        udpSamplePeak = false;
+        return;
+      }
+
       audioSyncPacket transmitData;
       strncpy_P(transmitData.header, PSTR(UDP_SYNC_HEADER), 6);
       // transmit samples that were not modified by limitSampleDynamics()
@@ -980,12 +1161,125 @@ class AudioReactive : public Usermod {
       return;
     } // transmitAudioData()
 
+    void transmitAudioData_v3()
+    {
+      audioSyncPacket_v3 transmitData;
+      strncpy_P(transmitData.header, PSTR(UDP_SYNC_HEADER_v3), 6);
+      transmitData.seq = syncSeq++;
+
+      // capture time of the current frame on the toki clock
+      Toki::Time capture = toki.getTime();
+      toki.adjust(capture, -(int32_t)(millis() - syncFrameTime));
+      transmitData.timeSec = capture.sec;
+      transmitData.timeMs  = capture.ms;
+
+      transmitData.flags = (udpSamplePeak ? AUDIOSYNC_PEAK : 0) | (udpBeat ? AUDIOSYNC_BEAT : 0) | (udpOnset ? AUDIOSYNC_ONSET : 0);
+      if (toki.getTimeSource() >= TOKI_TS_UDP_NTP) transmitData.flags |= AUDIOSYNC_SYNCED;
+      udpBeat  = false;
+      udpOnset = false;
+      transmitData.confidence = beatConfidence;
+
+      // transmit samples that were not modified by limitSampleDynamics()
+      transmitData.sampleRaw  = constrain(((soundAgc) ? rawSampleAgc : sampleRaw) * 64.0f, 0.0f, 65535.0f);
+      transmitData.sampleSmth = constrain(((soundAgc) ? sampleAgc    : sampleAvg) * 64.0f, 0.0f, 65535.0f);
+      transmitData.magnitude  = constrain(log2f(fmaxf(my_magnitude, 0.0f) + 1.0f) * 2048.0f, 0.0f, 65535.0f);
+      transmitData.majorPeak  = constrain(FFT_MajorPeak, 1.0f, 11025.0f);
+      transmitData.bpm        = constrain(beatBPM * 100.0f, 0.0f, 65535.0f);
+      int32_t beatAge = syncFrameTime - syncLastBeat;
+      transmitData.beatAge    = (syncLastBeat == 0 || beatAge < 0 || beatAge >= 0xFFFF) ? 0xFFFF : beatAge;
+      for (int i = 0; i < NUM_GEQ_CHANNELS; i++) transmitData.fftResult[i] = fftResult[i];
+      memcpy(transmitData.envelope, bandEnvelope, sizeof(transmitData.envelope));
+
+      fftUdp.beginMulticastPacket();
+      fftUdp.write(reinterpret_cast<uint8_t *>(&transmitData), sizeof(transmitData));
+      fftUdp.endPacket();
+    } // transmitAudioData_v3()
+
     static bool isValidUdpSyncVersion(const char *header) {
       return strncmp_P(header, PSTR(UDP_SYNC_HEADER), 6) == 0;
     }
     static bool isValidUdpSyncVersion_v1(const char *header) {
       return strncmp_P(header, PSTR(UDP_SYNC_HEADER_v1), 6) == 0;
     }
+    static bool isValidUdpSyncVersion_v3(const char *header) {
+      return strncmp_P(header, PSTR(UDP_SYNC_HEADER_v3), 6) == 0;
+    }
+
+    // V3 packets go into the jitter buffer, playAudioSyncFrame() takes them out
+    void decodeAudioData_v3(int packetSize, uint8_t *fftBuff) {
+      audioSyncPacket_v3 *receivedPacket = reinterpret_cast<audioSyncPacket_v3*>(fftBuff);
+      unsigned long now = millis();
+      audio_sync_frame_t frame;
+
+      // capture time on our millis() time line
+      uint32_t senderMs = receivedPacket->timeSec * 1000UL + receivedPacket->timeMs;
+      syncClockShared = (receivedPacket->flags & AUDIOSYNC_SYNCED) && (toki.getTimeSource() >= TOKI_TS_UDP_NTP);
+      if (syncClockShared) {
+        // same clock on both sides: all receivers play the frame at the same moment
+        Toki::Time local = toki.getTime();
+        int32_t age = (int32_t)(local.sec - receivedPacket->timeSec) * 1000 + (int32_t)local.ms - (int32_t)receivedPacket->timeMs;
+        frame.time = now - age;
+      } else {
+        // no shared clock: offset from the fastest packet so far, creeping up by 1ms/s to follow clock drift
+        int32_t offset = now - senderMs;
+        if (!syncOffsetValid || (offset - syncOffset) < 0) {
+          syncOffset = offset;
+          syncOffsetValid = true;
+        } else if (++syncOffsetCreep >= 50) {
+          syncOffset++;
+          syncOffsetCreep = 0;
+        }
+        frame.time = senderMs + syncOffset;
+      }
+
+      frame.seq        = receivedPacket->seq;
+      frame.flags      = receivedPacket->flags;
+      frame.confidence = receivedPacket->confidence;
+      frame.sampleRaw  = receivedPacket->sampleRaw / 64.0f;
+      frame.sampleSmth = receivedPacket->sampleSmth / 64.0f;
+      frame.magnitude  = exp2f(receivedPacket->magnitude / 2048.0f) - 1.0f;
+      frame.majorPeak  = receivedPacket->majorPeak;
+      frame.bpm        = receivedPacket->bpm / 100.0f;
+      frame.lastBeat   = (receivedPacket->beatAge == 0xFFFF) ? 0 : frame.time - receivedPacket->beatAge;
+      memcpy(frame.fftResult, receivedPacket->fftResult, sizeof(frame.fftResult));
+      memcpy(frame.envelope, receivedPacket->envelope, sizeof(frame.envelope));
+      syncBuffer.push(frame, now);
+    }
+
+    // V3 receive: state for the LED output time, interpolated from the jitter buffer. Called on every loop.
+    bool playAudioSyncFrame(void) {
+      audio_sync_frame_t frame;
+      uint8_t events;
+      unsigned long now = millis();
+      uint32_t outputTime = now + getOutputLatency();
+      uint32_t playTime = outputTime - audioSyncDelay;
+      if (!syncBuffer.get(playTime, frame, events)) return false;
+
+      // update samples for effects
+      volumeSmth   = fmaxf(frame.sampleSmth, 0.0f);
+      volumeRaw    = fmaxf(frame.sampleRaw, 0.0f);
+      // update internal samples
+      sampleRaw    = volumeRaw;
+      sampleAvg    = volumeSmth;
+      rawSampleAgc = volumeRaw;
+      sampleAgc    = volumeSmth;
+      multAgc      = 1.0f;
+
+      for (int i = 0; i < NUM_GEQ_CHANNELS; i++) fftResult[i] = frame.fftResult[i];
+      my_magnitude   = fmaxf(frame.magnitude, 0.0f);
+      FFT_Magnitude  = my_magnitude;
+      FFT_MajorPeak  = constrain(frame.majorPeak, 1.0f, 11025.0f);
+      beatBPM        = frame.bpm;
+      beatConfidence = frame.confidence;
+      memcpy(bandEnvelope, frame.envelope, sizeof(bandEnvelope));
+      beatPhase      = frame.lastBeat ? BeatTracker::phase(frame.bpm, frame.lastBeat, playTime) : 0;
+      audioFrameAge  = constrain((int32_t)(outputTime - frame.time), 0, UINT16_MAX);
+
+      if (events & AUDIOSYNC_PEAK)  { samplePeak = true; timeOfPeak  = now; }
+      if (events & AUDIOSYNC_BEAT)  { beatFlag   = true; timeOfBeat  = now; }
+      if (events & AUDIOSYNC_ONSET) { onsetFlag  = true; timeOfOnset = now; }
+      return true;
+    }
 
     void decodeAudioData(int packetSize, uint8_t *fftBuff) {
       audioSyncPacket *receivedPacket = reinterpret_cast<audioSyncPacket*>(fftBuff);
@@ -1044,14 +1338,28 @@ class AudioReactive : public Usermod {
       if (!udpSyncConnected) return false;
       bool haveFreshData = false;
 
-      size_t packetSize = fftUdp.parsePacket();
-      if (packetSize > 5) {
+      // a V3 sender may send two packets per cycle, so read everything that is waiting
+      for (int n = 0; n < 4; n++) {
+        size_t packetSize = fftUdp.parsePacket();
+        if (packetSize <= 5) break;
         //DEBUGSR_PRINTLN("Received UDP Sync Packet");
         uint8_t fftBuff[packetSize];
         fftUdp.read(fftBuff, packetSize);
+        bool haveV3 = (millis() - last_v3Time < 2500);
 
         // VERIFY THAT THIS IS A COMPATIBLE PACKET
-        if (packetSize == sizeof(audioSyncPacket) && (isValidUdpSyncVersion((const char *)fftBuff))) {
+        if (packetSize == sizeof(audioSyncPacket_v3) && (isValidUdpSyncVersion_v3((const char *)fftBuff))) {
+          if (!haveV3) {      // new stream - start over
+            syncBuffer.reset();
+            syncOffsetValid = false;
+          }
+          decodeAudioData_v3(packetSize, fftBuff);
+          last_v3Time = millis();
+          haveFreshData = true;
+          receivedFormat = 3;
+        } else if (haveV3) {
+          // V1/V2 packets of a V3 sender (sent for older receivers) - ignore
+        } else if (packetSize == sizeof(audioSyncPacket) && (isValidUdpSyncVersion((const char *)fftBuff))) {
           decodeAudioData(packetSize, fftBuff);
           //DEBUGSR_PRINTLN("Finished parsing UDP Sync Packet v2");
           haveFreshData = true;
@@ -1088,7 +1396,7 @@ class AudioReactive : public Usermod {
         // usermod exchangeable data
         // we will assign all usermod exportable data here as pointers to original variables or arrays and allocate memory for pointers
         um_data = new um_data_t;
-        um_data->u_size = 8;
+        um_data->u_size = 15;
         um_data->u_type = new um_types_t[um_data->u_size];
         um_data->u_data = new void*[um_data->u_size];
         um_data->u_data[0] = &volumeSmth;      //*used (New)
@@ -1107,6 +1415,20 @@ class AudioReactive : public Usermod {
         um_data->u_type[6] = UMT_BYTE;
         um_data->u_data[7] = &binNum;          // assigned in effect function from UI element!!! (Puddlepeak, Ripplepeak, Waterfall)
         um_data->u_type[7] = UMT_BYTE;
+        um_data->u_data[8] = &beatFlag;        //*used (Ripplepeak, Gravcenter, GEQ - when "Beat sync" is checked)
+        um_data->u_type[8] = UMT_BYTE;
+        um_data->u_data[9] = &beatBPM;         // used (New)
+        um_data->u_type[9] = UMT_FLOAT;
+        um_data->u_data[10] = &beatPhase;      // used (New)
+        um_data->u_type[10] = UMT_BYTE;
+        um_data->u_data[11] = bandEnvelope;    // used (New)
+        um_data->u_type[11] = UMT_BYTE_ARR;
+        um_data->u_data[12] = &onsetFlag;      // used (New)
+        um_data->u_type[12] = UMT_BYTE;
+        um_data->u_data[13] = &beatConfidence; // used (New)
+        um_data->u_type[13] = UMT_BYTE;
+        um_data->u_data[14] = &audioFrameAge;  // used (New)
+        um_data->u_type[14] = UMT_UINT16;
       }
 
       // Reset I2S peripheral for good measure
@@ -1150,6 +1472,11 @@ class AudioReactive : public Usermod {
           delay(100);
           if (audioSource) audioSource->initialize(i2swsPin, i2ssdPin, i2sckPin, mclkPin);
           break;
+        case 6:
+          DEBUGSR_PRINT(F("AR: File playback - ")); DEBUGSR_PRINTLN(audioFile);
+          audioSource = new FileSource(SAMPLE_RATE, BLOCK_SIZE, audioFile.c_str(), audioFileSpeed);
+          if (audioSource) audioSource->initialize();
+          break;
         #if  !defined(CONFIG_IDF_TARGET_ESP32S2) && !defined(CONFIG_IDF_TARGET_ESP32C3)
         case 5:
           DEBUGSR_PRINT(F("AR: I2S PDM Microphone - ")); DEBUGSR_PRINTLN(F(I2S_PDM_MIC_CHANNEL_TEXT));
@@ -1173,6 +1500,8 @@ class AudioReactive : public Usermod {
       delay(250); // give microphone enough time to initialise
 
       if (!audioSource) enabled = false;                 // audio failed to initialise
+      FFT.init();                                        // window and twiddle tables
+      beatTracker.init(float(SAMPLE_RATE) / samplesNew, float(SAMPLE_RATE) / samplesFFT);
       if (enabled) onUpdateBegin(false);                 // create FFT task
       if (FFT_Task == nullptr) enabled = false;          // FFT task creation failed
       if (enabled) disableSoundProcessing = false;       // all good - enable audio processing
@@ -1293,6 +1622,7 @@ class AudioReactive : public Usermod {
         // update samples for effects (raw, smooth) 
         volumeSmth = (soundAgc) ? sampleAgc   : sampleAvg;
         volumeRaw  = (soundAgc) ? rawSampleAgc: sampleRaw;
+        readAudioFrame();                     // FFT results, peaks and beats for effects
         // update FFTMagnitude, taking into account AGC amplification
         my_magnitude = FFT_Magnitude; // / 16.0f, 8.0f, 4.0f done in effects
         if (soundAgc) my_magnitude *= multAgc;
@@ -1303,6 +1633,13 @@ class AudioReactive : public Usermod {
 
       autoResetPeak();          // auto-reset sample peak after strip minShowDelay
       if (!udpSyncConnected) udpSamplePeak = false;  // reset UDP samplePeak while UDP is unconnected
+      if (captureRequest >= 0) {  // recording started or stopped via JSON API
+        int seconds = captureRequest;
+        captureRequest = -1;
+        if (seconds > 0) startCapture(seconds);
+        else stopCapture();
+      }
+      writeCapture();           // sound recording in progress
 
       connectUDPSoundSync();  // ensure we have a connection - if needed
 
@@ -1316,6 +1653,7 @@ class AudioReactive : public Usermod {
             if (have_new_sample) last_UDPTime = millis();
             lastTime = millis();
           }
+          if (millis() - last_v3Time < 2500) have_new_sample = playAudioSyncFrame(); // V3: played from the jitter buffer on every loop
           if (have_new_sample) syncVolumeSmth = volumeSmth;   // remember received sample
           else volumeSmth = syncVolumeSmth;                   // restore originally received sample for next run of dynamics limiter
           limitSampleDynamics();                              // run dynamics limiter on received volumeSmth, to hide jumps and hickups
@@ -1492,6 +1830,9 @@ class AudioReactive : public Usermod {
             // audio source sucessfully configured
             if (audioSource->getType() == AudioSource::Type_I2SAdc) {
               infoArr.add(F("ADC analog"));
+            } else if (audioSource->getType() == AudioSource::Type_File) {
+              snprintf_P(myStringBuffer, 15, PSTR("file @%us"), ((FileSource*)audioSource)->getPosition());
+              infoArr.add(myStringBuffer);
             } else {
               infoArr.add(F("I2S digital"));
             }
@@ -1506,7 +1847,8 @@ class AudioReactive : public Usermod {
           } else {
             // error during audio source setup
             infoArr.add(F("not initialized"));
-            infoArr.add(F(" - check GPIO config"));
+            if (dmType == 6) infoArr.add(F(" - check audio file"));
+            else infoArr.add(F(" - check GPIO config"));
           }
         }
 
@@ -1518,6 +1860,14 @@ class AudioReactive : public Usermod {
           infoArr.add(F("suspended"));
         }
 
+        // sound recording
+        if (captureFile) {
+          infoArr = user.createNestedArray(F("Recording"));
+          snprintf_P(myStringBuffer, 15, PSTR("%us / %us"), captureSamples / SAMPLE_RATE, captureLimit / SAMPLE_RATE);
+          infoArr.add(myStringBuffer);
+          if (captureRing->dropped) infoArr.add(F(" <i>(gaps)</i>"));
+        }
+
         // AGC or manual Gain
         if ((soundAgc==0) && (disableSoundProcessing == false) && !(audioSyncEnabled & 0x02)) {
           infoArr = user.createNestedArray(F("Manual Gain"));
@@ -1531,12 +1881,23 @@ class AudioReactive : public Usermod {
           infoArr.add("x");
         }
 
+        // tempo from beat tracking
+        if ((disableSoundProcessing == false) && !(audioSyncEnabled & 0x02)) {
+          infoArr = user.createNestedArray(F("Tempo"));
+          if ((beatBPM > 0.0f) && (beatConfidence > 40)) {
+            infoArr.add(roundf(beatBPM));
+            infoArr.add(F(" BPM"));
+          } else {
+            infoArr.add(F("no beat"));
+          }
+        }
+
         // UDP Sound Sync status
         infoArr = user.createNestedArray(F("UDP Sound Sync"));
         if (audioSyncEnabled) {
           if (audioSyncEnabled & 0x01) {
             infoArr.add(F("send mode"));
-            if ((udpSyncConnected) && (millis() - lastTime < 2500)) infoArr.add(F(" v2"));
+            if ((udpSyncConnected) && (millis() - lastTime < 2500)) infoArr.add(audioSyncV2 ? F(" v3+v2") : F(" v3"));
           } else if (audioSyncEnabled & 0x02) {
               infoArr.add(F("receive mode"));
           }
@@ -1546,6 +1907,21 @@ class AudioReactive : public Usermod {
         if (audioSyncEnabled && udpSyncConnected && (millis() - last_UDPTime < 2500)) {
             if (receivedFormat == 1) infoArr.add(F(" v1"));
             if (receivedFormat == 2) infoArr.add(F(" v2"));
+            if (receivedFormat == 3) infoArr.add(F(" v3"));
+        }
+        if ((audioSyncEnabled & 0x02) && udpSyncConnected && (millis() - last_v3Time < 2500)) {
+          const AudioSyncBuffer::audio_sync_stats_t& stats = syncBuffer.getStats();
+          uint32_t expected = stats.received + stats.lost;
+          char syncStats[64];
+          snprintf_P(syncStats, sizeof(syncStats), PSTR("%.1f%% lost, %u late, jitter %dms"),
+                     expected ? 100.0f * stats.lost / expected : 0.0f, (unsigned)stats.late, (int)roundf(stats.jitter));
+          infoArr = user.createNestedArray(F("Sync Quality"));
+          infoArr.add(syncStats);
+          if (syncClockShared) {  // transit time is only meaningful with a shared clock
+            infoArr = user.createNestedArray(F("Sync Latency"));
+            infoArr.add(roundf(stats.transit));
+            infoArr.add(F(" ms"));
+          }
         }
 
         #if defined(WLED_DEBUG) || defined(SR_DEBUG)
@@ -1581,6 +1957,7 @@ class AudioReactive : public Usermod {
         usermod = root.createNestedObject(FPSTR(_name));
       }
       usermod["on"] = enabled;
+      if (captureFile) usermod[F("rec")] = (captureLimit - captureSamples + SAMPLE_RATE - 1) / SAMPLE_RATE; // seconds left
     }
 
 
@@ -1601,6 +1978,9 @@ class AudioReactive : public Usermod {
         if (usermod[FPSTR(_inputLvl)].is<int>()) {
           inputLevel = min(255,max(0,usermod[FPSTR(_inputLvl)].as<int>()));
         }
+        if (usermod[F("rec")].is<int>()) {  // record the sound input for n seconds, 0 stops (may run on the async task, loop() does it)
+          captureRequest = max(0, usermod[F("rec")].as<int>());
+        }
       }
     }
 
@@ -1669,6 +2049,7 @@ class AudioReactive : public Usermod {
       dynLim[F("limiter")] = limiterOn;
       dynLim[F("rise")] = attackTime;
       dynLim[F("fall")] = decayTime;
+      dynLim[F("delay")] = audioDelay;
 
       JsonObject freqScale = top.createNestedObject("frequency");
       freqScale[F("scale")] = FFTScalingMode;
@@ -1676,6 +2057,12 @@ class AudioReactive : public Usermod {
       JsonObject sync = top.createNestedObject("sync");
       sync[F("port")] = audioSyncPort;
       sync[F("mode")] = audioSyncEnabled;
+      sync[F("delay")] = audioSyncDelay;
+      sync[F("v2")] = audioSyncV2;
+
+      JsonObject file = top.createNestedObject("file");
+      file[F("name")] = audioFile;
+      file[F("speed")] = audioFileSpeed;
     }
 
 
@@ -1729,11 +2116,20 @@ class AudioReactive : public Usermod {
       configComplete &= getJsonValue(top["dynamics"][F("limiter")], limiterOn);
       configComplete &= getJsonValue(top["dynamics"][F("rise")],  attackTime);
       configComplete &= getJsonValue(top["dynamics"][F("fall")],  decayTime);
+      configComplete &= getJsonValue(top["dynamics"][F("delay")], audioDelay);
+      audioDelay = min(audioDelay, (uint16_t)AUDIO_DELAY_MAX);
 
       configComplete &= getJsonValue(top["frequency"][F("scale")], FFTScalingMode);
 
       configComplete &= getJsonValue(top["sync"][F("port")], audioSyncPort);
       configComplete &= getJsonValue(top["sync"][F("mode")], audioSyncEnabled);
+      configComplete &= getJsonValue(top["sync"][F("delay")], audioSyncDelay);
+      configComplete &= getJsonValue(top["sync"][F("v2")], audioSyncV2);
+      audioSyncDelay = min(audioSyncDelay, (uint16_t)AUDIOSYNC_DELAY_MAX);
+
+      configComplete &= getJsonValue(top["file"][F("name")], audioFile);
+      configComplete &= getJsonValue(top["file"][F("speed")], audioFileSpeed);
+      if (audioFile.length() && audioFile[0] != '/') audioFile = "/" + audioFile;
 
       return configComplete;
     }
@@ -1752,6 +2148,7 @@ class AudioReactive : public Usermod {
     #if  !defined(CONFIG_IDF_TARGET_ESP32S2) && !defined(CONFIG_IDF_TARGET_ESP32C3)
       oappend(SET_F("addOption(dd,'Generic I2S PDM',5);"));
     #endif
+      oappend(SET_F("addOption(dd,'File playback',6);"));
       oappend(SET_F("dd=addDropdown('AudioReactive','config:AGC');"));
       oappend(SET_F("addOption(dd,'Off',0);"));
       oappend(SET_F("addOption(dd,'Normal',1);"));
@@ -1764,6 +2161,7 @@ class AudioReactive : public Usermod {
       oappend(SET_F("addInfo('AudioReactive:dynamics:limiter',0,' On ');"));  // 0 is field type, 1 is actual field
       oappend(SET_F("addInfo('AudioReactive:dynamics:rise',1,'ms <i>(&#x266A; effects only)</i>');"));
       oappend(SET_F("addInfo('AudioReactive:dynamics:fall',1,'ms <i>(&#x266A; effects only)</i>');"));
+      oappend(SET_F("addInfo('AudioReactive:dynamics:delay',1,'ms <i>(speaker lag, max 250)</i>');"));
 
       oappend(SET_F("dd=addDropdown('AudioReactive','frequency:scale');"));
       oappend(SET_F("addOption(dd,'None',0);"));
@@ -1775,6 +2173,9 @@ class AudioReactive : public Usermod {
       oappend(SET_F("addOption(dd,'Off',0);"));
       oappend(SET_F("addOption(dd,'Send',1);"));
       oappend(SET_F("addOption(dd,'Receive',2);"));
+      oappend(SET_F("addInfo('AudioReactive:sync:delay',1,'ms <i>(receive, same on all receivers)</i>');"));
+      oappend(SET_F("addInfo('AudioReactive:sync:v2',1,'<i>send for older receivers</i>');"));
+      oappend(SET_F("addInfo('AudioReactive:file:speed',1,'% <i>(of real time, 0 = unpaced)</i>');"));
       oappend(SET_F("addInfo('AudioReactive:digitalmic:type',1,'<i>requires reboot!</i>');"));  // 0 is field type, 1 is actual field
       oappend(SET_F("addInfo('AudioReactive:digitalmic:pin[]',0,'<i>sd/data/dout</i>','I2S SD');"));
       oappend(SET_F("addInfo('AudioReactive:digitalmic:pin[]',1,'<i>ws/clk/lrck</i>','I2S WS');"));
@@ -1808,6 +2209,12 @@ class AudioReactive : public Usermod {
     {
       return USERMOD_ID_AUDIOREACTIVE;
     }
+
+    // loop() runs on every main loop iteration: it feeds the effects
+    uint16_t getHooks()
+    {
+      return UM_HOOK_LOOP | UM_HOOK_BUTTON | UM_HOOK_UMDATA | UM_HOOK_JSON_STATE | UM_HOOK_JSON_INFO;
+    }
 };
 
 // strings to reduce flash memory usage (used more than twice)
@@ -1818,3 +2225,4 @@ const char AudioReactive::_analogmic[]  PROGMEM = "analogmic";
 const char AudioReactive::_digitalmic[] PROGMEM = "digitalmic";
 const char AudioReactive::UDP_SYNC_HEADER[]    PROGMEM = "00002"; // new sync header version, as format no longer compatible with previous structure
 const char AudioReactive::UDP_SYNC_HEADER_v1[] PROGMEM = "00001"; // old sync header version - need to add backwards-compatibility feature
+const char AudioReactive::UDP_SYNC_HEADER_v3[] PROGMEM = "00003"; // timestamped and numbered, played from a jitter buffer
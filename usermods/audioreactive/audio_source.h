@@ -5,6 +5,7 @@
 #include <driver/i2s.h>
 #include <driver/adc.h>
 #include <soc/i2s_reg.h>  // needed for SPH0465 timing workaround (classic ESP32)
+#include "audio_pcm.h"     // recorded audio (FileSource)
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
 #if !defined(CONFIG_IDF_TARGET_ESP32S2) && !defined(CONFIG_IDF_TARGET_ESP32S3) && !defined(CONFIG_IDF_TARGET_ESP32C3)
 #include <driver/adc_deprecated.h>
@@ -140,8 +141,8 @@ class AudioSource {
     /* check if the audio source driver was initialized successfully */
     virtual bool isInitialized(void) {return(_initialized);}
 
-    /* identify Audiosource type - I2S-ADC or I2S-digital */
-    typedef enum{Type_unknown=0, Type_I2SAdc=1, Type_I2SDigital=2} AudioSourceType;
+    /* identify Audiosource type - I2S-ADC, I2S-digital or file playback */
+    typedef enum{Type_unknown=0, Type_I2SAdc=1, Type_I2SDigital=2, Type_File=3} AudioSourceType;
     virtual AudioSourceType getType(void) {return(Type_I2SDigital);}               // default is "I2S digital source" - ADC type overrides this method
  
   protected:
@@ -685,3 +686,67 @@ class SPH0654 : public I2SSource {
 #endif
     }
 };
+
+/* File playback
+   Plays a recorded WAV file (16bit PCM, any sample rate, mono or stereo) or raw 16bit mono PCM
+   from the filesystem instead of reading a microphone. The file is repeated when it ends.
+   speed is in percent of real time; 0 means "as fast as the FFT task can process it".
+   The same file always produces the same samples, so effects can be tested and benchmarked reproducibly.
+*/
+class FileSource : public AudioSource {
+  public:
+    FileSource(SRate_t sampleRate, int blockSize, const char *fileName, uint16_t speed = 100, float sampleScale = 1.0f) :
+      AudioSource(sampleRate, blockSize, sampleScale),
+      _fileName(fileName),
+      _speed(speed)
+    {}
+
+    void initialize(int8_t = I2S_PIN_NO_CHANGE, int8_t = I2S_PIN_NO_CHANGE, int8_t = I2S_PIN_NO_CHANGE, int8_t = I2S_PIN_NO_CHANGE, int8_t = I2S_PIN_NO_CHANGE, int8_t = I2S_PIN_NO_CHANGE) {
+      _file = WLED_FS.open(_fileName, "r");
+      if (!_file) {
+        DEBUGSR_PRINTF("AR: Failed to open audio file %s\n", _fileName.c_str());
+        return;
+      }
+      if (!_reader.begin(&_file, _sampleRate, true)) {
+        DEBUGSR_PRINTF("AR: Unsupported audio file %s (16bit PCM WAV or raw PCM only)\n", _fileName.c_str());
+        _file.close();
+        return;
+      }
+      DEBUGSR_PRINTF("AR: Playing %s - %u Hz, %u channel(s), speed %u%%\n", _fileName.c_str(), _reader.format().sampleRate, _reader.format().channels, _speed);
+      _due = micros();
+      _initialized = true;
+    }
+
+    void deinitialize() {
+      _initialized = false;
+      if (_file) _file.close();
+    }
+
+    void getSamples(float *buffer, uint16_t num_samples) {
+      // FFTcode() does not pace file input, every batch blocks for at least a tick so the idle task (task watchdog) runs
+      if (!_initialized) { vTaskDelay(1); return; }
+      size_t n = _reader.read(buffer, num_samples);
+      for (size_t i = 0; i < num_samples; i++) buffer[i] = (i < n) ? buffer[i] * _sampleScale : 0.0f;
+
+      // pace playback like a microphone would: one batch per batch duration (scaled by speed), speed 0: as fast as possible
+      if (_speed == 0) { vTaskDelay(1); return; }
+      _due += (uint64_t)num_samples * 100000000ULL / ((uint64_t)_sampleRate * _speed);
+      int32_t wait = (int32_t)(_due - micros());
+      if (wait > 0) vTaskDelay(pdMS_TO_TICKS(wait / 1000) + 1);
+      else {
+        if (wait < -100000) _due = micros();  // more than 100ms behind (task was suspended) - don't try to catch up
+        vTaskDelay(1);
+      }
+    }
+
+    AudioSourceType getType(void) {return(Type_File);}
+
+    uint32_t getPosition(void) { return _initialized ? _reader.position() / _reader.format().sampleRate : 0; } // seconds into the file
+
+  private:
+    String _fileName;
+    uint16_t _speed;
+    File _file;
+    PcmReader<File> _reader;
+    uint32_t _due = 0;             // when the next batch is due (micros)
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * Receiver side of audio sync v3
+ *
+ * AudioSyncBuffer is a jitter buffer for timestamped audio frames received over UDP. Frames are kept in order of
+ * their capture time, already converted to the local millis() time line by the caller. Playback runs a fixed delay
+ * behind the capture time, so all receivers that share the sender clock show the same frame at the same moment:
+ * - values between two frames are interpolated
+ * - events (peak, beat, onset) are returned once, when playback passes the frame that carries them
+ * - frames that arrive after their playback time are dropped (their events are still delivered)
+ * It also keeps statistics on lost, late and reordered packets, transit time and jitter (RFC 3550 style).
+ *
+ * This header has no Arduino dependencies, it can be compiled on a host.
+ */
+
+#define AUDIOSYNC_PEAK    0x01  // frame flags
+#define AUDIOSYNC_BEAT    0x02
+#define AUDIOSYNC_ONSET   0x04
+#define AUDIOSYNC_EVENTS  0x07
+#define AUDIOSYNC_SYNCED  0x80  // sender clock is synced (NTP, or time sync from an NTP synced instance)
+
+typedef struct AudioSyncFrame {
+  uint32_t time;           // capture time on the local millis() time line
+  uint16_t seq;
+  uint8_t  flags;
+  uint8_t  confidence;
+  float    sampleRaw;
+  float    sampleSmth;
+  float    magnitude;
+  float    majorPeak;
+  float    bpm;
+  uint32_t lastBeat;       // local time line
+  uint8_t  fftResult[16];
+  uint8_t  envelope[4];
+} audio_sync_frame_t;
+
+class AudioSyncBuffer {
+  public:
+    static constexpr uint8_t SIZE = 16;
+
+    typedef struct Stats {
+      uint32_t received;
+      uint32_t lost;       // sequence gaps (corrected when a reordered packet shows up)
+      uint32_t late;       // arrived after their playback time
+      uint32_t reordered;
+      uint32_t underruns;  // playback ran past the newest frame
+      float    transit;    // average arrival - capture time in ms (latency if clocks are synced)
+      float    jitter;     // average transit variation in ms
+    } audio_sync_stats_t;
+
+    void reset() {
+      count = 0;
+      haveSeq = havePlayed = starved = false;
+      pendingEvents = 0;
+      memset(&stats, 0, sizeof(stats));
+      haveTransit = false;
+    }
+
+    // f.time must already be on the local time line; arrival: local receive time
+    void push(const audio_sync_frame_t& f, uint32_t arrival) {
+      stats.received++;
+      if (haveSeq) {
+        int16_t d = f.seq - lastSeq;
+        if (d == 0) return;                      // duplicate
+        if (d > 100 || d < -100) {               // sender restarted or long outage: start over
+          count = 0;
+          havePlayed = false;
+          d = 1;
+        }
+        if (d < 0) {
+          stats.reordered++;
+          if (stats.lost) stats.lost--;          // was counted as lost
+        } else {
+          if (d > 1) stats.lost += d - 1;
+          lastSeq = f.seq;
+        }
+      } else {
+        lastSeq = f.seq;
+        haveSeq = true;
+      }
+
+      int32_t transit = arrival - f.time;
+      if (haveTransit) {
+        float d = fabsf((float)(transit - lastTransit));
+        stats.jitter  += (d - stats.jitter) / 16.0f;
+        stats.transit += ((float)transit - stats.transit) / 16.0f;
+      } else {
+        stats.transit = transit;
+        haveTransit = true;
+      }
+      lastTransit = transit;
+
+      if (havePlayed && (int32_t)(f.time - played) <= 0) {
+        stats.late++;
+        pendingEvents |= f.flags & AUDIOSYNC_EVENTS;
+        return;
+      }
+
+      // insert sorted by time, drop the oldest frame when full
+      uint8_t pos = count;
+      while (pos > 0 && (int32_t)(frames[pos-1].time - f.time) > 0) pos--;
+      if (count == SIZE) {
+        if (pos == 0) return;                    // older than everything we keep
+        memmove(frames, frames + 1, (pos - 1) * sizeof(audio_sync_frame_t));
+        pos--;
+      } else {
+        memmove(frames + pos + 1, frames + pos, (count - pos) * sizeof(audio_sync_frame_t));
+        count++;
+      }
+      frames[pos] = f;
+    }
+
+    // state at local time t, interpolated between the frames around it; events that became due since the last call
+    bool get(uint32_t t, audio_sync_frame_t& out, uint8_t& events) {
+      events = pendingEvents;
+      pendingEvents = 0;
+      if (!count) return false;
+
+      for (uint8_t i = 0; i < count; i++) {
+        if ((int32_t)(frames[i].time - t) > 0) break;
+        if (!havePlayed || (int32_t)(frames[i].time - played) > 0) events |= frames[i].flags & AUDIOSYNC_EVENTS;
+      }
+      played = t;
+      havePlayed = true;
+
+      // keep one frame at or before t for interpolation
+      uint8_t drop = 0;
+      while (drop + 1 < count && (int32_t)(frames[drop + 1].time - t) <= 0) drop++;
+      if (drop) {
+        memmove(frames, frames + drop, (count - drop) * sizeof(audio_sync_frame_t));
+        count -= drop;
+      }
+
+      const audio_sync_frame_t& a = frames[0];
+      if (count == 1 || (int32_t)(t - a.time) <= 0) {
+        if ((int32_t)(t - a.time) > 0 && !starved) stats.underruns++;
+        starved = (int32_t)(t - a.time) > 0;
+        out = a;
+        return true;
+      }
+      starved = false;
+      const audio_sync_frame_t& b = frames[1];
+      float f = (float)(t - a.time) / (float)(b.time - a.time);
+      out = a;
+      out.sampleRaw  = lerp(a.sampleRaw,  b.sampleRaw,  f);
+      out.sampleSmth = lerp(a.sampleSmth, b.sampleSmth, f);
+      out.magnitude  = lerp(a.magnitude,  b.magnitude,  f);
+      out.majorPeak  = lerp(a.majorPeak,  b.majorPeak,  f);
+      for (uint8_t i = 0; i < sizeof(out.fftResult); i++) out.fftResult[i] = lerp(a.fftResult[i], b.fftResult[i], f) + 0.5f;
+      for (uint8_t i = 0; i < sizeof(out.envelope); i++)  out.envelope[i]  = lerp(a.envelope[i],  b.envelope[i],  f) + 0.5f;
+      return true;
+    }
+
+    uint8_t size() const { return count; }
+    const audio_sync_stats_t& getStats() const { return stats; }
+
+  private:
+    audio_sync_frame_t frames[SIZE];  // sorted by time
+    uint8_t  count = 0;
+    uint16_t lastSeq = 0;
+    bool     haveSeq = false;
+    uint32_t played = 0;               // last playback time, events up to here were delivered
+    bool     havePlayed = false;
+    bool     starved = false;
+    uint8_t  pendingEvents = 0;
+    int32_t  lastTransit = 0;
+    bool     haveTransit = false;
+    audio_sync_stats_t stats = {};
+
+    static inline float lerp(float a, float b, float f) { return a + (b - a) * f; }
+};
@@ -6029,6 +6029,7 @@ uint16_t mode_ripplepeak(void) {                // * Ripple peak. By Andrew Tuli
   #endif
   uint8_t *maxVol       =  (uint8_t*)um_data->u_data[6];
   uint8_t *binNum       =  (uint8_t*)um_data->u_data[7];
+  uint8_t beat          = (um_data->u_size > 8) ? *(uint8_t*)um_data->u_data[8] : samplePeak;
 
   // printUmData();
 
@@ -6044,6 +6045,11 @@ uint16_t mode_ripplepeak(void) {                // * Ripple peak. By Andrew Tuli
   SEGMENT.fade_out(240);                                  // Lower frame rate means less effective fading than FastLED
   SEGMENT.fade_out(240);
 
+  if (SEGMENT.check1) {                                   // beat sync: start ripples on the beat (rising edge only, the flag is held for a frame)
+    samplePeak = beat && !SEGENV.aux1;
+    SEGENV.aux1 = beat;
+  }
+
   for (int i = 0; i < SEGMENT.intensity/16; i++) {   // Limit the number of ripples.
     if (samplePeak) ripples[i].state = 255;
 
@@ -6082,7 +6088,7 @@ uint16_t mode_ripplepeak(void) {                // * Ripple peak. By Andrew Tuli
 
   return FRAMETIME;
 } // mode_ripplepeak()
-static const char _data_FX_MODE_RIPPLEPEAK[] PROGMEM = "Ripple Peak@Fade rate,Max # of ripples,Select bin,Volume (min);!,!;!;1v;c2=0,m12=0,si=0"; // Pixel, Beatsin
+static const char _data_FX_MODE_RIPPLEPEAK[] PROGMEM = "Ripple Peak@Fade rate,Max # of ripples,Select bin,Volume (min),,Beat sync;!,!;!;1v;c2=0,m12=0,si=0"; // Pixel, Beatsin
 
 
 #ifndef WLED_DISABLE_2D
@@ -6206,6 +6212,7 @@ uint16_t mode_gravcenter(void) {                // Gravcenter. By Andrew Tuline.
     um_data = simulateSound(SEGMENT.soundSim);
   }
   float   volumeSmth  = *(float*)  um_data->u_data[0];
+  uint8_t beat        = (um_data->u_size > 8) ? *(uint8_t*)um_data->u_data[8] : 0;
 
   //SEGMENT.fade_out(240);
   SEGMENT.fade_out(251);  // 30%
@@ -6217,6 +6224,11 @@ uint16_t mode_gravcenter(void) {                // Gravcenter. By Andrew Tuline.
   uint16_t tempsamp = constrain(mySampleAvg, 0, SEGLEN/2);     // Keep the sample from overflowing.
   uint8_t gravity = 8 - SEGMENT.speed/32;
 
+  if (SEGMENT.check1) {                         // beat sync: the peak dot is thrown to the ends on each beat and falls back
+    if (beat && !SEGENV.aux1 && tempsamp > 0) gravcen->topLED = SEGLEN/2 - 1;
+    SEGENV.aux1 = beat;
+  }
+
   for (int i=0; i<tempsamp; i++) {
     uint8_t index = inoise8(i*segmentSampleAvg+millis(), 5000+i*segmentSampleAvg);
     SEGMENT.setPixelColor(i+SEGLEN/2, color_blend(SEGCOLOR(1), SEGMENT.color_from_palette(index, false, PALETTE_SOLID_WRAP, 0), segmentSampleAvg*8));
@@ -6236,7 +6248,7 @@ uint16_t mode_gravcenter(void) {                // Gravcenter. By Andrew Tuline.
 
   return FRAMETIME;
 } // mode_gravcenter()
-static const char _data_FX_MODE_GRAVCENTER[] PROGMEM = "Gravcenter@Rate of fall,Sensitivity;!,!;!;1v;ix=128,m12=2,si=0"; // Circle, Beatsin
+static const char _data_FX_MODE_GRAVCENTER[] PROGMEM = "Gravcenter@Rate of fall,Sensitivity,,,,Beat sync;!,!;!;1v;ix=128,m12=2,si=0"; // Circle, Beatsin
 
 
 ///////////////////////
@@ -7134,6 +7146,7 @@ uint16_t mode_2DGEQ(void) { // By Will Tatam. Code reduction by Ewoud Wijma.
     um_data = simulateSound(SEGMENT.soundSim);
   }
   uint8_t *fftResult = (uint8_t*)um_data->u_data[2];
+  uint8_t beat       = (um_data->u_size > 8) ? *(uint8_t*)um_data->u_data[8] : 0;
 
   if (SEGENV.call == 0) for (int i=0; i<cols; i++) previousBarHeight[i] = 0;
 
@@ -7143,6 +7156,12 @@ uint16_t mode_2DGEQ(void) { // By Will Tatam. Code reduction by Ewoud Wijma.
     rippleTime = true;
   }
 
+  bool beatDrop = false;  // beat sync: peaks drop back to their bars on each beat
+  if (SEGMENT.check2) {
+    beatDrop = beat && !SEGENV.aux1;
+    SEGENV.aux1 = beat;
+  }
+
   if (SEGENV.call == 0) SEGMENT.fill(BLACK);
   int fadeoutDelay = (256 - SEGMENT.speed) / 64;
   if ((fadeoutDelay <= 1 ) || ((SEGENV.call % fadeoutDelay) == 0)) SEGMENT.fadeToBlackBy(SEGMENT.speed);
@@ -7153,7 +7172,7 @@ uint16_t mode_2DGEQ(void) { // By Will Tatam. Code reduction by Ewoud Wijma.
     band = constrain(band, 0, 15);
     uint16_t colorIndex = band * 17;
     uint16_t barHeight  = map(fftResult[band], 0, 255, 0, rows); // do not subtract -1 from rows here
-    if (barHeight > previousBarHeight[x]) previousBarHeight[x] = barHeight; //drive the peak up
+    if (barHeight > previousBarHeight[x] || beatDrop) previousBarHeight[x] = barHeight; //drive the peak up
 
     uint32_t ledColor = BLACK;
     for (int y=0; y < barHeight; y++) {
@@ -7171,7 +7190,7 @@ uint16_t mode_2DGEQ(void) { // By Will Tatam. Code reduction by Ewoud Wijma.
 
   return FRAMETIME;
 } // mode_2DGEQ()
-static const char _data_FX_MODE_2DGEQ[] PROGMEM = "GEQ@Fade speed,Ripple decay,# of bands,,,Color bars;!,,Peaks;!;2f;c1=255,c2=64,pal=11,si=0"; // Beatsin
+static const char _data_FX_MODE_2DGEQ[] PROGMEM = "GEQ@Fade speed,Ripple decay,# of bands,,,Color bars,Beat sync;!,,Peaks;!;2f;c1=255,c2=64,pal=11,si=0"; // Beatsin
 
 
 /////////////////////////
@@ -31,6 +31,11 @@
 
 #include "const.h"
 
+#ifdef WLED_ENABLE_PIPELINE
+  #define FRAME_HANDOFF_WAIT() delay(1)
+  #include "frame_handoff.h"
+#endif
+
 #define FASTLED_INTERNAL //remove annoying pragma messages
 #define USE_GET_MILLISECOND_TIMER
 #include "FastLED.h"
@@ -84,6 +89,7 @@
 #define FAIR_DATA_PER_SEG (MAX_SEGMENT_DATA / strip.getMaxSegments())
 
 #define MIN_SHOW_DELAY   (_frametime < 16 ? 8 : 15)
+#define FX_RENDER_WAIT   100 /* ms after which a slow render task is reported (parallel rendering) */
 
 #define NUM_COLORS       3 /* number of colors per segment */
 #define SEGMENT          strip._segments[strip.getCurrSegmentId()]
@@ -91,8 +97,8 @@
 //#define SEGCOLOR(x)      strip._segments[strip.getCurrSegmentId()].currentColor(x, strip._segments[strip.getCurrSegmentId()].colors[x])
 //#define SEGLEN           strip._segments[strip.getCurrSegmentId()].virtualLength()
 #define SEGCOLOR(x)      strip.segColor(x) /* saves us a few kbytes of code */
-#define SEGPALETTE       strip._currentPalette
-#define SEGLEN           strip._virtualSegmentLength /* saves us a few kbytes of code */
+#define SEGPALETTE       strip.ctx().palette
+#define SEGLEN           strip.ctx().length /* saves us a few kbytes of code */
 #define SPEED_FORMULA_L  (5U + (50U*(255U - SEGMENT.speed))/SEGLEN)
 
 // some common colors
@@ -394,6 +400,10 @@ typedef struct Segment {
     uint16_t _dataLen;
     static uint16_t _usedSegmentData;
 
+    // random palette (palette 1), shared by all segments
+    static CRGBPalette16 _randomPalette, _prevRandomPalette;
+    static unsigned long _lastPaletteChange;
+
     // transition data, valid only if transitional==true, holds values during transition
     struct Transition {
       uint32_t      _colorT[NUM_COLORS];
@@ -511,7 +521,20 @@ typedef struct Segment {
     inline uint8_t  getLightCapabilities(void) const { return _capabilities; }
 
     static uint16_t getUsedSegmentData(void)    { return _usedSegmentData; }
+#ifdef WLED_ENABLE_PARALLEL_FX
+    static void     addUsedSegmentData(int len) { __atomic_add_fetch(&_usedSegmentData, len, __ATOMIC_RELAXED); } // effects may allocate on both cores
+    static bool     reserveSegmentData(size_t len) { // checks the limit and adds in one step
+      uint16_t used = __atomic_load_n(&_usedSegmentData, __ATOMIC_RELAXED);
+      do {
+        if (used + len > MAX_SEGMENT_DATA) return false;
+      } while (!__atomic_compare_exchange_n(&_usedSegmentData, &used, (uint16_t)(used + len), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+      return true;
+    }
+#else
     static void     addUsedSegmentData(int len) { _usedSegmentData += len; }
+    static bool     reserveSegmentData(size_t len) { if (_usedSegmentData + len > MAX_SEGMENT_DATA) return false; _usedSegmentData += len; return true; }
+#endif
+    static void     handleRandomPalette(void);
 
     void    set(uint16_t i1, uint16_t i2, uint8_t grp=1, uint8_t spc=0, uint16_t ofs=UINT16_MAX, uint16_t i1Y=0, uint16_t i2Y=1);
     bool    setColor(uint8_t slot, uint32_t c); //returns true if changed
@@ -640,6 +663,16 @@ typedef struct Segment {
 } segment;
 //static int segSize = sizeof(Segment);
 
+// state of the effect function that is running, used through SEGMENT, SEGLEN, SEGCOLOR() and SEGPALETTE
+typedef struct RenderContext {
+  CRGBPalette16 palette;            // palette used for current effect (includes transition)
+  uint32_t      colors[NUM_COLORS]; // color used for effect (includes transition)
+  uint16_t      length;             // virtual segment length
+  uint16_t      delay;              // returned by the effect function
+  uint8_t       segment;            // segment index
+  uint8_t       mode;               // effect (includes transition)
+} render_ctx_t;
+
 // main "strip" class
 class WS2812FX {  // 96 bytes
   typedef uint16_t (*mode_ptr)(void); // pointer to mode function
@@ -669,9 +702,7 @@ class WS2812FX {  // 96 bytes
       panels(1),
 #endif
       // semi-private (just obscured) used in effect functions through macros
-      _currentPalette(CRGBPalette16(CRGB::Black)),
-      _colors_t{0,0,0},
-      _virtualSegmentLength(0),
+      _ctx{CRGBPalette16(CRGB::Black), {0,0,0}, 0, 0, 0, 0},
       // true private variables
       _length(DEFAULT_LED_COUNT),
       _brightness(DEFAULT_BRIGHTNESS),
@@ -688,7 +719,6 @@ class WS2812FX {  // 96 bytes
       customMappingTable(nullptr),
       customMappingSize(0),
       _lastShow(0),
-      _segment_index(0),
       _mainSegment(0)
     {
       WS2812FX::instance = this;
@@ -745,6 +775,18 @@ class WS2812FX {  // 96 bytes
     inline void setPixelColor(int n, CRGB c) { setPixelColor(n, c.red, c.green, c.blue); }
     inline void trigger(void) { _triggered = true; } // Forces the next frame to be computed on all active segments.
     inline void setShowCallback(show_callback cb) { _callback = cb; }
+#ifdef WLED_ENABLE_PIPELINE
+    // bus changes from the loop must be done between these, the output task sends frames in parallel
+    inline void suspendOutput(void) { _handoff.pause(); }
+    inline void resumeOutput(void)  { _handoff.resume(); }
+    inline uint32_t getDroppedFrames(void) { return _handoff.dropped; }
+    inline bool isPipelined(void) { return _outputTask && _pixels; }
+#else
+    inline void suspendOutput(void) {}
+    inline void resumeOutput(void)  {}
+    inline uint32_t getDroppedFrames(void) { return 0; }
+    inline bool isPipelined(void) { return false; }
+#endif
     inline void setTransition(uint16_t t) { _transitionDur = t; }
     inline void appendSegment(const Segment &seg = Segment()) { _segments.push_back(seg); }
 
@@ -774,7 +816,7 @@ class WS2812FX {  // 96 bytes
     inline uint8_t getBrightness(void) { return _brightness; }
     inline uint8_t getMaxSegments(void) { return MAX_NUM_SEGMENTS; }  // returns maximum number of supported segments (fixed value)
     inline uint8_t getSegmentsNum(void) { return _segments.size(); }  // returns currently present segments
-    inline uint8_t getCurrSegmentId(void) { return _segment_index; }
+    inline uint8_t getCurrSegmentId(void) { return ctx().segment; }
     inline uint8_t getMainSegmentId(void) { return _mainSegment; }
     inline uint8_t getPaletteCount() { return 13 + GRADIENT_PALETTE_COUNT; }  // will only return built-in palette count
     inline uint8_t getTargetFps() { return _targetFps; }
@@ -798,7 +840,7 @@ class WS2812FX {  // 96 bytes
       getPixelColor(uint16_t);
 
     inline uint32_t getLastShow(void) { return _lastShow; }
-    inline uint32_t segColor(uint8_t i) { return _colors_t[i]; }
+    inline uint32_t segColor(uint8_t i) { return ctx().colors[i]; }
 
     const char *
       getModeData(uint8_t id = 0) { return (id && id<_modeCount) ? _modeData[id] : PSTR("Solid"); }
@@ -859,13 +901,16 @@ class WS2812FX {  // 96 bytes
   // end 2D support
 
     void loadCustomPalettes(void); // loads custom palettes from JSON
-    CRGBPalette16 _currentPalette; // palette used for current effect (includes transition)
     std::vector<CRGBPalette16> customPalettes; // TODO: move custom palettes out of WS2812FX class
 
     // using public variables to reduce code size increase due to inline function getSegment() (with bounds checking)
     // and color transitions
-    uint32_t _colors_t[3]; // color used for effect (includes transition)
-    uint16_t _virtualSegmentLength;
+    render_ctx_t _ctx;
+#ifdef WLED_ENABLE_PARALLEL_FX
+    inline render_ctx_t& ctx(void) { return *_rc[xPortGetCoreID()]; } // each core renders its own segment
+#else
+    inline render_ctx_t& ctx(void) { return _ctx; }
+#endif
 
     std::vector<segment> _segments;
     friend class Segment;
@@ -898,11 +943,43 @@ class WS2812FX {  // 96 bytes
 
     uint32_t _lastShow;
 
-    uint8_t _segment_index;
     uint8_t _mainSegment;
 
     void
-      estimateCurrentAndLimitBri(void);
+      setSegmentCCT(int16_t cct, bool allowWBCorrection = false),
+      outputFrame(uint8_t bri),
+      estimateCurrentAndLimitBri(uint8_t bri);
+
+#ifdef WLED_ENABLE_PIPELINE
+    // pipelined output: effects render into _pixels, show() hands the frame over to the output task (other core)
+    uint32_t *_pixels = nullptr;      // render buffer, physical pixel order
+    int16_t  *_pixelCCT = nullptr;    // segment CCT of each pixel, only if there is a CCT bus
+    uint32_t *_outPixels = nullptr;   // handoff slot
+    int16_t  *_outCCT = nullptr;
+    uint16_t  _bufferLength = 0;
+    uint8_t   _outBrightness = 0;
+    int16_t   _renderCCT = -1;        // Bus::_cct belongs to the output task
+    FrameHandoff _handoff;
+    TaskHandle_t _outputTask = nullptr;
+
+    void allocatePipeline(void);
+    static void outputTaskCode(void *);
+#endif
+
+#ifdef WLED_ENABLE_PARALLEL_FX
+    // parallel rendering: service() queues due segments, renderQueued() splits them between this core and the render task
+    render_ctx_t *_rc[2] = {&_ctx, &_ctx}; // context in use on each core, _ctx outside of renderQueued()
+    render_ctx_t *_queue = nullptr;        // one per segment
+    uint32_t      _renderMask = 0;         // queue entries for the render task
+    volatile bool _renderDone = true;      // render task has finished its entries
+    uint8_t       _queued = 0;
+    TaskHandle_t  _renderTask = nullptr;
+    TaskHandle_t  _serviceTask = nullptr;
+
+    void renderQueued(uint32_t nowUp);
+    void renderContexts(bool worker);
+    static void renderTaskCode(void *);
+#endif
 };
 
 extern const char JSON_mode_names[];
@@ -69,6 +69,10 @@
   #error "Max segments must be at least max number of busses!"
 #endif
 
+#if defined(WLED_ENABLE_PARALLEL_FX) && MAX_NUM_SEGMENTS > 32
+  #error "Parallel rendering supports at most 32 segments!"
+#endif
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // Segment class implementation
@@ -77,6 +81,9 @@ uint16_t Segment::_usedSegmentData = 0U; // amount of RAM all segments use for t
 CRGB    *Segment::_globalLeds = nullptr;
 uint16_t Segment::maxWidth = DEFAULT_LED_COUNT;
 uint16_t Segment::maxHeight = 1;
+CRGBPalette16 Segment::_randomPalette = CRGBPalette16(DEFAULT_COLOR);
+CRGBPalette16 Segment::_prevRandomPalette = CRGBPalette16(CRGB(BLACK));
+unsigned long Segment::_lastPaletteChange = 0; // perhaps it should be per segment
 
 // copy constructor
 Segment::Segment(const Segment &orig) {
@@ -151,7 +158,7 @@ Segment& Segment::operator= (Segment &&orig) noexcept {
 bool Segment::allocateData(size_t len) {
   if (data && _dataLen == len) return true; //already allocated
   deallocateData();
-  if (Segment::getUsedSegmentData() + len > MAX_SEGMENT_DATA) return false; //not enough memory
+  if (!Segment::reserveSegmentData(len)) return false; //not enough memory
   // if possible use SPI RAM on ESP32
   #if defined(ARDUINO_ARCH_ESP32) && defined(WLED_USE_PSRAM)
   if (psramFound())
@@ -159,8 +166,10 @@ bool Segment::allocateData(size_t len) {
   else
   #endif
     data = (byte*) malloc(len);
-  if (!data) return false; //allocation failed
-  Segment::addUsedSegmentData(len);
+  if (!data) { //allocation failed
+    Segment::addUsedSegmentData(-(int)len);
+    return false;
+  }
   _dataLen = len;
   memset(data, 0, len);
   return true;
@@ -209,10 +218,20 @@ void Segment::setUpLeds() {
   }
 }
 
+// periodically replace the random palette, called before effects run so they only read it
+void Segment::handleRandomPalette() {
+  if (millis() - _lastPaletteChange > randomPaletteChangeTime * 1000U) {
+    _prevRandomPalette = _randomPalette;
+    _randomPalette = CRGBPalette16(
+                    CHSV(random8(), random8(160, 255), random8(128, 255)),
+                    CHSV(random8(), random8(160, 255), random8(128, 255)),
+                    CHSV(random8(), random8(160, 255), random8(128, 255)),
+                    CHSV(random8(), random8(160, 255), random8(128, 255)));
+    _lastPaletteChange = millis();
+  }
+}
+
 CRGBPalette16 &Segment::loadPalette(CRGBPalette16 &targetPalette, uint8_t pal) {
-  static unsigned long _lastPaletteChange = 0; // perhaps it should be per segment
-  static CRGBPalette16 randomPalette = CRGBPalette16(DEFAULT_COLOR);
-  static CRGBPalette16 prevRandomPalette = CRGBPalette16(CRGB(BLACK));
   byte tcp[72];
   if (pal < 245 && pal > GRADIENT_PALETTE_COUNT+13) pal = 0;
   if (pal > 245 && (strip.customPalettes.size() == 0 || 255U-pal > strip.customPalettes.size()-1)) pal = 0;
@@ -233,27 +252,17 @@ CRGBPalette16 &Segment::loadPalette(CRGBPalette16 &targetPalette, uint8_t pal) {
   switch (pal) {
     case 0: //default palette. Exceptions for specific effects above
       targetPalette = PartyColors_p; break;
-    case 1: {//periodically replace palette with a random one. Transition palette change in 500ms
+    case 1: {//periodically replaced with a random one (handleRandomPalette()). Transition palette change in 250ms
       uint32_t timeSinceLastChange = millis() - _lastPaletteChange;
-      if (timeSinceLastChange > randomPaletteChangeTime * 1000U) {
-        prevRandomPalette = randomPalette;
-        randomPalette = CRGBPalette16(
-                        CHSV(random8(), random8(160, 255), random8(128, 255)),
-                        CHSV(random8(), random8(160, 255), random8(128, 255)),
-                        CHSV(random8(), random8(160, 255), random8(128, 255)),
-                        CHSV(random8(), random8(160, 255), random8(128, 255)));
-        _lastPaletteChange = millis();
-        timeSinceLastChange = 0;
-      }
       if (timeSinceLastChange <= 250) {
-        targetPalette = prevRandomPalette;
+        targetPalette = _prevRandomPalette;
         // there needs to be 255 palette blends (48) for full blend but that is too resource intensive
         // so 128 is a compromise (we need to perform full blend of the two palettes as each segment can have random
         // palette selected but only 2 static palettes are used)
         size_t noOfBlends = ((128U * timeSinceLastChange) / 250U);
-        for (size_t i=0; i<noOfBlends; i++) nblendPaletteTowardPalette(targetPalette, randomPalette, 48);
+        for (size_t i=0; i<noOfBlends; i++) nblendPaletteTowardPalette(targetPalette, _randomPalette, 48);
       } else {
-        targetPalette = randomPalette;
+        targetPalette = _randomPalette;
       }
       break;}
     case 2: {//primary color only
@@ -967,7 +976,7 @@ uint8_t Segment::get_random_wheel_index(uint8_t pos) {
 
 /*
  * Gets a single color from the currently selected palette.
- * @param i Palette Index (if mapping is true, the full palette will be _virtualSegmentLength long, if false, 255). Will wrap around automatically.
+ * @param i Palette Index (if mapping is true, the full palette will be SEGLEN long, if false, 255). Will wrap around automatically.
  * @param mapping if true, LED position in segment is considered for color
  * @param wrap FastLED palettes will usually wrap back to the start smoothly. Set false to get a hard edge
  * @param mcol If the default palette 0 is selected, return the standard color 0, 1 or 2 instead. If >2, Party palette is used instead
@@ -1078,6 +1087,15 @@ void WS2812FX::finalizeInit(void)
     memset(Segment::_globalLeds, 0, arrSize);
   }
 
+#ifdef WLED_ENABLE_PIPELINE
+  allocatePipeline();
+#endif
+#ifdef WLED_ENABLE_PARALLEL_FX
+  if (!_queue) _queue = (render_ctx_t*) malloc(sizeof(render_ctx_t) * getMaxSegments());
+  // same stack size as the loop task, effects do not know which task runs them
+  if (_queue && !_renderTask) xTaskCreatePinnedToCore(renderTaskCode, "FXrender", 8192, nullptr, 1, &_renderTask, ARDUINO_RUNNING_CORE ? 0 : 1);
+#endif
+
   //segments are created in makeAutoSegments();
   DEBUG_PRINTLN(F("Loading custom palettes"));
   loadCustomPalettes(); // (re)load all custom palettes
@@ -1085,6 +1103,19 @@ void WS2812FX::finalizeInit(void)
   deserializeMap();     // (re)load default ledmap
 }
 
+#ifdef WLED_ENABLE_PARALLEL_FX
+// 1CH_X3 buses drive 3 LEDs with one IC, setting a pixel reads and writes the IC which may be shared with a segment on the other core
+static bool hasSharedICBus() {
+  for (size_t b = 0; b < busses.getNumBusses(); b++) {
+    Bus *bus = busses.getBus(b);
+    if (bus == nullptr || bus->getLength()==0) break;
+    if (bus->getType() == TYPE_WS2812_1CH_X3) return true;
+  }
+  return false;
+}
+
+#endif
+
 void WS2812FX::service() {
   uint32_t nowUp = millis(); // Be aware, millis() rolls over every 49 days
   now = nowUp + timebase;
@@ -1092,7 +1123,13 @@ void WS2812FX::service() {
   bool doShow = false;
 
   _isServicing = true;
-  _segment_index = 0;
+  Segment::handleRandomPalette();
+#ifdef WLED_ENABLE_PARALLEL_FX
+  // segment CCT is global in the busses (Bus::_cct), segments that use it must be rendered one after another
+  bool parallel = _renderTask && _queue && !correctWB && !hasCCTBus() && !hasSharedICBus();
+  _queued = 0;
+#endif
+  _ctx.segment = 0;
   for (segment &seg : _segments) {
     // reset the segment runtime data if needed
     seg.resetIfRequired();
@@ -1107,19 +1144,34 @@ void WS2812FX::service() {
       uint16_t delay = FRAMETIME;
 
       if (!seg.freeze) { //only run effect function if not frozen
-        _virtualSegmentLength = seg.virtualLength();
-        _colors_t[0] = seg.currentColor(0, seg.colors[0]);
-        _colors_t[1] = seg.currentColor(1, seg.colors[1]);
-        _colors_t[2] = seg.currentColor(2, seg.colors[2]);
-        seg.currentPalette(_currentPalette, seg.palette);
-
-        if (!cctFromRgb || correctWB) busses.setSegmentCCT(seg.currentBri(seg.cct, true), correctWB);
-        for (uint8_t c = 0; c < NUM_COLORS; c++) _colors_t[c] = gamma32(_colors_t[c]);
-
+        render_ctx_t *rctx = &_ctx;
+#ifdef WLED_ENABLE_PARALLEL_FX
+        if (parallel) {
+          rctx = &_queue[_queued];
+          rctx->segment = &seg - &_segments[0];
+        }
+#endif
+        rctx->length = seg.virtualLength();
+        rctx->colors[0] = seg.currentColor(0, seg.colors[0]);
+        rctx->colors[1] = seg.currentColor(1, seg.colors[1]);
+        rctx->colors[2] = seg.currentColor(2, seg.colors[2]);
+        seg.currentPalette(rctx->palette, seg.palette);
+        rctx->mode = seg.currentMode(seg.mode);
+
+        if (!cctFromRgb || correctWB) setSegmentCCT(seg.currentBri(seg.cct, true), correctWB);
+        for (uint8_t c = 0; c < NUM_COLORS; c++) rctx->colors[c] = gamma32(rctx->colors[c]);
+
+#ifdef WLED_ENABLE_PARALLEL_FX
+        if (parallel) { // effect runs in renderQueued(), which also sets next_time
+          _queued++;
+          _ctx.segment++;
+          continue;
+        }
+#endif
         // effect blending (execute previous effect)
         // actual code may be a bit more involved as effects have runtime data including allocated memory
         //if (seg.transitional && seg._modeP) (*_mode[seg._modeP])(progress());
-        delay = (*_mode[seg.currentMode(seg.mode)])();
+        delay = (*_mode[rctx->mode])();
         if (seg.mode != FX_MODE_HALLOWEEN_EYES) seg.call++;
         if (seg.transitional && delay > FRAMETIME) delay = FRAMETIME; // force faster updates during transition
 
@@ -1128,10 +1180,13 @@ void WS2812FX::service() {
 
       seg.next_time = nowUp + delay;
     }
-    _segment_index++;
+    _ctx.segment++;
   }
-  _virtualSegmentLength = 0;
-  busses.setSegmentCCT(-1);
+#ifdef WLED_ENABLE_PARALLEL_FX
+  if (_queued) renderQueued(nowUp);
+#endif
+  _ctx.length = 0;
+  setSegmentCCT(-1);
   if(doShow) {
     yield();
     show();
@@ -1144,6 +1199,14 @@ void IRAM_ATTR WS2812FX::setPixelColor(int i, uint32_t col)
 {
   if (i < customMappingSize) i = customMappingTable[i];
   if (i >= _length) return;
+#ifdef WLED_ENABLE_PIPELINE
+  if (_pixels) {
+    if (i >= _bufferLength) return;
+    _pixels[i] = col;
+    if (_pixelCCT) _pixelCCT[i] = _renderCCT;
+    return;
+  }
+#endif
   busses.setPixelColor(i, col);
 }
 
@@ -1151,9 +1214,23 @@ uint32_t WS2812FX::getPixelColor(uint16_t i)
 {
   if (i < customMappingSize) i = customMappingTable[i];
   if (i >= _length) return 0;
+#ifdef WLED_ENABLE_PIPELINE
+  if (_pixels) return i < _bufferLength ? _pixels[i] : 0;
+#endif
   return busses.getPixelColor(i);
 }
 
+void WS2812FX::setSegmentCCT(int16_t cct, bool allowWBCorrection)
+{
+#ifdef WLED_ENABLE_PIPELINE
+  if (_pixels) {
+    _renderCCT = BusManager::segmentCCT(cct, allowWBCorrection); // stored with each pixel, applied by the output task
+    return;
+  }
+#endif
+  busses.setSegmentCCT(cct, allowWBCorrection);
+}
+
 
 //DISCLAIMER
 //The following function attemps to calculate the current LED power usage,
@@ -1166,7 +1243,7 @@ uint32_t WS2812FX::getPixelColor(uint16_t i)
 #define MA_FOR_ESP        100 //how much mA does the ESP use (Wemos D1 about 80mA, ESP32 about 120mA)
                               //you can set it to 0 if the ESP is powered by USB and the LEDs by external
 
-void WS2812FX::estimateCurrentAndLimitBri() {
+void WS2812FX::estimateCurrentAndLimitBri(uint8_t bri) {
   //power limit calculation
   //each LED can draw up 195075 "power units" (approx. 53mA)
   //one PU is the power it takes to have 1 channel 1 step brighter per brightness step
@@ -1181,7 +1258,7 @@ void WS2812FX::estimateCurrentAndLimitBri() {
 
   if (ablMilliampsMax < 150 || actualMilliampsPerLed == 0) { //0 mA per LED and too low numbers turn off calculation
     currentMilliamps = 0;
-    busses.setBrightness(_brightness);
+    busses.setBrightness(bri);
     return;
   }
 
@@ -1220,19 +1297,19 @@ void WS2812FX::estimateCurrentAndLimitBri() {
   }
 
   uint32_t powerSum0 = powerSum;
-  powerSum *= _brightness;
+  powerSum *= bri;
 
   if (powerSum > powerBudget) //scale brightness down to stay in current limit
   {
     float scale = (float)powerBudget / (float)powerSum;
     uint16_t scaleI = scale * 255;
     uint8_t scaleB = (scaleI > 255) ? 255 : scaleI;
-    uint8_t newBri = scale8(_brightness, scaleB);
+    uint8_t newBri = scale8(bri, scaleB);
     busses.setBrightness(newBri); //to keep brightness uniform, sets virtual busses too
     currentMilliamps = (powerSum0 * newBri) / puPerMilliamp;
   } else {
     currentMilliamps = powerSum / puPerMilliamp;
-    busses.setBrightness(_brightness);
+    busses.setBrightness(bri);
   }
   currentMilliamps += MA_FOR_ESP; //add power of ESP back to estimate
   currentMilliamps += pLen; //add standby power back to estimate
@@ -1244,12 +1321,19 @@ void WS2812FX::show(void) {
   show_callback callback = _callback;
   if (callback) callback();
 
-  estimateCurrentAndLimitBri();
+#ifdef WLED_ENABLE_PIPELINE
+  if (isPipelined()) {
+    // hand the frame over to the output task and continue with the next one
+    _handoff.beginWrite();
+    memcpy(_outPixels, _pixels, _bufferLength * sizeof(uint32_t));
+    if (_pixelCCT) memcpy(_outCCT, _pixelCCT, _bufferLength * sizeof(int16_t));
+    _outBrightness = _brightness;
+    _handoff.commit();
+    xTaskNotifyGive(_outputTask);
+  } else
+#endif
+  outputFrame(_brightness);
 
-  // some buses send asynchronously and this method will return before
-  // all of the data has been sent.
-  // See https://github.com/Makuna/NeoPixelBus/wiki/ESP32-NeoMethods#neoesp32rmt-methods
-  busses.show();
   unsigned long now = millis();
   unsigned long diff = now - _lastShow;
   uint16_t fpsCurr = 200;
@@ -1258,11 +1342,167 @@ void WS2812FX::show(void) {
   _lastShow = now;
 }
 
+#ifdef WLED_ENABLE_PARALLEL_FX
+static bool segmentsOverlap(const Segment &a, const Segment &b) {
+  return a.start < b.stop && b.start < a.stop && a.startY < b.stopY && b.startY < a.stopY;
+}
+
+// simulateSound() uses static buffers, so sound reactive effects (flags v or f) stay on one core without audio data
+static bool isAudioEffect(const char *data) {
+  const char *p = data;
+  for (uint8_t i = 0; i < 3 && p; i++) if ((p = strchr(p, ';'))) p++; // flags are the 4th field
+  if (!p) return false;
+  for (; *p && *p != ';'; p++) if (*p == 'v' || *p == 'f') return true;
+  return false;
+}
+
+// effects that reseed random16() to replay the same sequence every frame, random16() calls on the other core would disturb it
+static bool isSeededEffect(uint8_t mode) {
+  return mode == FX_MODE_RANDOM_CHASE || mode == FX_MODE_TWINKLEUP;
+}
+
+// splits the queued segments between this core and the render task; overlapping segments stay on one core, in order
+void WS2812FX::renderQueued(uint32_t nowUp) {
+  um_data_t *um_data;
+  bool simulated = !usermods.getUMData(&um_data, USERMOD_ID_AUDIOREACTIVE);
+  uint32_t load[2] = {0, 0};
+  _renderMask = 0;
+  for (uint8_t k = 0; k < _queued; k++) {
+    const Segment &seg = _segments[_queue[k].segment];
+    if (isSeededEffect(_queue[k].mode)) { _renderMask = 0; break; } // no random16() calls on the other core meanwhile
+    bool local  = simulated && isAudioEffect(_modeData[_queue[k].mode]);
+    bool worker = false;
+    for (uint8_t j = 0; j < k; j++) {
+      if (!segmentsOverlap(seg, _segments[_queue[j].segment])) continue;
+      if (_renderMask & (1UL << j)) worker = true;
+      else                          local  = true;
+    }
+    if (local && worker) { _renderMask = 0; break; } // cannot be split, render all of them here
+    if (worker || (!local && load[1] < load[0])) _renderMask |= 1UL << k;
+    load[(_renderMask >> k) & 1] += seg.length();
+  }
+
+  if (_renderMask) {
+    _serviceTask = xTaskGetCurrentTaskHandle();
+    _renderDone = false;
+    xTaskNotifyGive(_renderTask);
+  }
+  renderContexts(false);
+  // the frame must be complete before it is shown and segments must not change while the render task uses them,
+  // so wait for as long as it takes (the timeout only reports a slow effect)
+  while (!_renderDone) {
+    if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FX_RENDER_WAIT)) && !_renderDone) DEBUG_PRINTLN(F("Render task is slow."));
+  }
+
+  for (uint8_t k = 0; k < _queued; k++) {
+    Segment &seg = _segments[_queue[k].segment];
+    uint16_t delay = _queue[k].delay;
+    if (seg.mode != FX_MODE_HALLOWEEN_EYES) seg.call++;
+    if (seg.transitional && delay > FRAMETIME) delay = FRAMETIME; // force faster updates during transition
+    seg.handleTransition();
+    seg.next_time = nowUp + delay;
+  }
+}
+
+// runs the queued effects assigned to this core (worker: the render task)
+void WS2812FX::renderContexts(bool worker) {
+  uint8_t core = xPortGetCoreID();
+  for (uint8_t k = 0; k < _queued; k++) {
+    if (bool(_renderMask & (1UL << k)) != worker) continue;
+    _rc[core] = &_queue[k];
+    _queue[k].delay = (*_mode[_queue[k].mode])();
+  }
+  _rc[core] = &_ctx;
+}
+
+void WS2812FX::renderTaskCode(void *)
+{
+  WS2812FX *s = instance;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    s->renderContexts(true);
+    s->_renderDone = true;
+    xTaskNotifyGive(s->_serviceTask);
+  }
+}
+#endif
+
+// power limiting and sending of the bus contents (pipelined: in the output task)
+void WS2812FX::outputFrame(uint8_t bri) {
+  estimateCurrentAndLimitBri(bri);
+
+  // some buses send asynchronously and this method will return before
+  // all of the data has been sent.
+  // See https://github.com/Makuna/NeoPixelBus/wiki/ESP32-NeoMethods#neoesp32rmt-methods
+  busses.show();
+}
+
+#ifdef WLED_ENABLE_PIPELINE
+// render and output buffers follow the LED count; the output is paused (or not started yet) when this is called
+void WS2812FX::allocatePipeline(void) {
+  free(_pixels);   _pixels = nullptr;
+  free(_outPixels); _outPixels = nullptr;
+  free(_pixelCCT); _pixelCCT = nullptr;
+  free(_outCCT);   _outCCT = nullptr;
+  _bufferLength = _length;
+
+  bool cct = hasCCTBus();
+  _pixels    = (uint32_t*) calloc(_bufferLength, sizeof(uint32_t));
+  _outPixels = (uint32_t*) calloc(_bufferLength, sizeof(uint32_t));
+  if (cct) {
+    _pixelCCT = (int16_t*) malloc(_bufferLength * sizeof(int16_t));
+    _outCCT   = (int16_t*) malloc(_bufferLength * sizeof(int16_t));
+  }
+  if (!_pixels || !_outPixels || (cct && (!_pixelCCT || !_outCCT))) {
+    DEBUG_PRINTLN(F("Not enough memory for pipelined output."));
+    free(_pixels);   _pixels = nullptr;   // render directly into the busses
+    free(_outPixels); _outPixels = nullptr;
+    free(_pixelCCT); _pixelCCT = nullptr;
+    free(_outCCT);   _outCCT = nullptr;
+    return;
+  }
+  if (cct) {
+    for (uint16_t i = 0; i < _bufferLength; i++) _pixelCCT[i] = -1;
+    memcpy(_outCCT, _pixelCCT, _bufferLength * sizeof(int16_t));
+  }
+
+  // output task on the core that is not running loop(), above the audio task (priority 1)
+  if (!_outputTask) xTaskCreatePinnedToCore(outputTaskCode, "LEDout", 3072, nullptr, 2, &_outputTask, ARDUINO_RUNNING_CORE ? 0 : 1);
+}
+
+// copies each frame handed over by show() into the bus buffers and sends it
+void WS2812FX::outputTaskCode(void *)
+{
+  WS2812FX *s = instance;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    if (!s->_handoff.enter()) continue;  // paused for a state change
+    if (s->_handoff.beginRead()) {
+      uint8_t bri = s->_outBrightness;
+      if (s->_outPixels) {
+        int16_t cct = INT16_MIN;
+        for (uint16_t i = 0; i < s->_bufferLength; i++) {
+          if (s->_outCCT && s->_outCCT[i] != cct) Bus::setCCT(cct = s->_outCCT[i]);
+          busses.setPixelColor(i, s->_outPixels[i]);
+        }
+      }
+      s->_handoff.endRead();
+      s->outputFrame(bri);
+    }
+    s->_handoff.leave();
+  }
+}
+#endif
+
 /**
  * Returns a true value if any of the strips are still being updated.
  * On some hardware (ESP32), strip updates are done asynchronously.
+ * Pipelined: the output task has not picked up the last frame yet.
  */
 bool WS2812FX::isUpdating() {
+#ifdef WLED_ENABLE_PIPELINE
+  if (isPipelined()) return _handoff.pending();
+#endif
   return !busses.canAllShow();
 }
 
@@ -1322,7 +1562,7 @@ void WS2812FX::setBrightness(uint8_t b, bool direct) {
   }
   if (direct) {
     // would be dangerous if applied immediately (could exceed ABL), but will not output until the next show()
-    busses.setBrightness(b);
+    if (!isPipelined()) busses.setBrightness(b); // pipelined: every frame carries its brightness
   } else {
     unsigned long t = millis();
     if (_segments[0].next_time > t + 22 && t - _lastShow > MIN_SHOW_DELAY) show(); //apply brightness change immediately if no refresh soon
@@ -1561,12 +1801,12 @@ bool WS2812FX::checkSegmentAlignment() {
 
 //After this function is called, setPixelColor() will use that segment (offsets, grouping, ... will apply)
 //Note: If called in an interrupt (e.g. JSON API), original segment must be restored,
-//otherwise it can lead to a crash on ESP32 because _segment_index is modified while in use by the main thread
+//otherwise it can lead to a crash on ESP32 because the segment index is modified while in use by the main thread
 uint8_t WS2812FX::setPixelSegment(uint8_t n) {
-  uint8_t prevSegId = _segment_index;
+  uint8_t prevSegId = ctx().segment;
   if (n < _segments.size()) {
-    _segment_index = n;
-    _virtualSegmentLength = _segments[_segment_index].virtualLength();
+    ctx().segment = n;
+    ctx().length = _segments[n].virtualLength();
   }
   return prevSegId;
 }
@@ -522,12 +522,16 @@ void BusManager::setBrightness(uint8_t b) {
 }
 
 void BusManager::setSegmentCCT(int16_t cct, bool allowWBCorrection) {
+  Bus::setCCT(segmentCCT(cct, allowWBCorrection));
+}
+
+int16_t BusManager::segmentCCT(int16_t cct, bool allowWBCorrection) {
   if (cct > 255) cct = 255;
   if (cct >= 0) {
     //if white balance correction allowed, save as kelvin value instead of 0-255
     if (allowWBCorrection) cct = 1900 + (cct << 5);
   } else cct = -1;
-  Bus::setCCT(cct);
+  return cct;
 }
 
 uint32_t BusManager::getPixelColor(uint16_t pix) {
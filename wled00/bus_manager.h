@@ -348,6 +348,7 @@ class BusManager {
     void setBrightness(uint8_t b);
 
     void setSegmentCCT(int16_t cct, bool allowWBCorrection = false);
+    static int16_t segmentCCT(int16_t cct, bool allowWBCorrection = false); // value setSegmentCCT() passes to Bus::setCCT()
 
     uint32_t getPixelColor(uint16_t pix);
 
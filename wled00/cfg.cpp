@@ -15,6 +15,7 @@ void getStringFromJson(char* dest, const char* src, size_t len) {
 
 bool deserializeConfig(JsonObject doc, bool fromFS) {
   bool needsSave = false;
+  invalidateSettingsJS();
   //int rev_major = doc["rev"][0]; // 1
   //int rev_minor = doc["rev"][1]; // 0
 
@@ -391,6 +392,7 @@ bool deserializeConfig(JsonObject doc, bool fromFS) {
   CJSON(syncGroups, if_sync_send["grp"]);
   if (if_sync_send[F("twice")]) udpNumRetries = 1; // import setting from 0.13 and earlier
   CJSON(udpNumRetries, if_sync_send["ret"]);
+  CJSON(udpSyncBinary, if_sync_send[F("bin")]);
 
   JsonObject if_nodes = interfaces["nodes"];
   CJSON(nodeListEnabled, if_nodes[F("list")]);
@@ -414,12 +416,29 @@ bool deserializeConfig(JsonObject doc, bool fromFS) {
   if (e131Priority > 200) e131Priority = 200;
   CJSON(DMXMode, if_live_dmx["mode"]);
 
+  JsonArray dmx_umap = if_live_dmx[F("umap")]; // [[universe, first LED], ...]
+  if (!dmx_umap.isNull()) {
+    e131UniverseMapSize = 0;
+    for (JsonArray entry : dmx_umap) {
+      if (e131UniverseMapSize >= E131_MAX_UNIVERSE_COUNT) break;
+      if (entry.size() < 2) continue;
+      e131UniverseMap[e131UniverseMapSize][0] = entry[0] | 1;
+      e131UniverseMap[e131UniverseMapSize][1] = entry[1] | 0;
+      e131UniverseMapSize++;
+    }
+  }
+  invalidateE131UniverseTable();
+
   tdd = if_live[F("timeout")] | -1;
   if (tdd >= 0) realtimeTimeoutMs = tdd * 100;
   CJSON(arlsForceMaxBri, if_live[F("maxbri")]);
   CJSON(arlsDisableGammaCorrection, if_live[F("no-gc")]); // false
   CJSON(arlsOffset, if_live[F("offset")]); // 0
 
+  JsonObject if_live_jb = if_live[F("jb")];
+  CJSON(realtimeBufferDepth, if_live_jb["d"]); // 0 = disabled
+  CJSON(realtimeBufferMaxLatency, if_live_jb[F("lat")]);
+
   CJSON(alexaEnabled, interfaces["va"][F("alexa")]); // false
 
   CJSON(macroAlexaOn, interfaces["va"]["macros"][0]);
@@ -522,6 +541,10 @@ bool deserializeConfig(JsonObject doc, bool fromFS) {
     }
     it++;
   }
+  cuesChanged = true;
+
+  JsonArray cues = tm[F("cue")];
+  if (!cues.isNull()) deserializeCues(cues);
 
   JsonObject ota = doc["ota"];
   const char* pwd = ota["psk"]; //normally not present due to security
@@ -607,6 +630,7 @@ void deserializeConfigFromFS() {
 
 void serializeConfig() {
   serializeConfigSec();
+  invalidateSettingsJS();
 
   DEBUG_PRINTLN(F("Writing settings to /cfg.json..."));
 
@@ -844,6 +868,7 @@ void serializeConfig() {
   if_sync_send["macro"] = notifyMacro;
   if_sync_send["grp"] = syncGroups;
   if_sync_send["ret"] = udpNumRetries;
+  if_sync_send[F("bin")] = udpSyncBinary;
 
   JsonObject if_nodes = interfaces.createNestedObject("nodes");
   if_nodes[F("list")] = nodeListEnabled;
@@ -862,12 +887,24 @@ void serializeConfig() {
   if_live_dmx[F("addr")] = DMXAddress;
   if_live_dmx[F("dss")] = DMXSegmentSpacing;
   if_live_dmx["mode"] = DMXMode;
+  if (e131UniverseMapSize) {
+    JsonArray dmx_umap = if_live_dmx.createNestedArray(F("umap"));
+    for (uint8_t i = 0; i < e131UniverseMapSize; i++) {
+      JsonArray entry = dmx_umap.createNestedArray();
+      entry.add(e131UniverseMap[i][0]);
+      entry.add(e131UniverseMap[i][1]);
+    }
+  }
 
   if_live[F("timeout")] = realtimeTimeoutMs / 100;
   if_live[F("maxbri")] = arlsForceMaxBri;
   if_live[F("no-gc")] = arlsDisableGammaCorrection;
   if_live[F("offset")] = arlsOffset;
 
+  JsonObject if_live_jb = if_live.createNestedObject(F("jb"));
+  if_live_jb["d"] = realtimeBufferDepth;
+  if_live_jb[F("lat")] = realtimeBufferMaxLatency;
+
   JsonObject if_va = interfaces.createNestedObject("va");
   if_va[F("alexa")] = alexaEnabled;
 
@@ -955,6 +992,8 @@ void serializeConfig() {
     }
   }
 
+  serializeCues(timers.createNestedArray(F("cue")));
+
   JsonObject ota = doc.createNestedObject("ota");
   ota[F("lock")] = otaLock;
   ota[F("lock-wifi")] = wifiLock;
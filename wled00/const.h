@@ -22,6 +22,17 @@
   #endif
 #endif
 
+// usermod hooks (Usermod::getHooks()) - usermods are only called for the hooks they declare
+#define UM_HOOK_LOOP        0x0001
+#define UM_HOOK_OVERLAY     0x0002  // handleOverlayDraw()
+#define UM_HOOK_BUTTON      0x0004
+#define UM_HOOK_UMDATA      0x0008  // getUMData()
+#define UM_HOOK_JSON_STATE  0x0010  // addToJsonState() and readFromJsonState()
+#define UM_HOOK_JSON_INFO   0x0020
+#define UM_HOOK_MQTT        0x0040  // onMqttConnect() and onMqttMessage()
+#define UM_HOOK_STATE       0x0080  // onStateChange()
+#define UM_HOOK_ALL         0xFFFF  // default
+
 #ifndef WLED_MAX_BUSSES
   #ifdef ESP8266
     #define WLED_MAX_BUSSES 3
@@ -311,6 +322,25 @@
 //Playlist option byte
 #define PL_OPTION_SHUFFLE      0x01
 
+//Playlist limits
+#ifndef WLED_MAX_PLAYLIST_ENTRIES
+  #ifdef ESP8266
+    #define WLED_MAX_PLAYLIST_ENTRIES 250  // including the entries of nested playlists
+  #else
+    #define WLED_MAX_PLAYLIST_ENTRIES 1000
+  #endif
+#endif
+#define PLAYLIST_MAX_DEPTH     3    // levels of playlists within playlists
+
+//Timer limits (in addition to the 10 timers of the time settings page)
+#ifndef WLED_MAX_CUES
+  #ifdef ESP8266
+    #define WLED_MAX_CUES 64
+  #else
+    #define WLED_MAX_CUES 256
+  #endif
+#endif
+
 // Segment capability byte
 #define SEG_CAPABILITY_RGB     0x01
 #define SEG_CAPABILITY_W       0x02
@@ -371,13 +401,12 @@
 #define SETTINGS_STACK_BUF_SIZE 3096
 #endif
 
-#ifdef WLED_USE_ETHERNET
-  #define E131_MAX_UNIVERSE_COUNT 20
-#else
+// universe state is allocated for the universes actually needed by the LED count (or universe map)
+#ifndef E131_MAX_UNIVERSE_COUNT
   #ifdef ESP8266
-    #define E131_MAX_UNIVERSE_COUNT 9
+    #define E131_MAX_UNIVERSE_COUNT 16
   #else
-    #define E131_MAX_UNIVERSE_COUNT 12
+    #define E131_MAX_UNIVERSE_COUNT 64
   #endif
 #endif
 
@@ -400,6 +429,11 @@
 #endif
 #endif
 
+// JSON buffer request priorities (requestJSONBuffer())
+#define JSON_PRIO_LOW     0  // settings pages, does not get the last free buffer
+#define JSON_PRIO_NORMAL  1  // JSON API responses
+#define JSON_PRIO_HIGH    2  // may wait briefly for a buffer
+
 #define TOUCH_THRESHOLD 32 // limit to recognize a touch, higher value means more sensitive
 
 // Size of buffer for API JSON object (increase for more segments)
@@ -409,6 +443,25 @@
   #define JSON_BUFFER_SIZE 24576
 #endif
 
+// Size of the document holding one piece (state header, segment or info) of a streamed JSON response
+#ifndef JSON_STREAM_PIECE_SIZE
+  #ifdef ESP8266
+    #define JSON_STREAM_PIECE_SIZE 4096
+  #else
+    #define JSON_STREAM_PIECE_SIZE 8192
+  #endif
+#endif
+#define JSON_STREAM_LOCK_WAIT 20 // ms a streamed piece waits for the JSON buffer lock before the stream pauses
+
+// JSON API paths
+#define JSON_PATH_STATE      1
+#define JSON_PATH_INFO       2
+#define JSON_PATH_STATE_INFO 3
+#define JSON_PATH_NODES      4
+#define JSON_PATH_PALETTES   5
+#define JSON_PATH_FXDATA     6
+#define JSON_PATH_NETWORKS   7
+
 //#define MIN_HEAP_SIZE (8k for AsyncWebServer)
 #define MIN_HEAP_SIZE 8192
 
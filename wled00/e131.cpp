@@ -8,19 +8,154 @@
  * E1.31 handler
  */
 
+/*
+ * Universe table
+ * Maps each received universe to its first LED in O(1) (open addressing hash table) and keeps per-universe
+ * sequence numbers. The number of universes is derived from the LED count and DMX mode, or taken from
+ * the sparse universe map (e131UniverseMap) if one is configured.
+ */
+typedef struct E131Universe {
+  uint16_t universe;
+  uint16_t ledOffset;  // first LED fed by this universe
+  uint8_t  lastSeq;    // to detect packet loss
+  bool     seqValid;   // lastSeq was received (sequence 0 is valid after a wrap)
+} e131_universe_t;
+
+static e131_universe_t* e131Slots = nullptr;
+static uint16_t* e131Lookup = nullptr; // hash table of slot index +1 (0 = empty)
+static uint16_t e131SlotCount  = 0;
+static uint16_t e131LookupMask = 0;
+static uint16_t e131LastSlot   = 0;    // slot feeding the highest LEDs, completes a frame
+static uint16_t e131TableLen   = 0;    // LED count the table was built for
+static volatile bool e131TableDirty = true; // DMX settings changed, see invalidateE131UniverseTable()
+
+static uint16_t getLedsInFirstUniverse(bool is4Chan)
+{
+  const uint16_t dmxChannelsPerLed = is4Chan ? 4 : 3;
+  const uint16_t dimmerOffset = (DMXMode == DMX_MODE_MULTIPLE_DRGB) ? 1 : 0;
+  const uint16_t dmxLenOffset = (DMXAddress == 0) ? 0 : 1; // For legacy DMX start address 0
+  return (((MAX_CHANNELS_PER_UNIVERSE - DMXAddress) + dmxLenOffset) - dimmerOffset) / dmxChannelsPerLed;
+}
+
+// number of universes needed for the configured LED count and DMX mode
+uint16_t getE131UniverseCount()
+{
+  switch (DMXMode) {
+    case DMX_MODE_DISABLED:
+      return 0;
+    case DMX_MODE_MULTIPLE_DRGB:
+    case DMX_MODE_MULTIPLE_RGB:
+    case DMX_MODE_MULTIPLE_RGBW:
+      {
+        if (e131UniverseMapSize) return e131UniverseMapSize;
+        bool is4Chan = (DMXMode == DMX_MODE_MULTIPLE_RGBW);
+        const uint16_t ledsInFirstUniverse = getLedsInFirstUniverse(is4Chan);
+        const uint16_t ledsPerUniverse = is4Chan ? MAX_4_CH_LEDS_PER_UNIVERSE : MAX_3_CH_LEDS_PER_UNIVERSE;
+        const uint16_t totalLen = strip.getLengthTotal();
+        if (totalLen <= ledsInFirstUniverse) return 1;
+        uint16_t count = 1 + (totalLen - ledsInFirstUniverse + ledsPerUniverse - 1) / ledsPerUniverse;
+        return MIN(count, E131_MAX_UNIVERSE_COUNT);
+      }
+    default:
+      return 1; // 1 universe is enough
+  }
+}
+
+static void buildE131UniverseTable(uint16_t len)
+{
+  if (e131Slots) free(e131Slots);
+  e131Slots = nullptr;
+  e131Lookup = nullptr;
+  e131SlotCount = e131LookupMask = e131LastSlot = 0;
+  e131TableLen = len;
+  e131TableDirty = false;
+
+  uint16_t count = getE131UniverseCount();
+  if (!count) return;
+  uint32_t lookupSize = 4;
+  while (lookupSize < 2U * count) lookupSize <<= 1; // keep load factor <= 0.5
+  e131Slots = (e131_universe_t*)calloc(1, count * sizeof(e131_universe_t) + lookupSize * sizeof(uint16_t));
+  if (!e131Slots) {
+    DEBUG_PRINTLN(F("E1.31 universe table allocation failed."));
+    return;
+  }
+  e131Lookup = (uint16_t*)(e131Slots + count);
+  e131LookupMask = lookupSize - 1;
+
+  bool multi = (DMXMode == DMX_MODE_MULTIPLE_DRGB || DMXMode == DMX_MODE_MULTIPLE_RGB || DMXMode == DMX_MODE_MULTIPLE_RGBW);
+  bool is4Chan = (DMXMode == DMX_MODE_MULTIPLE_RGBW);
+  const uint16_t ledsInFirstUniverse = getLedsInFirstUniverse(is4Chan);
+  const uint16_t ledsPerUniverse = is4Chan ? MAX_4_CH_LEDS_PER_UNIVERSE : MAX_3_CH_LEDS_PER_UNIVERSE;
+
+  for (uint16_t i = 0; i < count; i++) {
+    e131_universe_t& s = e131Slots[i];
+    if (multi && e131UniverseMapSize) {
+      s.universe  = e131UniverseMap[i][0];
+      s.ledOffset = e131UniverseMap[i][1];
+    } else {
+      s.universe  = e131Universe + i;
+      s.ledOffset = i ? ledsInFirstUniverse + (i - 1) * ledsPerUniverse : 0;
+    }
+    if (s.ledOffset >= e131Slots[e131LastSlot].ledOffset) e131LastSlot = i;
+    uint16_t h = s.universe & e131LookupMask;
+    while (e131Lookup[h]) {
+      if (e131Slots[e131Lookup[h]-1].universe == s.universe) break; // duplicate universe, first entry wins
+      h = (h + 1) & e131LookupMask;
+    }
+    if (!e131Lookup[h]) e131Lookup[h] = i + 1;
+  }
+  e131SlotCount = count;
+  DEBUG_PRINTF("E1.31 universe table: %u universes.\n", count);
+}
+
+// rebuilds the universe table if the LED count or DMX settings changed since it was built
+static void checkE131UniverseTable()
+{
+  uint16_t len = strip.getLengthTotal();
+  if (e131TableDirty || len != e131TableLen) buildE131UniverseTable(len);
+}
+
+// any task: DMX mode, universe, address or universe map changed
+void invalidateE131UniverseTable()
+{
+  e131TableDirty = true;
+}
+
+// returns slot index of a universe or -1 if it is not handled
+static int findE131Universe(uint16_t uni)
+{
+  if (!e131Lookup) return -1;
+  uint16_t h = uni & e131LookupMask;
+  while (e131Lookup[h]) {
+    uint16_t slot = e131Lookup[h] - 1;
+    if (e131Slots[slot].universe == uni) return slot;
+    h = (h + 1) & e131LookupMask;
+  }
+  return -1;
+}
+
 //DDP protocol support, called by handleE131Packet
 //handles RGB data only
 void handleDDPPacket(e131_packet_t* p) {
-  int lastPushSeq = e131LastSequenceNumber[0];
+  static uint8_t lastSeq = 0; // sequence number of previous packet (for statistics), DDP uses 1-15, 0 = not numbered
+  static uint8_t lastPushSeq = 0;
+
+  realtimeStatsPacket(REALTIME_MODE_DDP, htons(p->dataLen));
+  uint8_t seq = p->sequenceNum & 0xF;
+  if (seq && lastSeq) {
+    uint8_t diff = (seq + 15 - lastSeq) % 15; // sequence numbers 1-15 wrap around
+    if (diff > 1 && diff < 8) realtimeStatsGap(REALTIME_MODE_DDP, diff - 1);
+  }
+  if (seq) lastSeq = seq;
 
   //reject late packets belonging to previous frame (assuming 4 packets max. before push)
   if (e131SkipOutOfSequence && lastPushSeq) {
     int sn = p->sequenceNum & 0xF;
     if (sn) {
       if (lastPushSeq > 5) {
-        if (sn > (lastPushSeq -5) && sn < lastPushSeq) return;
+        if (sn > (lastPushSeq -5) && sn < lastPushSeq) { realtimeStatsDropped(REALTIME_MODE_DDP); return; }
       } else {
-        if (sn > (10 + lastPushSeq) || sn < lastPushSeq) return;
+        if (sn > (10 + lastPushSeq) || sn < lastPushSeq) { realtimeStatsDropped(REALTIME_MODE_DDP); return; }
       }
     }
   }
@@ -35,6 +170,7 @@ void handleDDPPacket(e131_packet_t* p) {
   if (p->flags & DDP_TIMECODE_FLAG) c = 4; //packet has timecode flag, we do not support it, but data starts 4 bytes later
 
   realtimeLock(realtimeTimeoutMs, REALTIME_MODE_DDP);
+  realtimeStatsArrival();
 
   if (!realtimeOverride || (realtimeMode && useMainSegmentOnly)) {
     for (uint16_t i = start; i < stop; i++) {
@@ -45,9 +181,9 @@ void handleDDPPacket(e131_packet_t* p) {
 
   bool push = p->flags & DDP_PUSH_FLAG;
   if (push) {
-    e131NewData = true;
+    if (!realtimeBufferCommit()) e131NewData = true;
     byte sn = p->sequenceNum & 0xF;
-    if (sn) e131LastSequenceNumber[0] = sn;
+    if (sn) lastPushSeq = sn;
   }
 }
 
@@ -90,6 +226,8 @@ void handleE131Packet(e131_packet_t* p, IPAddress clientIP, byte protocol){
     return;
   }
 
+  realtimeStatsPacket(mde, dmxChannels);
+
   #ifdef WLED_ENABLE_DMX
   // does not act on out-of-order packets yet
   if (e131ProxyUniverse > 0 && uni == e131ProxyUniverse) {
@@ -100,14 +238,22 @@ void handleE131Packet(e131_packet_t* p, IPAddress clientIP, byte protocol){
   #endif
 
   // only listen for universes we're handling & allocated memory
-  if (uni < e131Universe || uni >= (e131Universe + E131_MAX_UNIVERSE_COUNT)) return;
+  checkE131UniverseTable();
+  int slot = findE131Universe(uni);
+  if (slot < 0) return;
+
+  uint16_t previousUniverses = slot;
+  uint8_t& lastSeq = e131Slots[slot].lastSeq;
+  bool& seqValid = e131Slots[slot].seqValid;
 
-  uint8_t previousUniverses = uni - e131Universe;
+  realtimeStatsUniverse(mde, slot);
+  realtimeStatsSequence(mde, seqValid ? lastSeq : -1, seq);
 
-  if (e131SkipOutOfSequence)
-    if (seq < e131LastSequenceNumber[previousUniverses] && seq > 20 && e131LastSequenceNumber[previousUniverses] < 250){
+  if (e131SkipOutOfSequence && seqValid)
+    if (seq < lastSeq && seq > 20 && lastSeq < 250){
+      realtimeStatsDropped(mde);
       DEBUG_PRINT(F("skipping E1.31 frame (last seq="));
-      DEBUG_PRINT(e131LastSequenceNumber[previousUniverses]);
+      DEBUG_PRINT(lastSeq);
       DEBUG_PRINT(F(", current seq="));
       DEBUG_PRINT(seq);
       DEBUG_PRINT(F(", universe="));
@@ -115,11 +261,14 @@ void handleE131Packet(e131_packet_t* p, IPAddress clientIP, byte protocol){
       DEBUG_PRINTLN(")");
       return;
     }
-  e131LastSequenceNumber[previousUniverses] = seq;
+  lastSeq = seq;
+  seqValid = true;
+  realtimeStatsArrival();
 
   // update status info
   realtimeIP = clientIP;
   byte wChannel = 0;
+  bool frameComplete = true; // only the last universe completes a multi-universe frame
   uint16_t totalLen = strip.getLengthTotal();
   uint16_t availDMXLen = 0;
   uint16_t dataOffset = DMXAddress;
@@ -265,27 +414,23 @@ void handleE131Packet(e131_packet_t* p, IPAddress clientIP, byte protocol){
       {
         bool is4Chan = (DMXMode == DMX_MODE_MULTIPLE_RGBW);
         const uint16_t dmxChannelsPerLed = is4Chan ? 4 : 3;
-        const uint16_t ledsPerUniverse = is4Chan ? MAX_4_CH_LEDS_PER_UNIVERSE : MAX_3_CH_LEDS_PER_UNIVERSE;
         uint8_t stripBrightness = bri;
-        uint16_t previousLeds, dmxOffset, ledsTotal;
+        uint16_t previousLeds = e131Slots[slot].ledOffset;
+        uint16_t dmxOffset, ledsTotal;
 
         if (previousUniverses == 0) {
           if (availDMXLen < 1) return;
           dmxOffset = dataOffset;
-          previousLeds = 0;
           // First DMX address is dimmer in DMX_MODE_MULTIPLE_DRGB mode.
           if (DMXMode == DMX_MODE_MULTIPLE_DRGB) {
             stripBrightness = e131_data[dmxOffset++];
-            ledsTotal = (availDMXLen - 1) / dmxChannelsPerLed;
+            ledsTotal = previousLeds + (availDMXLen - 1) / dmxChannelsPerLed;
           } else {
-            ledsTotal = availDMXLen / dmxChannelsPerLed;
+            ledsTotal = previousLeds + availDMXLen / dmxChannelsPerLed;
           }
         } else {
           // All subsequent universes start at the first channel.
           dmxOffset = (protocol == P_ARTNET) ? 0 : 1;
-          const uint16_t dimmerOffset = (DMXMode == DMX_MODE_MULTIPLE_DRGB) ? 1 : 0;
-          uint16_t ledsInFirstUniverse = (((MAX_CHANNELS_PER_UNIVERSE - DMXAddress) + dmxLenOffset) - dimmerOffset) / dmxChannelsPerLed;
-          previousLeds = ledsInFirstUniverse + (previousUniverses - 1) * ledsPerUniverse;
           ledsTotal = previousLeds + (dmxChannels / dmxChannelsPerLed);
         }
 
@@ -300,6 +445,7 @@ void handleE131Packet(e131_packet_t* p, IPAddress clientIP, byte protocol){
         if (ledsTotal > totalLen) {
           ledsTotal = totalLen;
         }
+        frameComplete = (ledsTotal == totalLen || slot == e131LastSlot);
 
         if (DMXMode == DMX_MODE_MULTIPLE_DRGB && previousUniverses == 0) {
           if (bri != stripBrightness) {
@@ -327,65 +473,27 @@ void handleE131Packet(e131_packet_t* p, IPAddress clientIP, byte protocol){
       break;
   }
 
-  e131NewData = true;
+  if (realtimeBufferActive()) {
+    if (frameComplete) realtimeBufferCommit();
+  } else {
+    e131NewData = true;
+  }
+}
+
+// multicast: joins the groups of universes added since e131.begin() (LED count or DMX settings changed), called from the loop
+void handleE131Multicast()
+{
+  if (!e131Multicast || !interfacesInited || apActive || !WLED_CONNECTED) return;
+  e131.updateMulticast(e131Universe, getE131UniverseCount());
 }
 
 void handleArtnetPollReply(IPAddress ipAddress) {
   ArtPollReply artnetPollReply;
   prepareArtnetPollReply(&artnetPollReply);
 
-  uint16_t startUniverse = e131Universe;
-  uint16_t endUniverse = e131Universe;
-
-  switch (DMXMode) {
-    case DMX_MODE_DISABLED:
-      return;  // nothing to do
-      break;
-
-    case DMX_MODE_SINGLE_RGB:
-    case DMX_MODE_SINGLE_DRGB:
-    case DMX_MODE_PRESET:
-    case DMX_MODE_EFFECT:
-    case DMX_MODE_EFFECT_W:
-    case DMX_MODE_EFFECT_SEGMENT:
-    case DMX_MODE_EFFECT_SEGMENT_W:
-      break;  // 1 universe is enough
-
-    case DMX_MODE_MULTIPLE_DRGB:
-    case DMX_MODE_MULTIPLE_RGB:
-    case DMX_MODE_MULTIPLE_RGBW:
-      {
-        bool is4Chan = (DMXMode == DMX_MODE_MULTIPLE_RGBW);
-        const uint16_t dmxChannelsPerLed = is4Chan ? 4 : 3;
-        const uint16_t dimmerOffset = (DMXMode == DMX_MODE_MULTIPLE_DRGB) ? 1 : 0;
-        const uint16_t dmxLenOffset = (DMXAddress == 0) ? 0 : 1; // For legacy DMX start address 0
-        const uint16_t ledsInFirstUniverse = (((MAX_CHANNELS_PER_UNIVERSE - DMXAddress) + dmxLenOffset) - dimmerOffset) / dmxChannelsPerLed;
-        const uint16_t totalLen = strip.getLengthTotal();
-
-        if (totalLen > ledsInFirstUniverse) {
-          const uint16_t ledsPerUniverse = is4Chan ? MAX_4_CH_LEDS_PER_UNIVERSE : MAX_3_CH_LEDS_PER_UNIVERSE;
-          const uint16_t remainLED = totalLen - ledsInFirstUniverse;
-
-          endUniverse += (remainLED / ledsPerUniverse);
-
-          if ((remainLED % ledsPerUniverse) > 0) {
-            endUniverse++;
-          }
-
-          if ((endUniverse - startUniverse) > E131_MAX_UNIVERSE_COUNT) {
-            endUniverse = startUniverse + E131_MAX_UNIVERSE_COUNT - 1;
-          }
-        }
-        break;
-      }
-    default:
-      DEBUG_PRINTLN(F("unknown E1.31 DMX mode"));
-      return;  // nothing to do
-      break;
-  }
-
-  for (uint16_t i = startUniverse; i <= endUniverse; ++i) {
-    sendArtnetPollReply(&artnetPollReply, ipAddress, i);
+  checkE131UniverseTable();
+  for (uint16_t i = 0; i < e131SlotCount; i++) {
+    sendArtnetPollReply(&artnetPollReply, ipAddress, e131Slots[i].universe);
   }
 }
 
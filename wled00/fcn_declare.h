@@ -73,6 +73,9 @@ void initDMX();
 void handleDMX();
 
 //e131.cpp
+uint16_t getE131UniverseCount();
+void invalidateE131UniverseTable();
+void handleE131Multicast();
 void handleE131Packet(e131_packet_t* p, IPAddress clientIP, byte protocol);
 void handleArtnetPollReply(IPAddress ipAddress);
 void prepareArtnetPollReply(ArtPollReply* reply);
@@ -84,6 +87,13 @@ bool writeObjectToFileUsingId(const char* file, uint16_t id, JsonDocument* conte
 bool writeObjectToFile(const char* file, const char* key, JsonDocument* content);
 bool readObjectFromFileUsingId(const char* file, uint16_t id, JsonDocument* dest);
 bool readObjectFromFile(const char* file, const char* key, JsonDocument* dest);
+void invalidatePresetIndex();
+char* readObjectTextFromFileUsingId(const char* file, uint16_t id);
+void initPresetLog();
+void handlePresetLog(bool force = false);
+void discardPresetLog();
+bool flushPresetLog();
+void serializePresetLogStats(JsonObject root);
 void updateFSInfo();
 void closeFile();
 
@@ -127,11 +137,48 @@ void handleIR();
 bool deserializeSegment(JsonObject elem, byte it, byte presetId = 0);
 bool deserializeState(JsonObject root, byte callMode = CALL_MODE_DIRECT_CHANGE, byte presetId = 0);
 void serializeSegment(JsonObject& root, Segment& seg, byte id, bool forPreset = false, bool segmentBounds = true);
+void serializeStateHeader(JsonObject root, bool forPreset = false, bool includeBri = true);
 void serializeState(JsonObject root, bool forPreset = false, bool includeBri = true, bool segmentBounds = true, bool selectedSegmentsOnly = false);
 void serializeInfo(JsonObject root);
+void serializeNodes(JsonObject root);
 void serializeModeNames(JsonArray arr, const char *qstring);
 void serializeModeData(JsonObject root);
 void serveJson(AsyncWebServerRequest* request);
+
+// Streams state and/or info JSON (JSON_PATH_STATE, _INFO or _STATE_INFO) one piece at a time
+// (state header, each segment, info), memory use does not depend on the number of segments
+// each piece is built while holding the JSON buffer lock, if it is busy the stream pauses (busy()) and read() can be retried
+class JsonStateStream {
+  public:
+    JsonStateStream(uint8_t content);
+    ~JsonStateStream();
+    size_t read(uint8_t* buf, size_t maxLen); // copies the next output bytes, returns 0 at the end
+    size_t measure();                         // length of the complete output, rewinds the stream
+    void rewind();
+    bool ok()   { return !_failed; }
+    bool busy() { return _busy; }
+    bool done() { return _part == PART_DONE && _textPos >= _textLen; }
+  private:
+    enum : uint8_t { PART_OPEN, PART_STATE, PART_SEG, PART_STATE_END, PART_INFO, PART_DONE };
+    DynamicJsonDocument _doc;
+    char*    _text = nullptr;
+    size_t   _textCap = 0;
+    size_t   _textLen = 0;
+    size_t   _textPos = 0;
+    uint8_t  _content;
+    uint8_t  _part = PART_OPEN;
+    uint8_t  _seg = 0;
+    uint8_t  _segCount = 0;
+    bool     _failed = false;
+    bool     _busy = false;
+    bool nextPiece();
+    bool fillPiece();
+    bool reserveText(size_t len);
+    void appendText(const char* str, size_t len);
+    void appendText(const __FlashStringHelper* str);
+    void appendDoc(bool open);
+};
+
 #ifdef WLED_ENABLE_JSONLIVE
 bool serveLiveLeds(AsyncWebServerRequest* request, uint32_t wsClient = 0);
 #endif
@@ -173,6 +220,10 @@ byte weekdayMondayFirst();
 void checkTimers();
 void calculateSunriseAndSunset();
 void setTimeFromAPI(uint32_t timein);
+void handleCues();
+void deserializeCues(JsonArray arr);
+void serializeCues(JsonArray arr);
+void serializeCueStats(JsonObject root);
 
 //overlay.cpp
 void handleOverlayDraw();
@@ -190,18 +241,57 @@ void serializePlaylist(JsonObject obj);
 void initPresetsFile();
 void handlePresets();
 bool applyPreset(byte index, byte callMode = CALL_MODE_DIRECT_CHANGE);
+void prefetchPreset(byte index);
+void pinPreset(byte index);
 inline bool applyTemporaryPreset() {return applyPreset(255);};
 void savePreset(byte index, const char* pname = nullptr, JsonObject saveobj = JsonObject());
 inline void saveTemporaryPreset() {savePreset(255);};
 void deletePreset(byte index);
+void serializePresetStats(JsonObject root);
 bool getPresetName(byte index, String& name);
 
+//snapshot.cpp
+bool isSnapshotState(JsonObject root);
+void createSnapshot(byte preset, bool on, byte briValue, int transition);
+bool applySnapshot(byte preset);
+bool hasSnapshot(byte preset);
+void dropSnapshot(byte preset);
+void handleSnapshots();
+
+//realtime_buffer.cpp
+bool realtimeBufferActive();
+bool realtimeBufferSetPixel(uint16_t pix, uint32_t c);
+bool realtimeBufferCommit();
+void resetRealtimeBuffer();
+void handleRealtimeBuffer();
+uint16_t getRealtimeBufferInterval();
+void serializeRealtimeBuffer(JsonObject root);
+
+//realtime_stats.cpp
+void realtimeStatsPacket(byte mode, size_t len);
+void realtimeStatsArrival();
+unsigned long realtimeStatsTakeArrival();
+void realtimeStatsUniverse(byte mode, uint16_t slot);
+void realtimeStatsSequence(byte mode, int16_t last, uint8_t seq);
+void realtimeStatsGap(byte mode, uint16_t missing);
+void realtimeStatsDropped(byte mode);
+void realtimeStatsShown(unsigned long arrival);
+void serializeRealtimeStats(JsonObject root);
+
+//udp_sync.cpp
+void notifyBinary(byte callMode, bool followUp);
+void handleSyncRetransmit();
+bool handleSyncPacket(const byte* udpIn, size_t len, IPAddress remoteIP);
+void serializeSyncStats(JsonObject root);
+
 //set.cpp
 bool isAsterisksOnly(const char* str, byte maxLen);
 void handleSettingsSet(AsyncWebServerRequest *request, byte subPage);
 bool handleSet(AsyncWebServerRequest *request, const String& req, bool apply=true);
 
 //udp.cpp
+void applySyncTimebase(uint32_t t);
+void adjustSyncTime(Toki::Time tm, uint8_t timeSource, bool timebaseUpdated);
 void notify(byte callMode, bool followUp=false);
 uint8_t realtimeBroadcast(uint8_t type, IPAddress client, uint16_t length, byte *buffer, uint8_t bri=255, bool isRGBW=false);
 void realtimeLock(uint32_t timeoutMs, byte md = REALTIME_MODE_GENERIC);
@@ -272,12 +362,29 @@ class Usermod {
     virtual void onUpdateBegin(bool) {}                                      // fired prior to and after unsuccessful firmware update
     virtual void onStateChange(uint8_t mode) {}                              // fired upon WLED state change
     virtual uint16_t getId() {return USERMOD_ID_UNSPECIFIED;}
+    virtual uint16_t getHooks() { return UM_HOOK_ALL; }                      // UM_HOOK_* flags of implemented methods; others are not called
+    virtual uint16_t getLoopInterval() { return 0; }                         // minimum time between loop() calls in ms, 0 = every main loop
 };
 
 class UsermodManager {
   private:
     Usermod* ums[WLED_MAX_USERMODS];
     byte numMods = 0;
+    uint16_t hooks[WLED_MAX_USERMODS];        // cached getHooks()
+    uint16_t loopInterval[WLED_MAX_USERMODS]; // cached getLoopInterval()
+    unsigned long lastLoop[WLED_MAX_USERMODS];
+
+    // time spent in loop() and handleOverlayDraw(), for /json/info
+    typedef struct UsermodTime {
+      uint32_t calls;
+      uint32_t max;    // us
+      uint64_t total;  // us
+    } um_time_t;
+    um_time_t loopTime[WLED_MAX_USERMODS];
+    um_time_t overlayTime[WLED_MAX_USERMODS];
+
+    void updateHooks(byte i);
+    static void account(um_time_t& t, unsigned long start);
 
   public:
     void loop();
@@ -299,6 +406,7 @@ class UsermodManager {
     bool add(Usermod* um);
     Usermod* lookup(uint16_t mod_id);
     byte getModCount() {return numMods;};
+    void serializeStats(JsonObject root);
 };
 
 //usermods_list.cpp
@@ -320,8 +428,11 @@ void sappend(char stype, const char* key, int val);
 void sappends(char stype, const char* key, char* val);
 void prepareHostname(char* hostname);
 bool isAsterisksOnly(const char* str, byte maxLen);
-bool requestJSONBufferLock(uint8_t module=255);
+bool requestJSONBufferLock(uint8_t module=255, uint16_t timeout=1000);
 void releaseJSONBufferLock();
+JsonDocument* requestJSONBuffer(uint8_t module, uint8_t prio = JSON_PRIO_NORMAL);
+void releaseJSONBuffer(JsonDocument* buffer);
+void serializeJSONBufferStats(JsonObject root);
 uint8_t extractModeName(uint8_t mode, const char *src, char *dest, uint8_t maxLen);
 uint8_t extractModeSlider(uint8_t mode, uint8_t slider, char *dest, uint8_t maxLen, uint8_t *var = nullptr);
 int16_t extractModeDefaults(uint8_t mode, const char *segVar);
@@ -360,11 +471,14 @@ void clearEEPROM();
 #endif
 
 //wled_serial.cpp
+void initSerialBuffer();
 void handleSerial();
+void serializeSerialStats(JsonObject root);
 void updateBaudRate(uint32_t rate);
 
 //wled_server.cpp
 bool isIp(String str);
+void serializeWebStats(JsonObject root);
 void createEditHandler(bool enable);
 bool captivePortal(AsyncWebServerRequest *request);
 void initServer();
@@ -376,12 +490,19 @@ String settingsProcessor(const String& var);
 String dmxProcessor(const String& var);
 void serveSettings(AsyncWebServerRequest* request, bool post = false);
 void serveSettingsJS(AsyncWebServerRequest* request);
+void invalidateSettingsJS();
+void handleSettingsJS();
 
 //ws.cpp
 void handleWs();
 void wsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len);
 void sendDataWs(AsyncWebSocketClient * client = nullptr);
 
+//ws_live.cpp
+bool startLiveStreamWs(AsyncWebSocketClient* client, JsonObject lv);
+void stopLiveStreamWs(uint32_t id);
+void handleLiveStreamWs();
+
 //xml.cpp
 void XML_response(AsyncWebServerRequest *request, char* dest = nullptr);
 void URL_response(AsyncWebServerRequest *request);
@@ -175,7 +175,443 @@ void writeSpace(uint16_t l)
   if (knownLargestSpace < l) knownLargestSpace = l;
 }
 
-bool appendObjectToFile(const char* key, JsonDocument* content, uint32_t s, uint32_t contentLen = 0)
+/*
+ * Preset index
+ * Offsets of the objects in presets.json by preset id, so that reading or replacing a preset does not have to
+ * search the file. It is built in one pass over the file when first needed and kept up to date on writes.
+ * If it does not match the file (size changed, or the key is not at the expected offset after an upload or edit)
+ * it is rebuilt.
+ */
+#define PRESET_INDEX_SIZE 251 // ids 0-250, the temporary preset 255 lives in tmp.json
+
+static uint32_t* presetIndex = nullptr; // offset of the '{' of each preset object, 0 if not in the file
+static uint32_t presetIndexFileSize = 0;
+static bool presetIndexValid = false;
+
+void invalidatePresetIndex()
+{
+  presetIndexValid = false;
+}
+
+// preset id for a key like "12": in presets.json, -1 for anything else
+static int16_t getPresetIndexId(const char* file, const char* key)
+{
+  if (!key || strcmp_P(file, PSTR("/presets.json")) || key[0] != '"' || !isdigit(key[1])) return -1;
+  int16_t id = 0;
+  const char* p = key + 1;
+  while (isdigit(*p)) {
+    id = id * 10 + (*p++ - '0');
+    if (id >= PRESET_INDEX_SIZE) return -1;
+  }
+  return (p[0] == '"' && p[1] == ':' && !p[2]) ? id : -1;
+}
+
+// one pass over the open presets file, records where each top level object starts
+static bool buildPresetIndex()
+{
+  #ifdef WLED_DEBUG_FS
+    DEBUGFS_PRINTLN(F("Build preset index"));
+    uint32_t s = millis();
+  #endif
+  presetIndexValid = false;
+  if (!presetIndex) presetIndex = (uint32_t*)malloc(PRESET_INDEX_SIZE * sizeof(uint32_t));
+  if (!presetIndex) return false;
+  memset(presetIndex, 0, PRESET_INDEX_SIZE * sizeof(uint32_t));
+
+  byte buf[FS_BUFSIZE];
+  uint16_t depth = 0;
+  bool inString = false, escape = false;
+  int16_t key = -1, pendingKey = -1; // numeric key being read / read and waiting for its object
+  uint8_t digits = 0;
+  uint32_t pos = 0;
+  f.seek(0);
+  while (pos < f.size()) {
+    uint16_t bufsize = f.read(buf, FS_BUFSIZE);
+    if (!bufsize) break;
+    for (uint16_t i = 0; i < bufsize; i++, pos++) {
+      char c = buf[i];
+      if (inString) {
+        if (escape) escape = false;
+        else if (c == '\\') escape = true;
+        else if (c == '"') {
+          inString = false;
+          if (key >= 0 && digits) pendingKey = key;
+        } else if (key >= 0) {
+          key = (isdigit(c) && !(digits && !key) && key * 10 + c - '0' < PRESET_INDEX_SIZE) ? key * 10 + c - '0' : -1;
+          digits++;
+        }
+      } else if (c == '"') {
+        inString = true;
+        key = (depth == 1) ? 0 : -1; // strings on the top level are keys
+        digits = 0;
+      } else if (c == '{') {
+        if (depth == 1 && pendingKey >= 0 && !presetIndex[pendingKey]) presetIndex[pendingKey] = pos;
+        pendingKey = -1;
+        depth++;
+      } else if (c == '}') {
+        if (depth) depth--;
+      } else if (c != ':' && !isspace(c)) {
+        pendingKey = -1; // the value of the key is not an object
+      }
+    }
+  }
+  presetIndexFileSize = f.size();
+  presetIndexValid = true;
+  DEBUGFS_PRINTF("Indexed, took %d ms\n", millis() - s);
+  return true;
+}
+
+// checks that key is in front of the object at pos, whitespace around the ':' is allowed
+static bool presetKeyAt(uint32_t pos, const char* key)
+{
+  char buf[32];
+  int keyLen = strlen(key);
+  if (!pos || !keyLen) return false;
+  uint32_t start = pos > sizeof(buf) - 1 ? pos - (sizeof(buf) - 1) : 0;
+  int len = pos - start + 1;
+  f.seek(start);
+  if (f.read((byte*)buf, len) != (size_t)len || buf[len - 1] != '{') return false;
+  int i = len - 2;
+  for (int k = keyLen - 1; k >= 0; k--) {
+    if (k == keyLen - 1 || key[k + 1] == ':') while (i >= 0 && isspace(buf[i])) i--;
+    if (i < 0 || buf[i] != key[k]) return false;
+    i--;
+  }
+  return true;
+}
+
+// like bufferedFind(key), but uses the preset index for presets.json
+static bool findObject(const char* file, const char* key)
+{
+  int16_t id = getPresetIndexId(file, key);
+  if (id < 0) return bufferedFind(key);
+  if (!presetIndexValid || presetIndexFileSize != f.size()) {
+    if (!buildPresetIndex()) return bufferedFind(key);
+  }
+  if (!presetIndex[id]) return false;
+  if (!presetKeyAt(presetIndex[id], key)) {
+    // the file was changed without going through writeObjectToFile()
+    if (!buildPresetIndex()) return bufferedFind(key);
+    if (!presetKeyAt(presetIndex[id], key)) return false;
+  }
+  f.seek(presetIndex[id]);
+  return true;
+}
+
+// index id: preset id the object is written for, -1 if not indexed
+static void updatePresetIndex(int16_t id, uint32_t pos)
+{
+  if (!presetIndexValid) return;
+  if (id >= 0) presetIndex[id] = pos;
+  presetIndexFileSize = f.size();
+}
+
+/*
+ * Preset log
+ * Preset writes are appended to /presets.log instead of being written into presets.json in place, which blanked and
+ * rewrote parts of the file on every save and could leave it corrupted when the power went out in the middle.
+ * The log is merged into a new presets.json when it grows large, before presets.json is served and on boot, so
+ * single saves do not rewrite the whole file. The merged file is written to /presets.tmp and renamed over presets.json, so
+ * there is always either the old or the new complete file, and the log is only removed after the rename.
+ *
+ * Record: magic, preset id, content length (2 bytes, little endian, 0: preset deleted), CRC16 of the content (2 bytes),
+ * content (JSON object). A record that is cut short or fails the CRC was being written when the power went out,
+ * it and anything after it are ignored.
+ */
+#define PRESET_LOG_MAGIC    0xA5
+#define PRESET_LOG_HEADER   6
+#ifdef ESP8266
+  #define PRESET_LOG_MAX_SIZE 8192
+#else
+  #define PRESET_LOG_MAX_SIZE 16384
+#endif
+#define PRESET_LOG_RETRY    60000  // ms after a failed merge before it is tried again
+#define PRESET_LOG_DELETED  0x80000000UL
+
+static const char presetLogFile[] PROGMEM = "/presets.log";
+static const char presetTmpFile[] PROGMEM = "/presets.tmp";
+
+static uint32_t* presetLogIndex = nullptr; // offset of the content of the latest record for each preset id | PRESET_LOG_DELETED, 0 if none
+static uint32_t presetLogSize = 0;         // 0 if there is no log
+static unsigned long presetLogFailed = 0;  // last failed merge, 0 if none
+static volatile bool presetLogMergeNow = false; // a write failed or the log could not be read completely
+static volatile bool presetLogDiscard = false;  // presets.json was uploaded, the log is removed in the loop
+// metrics
+static uint32_t presetLogWrites = 0, presetLogMerges = 0;
+static uint32_t presetLogBytes = 0;        // bytes written to flash for presets, including merges
+
+static bool allocPresetLogIndex()
+{
+  if (!presetLogIndex) presetLogIndex = (uint32_t*)calloc(PRESET_INDEX_SIZE, sizeof(uint32_t));
+  return presetLogIndex != nullptr;
+}
+
+// opens the object for key in the log (true) or in file, f is positioned at its '{'
+// returns false if it does not exist or was deleted
+static bool openObject(const char* file, const char* key)
+{
+  int16_t id = getPresetIndexId(file, key);
+  if (id >= 0 && presetLogIndex && presetLogIndex[id] && !presetLogDiscard) {
+    if (presetLogIndex[id] & PRESET_LOG_DELETED) return false;
+    f = WLED_FS.open(FPSTR(presetLogFile), "r");
+    if (!f) return false;
+    f.seek(presetLogIndex[id]);
+    return true;
+  }
+  f = WLED_FS.open(file, "r");
+  if (!f) return false;
+  if (key != nullptr && !findObject(file, key)) {
+    f.close();
+    return false;
+  }
+  return true;
+}
+
+// appends a record for preset id to the log, null content deletes the preset
+static bool appendPresetLog(int16_t id, JsonDocument* content)
+{
+  if (!allocPresetLogIndex()) return false;
+  size_t len = content->isNull() ? 0 : measureJson(*content);
+  if (len > UINT16_MAX) return false;
+
+  // there has to be space to merge the log
+  updateFSInfo();
+  File pf = WLED_FS.open(F("/presets.json"), "r");
+  size_t presetsSize = pf ? pf.size() : 0;
+  pf.close();
+  if (presetsSize + presetLogSize + PRESET_LOG_HEADER + len + 9000 > (fsBytesTotal - fsBytesUsed)) {
+    errorFlag = ERR_FS_QUOTA;
+    return false;
+  }
+
+  byte* rec = (byte*)malloc(PRESET_LOG_HEADER + len + 1); // serializeJson() adds a terminator
+  if (!rec) return false;
+  if (len) serializeJson(*content, (char*)rec + PRESET_LOG_HEADER, len + 1);
+  uint16_t crc = len ? crc16(rec + PRESET_LOG_HEADER, len) : 0;
+  rec[0] = PRESET_LOG_MAGIC;
+  rec[1] = id;
+  rec[2] = len & 0xFF;
+  rec[3] = len >> 8;
+  rec[4] = crc & 0xFF;
+  rec[5] = crc >> 8;
+
+  File log = WLED_FS.open(FPSTR(presetLogFile), "a");
+  uint32_t pos = log ? log.size() : 0;
+  bool ok = log && log.write(rec, PRESET_LOG_HEADER + len) == PRESET_LOG_HEADER + len;
+  if (log) log.close();
+  free(rec);
+  if (!ok) {
+    presetLogMergeNow = true; // do not append behind a broken record
+    return false;
+  }
+  presetLogIndex[id] = (pos + PRESET_LOG_HEADER) | (len ? 0 : PRESET_LOG_DELETED);
+  presetLogSize = pos + PRESET_LOG_HEADER + len;
+  presetLogWrites++;
+  presetLogBytes += PRESET_LOG_HEADER + len;
+  DEBUGFS_PRINTF("Logged preset %d, %d bytes\n", id, len);
+  return true;
+}
+
+// reads the log written before the last reboot into presetLogIndex
+static void scanPresetLog()
+{
+  File log = WLED_FS.open(FPSTR(presetLogFile), "r");
+  if (!log) return;
+  byte header[PRESET_LOG_HEADER];
+  uint32_t pos = 0;
+  while (allocPresetLogIndex() && log.read(header, PRESET_LOG_HEADER) == PRESET_LOG_HEADER) {
+    uint16_t len = header[2] | (header[3] << 8);
+    uint16_t crc = header[4] | (header[5] << 8);
+    if (header[0] != PRESET_LOG_MAGIC || header[1] >= PRESET_INDEX_SIZE) break;
+    byte* content = len ? (byte*)malloc(len) : nullptr;
+    bool valid = !len || (content && log.read(content, len) == len && crc16(content, len) == crc && content[0] == '{');
+    free(content);
+    if (!valid) break;
+    pos += PRESET_LOG_HEADER;
+    presetLogIndex[header[1]] = pos | (len ? 0 : PRESET_LOG_DELETED);
+    pos += len;
+  }
+  if (pos < log.size()) DEBUGFS_PRINTF("Preset log broken at %d of %d\n", pos, log.size());
+  presetLogSize = log.size(); // merged right away, the broken tail is dropped then
+  log.close();
+}
+
+// copies len bytes from the current position of src to dst
+static bool copyFileBytes(File& src, File& dst, size_t len)
+{
+  byte buf[FS_BUFSIZE];
+  while (len) {
+    uint16_t block = src.read(buf, MIN(len, FS_BUFSIZE));
+    if (!block || dst.write(buf, block) != block) return false;
+    len -= block;
+  }
+  return true;
+}
+
+// copies the JSON object starting at the current position of src to dst
+static bool copyFileObject(File& src, File& dst)
+{
+  byte buf[FS_BUFSIZE];
+  uint16_t depth = 0;
+  bool inString = false, escape = false;
+  while (src.available()) {
+    uint16_t bufsize = src.read(buf, FS_BUFSIZE);
+    if (!bufsize) break;
+    for (uint16_t i = 0; i < bufsize; i++) {
+      char c = buf[i];
+      if (inString) {
+        if (escape) escape = false;
+        else if (c == '\\') escape = true;
+        else if (c == '"') inString = false;
+      } else if (c == '"') {
+        inString = true;
+      } else if (c == '{' || c == '[') {
+        depth++;
+      } else if ((c == '}' || c == ']') && depth && !--depth) {
+        return dst.write(buf, i + 1) == i + 1U;
+      }
+    }
+    if (dst.write(buf, bufsize) != bufsize) return false;
+  }
+  return false;
+}
+
+// writes presets.json with the log applied to /presets.tmp and renames it over presets.json
+// the caller has to hold the JSON buffer lock so that no preset is written at the same time
+static bool mergePresetLog()
+{
+  if (!presetLogSize) return true;
+  #ifdef WLED_DEBUG_FS
+    DEBUGFS_PRINTLN(F("Merge preset log"));
+    uint32_t s = millis();
+  #endif
+  if (doCloseFile) closeFile();
+  File log = WLED_FS.open(FPSTR(presetLogFile), "r");
+  File out = WLED_FS.open(FPSTR(presetTmpFile), "w");
+  f = WLED_FS.open(F("/presets.json"), "r");
+  bool ok = out && (log || !presetLogIndex);
+  if (ok && f && (!presetIndexValid || presetIndexFileSize != f.size())) ok = buildPresetIndex();
+
+  uint32_t written = 0;
+  if (ok) written += out.print(F("{\"0\":{}"));
+  for (size_t id = 1; ok && id < PRESET_INDEX_SIZE; id++) {
+    char key[10];
+    sprintf(key, "\"%d\":", id);
+    uint32_t start = out.position();
+    if (presetLogIndex && presetLogIndex[id]) {
+      if (presetLogIndex[id] & PRESET_LOG_DELETED) continue;
+      byte header[PRESET_LOG_HEADER];
+      log.seek(presetLogIndex[id] - PRESET_LOG_HEADER);
+      if (log.read(header, PRESET_LOG_HEADER) != PRESET_LOG_HEADER) { ok = false; break; }
+      out.write(',');
+      out.print(key);
+      ok = copyFileBytes(log, out, header[2] | (header[3] << 8));
+    } else if (f && presetIndex[id]) {
+      // the index can only be off if the file was changed behind its back, search the key then rather than losing the preset
+      if (presetKeyAt(presetIndex[id], key)) f.seek(presetIndex[id]);
+      else if (!bufferedFind(key)) { ok = false; break; }
+      out.write(',');
+      out.print(key);
+      ok = copyFileObject(f, out);
+    }
+    written += out.position() - start;
+  }
+  if (ok) ok = out.write('}') == 1;
+  written++;
+  if (f) f.close();
+  if (log) log.close();
+  if (out) out.close();
+  if (presetLogDiscard) ok = false; // presets.json is being uploaded
+  // presets.json is only replaced by a complete file
+  if (ok && !WLED_FS.rename(FPSTR(presetTmpFile), F("/presets.json"))) {
+    // file systems that do not rename over an existing file, recovered on boot by initPresetLog() if interrupted here
+    ok = WLED_FS.remove(F("/presets.json")) && WLED_FS.rename(FPSTR(presetTmpFile), F("/presets.json"));
+  }
+  if (!ok) {
+    WLED_FS.remove(FPSTR(presetTmpFile));
+    DEBUGFS_PRINTLN(F("Merge failed."));
+    presetLogMergeNow = false; // try again later
+    presetLogFailed = millis() | 1;
+    return false;
+  }
+  WLED_FS.remove(FPSTR(presetLogFile));
+  if (presetLogIndex) memset(presetLogIndex, 0, PRESET_INDEX_SIZE * sizeof(uint32_t));
+  presetLogSize = 0;
+  presetLogFailed = 0;
+  presetLogMergeNow = false;
+  presetIndexValid = false;
+  presetLogMerges++;
+  presetLogBytes += written;
+  DEBUGFS_PRINTF("Merged, %d bytes, took %d ms\n", written, millis() - s);
+  return true;
+}
+
+// on boot: completes a merge that was interrupted by a power loss and merges the log of the last run
+void initPresetLog()
+{
+  if (WLED_FS.exists(FPSTR(presetTmpFile))) {
+    // the rename fallback in mergePresetLog() was interrupted after the old file was removed
+    if (!WLED_FS.exists(F("/presets.json"))) WLED_FS.rename(FPSTR(presetTmpFile), F("/presets.json"));
+    else WLED_FS.remove(FPSTR(presetTmpFile)); // merge was interrupted, the log is still there
+  }
+  scanPresetLog();
+  if (presetLogSize) mergePresetLog();
+}
+
+static void doDiscardPresetLog()
+{
+  presetLogDiscard = false;
+  WLED_FS.remove(FPSTR(presetLogFile));
+  if (presetLogIndex) memset(presetLogIndex, 0, PRESET_INDEX_SIZE * sizeof(uint32_t));
+  presetLogSize = 0;
+  presetLogFailed = 0;
+  presetLogMergeNow = false;
+}
+
+// merges the log if it is due, or if force is set; loop only
+void handlePresetLog(bool force)
+{
+  if (presetLogDiscard) {
+    if (!requestJSONBufferLock(22)) return;
+    doDiscardPresetLog();
+    releaseJSONBufferLock();
+    return;
+  }
+  if (!presetLogSize) return;
+  if (!force && !presetLogMergeNow && presetLogSize < PRESET_LOG_MAX_SIZE) return;
+  if (!force && presetLogFailed && millis() - presetLogFailed < PRESET_LOG_RETRY) return;
+  if (!requestJSONBufferLock(22)) return;
+  mergePresetLog();
+  releaseJSONBufferLock();
+}
+
+// presets.json was replaced (upload), records in the log are outdated; any task, the log is removed in the loop
+void discardPresetLog()
+{
+  presetLogDiscard = true;
+}
+
+// any task: brings presets.json up to date before it is served, false if the log could not be merged
+bool flushPresetLog()
+{
+  if (!presetLogSize || presetLogDiscard) return true;
+  if (!requestJSONBufferLock(27)) return false;
+  bool ok = mergePresetLog();
+  releaseJSONBufferLock();
+  return ok;
+}
+
+void serializePresetLogStats(JsonObject root)
+{
+  if (!presetLogWrites && !presetLogMerges) return;
+  JsonObject pl = root.createNestedObject(F("plog"));
+  pl[F("w")]  = presetLogWrites;  // presets written
+  pl["b"]     = presetLogBytes;   // bytes written to flash for presets
+  pl[F("m")]  = presetLogMerges;
+  pl[F("sz")] = presetLogSize;    // bytes in the log not yet merged
+}
+
+bool appendObjectToFile(const char* key, JsonDocument* content, uint32_t s, uint32_t contentLen = 0, int16_t indexId = -1)
 {
   #ifdef WLED_DEBUG_FS
     DEBUGFS_PRINTLN(F("Append"));
@@ -191,6 +627,7 @@ bool appendObjectToFile(const char* key, JsonDocument* content, uint32_t s, uint
   }
 
   if (content->isNull()) {
+    updatePresetIndex(-1, 0);
     doCloseFile = true;
     return true; //nothing  to append
   }
@@ -201,7 +638,9 @@ bool appendObjectToFile(const char* key, JsonDocument* content, uint32_t s, uint
   if (bufferedFindSpace(contentLen + strlen(key) + 1)) {
     if (f.position() > 2) f.write(','); //add comma if not first object
     f.print(key);
+    uint32_t objPos = f.position();
     serializeJson(*content, f);
+    updatePresetIndex(indexId, objPos);
     DEBUGFS_PRINTF("Inserted, took %d ms (total %d)", millis() - s1, millis() - s);
     doCloseFile = true;
     return true;
@@ -244,10 +683,12 @@ bool appendObjectToFile(const char* key, JsonDocument* content, uint32_t s, uint
   }
 
   f.print(key);
+  uint32_t objPos = f.position();
 
   //Append object
   serializeJson(*content, f);
   f.write('}');
+  updatePresetIndex(indexId, objPos);
 
   doCloseFile = true;
   DEBUGFS_PRINTF("Appended, took %d ms (total %d)", millis() - s1, millis() - s);
@@ -270,6 +711,9 @@ bool writeObjectToFile(const char* file, const char* key, JsonDocument* content)
     s = millis();
   #endif
 
+  int16_t indexId = getPresetIndexId(file, key);
+  if (indexId > 0) return appendPresetLog(indexId, content); // presets.json
+
   uint32_t pos = 0;
   f = WLED_FS.open(file, "r+");
   if (!f && !WLED_FS.exists(file)) f = WLED_FS.open(file, "w+");
@@ -278,9 +722,9 @@ bool writeObjectToFile(const char* file, const char* key, JsonDocument* content)
     return false;
   }
 
-  if (!bufferedFind(key)) //key does not exist in file
+  if (!findObject(file, key)) //key does not exist in file
   {
-    return appendObjectToFile(key, content, s);
+    return appendObjectToFile(key, content, s, 0, indexId);
   }
 
   //an object with this key already exists, replace or delete it
@@ -316,8 +760,10 @@ bool writeObjectToFile(const char* file, const char* key, JsonDocument* content)
     if (pos > 3) pos--; //also delete leading comma if not first object
     f.seek(pos);
     writeSpace(pos2 - pos);
-    if (contentLen) return appendObjectToFile(key, content, s, contentLen);
+    updatePresetIndex(indexId, 0);
+    if (contentLen) return appendObjectToFile(key, content, s, contentLen, indexId);
   }
+  updatePresetIndex(-1, 0); // replaced in place, only the size may have changed
 
   doCloseFile = true;
   DEBUGFS_PRINTF("Replaced/deleted, took %d ms\n", millis() - s);
@@ -339,12 +785,8 @@ bool readObjectFromFile(const char* file, const char* key, JsonDocument* dest)
     DEBUGFS_PRINTF("Read from %s with key %s >>>\n", file, (key==nullptr)?"nullptr":key);
     uint32_t s = millis();
   #endif
-  f = WLED_FS.open(file, "r");
-  if (!f) return false;
-
-  if (key != nullptr && !bufferedFind(key)) //key does not exist in file
+  if (!openObject(file, key)) //key does not exist in file
   {
-    f.close();
     dest->clear();
     DEBUGFS_PRINTLN(F("Obj not found."));
     return false;
@@ -357,6 +799,79 @@ bool readObjectFromFile(const char* file, const char* key, JsonDocument* dest)
   return true;
 }
 
+// reads the object stored under id without parsing it, so that it can be deserialized later without file access
+// returns a null terminated copy of the object with whitespace outside of strings removed (free() it), nullptr if not found
+char* readObjectTextFromFileUsingId(const char* file, uint16_t id)
+{
+  char key[10];
+  sprintf(key, "\"%d\":", id);
+  if (doCloseFile) closeFile();
+  #ifdef WLED_DEBUG_FS
+    DEBUGFS_PRINTF("Read text from %s with key %s >>>\n", file, key);
+    uint32_t s = millis();
+  #endif
+  if (!openObject(file, key)) {
+    DEBUGFS_PRINTLN(F("Obj not found."));
+    return nullptr;
+  }
+
+  // first pass finds the end of the object, second pass copies it
+  uint32_t start = f.position(), len = 0;
+  char* text = nullptr;
+  bool ok = false;
+  byte buf[FS_BUFSIZE];
+  for (uint8_t pass = 0; pass < 2; pass++) {
+    uint16_t depth = 0;
+    bool inString = false, escape = false, done = false;
+    uint32_t n = 0;
+    f.seek(start);
+    while (!done && f.position() < f.size()) {
+      uint16_t bufsize = f.read(buf, FS_BUFSIZE);
+      if (!bufsize) break;
+      for (uint16_t i = 0; i < bufsize && !done; i++) {
+        char c = buf[i];
+        if (inString) {
+          if (escape) escape = false;
+          else if (c == '\\') escape = true;
+          else if (c == '"') inString = false;
+        } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+          continue;
+        } else if (c == '"') {
+          inString = true;
+        } else if (c == '{' || c == '[') {
+          depth++;
+        } else if (c == '}' || c == ']') {
+          if (!--depth) done = true;
+        }
+        if (text && n < len) text[n] = c;
+        n++;
+      }
+    }
+    if (!done) break; // truncated file
+    if (pass) {
+      text[len] = '\0';
+      ok = (n == len); // unless the file changed in between
+      break;
+    }
+    len = n;
+    // if possible use SPI RAM on ESP32
+    #if defined(ARDUINO_ARCH_ESP32) && defined(WLED_USE_PSRAM)
+    if (psramFound())
+      text = (char*) ps_malloc(len + 1);
+    else
+    #endif
+      text = (char*) malloc(len + 1);
+    if (!text) break;
+  }
+  f.close();
+  if (ok) {
+    DEBUGFS_PRINTF("Read %d bytes, took %d ms\n", len, millis() - s);
+    return text;
+  }
+  free(text);
+  return nullptr;
+}
+
 void updateFSInfo() {
   #ifdef ARDUINO_ARCH_ESP32
     #if WLED_FS == LITTLEFS || ESP_IDF_VERSION_MAJOR >= 4
@@ -403,6 +918,12 @@ bool handleFileRead(AsyncWebServerRequest* request, String path){
     request->send(WLED_FS, pathWithGz, contentType);
     return true;
   }*/
+  if (path.equals("/presets.json") && !flushPresetLog()) { // could not be brought up to date, ask again later
+    AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", F("Merging presets"));
+    response->addHeader(F("Retry-After"), "1");
+    request->send(response);
+    return true;
+  }
   if(WLED_FS.exists(path)) {
     request->send(WLED_FS, path, contentType);
     return true;
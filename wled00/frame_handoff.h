@@ -0,0 +1,82 @@
+#ifndef WLED_FRAME_HANDOFF_H
+#define WLED_FRAME_HANDOFF_H
+
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Frame handoff between the render loop and the output task (WLED_ENABLE_PIPELINE)
+ *
+ * The renderer draws into its own pixel buffer. When a frame is complete it copies it into the single
+ * handoff slot and wakes the output task, which copies the slot into the bus buffers and sends it.
+ * The slot holds at most one frame: if the output falls behind, a newer frame replaces the one still
+ * waiting (counted as dropped); only while the output task is copying the slot the renderer has to wait.
+ *
+ * State changes (bus reconfiguration, buffer reallocation) pause the output between two frames.
+ *
+ * Only std::atomic is used, so this can be compiled and exercised with threads on a host.
+ * FRAME_HANDOFF_WAIT() is called while spinning.
+ */
+
+#ifndef FRAME_HANDOFF_WAIT
+  #include <thread>
+  #define FRAME_HANDOFF_WAIT() std::this_thread::yield()
+#endif
+
+class FrameHandoff {
+  public:
+    // renderer: claim the slot for writing; waits while the output task is copying it
+    void beginWrite() {
+      for (;;) {
+        uint8_t s = _state.load(std::memory_order_acquire);
+        if ((s == FREE || s == READY) && _state.compare_exchange_weak(s, WRITING, std::memory_order_acquire)) {
+          if (s == READY) dropped++;                 // output did not pick up the previous frame
+          return;
+        }
+        FRAME_HANDOFF_WAIT();
+      }
+    }
+    // renderer: frame is in the slot
+    void commit() { frames++; _state.store(READY, std::memory_order_release); }
+
+    // output: take the newest frame, false if there is none
+    bool beginRead() {
+      uint8_t s = READY;
+      return _state.compare_exchange_strong(s, READING, std::memory_order_acquire);
+    }
+    // output: done copying, the slot can be written again
+    void endRead() { _state.store(FREE, std::memory_order_release); }
+
+    bool pending() const { return _state.load(std::memory_order_relaxed) == READY; }
+
+    // loop: stop the output between frames, then change what it uses; pauses nest
+    void pause() {
+      if (_pauses++) return;
+      _pauseRequest.store(true);                     // seq_cst together with enter() (Dekker style)
+      while (_outputActive.load()) FRAME_HANDOFF_WAIT();
+    }
+    void resume() {
+      if (_pauses && !--_pauses) _pauseRequest.store(false);
+    }
+
+    // output: bracket everything that touches the busses; false while paused
+    bool enter() {
+      _outputActive.store(true);
+      if (!_pauseRequest.load()) return true;
+      _outputActive.store(false);
+      return false;
+    }
+    void leave() { _outputActive.store(false, std::memory_order_release); }
+
+    uint32_t frames = 0;   // written by the renderer only
+    uint32_t dropped = 0;
+
+  private:
+    enum : uint8_t { FREE, WRITING, READY, READING };
+    std::atomic<uint8_t> _state{FREE};
+    std::atomic<bool>    _pauseRequest{false};
+    std::atomic<bool>    _outputActive{false};
+    uint8_t              _pauses = 0;        // loop only
+};
+
+#endif
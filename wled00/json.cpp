@@ -1,14 +1,7 @@
 #include "wled.h"
 
 #include "palettes.h"
-
-#define JSON_PATH_STATE      1
-#define JSON_PATH_INFO       2
-#define JSON_PATH_STATE_INFO 3
-#define JSON_PATH_NODES      4
-#define JSON_PATH_PALETTES   5
-#define JSON_PATH_FXDATA     6
-#define JSON_PATH_NETWORKS   7
+#include <memory>
 
 /*
  * JSON API (De)serialization
@@ -513,7 +506,8 @@ void serializeSegment(JsonObject& root, Segment& seg, byte id, bool forPreset, b
   root["m12"] = seg.map1D2D;
 }
 
-void serializeState(JsonObject root, bool forPreset, bool includeBri, bool segmentBounds, bool selectedSegmentsOnly)
+// everything in the state object except the segment array
+void serializeStateHeader(JsonObject root, bool forPreset, bool includeBri)
 {
   if (includeBri) {
     root["on"] = (bri > 0);
@@ -548,6 +542,11 @@ void serializeState(JsonObject root, bool forPreset, bool includeBri, bool segme
   }
 
   root[F("mainseg")] = strip.getMainSegmentId();
+}
+
+void serializeState(JsonObject root, bool forPreset, bool includeBri, bool segmentBounds, bool selectedSegmentsOnly)
+{
+  serializeStateHeader(root, forPreset, includeBri);
 
   JsonArray seg = root.createNestedArray("seg");
   for (size_t s = 0; s < strip.getMaxSegments(); s++) {
@@ -581,6 +580,7 @@ void serializeInfo(JsonObject root)
   leds[F("count")] = strip.getLengthTotal();
   leds[F("pwr")] = strip.currentMilliamps;
   leds["fps"] = strip.getFps();
+  if (strip.isPipelined()) leds[F("drop")] = strip.getDroppedFrames();
   leds[F("maxpwr")] = (strip.currentMilliamps)? strip.ablMilliampsMax : 0;
   leds[F("maxseg")] = strip.getMaxSegments();
   //leds[F("actseg")] = strip.getActiveSegmentsNum();
@@ -646,6 +646,22 @@ void serializeInfo(JsonObject root)
     root[F("lip")] = realtimeIP.toString();
   }
 
+  if (realtimeBufferDepth) {
+    JsonObject rtb = root.createNestedObject(F("rtb"));
+    serializeRealtimeBuffer(rtb);
+  }
+  serializeRealtimeStats(root);
+  serializeSyncStats(root);
+  serializeJSONBufferStats(root);
+  serializePresetStats(root);
+  serializeCueStats(root);
+  serializePresetLogStats(root);
+  serializeWebStats(root);
+  usermods.serializeStats(root);
+  #ifdef WLED_ENABLE_ADALIGHT
+  serializeSerialStats(root);
+  #endif
+
   #ifdef WLED_ENABLE_WEBSOCKETS
   root[F("ws")] = ws.count();
   #else
@@ -980,6 +996,174 @@ void serializeModeNames(JsonArray arr) {
   }
 }
 
+/*
+ * Streaming state/info serializer
+ * Each piece (state header, a segment, info) is built in a small document and written out as text
+ * before the next one is built, so no document ever holds the complete state.
+ */
+JsonStateStream::JsonStateStream(uint8_t content) : _doc(JSON_STREAM_PIECE_SIZE), _content(content)
+{
+  if (!_doc.capacity()) _failed = true;
+}
+
+JsonStateStream::~JsonStateStream()
+{
+  if (_text) free(_text);
+}
+
+void JsonStateStream::rewind()
+{
+  _part = PART_OPEN;
+  _seg = _segCount = 0;
+  _textLen = _textPos = 0;
+}
+
+// makes room for len more characters
+bool JsonStateStream::reserveText(size_t len)
+{
+  if (_textLen + len + 1 <= _textCap) return true;
+  char* text = (char*)realloc(_text, _textLen + len + 1);
+  if (!text) {
+    DEBUG_PRINTLN(F("JSON stream out of memory!"));
+    _failed = true;
+    return false;
+  }
+  _text = text;
+  _textCap = _textLen + len + 1;
+  return true;
+}
+
+void JsonStateStream::appendText(const char* str, size_t len)
+{
+  if (!reserveText(len)) return;
+  memcpy(_text + _textLen, str, len);
+  _textLen += len;
+  _text[_textLen] = '\0';
+}
+
+void JsonStateStream::appendText(const __FlashStringHelper* str)
+{
+  char buf[16];
+  strncpy_P(buf, (PGM_P)str, sizeof(buf)-1);
+  buf[sizeof(buf)-1] = '\0';
+  appendText(buf, strlen(buf));
+}
+
+// open: leave the object open (drop the closing brace) so that more members can follow
+void JsonStateStream::appendDoc(bool open)
+{
+  size_t len = measureJson(_doc);
+  if (!reserveText(len)) return;
+  serializeJson(_doc, _text + _textLen, len + 1);
+  _textLen += (open && len) ? len - 1 : len;
+  _text[_textLen] = '\0';
+}
+
+// serializes the state header, the current segment or info into _doc while holding the JSON buffer lock, so that
+// segments can not be changed or reallocated meanwhile; _doc grows (up to JSON_BUFFER_SIZE) if the piece does not fit
+// returns false if the lock is busy (_busy is set) or the piece can not be built (_failed is set)
+bool JsonStateStream::fillPiece()
+{
+  if (!requestJSONBufferLock(23, JSON_STREAM_LOCK_WAIT)) {
+    _busy = true;
+    return false;
+  }
+  while (true) {
+    _doc.clear();
+    JsonObject root = _doc.to<JsonObject>();
+    switch (_part) {
+      case PART_STATE:
+        serializeStateHeader(root);
+        break;
+      case PART_SEG:
+        // segments may be added or removed between pieces, check the count every time
+        if (_seg >= strip.getSegmentsNum()) _part = PART_STATE_END;
+        else if (strip.getSegment(_seg).isActive()) serializeSegment(root, strip.getSegment(_seg), _seg);
+        break;
+      case PART_INFO:
+        serializeInfo(root);
+        break;
+    }
+    if (!_doc.overflowed()) break;
+    size_t capacity = _doc.capacity() * 2;
+    if (capacity > JSON_BUFFER_SIZE || !(_doc = DynamicJsonDocument(capacity)).capacity()) {
+      DEBUG_PRINTLN(F("JSON stream piece too large!"));
+      _failed = true;
+      break;
+    }
+  }
+  releaseJSONBufferLock();
+  return !_failed;
+}
+
+// builds the text of the next piece, returns false at the end of the output or while the JSON buffer lock is busy
+bool JsonStateStream::nextPiece()
+{
+  _textLen = _textPos = 0;
+  _busy = false;
+  while (!_textLen) {
+    if (_busy) return false; // paused, the same piece is tried again with the next read()
+    if (_failed) _part = PART_DONE;
+    switch (_part) {
+      case PART_OPEN:
+        if (_content == JSON_PATH_STATE_INFO) appendText(F("{\"state\":"));
+        _part = (_content == JSON_PATH_INFO) ? PART_INFO : PART_STATE;
+        break;
+      case PART_STATE:
+        if (!fillPiece()) break;
+        appendDoc(true);
+        appendText(F(",\"seg\":["));
+        _part = PART_SEG;
+        break;
+      case PART_SEG:
+        if (!fillPiece() || _part != PART_SEG) break;
+        if (_doc.size()) { // inactive segments are left out
+          if (_segCount++) appendText(F(","));
+          appendDoc(false);
+        }
+        _seg++;
+        break;
+      case PART_STATE_END:
+        appendText(F("]}"));
+        _part = (_content == JSON_PATH_STATE) ? PART_DONE : PART_INFO;
+        break;
+      case PART_INFO:
+        if (!fillPiece()) break;
+        if (_content == JSON_PATH_STATE_INFO) appendText(F(",\"info\":"));
+        appendDoc(false);
+        if (_content == JSON_PATH_STATE_INFO) appendText(F("}"));
+        _part = PART_DONE;
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+size_t JsonStateStream::read(uint8_t* buf, size_t maxLen)
+{
+  size_t n = 0;
+  while (n < maxLen) {
+    if (_textPos >= _textLen && !nextPiece()) break;
+    size_t len = MIN(maxLen - n, _textLen - _textPos);
+    memcpy(buf + n, _text + _textPos, len);
+    n += len;
+    _textPos += len;
+  }
+  return n;
+}
+
+size_t JsonStateStream::measure()
+{
+  byte err = errorFlag; // serializing the state clears the error, keep it for the actual output
+  size_t len = 0;
+  while (nextPiece()) len += _textLen;
+  errorFlag = err;
+  rewind();
+  return len;
+}
+
 void serveJson(AsyncWebServerRequest* request)
 {
   byte subJson = 0;
@@ -999,13 +1183,14 @@ void serveJson(AsyncWebServerRequest* request)
   #endif
   else if (url.indexOf(F("eff")) > 0) {
     // this serves just effect names without FX data extensions in names
-    if (requestJSONBufferLock(19)) {
-      AsyncJsonResponse* response = new AsyncJsonResponse(&doc, true);  // array document
+    JsonDocument* buffer = requestJSONBuffer(19);
+    if (buffer) {
+      AsyncJsonResponse* response = new AsyncJsonResponse(buffer, true);  // array document
       JsonArray lDoc = response->getRoot();
       serializeModeNames(lDoc); // remove WLED-SR extensions from effect names
       response->setLength();
       request->send(response);
-      releaseJSONBufferLock();
+      releaseJSONBuffer(buffer);
     } else {
       request->send(503, "application/json", F("{\"error\":3}"));
     }
@@ -1023,20 +1208,39 @@ void serveJson(AsyncWebServerRequest* request)
     return;
   }
 
-  if (!requestJSONBufferLock(17)) {
+  if (subJson == JSON_PATH_STATE || subJson == JSON_PATH_INFO || subJson == JSON_PATH_STATE_INFO) {
+    // stream as chunked response, the stream is freed together with the response
+    std::shared_ptr<JsonStateStream> stream = std::make_shared<JsonStateStream>(subJson);
+    if (!stream->ok()) {
+      request->send(503, "application/json", F("{\"error\":3}"));
+      return;
+    }
+    request->send(request->beginChunkedResponse("application/json", [stream](uint8_t *buf, size_t maxLen, size_t index) -> size_t {
+      size_t len = stream->read(buf, maxLen);
+      #ifdef RESPONSE_TRY_AGAIN
+      if (!len && stream->busy()) return RESPONSE_TRY_AGAIN; // state is being changed, ask again later
+      #else
+      for (unsigned long start = millis(); !len && stream->busy() && millis()-start < 1000; ) len = stream->read(buf, maxLen);
+      #endif
+      return len;
+    }));
+    return;
+  }
+
+  // the full /json reads segments and must not run while the loop changes them, it takes the primary doc (and its lock)
+  JsonDocument* buffer = nullptr;
+  if (subJson) buffer = requestJSONBuffer(17);
+  else if (requestJSONBufferLock(17)) buffer = &doc;
+  if (!buffer) {
     request->send(503, "application/json", F("{\"error\":3}"));
     return;
   }
-  AsyncJsonResponse *response = new AsyncJsonResponse(&doc, subJson==6);
+  AsyncJsonResponse *response = new AsyncJsonResponse(buffer, subJson==6);
 
   JsonVariant lDoc = response->getRoot();
 
   switch (subJson)
   {
-    case JSON_PATH_STATE:
-      serializeState(lDoc); break;
-    case JSON_PATH_INFO:
-      serializeInfo(lDoc); break;
     case JSON_PATH_NODES:
       serializeNodes(lDoc); break;
     case JSON_PATH_PALETTES:
@@ -1050,12 +1254,9 @@ void serveJson(AsyncWebServerRequest* request)
       serializeState(state);
       JsonObject info = lDoc.createNestedObject("info");
       serializeInfo(info);
-      if (subJson != JSON_PATH_STATE_INFO)
-      {
-        JsonArray effects = lDoc.createNestedArray(F("effects"));
-        serializeModeNames(effects); // remove WLED-SR extensions from effect names
-        lDoc[F("palettes")] = serialized((const __FlashStringHelper*)JSON_palette_names);
-      }
+      JsonArray effects = lDoc.createNestedArray(F("effects"));
+      serializeModeNames(effects); // remove WLED-SR extensions from effect names
+      lDoc[F("palettes")] = serialized((const __FlashStringHelper*)JSON_palette_names);
       //lDoc["m"] = lDoc.memoryUsage(); // JSON buffer usage, for remote debugging
   }
 
@@ -1063,7 +1264,7 @@ void serveJson(AsyncWebServerRequest* request)
 
   response->setLength();
   request->send(response);
-  releaseJSONBufferLock();
+  releaseJSONBuffer(buffer);
 }
 
 #ifdef WLED_ENABLE_JSONLIVE
@@ -1092,7 +1293,14 @@ bool serveLiveLeds(AsyncWebServerRequest* request, uint32_t wsClient)
     uint8_t r = qadd8(W(c), R(c)); //add white channel to RGB channels as a simple RGBW -> RGB map
     uint8_t g = qadd8(W(c), G(c));
     uint8_t b = qadd8(W(c), B(c));
-    olen += sprintf(obuf + olen, "\"%06X\",", RGBW32(r,g,b,0));
+    // "RRGGBB", without sprintf
+    static const char hex[] PROGMEM = "0123456789ABCDEF";
+    obuf[olen++] = '"';
+    obuf[olen++] = pgm_read_byte(&hex[r >> 4]); obuf[olen++] = pgm_read_byte(&hex[r & 0xF]);
+    obuf[olen++] = pgm_read_byte(&hex[g >> 4]); obuf[olen++] = pgm_read_byte(&hex[g & 0xF]);
+    obuf[olen++] = pgm_read_byte(&hex[b >> 4]); obuf[olen++] = pgm_read_byte(&hex[b & 0xF]);
+    obuf[olen++] = '"';
+    obuf[olen++] = ',';
   }
   olen -= 1;
   oappend((const char*)F("],\"n\":"));
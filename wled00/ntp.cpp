@@ -1,6 +1,7 @@
 #include "src/dependencies/timezone/Timezone.h"
 #include "wled.h"
 #include "fcn_declare.h"
+#include <algorithm>
 
 /*
  * Acquires time from NTP server
@@ -176,6 +177,7 @@ void handleTime() {
     checkTimers();
     checkCountdown();
   }
+  handleCues();
 }
 
 void handleNetworkTime()
@@ -323,13 +325,14 @@ byte weekdayMondayFirst()
   return wd;
 }
 
-bool isTodayInDateRange(byte monthStart, byte dayStart, byte monthEnd, byte dayEnd)
+// date range of a timer, for the local day t
+static bool isDayInDateRange(time_t t, byte monthStart, byte dayStart, byte monthEnd, byte dayEnd)
 {
 	if (monthStart == 0 || dayStart == 0) return true;
 	if (monthEnd == 0) monthEnd = monthStart;
 	if (dayEnd == 0) dayEnd = 31;
-	byte d = day(localTime);
-	byte m = month(localTime);
+	byte d = day(t);
+	byte m = month(t);
 
 	if (monthStart < monthEnd) {
 		if (m > monthStart && m < monthEnd) return true;
@@ -349,6 +352,7 @@ bool isTodayInDateRange(byte monthStart, byte dayStart, byte monthEnd, byte dayE
 	return (m == monthStart && d >= dayStart && d <= dayEnd); //just the designated days this month
 }
 
+// timers are fired by handleCues(), this only keeps sunrise and sunset of the current day up to date
 void checkTimers()
 {
   if (lastTimerMinute != minute(localTime)) //only check once a new minute begins
@@ -359,50 +363,6 @@ void checkTimers()
     if (!hour(localTime) && minute(localTime)==1) calculateSunriseAndSunset();
 
     DEBUG_PRINTF("Local time: %02d:%02d\n", hour(localTime), minute(localTime));
-    for (uint8_t i = 0; i < 8; i++)
-    {
-      if (timerMacro[i] != 0
-          && (timerWeekday[i] & 0x01) //timer is enabled
-          && (timerHours[i] == hour(localTime) || timerHours[i] == 24) //if hour is set to 24, activate every hour
-          && timerMinutes[i] == minute(localTime)
-          && ((timerWeekday[i] >> weekdayMondayFirst()) & 0x01) //timer should activate at current day of week
-          && isTodayInDateRange(((timerMonth[i] >> 4) & 0x0F), timerDay[i], timerMonth[i] & 0x0F, timerDayEnd[i])
-         )
-      {
-        unloadPlaylist();
-        applyPreset(timerMacro[i]);
-      }
-    }
-    // sunrise macro
-    if (sunrise) {
-      time_t tmp = sunrise + timerMinutes[8]*60;  // NOTE: may not be ok
-      DEBUG_PRINTF("Trigger time: %02d:%02d\n", hour(tmp), minute(tmp));
-      if (timerMacro[8] != 0
-          && hour(tmp) == hour(localTime)
-          && minute(tmp) == minute(localTime)
-          && (timerWeekday[8] & 0x01) //timer is enabled
-          && ((timerWeekday[8] >> weekdayMondayFirst()) & 0x01)) //timer should activate at current day of week
-      {
-        unloadPlaylist();
-        applyPreset(timerMacro[8]);
-        DEBUG_PRINTF("Sunrise macro %d triggered.",timerMacro[8]);
-      }
-    }
-    // sunset macro
-    if (sunset) {
-      time_t tmp = sunset + timerMinutes[9]*60;  // NOTE: may not be ok
-      DEBUG_PRINTF("Trigger time: %02d:%02d\n", hour(tmp), minute(tmp));
-      if (timerMacro[9] != 0
-          && hour(tmp) == hour(localTime)
-          && minute(tmp) == minute(localTime)
-          && (timerWeekday[9] & 0x01) //timer is enabled
-          && ((timerWeekday[9] >> weekdayMondayFirst()) & 0x01)) //timer should activate at current day of week
-      {
-        unloadPlaylist();
-        applyPreset(timerMacro[9]);
-        DEBUG_PRINTF("Sunset macro %d triggered.",timerMacro[9]);
-      }
-    }
   }
 }
 
@@ -509,4 +469,264 @@ void setTimeFromAPI(uint32_t timein) {
     calculateSunriseAndSunset();
   }
   if (presetsModifiedTime == 0) presetsModifiedTime = timein;
-}
\ No newline at end of file
+}
+
+/*
+ * Timer scheduler ("cues")
+ *
+ * The 10 timers of the time settings page and any number of cues from cfg.json (timers.cue) are fired at their
+ * exact time (millisecond resolution) on the synced clock. Each enabled timer has its next fire time in a priority
+ * queue, so the loop only compares the earliest one with the current time; when it fired, its next time is queued.
+ * The queue is rebuilt when timers, time zone or location change, and when the clock is set or adjusted.
+ * Cues from cfg.json are deserialized and serialized with the JSON buffer lock held (any task), the loop takes
+ * them over under the same lock. The queue itself is only used in the loop.
+ */
+
+#define CUE_ENABLED   0x01
+#define CUE_HOURLY    0x02  // every hour at min:sec.ms
+#define CUE_SUNRISE   0x04  // time is an offset from sunrise
+#define CUE_SUNSET    0x08  // time is an offset from sunset
+#define CUE_MAX_LATE  60000 // ms, cues that are due longer than this (i.e. clock set forward) are skipped
+#define CUE_LEGACY    10    // timerHours[] etc.: 8 timers, sunrise, sunset
+
+typedef struct Cue {
+  int32_t time;     // ms after local midnight (after the full hour if hourly), or offset from sunrise/sunset
+  uint8_t preset;
+  uint8_t flags;
+  uint8_t dow;      // bit 0 = Monday ... bit 6 = Sunday
+  uint8_t months;   // start month << 4 | end month, 0: all year
+  uint8_t dayStart, dayEnd;
+} cue_t;
+
+typedef struct CueTime {
+  uint64_t due;     // synced time in ms
+  uint16_t cue;
+  bool operator>(const CueTime &o) const { return due > o.due || (due == o.due && cue > o.cue); }
+} cue_time_t;
+
+static std::vector<cue_t> cues, pendingCues;  // from cfg.json; pendingCues is filled from any task, taken over in the loop
+static volatile bool cuesPending = false;
+static std::vector<cue_time_t> cueQueue;      // min heap
+static volatile uint32_t cueNextSec = 0;      // synced time (s) of the first cue in the queue, 0 if it is empty
+static uint32_t cueClock = 0, cueMillis = 0;  // synced time and millis() at the last check
+static bool     cueSynced = false;            // time was set when the queue was built
+static uint8_t  cueTz = 255;
+static int      cueUtcOffset = 0;
+static float    cueLat = 0.0f, cueLon = 0.0f;
+static uint32_t cuesFired = 0, cuesSkipped = 0;
+static uint16_t cueLate = 0, cueLateMax = 0;   // ms after the due time
+static float    cueLateAvg = 0.0f;
+
+static uint64_t cueTime() {
+  Toki::Time t = toki.getTime();
+  return (uint64_t)t.sec * 1000 + t.ms;
+}
+
+// the timers of the settings page, as cues
+static bool getLegacyCue(uint8_t i, cue_t &c) {
+  if (!timerMacro[i]) return false;
+  c.preset = timerMacro[i];
+  c.flags  = (timerWeekday[i] & 0x01) ? CUE_ENABLED : 0;
+  c.dow    = timerWeekday[i] >> 1;
+  if (i < 8) {
+    if (timerHours[i] > 24) return false;
+    if (timerHours[i] == 24) c.flags |= CUE_HOURLY; //if hour is set to 24, activate every hour
+    c.time     = ((timerHours[i] % 24) * 60 + timerMinutes[i]) * 60000;
+    if (c.time < 0) return false;
+    c.months   = timerMonth[i];
+    c.dayStart = timerDay[i];
+    c.dayEnd   = timerDayEnd[i];
+  } else {
+    c.flags   |= (i == 8) ? CUE_SUNRISE : CUE_SUNSET;
+    c.time     = timerMinutes[i] * 60000;
+    c.months   = c.dayStart = c.dayEnd = 0;
+  }
+  return true;
+}
+
+static bool getCue(uint16_t i, cue_t &c) {
+  if (i < CUE_LEGACY) return getLegacyCue(i, c);
+  if (i - CUE_LEGACY >= cues.size()) return false;
+  c = cues[i - CUE_LEGACY];
+  return true;
+}
+
+// first time (synced ms) after "after" the cue fires, 0 if it does not within a year
+static uint64_t nextCueTime(const cue_t &c, uint64_t after) {
+  if (!(c.flags & CUE_ENABLED) || !c.dow || !tz) return 0;
+  bool sun = c.flags & (CUE_SUNRISE | CUE_SUNSET);
+  if (sun && !(int)(longitude*10.) && !(int)(latitude*10.)) return 0;
+
+  time_t today = previousMidnight(tz->toLocal(after / 1000 + utcOffsetSecs));
+  for (int d = 0; d < 400; d++) {
+    time_t midnight = today + d * SECS_PER_DAY;
+    byte wd = weekday(midnight) - 1;
+    if (wd == 0) wd = 7; // Monday first
+    if (!((c.dow >> (wd - 1)) & 0x01)) continue;
+    if (!isDayInDateRange(midnight, c.months >> 4, c.dayStart, c.months & 0x0F, c.dayEnd)) continue;
+
+    if (sun) {
+      int minUTC = getSunriseUTC(year(midnight), month(midnight), day(midnight), latitude, longitude, c.flags & CUE_SUNSET);
+      if (!minUTC) continue; // the sun does not rise (set) on this day
+      if (minUTC < 0) minUTC += 24*60; // add a day if negative
+      // midnight is also the UTC midnight of that date; synced time is UTC - utcOffsetSecs, like below
+      int64_t t = ((int64_t)midnight + minUTC * 60 - utcOffsetSecs) * 1000 + c.time;
+      if (t > (int64_t)after) return t;
+      continue;
+    }
+    for (uint8_t h = 0; h < ((c.flags & CUE_HOURLY) ? 24 : 1); h++) {
+      uint32_t ms = c.time + h * 3600000UL;
+      time_t local = midnight + ms / 1000;
+      uint64_t t = (uint64_t)(tz->toUTC(local) - utcOffsetSecs) * 1000 + ms % 1000;
+      if (t > after) return t;
+    }
+  }
+  return 0;
+}
+
+static void queueCue(uint16_t i, uint64_t after) {
+  cue_t c;
+  if (!getCue(i, c)) return;
+  uint64_t t = nextCueTime(c, after);
+  if (!t) return;
+  cueQueue.push_back({t, i});
+  std::push_heap(cueQueue.begin(), cueQueue.end(), std::greater<cue_time_t>());
+}
+
+// after: cues are queued with their first time after this
+static void scheduleCues(uint64_t after) {
+  cuesChanged = false;
+  cueQueue.clear();
+  cueTz = currentTimezone;
+  cueUtcOffset = utcOffsetSecs;
+  cueLat = latitude;
+  cueLon = longitude;
+  cueSynced = toki.getTimeSource() != TOKI_TS_NONE;
+  if (!cueSynced) return; // no timers on the time since boot
+  for (uint16_t i = 0; i < CUE_LEGACY + cues.size(); i++) queueCue(i, after);
+  DEBUG_PRINTF("Scheduled %u cues.\n", cueQueue.size());
+}
+
+void handleCues()
+{
+  uint64_t now = cueTime();
+  uint32_t ms  = millis();
+  int32_t adjusted = (int32_t)(((uint32_t)now - cueClock) - (ms - cueMillis)); // clock was set since the last check
+  cueClock  = now;
+  cueMillis = ms;
+
+  // cues from cfg.json, deserializeCues() and serializeCues() use them with the lock held
+  if (cuesPending && !fileDoc && requestJSONBufferLock(25)) {
+    cues.swap(pendingCues);
+    std::vector<cue_t>().swap(pendingCues);
+    cuesPending = false;
+    releaseJSONBufferLock();
+    cuesChanged = true;
+  }
+
+  bool synced  = toki.getTimeSource() != TOKI_TS_NONE;
+  bool stepped = adjusted > 1000 || adjusted < -1000;
+  if (cuesChanged || stepped || cueSynced != synced
+      || cueTz != currentTimezone || cueUtcOffset != utcOffsetSecs || cueLat != latitude || cueLon != longitude) {
+    // after a step of the synced clock continue from where it would be without the step (limited to a day): cues that
+    // were stepped over are due and fire or count as skipped, cues do not fire twice when the clock was set back
+    uint64_t after = now;
+    if (stepped && cueSynced && synced) after = now - constrain(adjusted, -86400000L, 86400000L);
+    scheduleCues(after);
+  }
+
+  while (!cueQueue.empty() && cueQueue.front().due <= now) {
+    std::pop_heap(cueQueue.begin(), cueQueue.end(), std::greater<cue_time_t>());
+    cue_time_t fired = cueQueue.back();
+    cueQueue.pop_back();
+    cue_t c;
+    if (!getCue(fired.cue, c)) continue;
+
+    uint64_t late = now - fired.due;
+    if (late > CUE_MAX_LATE) {
+      cuesSkipped++;
+    } else {
+      cueLate = late;
+      if (cueLate > cueLateMax) cueLateMax = cueLate;
+      cueLateAvg += ((float)cueLate - cueLateAvg) / 16.0f;
+      cuesFired++;
+      unloadPlaylist();
+      applyPreset(c.preset);
+      DEBUG_PRINTF("Cue %d (preset %d) fired %d ms late.\n", fired.cue, c.preset, cueLate);
+    }
+    queueCue(fired.cue, fired.due);
+  }
+  cueNextSec = cueQueue.empty() ? 0 : cueQueue.front().due / 1000;
+}
+
+// cues in cfg.json (timers.cue), same fields as timers.ins plus "sec", "ms" and "sun" (1: sunrise, 2: sunset)
+void deserializeCues(JsonArray arr)
+{
+  std::vector<cue_t> list;
+  for (JsonObject cue : arr) {
+    if (list.size() >= WLED_MAX_CUES) break;
+    cue_t c = {};
+    c.preset = cue["macro"] | 0;
+    if (!c.preset) continue;
+    int hour = cue[F("hour")] | 0;
+    byte sun = cue[F("sun")] | 0;
+    c.flags = (cue["en"] | 1) ? CUE_ENABLED : 0;
+    if      (sun == 1)   c.flags |= CUE_SUNRISE;
+    else if (sun == 2)   c.flags |= CUE_SUNSET;
+    else if (hour == 24) { c.flags |= CUE_HOURLY; hour = 0; }
+    c.time = ((hour * 60 + (cue["min"] | 0)) * 60 + (cue[F("sec")] | 0)) * 1000 + (cue["ms"] | 0);
+    if (!sun && (c.time < 0 || c.time >= 24*3600000)) continue;
+    c.dow = cue[F("dow")] | 0x7F;
+    JsonObject start = cue["start"];
+    JsonObject end = cue["end"];
+    byte startm = start["mon"] | 0;
+    if (startm) {
+      c.months   = (startm << 4) | ((end["mon"] | 12) & 0x0F);
+      c.dayStart = start["day"] | 1;
+      c.dayEnd   = end["day"] | 31;
+    }
+    list.push_back(c);
+  }
+  pendingCues.swap(list);
+  cuesPending = cuesChanged = true;
+}
+
+void serializeCues(JsonArray arr)
+{
+  for (const cue_t &c : cuesPending ? pendingCues : cues) {
+    JsonObject cue = arr.createNestedObject();
+    cue["en"] = c.flags & CUE_ENABLED;
+    if (c.flags & CUE_SUNRISE) cue[F("sun")] = 1;
+    if (c.flags & CUE_SUNSET)  cue[F("sun")] = 2;
+    int32_t t = c.time;
+    cue[F("hour")] = (c.flags & CUE_HOURLY) ? 24 : t / 3600000;
+    cue["min"]     = t / 60000 % 60;
+    cue[F("sec")]  = t / 1000 % 60;
+    cue["ms"]      = t % 1000;
+    cue["macro"]   = c.preset;
+    cue[F("dow")]  = c.dow;
+    if (c.months) {
+      JsonObject start = cue.createNestedObject("start");
+      start["mon"] = c.months >> 4;
+      start["day"] = c.dayStart;
+      JsonObject end = cue.createNestedObject("end");
+      end["mon"] = c.months & 0x0F;
+      end["day"] = c.dayEnd;
+    }
+  }
+}
+
+// may run on the async task, only uses scalars
+void serializeCueStats(JsonObject root)
+{
+  uint32_t next = cueNextSec;
+  if (!next && !cuesFired) return;
+  JsonObject cs = root.createNestedObject(F("cues"));
+  cs["n"]       = cuesFired;
+  cs[F("skip")] = cuesSkipped;  // due while the clock was set forward
+  cs[F("late")] = cueLate;      // last cue: ms after its time
+  cs[F("lavg")] = (int)(cueLateAvg + 0.5f);
+  cs[F("lmax")] = cueLateMax;
+  uint32_t sec = toki.getTime().sec;
+  if (next) cs[F("next")] = next > sec ? next - sec : 0; // seconds
+}
@@ -2,102 +2,182 @@
 
 /*
  * Handles playlists, timed sequences of presets
+ *
+ * Entries are scheduled on the synced time line (toki), each one starts exactly one duration after the previous
+ * one was due, so instances with synced time that start a playlist at the same moment ("at" or "align") switch
+ * entries together and do not drift apart. loadPlaylist() (which may run on the async task) only stores the top
+ * level entries; the loop then expands nested playlists and reads the presets of all entries into RAM ahead of
+ * time, so a step does not need file access.
  */
 
+#define PLE_NESTED   0x01   // entry is a playlist, its entries follow it
+#define PLE_EXPANDED 0x02   // entry comes from a nested playlist (not saved)
+
+#ifdef ESP8266
+  #define PLAYLIST_NESTED_DOC 2048
+#else
+  #define PLAYLIST_NESTED_DOC 8192
+#endif
+
 typedef struct PlaylistEntry {
-  uint8_t preset; //ID of the preset to apply
-  uint16_t dur;   //Duration of the entry (in tenths of seconds)
-  uint16_t tr;    //Duration of the transition TO this entry (in tenths of seconds)
+  uint32_t dur;    //Duration of the entry (in milliseconds)
+  uint16_t tr;     //Duration of the transition TO this entry (in milliseconds)
+  uint8_t preset;  //ID of the preset to apply
+  uint8_t flags;
 } ple;
 
 byte           playlistRepeat = 1;        //how many times to repeat the playlist (0 = infinitely)
 byte           playlistEndPreset = 0;     //what preset to apply after playlist end (0 = stay on last preset)
 byte           playlistOptions = 0;       //bit 0: shuffle playlist after each iteration. bits 1-7 TBD
 
-PlaylistEntry *playlistEntries = nullptr;
-byte           playlistLen;               //number of playlist entries
-int8_t         playlistIndex = -1;
-uint16_t       playlistEntryDur = 0;      //duration of the current entry in tenths of seconds
+std::vector<PlaylistEntry> playlistEntries;
+int16_t        playlistIndex = -1;
+
+static uint32_t playlistNext = 0;         // synced time (ms) when the next entry is due
+static uint32_t playlistCycle = 0;        // duration of one pass through the playlist (ms)
+static uint16_t playlistAlign = 0;        // start on a multiple of this (ms) of the synced time
+static bool     playlistAbsolute = false; // started at a given time ("at"), follows clock adjustments
+static uint32_t playlistAt = 0;           // unix time given with "at"
+static volatile bool playlistLoaded = false; // set by loadPlaylist(), the loop expands and starts the playlist
+static uint32_t playlistClock = 0, playlistMillis = 0; // synced time and millis() at the last check
+
+
+// synced time in milliseconds, wraps around; the same on all instances with synced time
+static uint64_t playlistTime() {
+  Toki::Time t = toki.getTime();
+  return (uint64_t)t.sec * 1000 + t.ms;
+}
+
+// "dur" and "transition" are given in tenths of seconds, fractions are allowed
+static uint32_t tenthsToMs(float tenths, uint32_t max) {
+  if (tenths <= 0.0f) return 0;
+  float ms = tenths * 100.0f + 0.5f;
+  return ms < max ? ms : max;
+}
+
+static void addTenths(JsonArray arr, uint32_t ms) {
+  if (ms % 100) arr.add(ms / 100.0f);
+  else          arr.add(ms / 100);
+}
 
-//values we need to keep about the parent playlist while inside sub-playlist
-//int8_t         parentPlaylistIndex = -1;
-//byte           parentPlaylistRepeat = 0;
-//byte           parentPlaylistPresetId = 0; //for re-loading
+static bool addNestedPlaylist(byte preset, uint8_t depth, uint32_t* notPlaylist);
 
+// reads the entries of a playlist object into level
+static void readPlaylistEntries(JsonObject playlistObj, uint8_t flags, std::vector<PlaylistEntry> &level) {
+  JsonArray presets = playlistObj["ps"];
+  JsonArray durations = playlistObj["dur"];
+  JsonArray transitions = playlistObj[F("transition")];
 
+  float dur = 100; //10 seconds as fallback
+  float tr  = transitionDelay / 100.0f;
+  if (durations.isNull())   dur = playlistObj["dur"] | dur;
+  if (transitions.isNull()) tr  = playlistObj[F("transition")] | tr;
+
+  // missing durations and transitions repeat the last one given
+  JsonArray::iterator d = durations.begin(), t = transitions.begin();
+  for (JsonVariant ps : presets) {
+    if (playlistEntries.size() + level.size() >= WLED_MAX_PLAYLIST_ENTRIES) break;
+    if (d != durations.end())   { dur = d->as<float>(); ++d; }
+    if (t != transitions.end()) { tr  = t->as<float>(); ++t; }
+    uint32_t ms = tenthsToMs(dur, INT32_MAX / 2);
+    level.push_back({ms ? ms : 10000, (uint16_t)tenthsToMs(tr, UINT16_MAX), ps.as<uint8_t>(), flags});
+  }
+}
+
+// appends entries, and after each entry that is a playlist itself the entries of that one
+static void addPlaylistEntries(const std::vector<PlaylistEntry> &level, uint8_t depth, uint32_t* notPlaylist) {
+  for (const PlaylistEntry &e : level) {
+    if (playlistEntries.size() >= WLED_MAX_PLAYLIST_ENTRIES) break;
+    size_t pos = playlistEntries.size();
+    playlistEntries.push_back(e);
+    if (depth < PLAYLIST_MAX_DEPTH && addNestedPlaylist(e.preset, depth + 1, notPlaylist)) playlistEntries[pos].flags |= PLE_NESTED;
+  }
+}
+
+// appends the entries of preset if it is a playlist; its repetitions are unrolled (endless counts as once),
+// its shuffle option and end preset are ignored
+static bool addNestedPlaylist(byte preset, uint8_t depth, uint32_t* notPlaylist) {
+  if (!preset || preset > 250 || (notPlaylist[preset >> 5] & (1UL << (preset & 0x1F)))) return false;
+  char *text = readObjectTextFromFileUsingId("/presets.json", preset);
+  if (!text) return false;
+  DynamicJsonDocument nested(PLAYLIST_NESTED_DOC);
+  StaticJsonDocument<64> filter;
+  filter[F("playlist")] = true;
+  DeserializationError error = deserializeJson(nested, (const char*)text, DeserializationOption::Filter(filter));
+  free(text);
+  JsonObject playlistObj = nested[F("playlist")];
+  if (error || playlistObj.isNull() || !playlistObj["ps"].size()) {
+    notPlaylist[preset >> 5] |= 1UL << (preset & 0x1F); // entries often repeat a preset, read it only once
+    return false;
+  }
+
+  size_t start = playlistEntries.size();
+  std::vector<PlaylistEntry> level;
+  readPlaylistEntries(playlistObj, PLE_EXPANDED, level);
+  addPlaylistEntries(level, depth, notPlaylist);
+  size_t len = playlistEntries.size() - start;
+  int rep = playlistObj[F("repeat")];
+  for (int r = 1; r < rep && playlistEntries.size() + len <= WLED_MAX_PLAYLIST_ENTRIES; r++) {
+    for (size_t i = 0; i < len; i++) {
+      PlaylistEntry e = playlistEntries[start + i]; // copy, push_back may reallocate
+      playlistEntries.push_back(e);
+    }
+  }
+  DEBUG_PRINTF("Nested playlist %d: %u entries\n", preset, playlistEntries.size() - start);
+  return len > 0;
+}
+
+
+// shuffles the top level entries, an entry that is a playlist keeps its entries with it
 void shufflePlaylist() {
-  int currentIndex = playlistLen;
-  PlaylistEntry temporaryValue;
+  std::vector<uint16_t> blocks; // index of the first entry of each block
+  for (size_t i = 0; i < playlistEntries.size(); i++) {
+    if (!(playlistEntries[i].flags & PLE_EXPANDED)) blocks.push_back(i);
+  }
+  int currentIndex = blocks.size();
 
   // While there remain elements to shuffle...
   while (currentIndex--) {
     // Pick a random element...
     int randomIndex = random(0, currentIndex);
     // And swap it with the current element.
-    temporaryValue = playlistEntries[currentIndex];
-    playlistEntries[currentIndex] = playlistEntries[randomIndex];
-    playlistEntries[randomIndex] = temporaryValue;
+    std::swap(blocks[currentIndex], blocks[randomIndex]);
+  }
+
+  std::vector<PlaylistEntry> shuffled;
+  shuffled.reserve(playlistEntries.size());
+  for (uint16_t start : blocks) {
+    size_t i = start;
+    do shuffled.push_back(playlistEntries[i++]);
+    while (i < playlistEntries.size() && (playlistEntries[i].flags & PLE_EXPANDED));
   }
+  playlistEntries.swap(shuffled);
   DEBUG_PRINTLN(F("Playlist shuffle."));
 }
 
 
 void unloadPlaylist() {
-  if (playlistEntries != nullptr) {
-    delete[] playlistEntries;
-    playlistEntries = nullptr;
-  }
+  playlistEntries.clear();
+  playlistEntries.shrink_to_fit();
   currentPlaylist = playlistIndex = -1;
-  playlistLen = playlistEntryDur = playlistOptions = 0;
+  playlistOptions = 0;
+  playlistCycle = playlistAlign = 0;
+  playlistAt = 0;
+  playlistAbsolute = false;
+  playlistLoaded = false;
+  prefetchPreset(0);
   DEBUG_PRINTLN(F("Playlist unloaded."));
 }
 
 
+// stores the top level entries and options, the loop expands and starts the playlist (see startPlaylist())
 int16_t loadPlaylist(JsonObject playlistObj, byte presetId) {
   unloadPlaylist();
 
-  JsonArray presets = playlistObj["ps"];
-  playlistLen = presets.size();
-  if (playlistLen == 0) return -1;
-  if (playlistLen > 100) playlistLen = 100;
-
-  playlistEntries = new PlaylistEntry[playlistLen];
-  if (playlistEntries == nullptr) return -1;
-
-  byte it = 0;
-  for (int ps : presets) {
-    if (it >= playlistLen) break;
-    playlistEntries[it].preset = ps;
-    it++;
-  }
-
-  it = 0;
-  JsonArray durations = playlistObj["dur"];
-  if (durations.isNull()) {
-    playlistEntries[0].dur = playlistObj["dur"] | 100; //10 seconds as fallback
-    it = 1;
-  } else {
-    for (int dur : durations) {
-      if (it >= playlistLen) break;
-      playlistEntries[it].dur = (dur > 1) ? dur : 100;
-      it++;
-    }
-  }
-  for (int i = it; i < playlistLen; i++) playlistEntries[i].dur = playlistEntries[it -1].dur;
-
-  it = 0;
-  JsonArray tr = playlistObj[F("transition")];
-  if (tr.isNull()) {
-    playlistEntries[0].tr = playlistObj[F("transition")] | (transitionDelay / 100);
-    it = 1;
-  } else {
-    for (int transition : tr) {
-      if (it >= playlistLen) break;
-      playlistEntries[it].tr = transition;
-      it++;
-    }
-  }
-  for (int i = it; i < playlistLen; i++) playlistEntries[i].tr = playlistEntries[it -1].tr;
+  std::vector<PlaylistEntry> top;
+  readPlaylistEntries(playlistObj, 0, top);
+  if (top.empty()) return -1;
+  playlistEntries.swap(top);
 
   int rep = playlistObj[F("repeat")];
   bool shuffle = false;
@@ -113,41 +193,147 @@ int16_t loadPlaylist(JsonObject playlistObj, byte presetId) {
   if (playlistEndPreset > 250) playlistEndPreset = 0;
   shuffle = shuffle || playlistObj["r"];
   if (shuffle) playlistOptions += PL_OPTION_SHUFFLE;
+  playlistAt    = playlistObj[F("at")] | 0;
+  playlistAlign = playlistObj[F("align")] | 0;
 
   currentPlaylist = presetId;
-  DEBUG_PRINTLN(F("Playlist loaded."));
+  playlistLoaded = true;
+  DEBUG_PRINTF("Playlist loaded: %u entries.\n", playlistEntries.size());
   return currentPlaylist;
 }
 
 
-void handlePlaylist() {
-  static unsigned long presetCycledTime = 0;
-  // if fileDoc is not null JSON buffer is in use so just quit
-  if (currentPlaylist < 0 || playlistEntries == nullptr || fileDoc != nullptr) return;
+// called from the loop with the JSON buffer lock held (reads presets.json): expands nested playlists,
+// pins the presets of all entries and sets the start time, false if nothing is left to play
+static bool startPlaylist() {
+  std::vector<PlaylistEntry> top;
+  top.swap(playlistEntries);
+  uint32_t notPlaylist[8] = {0};
+  if (currentPlaylist > 0 && currentPlaylist < 251) notPlaylist[currentPlaylist >> 5] |= 1UL << (currentPlaylist & 0x1F); // do not expand itself
+  addPlaylistEntries(top, 0, notPlaylist);
+
+  uint64_t cycle = 0;
+  for (const PlaylistEntry &e : playlistEntries) {
+    if (e.flags & PLE_NESTED) continue;
+    cycle += e.dur;
+    pinPreset(e.preset); // read all presets of the playlist into RAM
+  }
+  if (!cycle) return false; // only nested playlists that got truncated
+  playlistCycle = MIN(cycle, INT32_MAX);
 
-  if (millis() - presetCycledTime > (100*playlistEntryDur)) {
-    presetCycledTime = millis();
-    if (bri == 0 || nightlightActive) return;
+  // start now, on the next multiple of "align" ms, or at the unix time "at" (which may be in the past to join a running show)
+  uint64_t now = playlistTime();
+  uint64_t start = now;
+  if (playlistAt) {
+    start = (uint64_t)playlistAt * 1000;
+    playlistAbsolute = true;
+    if (start < now) { // skip whole passes, handlePlaylist() steps through the remaining part
+      uint64_t behind = now - start;
+      uint64_t passes = behind / playlistCycle;
+      if (playlistRepeat) passes = MIN(passes, (uint64_t)playlistRepeat - 1);
+      start += passes * playlistCycle;
+      if (playlistRepeat) playlistRepeat -= passes;
+    }
+  } else if (playlistAlign) {
+    start = now + playlistAlign - now % playlistAlign;
+  }
+  playlistNext   = start;
+  playlistClock  = now;
+  playlistMillis = millis();
+  DEBUG_PRINTF("Playlist started: %u entries.\n", playlistEntries.size());
+  return true;
+}
 
-    ++playlistIndex %= playlistLen; // -1 at 1st run (limit to playlistLen)
+
+// moves playlistIndex to the next entry to apply, false at the end of the playlist
+static bool nextPlaylistEntry() {
+  for (size_t i = 0; i <= playlistEntries.size(); i++) {
+    playlistIndex = (playlistIndex + 1) % playlistEntries.size(); // -1 at 1st run
 
     // playlist roll-over
     if (!playlistIndex) {
-      if (playlistRepeat == 1) { //stop if all repetitions are done
-        unloadPlaylist();
-        if (playlistEndPreset) applyPreset(playlistEndPreset);
-        return;
-      }
+      if (playlistRepeat == 1) return false; //stop if all repetitions are done
       if (playlistRepeat > 1) playlistRepeat--; // decrease repeat count on each index reset if not an endless playlist
       // playlistRepeat == 0: endless loop
       if (playlistOptions & PL_OPTION_SHUFFLE) shufflePlaylist(); // shuffle playlist and start over
     }
+    if (!(playlistEntries[playlistIndex].flags & PLE_NESTED)) return true;
+  }
+  return false;
+}
 
-    jsonTransitionOnce = true;
-    transitionDelayTemp = playlistEntries[playlistIndex].tr * 100;
-    playlistEntryDur = playlistEntries[playlistIndex].dur;
-    applyPreset(playlistEntries[playlistIndex].preset);
+
+void handlePlaylist() {
+  // if fileDoc is not null JSON buffer is in use (loadPlaylist() may be running) so just quit
+  if (currentPlaylist < 0 || playlistEntries.empty() || fileDoc != nullptr) return;
+
+  if (playlistLoaded) {
+    if (!requestJSONBufferLock(24)) return; // presets.json must not be written meanwhile
+    playlistLoaded = false;
+    bool started = startPlaylist();
+    releaseJSONBufferLock();
+    if (!started) {
+      unloadPlaylist();
+      return;
+    }
+  }
+
+  uint32_t now = playlistTime();
+  uint32_t ms  = millis();
+  // the synced clock was set (i.e. first NTP sync): a playlist started at a given time follows it, others keep their pace
+  int32_t adjusted = (int32_t)((now - playlistClock) - (ms - playlistMillis));
+  if (!playlistAbsolute && (adjusted > 1000 || adjusted < -1000)) playlistNext += adjusted;
+  playlistClock  = now;
+  playlistMillis = ms;
+
+  // while the light is off the playlist pauses, its current entry runs for its full time once the light is on again;
+  // a playlist started with "at" or "align" keeps going instead, to stay in lockstep with the other devices
+  if (!playlistAt && !playlistAlign && (bri == 0 || nightlightActive)) {
+    if ((int32_t)(now - playlistNext) >= 0) playlistNext = now + (playlistIndex < 0 ? 0 : playlistEntries[playlistIndex].dur);
+    return;
+  }
+
+  if ((int32_t)(now - playlistNext) < 0) return;
+
+  // an endless playlist that fell behind by more than a pass (realtime mode, clock adjustment) skips the whole passes
+  uint32_t behind = now - playlistNext;
+  if (!playlistRepeat && !(playlistOptions & PL_OPTION_SHUFFLE) && behind > playlistCycle) {
+    playlistNext += behind - behind % playlistCycle;
+  }
+
+  // step to the entry that is due now; entries that ended meanwhile are skipped without being applied
+  // (a synced playlist keeps going while the light is off, so it is on schedule when turned on again;
+  // if it ends meanwhile the end preset is not applied, it must not turn the light on at an arbitrary time)
+  do {
+    if (!nextPlaylistEntry()) {
+      byte endPreset = playlistEndPreset;
+      unloadPlaylist();
+      if (endPreset && bri && !nightlightActive) applyPreset(endPreset);
+      return;
+    }
+    playlistNext += playlistEntries[playlistIndex].dur;
+  } while ((int32_t)(now - playlistNext) >= 0);
+
+  if (bri == 0 || nightlightActive) return;
+
+  jsonTransitionOnce = true;
+  transitionDelayTemp = playlistEntries[playlistIndex].tr;
+  applyPreset(playlistEntries[playlistIndex].preset);
+
+  // read the next entry while this one is running (if it is not in RAM already)
+  byte next = 0;
+  for (size_t i = playlistIndex + 1; i < playlistEntries.size() && !next; i++) {
+    if (!(playlistEntries[i].flags & PLE_NESTED)) next = playlistEntries[i].preset;
+  }
+  if (!next) {
+    if (playlistRepeat == 1) next = playlistEndPreset;
+    else if (!(playlistOptions & PL_OPTION_SHUFFLE)) {
+      for (size_t i = 0; i < playlistEntries.size() && !next; i++) {
+        if (!(playlistEntries[i].flags & PLE_NESTED)) next = playlistEntries[i].preset;
+      }
+    }
   }
+  if (next) prefetchPreset(next);
 }
 
 
@@ -159,9 +345,11 @@ void serializePlaylist(JsonObject sObj) {
   playlist[F("repeat")] = (playlistIndex < 0) ? playlistRepeat - 1 : playlistRepeat; // remove added repetition count (if not yet running)
   playlist["end"] = playlistEndPreset;
   playlist["r"] = playlistOptions & PL_OPTION_SHUFFLE;
-  for (int i=0; i<playlistLen; i++) {
-    ps.add(playlistEntries[i].preset);
-    dur.add(playlistEntries[i].dur);
-    transition.add(playlistEntries[i].tr);
+  if (playlistAlign) playlist[F("align")] = playlistAlign;
+  for (const PlaylistEntry &e : playlistEntries) {
+    if (e.flags & PLE_EXPANDED) continue; // nested playlists are saved as their preset ID
+    ps.add(e.preset);
+    addTenths(dur, e.dur);
+    addTenths(transition, e.tr);
   }
 }
@@ -16,10 +16,139 @@ static char quickLoad[9];
 static char saveName[33];
 static bool includeBri = true, segBounds = true, selectedOnly = false, playlistSave = false;;
 
+// preset apply latency (ms), from the request to the applied state
+static unsigned long presetRequestTime = 0;
+static uint32_t presetsApplied = 0;
+static uint16_t presetReadTime = 0, presetApplyTime = 0, presetApplyMax = 0;
+
+// presets read ahead of time (the next playlist entry, and the entries of a running playlist)
+// so that applying them does not need file access; the JSON text is kept, applying it still parses it
+// and runs deserializeState() (the bundled ArduinoJson has no compact binary format, a parsed document
+// per slot would take several times the RAM). Only presets with a snapshot skip both.
+#ifdef ESP8266
+  #define PRESET_TEXT_SLOTS 2
+#else
+  #define PRESET_TEXT_SLOTS 8
+#endif
+
+typedef struct PresetText {
+  char         *text;
+  unsigned long modified;  // presetsModifiedTime when it was read
+  byte          preset;
+} preset_text_t;
+
+static preset_text_t presetTexts[PRESET_TEXT_SLOTS] = {};
+static volatile byte presetToPrefetch = 0;           // read next, kept until applied
+static volatile uint32_t presetsPinned[8] = {0};     // bit per preset id: read and kept until prefetchPreset(0)
+static volatile uint32_t presetsToRead[8] = {0};     // pinned presets that have not been read yet
+static volatile uint32_t presetsStale[8]  = {0};     // set from any task, texts are freed in the loop
+static volatile bool allPresetsStale = false;
+static volatile bool presetsUnpin = false;           // set by prefetchPreset(0) from any task, pins are dropped in the loop
+static uint32_t presetsPrefetched = 0;         // applied from a text read ahead of time
+static uint32_t presetsFromSnapshot = 0;       // applied from a binary snapshot
+
 static const char *getFileName(bool persist = true) {
   return persist ? "/presets.json" : "/tmp.json";
 }
 
+static inline bool presetBit(const volatile uint32_t* bits, byte index) { return bits[index >> 5] & (1UL << (index & 0x1F)); }
+static inline void setPresetBit(volatile uint32_t* bits, byte index)     { bits[index >> 5] |= 1UL << (index & 0x1F); }
+static inline void clearPresetBit(volatile uint32_t* bits, byte index)   { bits[index >> 5] &= ~(1UL << (index & 0x1F)); }
+
+static int findPresetText(byte index) {
+  for (size_t i = 0; i < PRESET_TEXT_SLOTS; i++) {
+    if (presetTexts[i].text && presetTexts[i].preset == index) return i;
+  }
+  return -1;
+}
+
+static void freePresetText(int slot) {
+  free(presetTexts[slot].text);
+  presetTexts[slot].text = nullptr;
+  presetTexts[slot].preset = 0;
+}
+
+// pins are only changed in the loop, the bit operations are not atomic
+static void unpinPresets() {
+  if (!presetsUnpin) return;
+  presetsUnpin = false;
+  for (size_t i = 0; i < 8; i++) presetsPinned[i] = presetsToRead[i] = 0;
+}
+
+// frees texts whose preset changed, pinned presets are read again
+static void dropStalePresetTexts() {
+  uint32_t stale[8];
+  for (size_t i = 0; i < 8; i++) {
+    stale[i] = presetsStale[i];
+    presetsStale[i] = 0;
+  }
+  bool all = allPresetsStale;
+  allPresetsStale = false;
+  for (size_t i = 0; i < PRESET_TEXT_SLOTS; i++) {
+    byte index = presetTexts[i].preset;
+    if (!presetTexts[i].text) continue;
+    if (!all && !presetBit(stale, index) && presetTexts[i].modified == presetsModifiedTime) continue;
+    freePresetText(i);
+    if (presetBit(presetsPinned, index)) setPresetBit(presetsToRead, index);
+  }
+}
+
+// the JSON of a preset is about to change (index 0: presets.json as a whole)
+static void presetChanged(byte index) {
+  if (index) setPresetBit(presetsStale, index);
+  else       allPresetsStale = true;
+  dropSnapshot(index);
+}
+
+// slot for the text of a preset: a free one, or one that is not pinned; pinned presets leave one slot for prefetching
+static int presetTextSlot(bool pinned) {
+  int empty = -1, unpinned = -1;
+  size_t used = 0; // by pinned presets
+  for (size_t i = 0; i < PRESET_TEXT_SLOTS; i++) {
+    if (!presetTexts[i].text)                                  empty = i;
+    else if (presetBit(presetsPinned, presetTexts[i].preset)) used++;
+    else                                                       unpinned = i;
+  }
+  if (pinned && used >= PRESET_TEXT_SLOTS - 1) return -1;
+  if (empty >= 0) return empty;
+  if (unpinned >= 0) freePresetText(unpinned);
+  return unpinned;
+}
+
+// reads the preset requested by prefetchPreset(), or one of the pinned presets
+// it is done right after a frame was shown so that the file access does not delay the next one
+static void doPrefetchPreset() {
+  if (millis() - strip.getLastShow() > strip.getFrameTime() / 2) return; // wait for the next frame
+  byte index = presetToPrefetch;
+  presetToPrefetch = 0;
+  if (!index) {
+    for (size_t i = 0; i < 8 && !index; i++) if (presetsToRead[i]) index = (i << 5) + __builtin_ctz(presetsToRead[i]);
+    if (!index) return;
+    clearPresetBit(presetsToRead, index);
+  }
+  if (findPresetText(index) >= 0 || hasSnapshot(index)) return; // nothing to read
+  int slot = presetTextSlot(presetBit(presetsPinned, index));
+  if (slot < 0) return; // read when it is applied
+  #ifdef WLED_DEBUG
+  unsigned long start = millis();
+  #endif
+  if (!requestJSONBufferLock(9)) return; // presets.json must not be written meanwhile
+  char *text = readObjectTextFromFileUsingId(getFileName(), index);
+  releaseJSONBufferLock();
+  if (!text) return;
+  // make sure it parses, the apply stage can then use it without further checks
+  StaticJsonDocument<16> filter, check;
+  filter.to<JsonObject>(); // keeps nothing, only validates
+  if (deserializeJson(check, (const char*)text, DeserializationOption::Filter(filter))) {
+    free(text);
+    return;
+  }
+  presetTexts[slot].text     = text;
+  presetTexts[slot].preset   = index;
+  presetTexts[slot].modified = presetsModifiedTime;
+  DEBUG_PRINTF("Prefetched preset %d in %lu ms\n", index, millis() - start);
+}
+
 static void doSaveState() {
   bool persist = (presetToSave < 251);
   const char *filename = getFileName(persist);
@@ -67,7 +196,12 @@ static void doSaveState() {
   #endif
   writeObjectToFileUsingId(filename, presetToSave, fileDoc);
 
-  if (persist) presetsModifiedTime = toki.second(); //unix time
+  if (persist) {
+    presetsModifiedTime = toki.second(); //unix time
+    presetChanged(presetToSave);
+    // a preset of the complete current state can be applied from a snapshot
+    if (!playlistSave && includeBri && segBounds && !selectedOnly && saveLedmap < 0) createSnapshot(presetToSave, bri > 0, briLast, transitionDelay/100);
+  }
   releaseJSONBufferLock();
   updateFSInfo();
 
@@ -117,9 +251,31 @@ bool applyPreset(byte index, byte callMode)
   DEBUG_PRINTLN(index);
   presetToApply = index;
   callModeToApply = callMode;
+  presetRequestTime = millis();
   return true;
 }
 
+// request to read a preset ahead of the applyPreset() call for it (0: drop all presets read ahead, including pinned ones)
+void prefetchPreset(byte index)
+{
+  if (index > 250) return; // the temporary preset is kept in RAM anyway (ESP32)
+  if (!index) {
+    presetsUnpin = true;
+    allPresetsStale = true;
+  }
+  presetToPrefetch = index;
+}
+
+// request to read a preset and keep it in RAM until prefetchPreset(0), i.e. an entry of a running playlist
+// must be called from the loop (handlePlaylist())
+void pinPreset(byte index)
+{
+  if (!index || index > 250) return;
+  unpinPresets(); // a prefetchPreset(0) before this call applies to the previous playlist
+  setPresetBit(presetsPinned, index);
+  setPresetBit(presetsToRead, index);
+}
+
 void handlePresets()
 {
   if (presetToSave) {
@@ -127,6 +283,17 @@ void handlePresets()
     return;
   }
 
+  if (presetToApply == 0 && !fileDoc) {
+    unpinPresets();
+    dropStalePresetTexts();
+    if (millis() - strip.getLastShow() < strip.getFrameTime() / 2) { // right after a frame, like prefetching
+      handleSnapshots();
+      handlePresetLog();
+    }
+    doPrefetchPreset();
+    return;
+  }
+
   if (presetToApply == 0 || fileDoc) return; // no preset waiting to apply, or JSON buffer is already allocated, return to loop until free
 
   bool changePreset = false;
@@ -144,6 +311,27 @@ void handlePresets()
 
   DEBUG_PRINT(F("Applying preset: "));
   DEBUG_PRINTLN(tmpPreset);
+  unsigned long requestTime = presetRequestTime; // deserializeState() may request the next preset
+  unsigned long readStart = millis();
+
+  dropStalePresetTexts();
+  int text = tmpPreset < 251 ? findPresetText(tmpPreset) : -1;
+  bool keepText = presetBit(presetsPinned, tmpPreset); // playlist entry, stays in RAM
+
+  if (tmpPreset < 251 && applySnapshot(tmpPreset)) {
+    if (text >= 0 && !keepText) freePresetText(text);
+    presetCycCurr = currentPreset = tmpPreset;
+    releaseJSONBufferLock();
+    presetReadTime = 0;
+    presetApplyTime = MIN(millis() - requestTime, UINT16_MAX);
+    if (presetApplyTime > presetApplyMax) presetApplyMax = presetApplyTime;
+    presetsApplied++;
+    presetsFromSnapshot++;
+    notify(tmpMode); // force UDP notification
+    stateUpdated(tmpMode);
+    updateInterfaces(tmpMode);
+    return;
+  }
 
   #ifdef ARDUINO_ARCH_ESP32
   if (tmpPreset==255 && tmpRAMbuffer!=nullptr) {
@@ -151,10 +339,16 @@ void handlePresets()
     errorFlag = ERR_NONE;
   } else
   #endif
-  {
-  errorFlag = readObjectFromFileUsingId(filename, tmpPreset, fileDoc) ? ERR_NONE : ERR_FS_PLOAD;
+  if (text >= 0) {
+    deserializeJson(*fileDoc, (const char*)presetTexts[text].text); // already validated, saves the file access only
+    if (!keepText) freePresetText(text);
+    presetsPrefetched++;
+    errorFlag = ERR_NONE;
+  } else {
+    errorFlag = readObjectFromFileUsingId(filename, tmpPreset, fileDoc) ? ERR_NONE : ERR_FS_PLOAD;
   }
   fdo = fileDoc->as<JsonObject>();
+  presetReadTime = MIN(millis() - readStart, UINT16_MAX);
 
   //HTTP API commands
   const char* httpwin = fdo["win"];
@@ -168,7 +362,9 @@ void handlePresets()
   } else {
     if (!fdo["seg"].isNull() || !fdo["on"].isNull() || !fdo["bri"].isNull() || !fdo["nl"].isNull() || !fdo["ps"].isNull() || !fdo[F("playlist")].isNull()) changePreset = true;
     fdo.remove("ps"); //remove load request for presets to prevent recursive crash
+    bool snapshot = tmpPreset < 251 && isSnapshotState(fdo); // check before deserializeState() modifies fdo
     deserializeState(fdo, CALL_MODE_NO_NOTIFY, tmpPreset); // may change presetToApply by calling applyPreset()
+    if (snapshot && !errorFlag) createSnapshot(tmpPreset, fdo["on"], fdo["bri"], fdo[F("transition")] | -1);
   }
   if (!errorFlag && tmpPreset < 255 && changePreset) presetCycCurr = currentPreset = tmpPreset;
 
@@ -181,6 +377,9 @@ void handlePresets()
   #endif
 
   releaseJSONBufferLock(); // will also clear fileDoc
+  presetApplyTime = MIN(millis() - requestTime, UINT16_MAX);
+  if (presetApplyTime > presetApplyMax) presetApplyMax = presetApplyTime;
+  presetsApplied++;
   if (changePreset) notify(tmpMode); // force UDP notification
   stateUpdated(tmpMode);  // was colorUpdated() if anything breaks
   updateInterfaces(tmpMode);
@@ -220,6 +419,7 @@ void savePreset(byte index, const char* pname, JsonObject sObj)
       sObj.remove(F("psave"));
       if (sObj["n"].isNull()) sObj["n"] = saveName;
       initPresetsFile(); // just in case if someone deleted presets.json using /edit
+      presetChanged(index);
       writeObjectToFileUsingId(getFileName(index<255), index, fileDoc);
       presetsModifiedTime = toki.second(); //unix time
       updateFSInfo();
@@ -234,7 +434,20 @@ void savePreset(byte index, const char* pname, JsonObject sObj)
 
 void deletePreset(byte index) {
   StaticJsonDocument<24> empty;
+  presetChanged(index);
   writeObjectToFileUsingId(getFileName(), index, &empty);
   presetsModifiedTime = toki.second(); //unix time
   updateFSInfo();
-}
\ No newline at end of file
+}
+
+void serializePresetStats(JsonObject root)
+{
+  if (!presetsApplied) return;
+  JsonObject ps = root.createNestedObject(F("pstat"));
+  ps["n"]       = presetsApplied;
+  ps[F("pf")]   = presetsPrefetched; // of those, read ahead of time
+  ps[F("sn")]   = presetsFromSnapshot; // of those, applied from a binary snapshot
+  ps[F("rd")]   = presetReadTime;  // last preset: reading from file
+  ps[F("ap")]   = presetApplyTime; // last preset: request to applied
+  ps[F("amax")] = presetApplyMax;
+}
@@ -0,0 +1,368 @@
+#include "wled.h"
+
+/*
+ * Realtime jitter buffer
+ * Holds up to realtimeBufferDepth complete frames received via network realtime protocols
+ * (UDP, Hyperion, E1.31, Art-Net, TPM2.NET, DDP) and plays them out at the measured input rate.
+ * If a frame arrives late, the output is cross-faded from the held frame to the late one
+ * instead of jumping to it.
+ */
+
+#ifdef ESP8266
+  #define RTB_MAX_DEPTH 3
+#else
+  #define RTB_MAX_DEPTH 8
+#endif
+#define RTB_MIN_INTERVAL  8     // ms, fastest playout rate
+#define RTB_MAX_INTERVAL  250   // ms, slowest playout rate (input gaps above this are ignored for rate measurement)
+
+// The protocol handlers (E1.31, Art-Net and DDP run on the network task on ESP32) fill rtbIngest and the ring,
+// the loop plays frames out. Both sides only touch the ring block under rtbMux; the loop copies frames out of it
+// into its own playout block (rtbShown, rtbTarget) and renders from there.
+static uint32_t* rtbIngest   = nullptr; // frame currently being assembled by the protocol handlers, start of the ring block
+static uint32_t* rtbRing     = nullptr; // realtimeBufferDepth frames waiting for playout
+static volatile uint16_t rtbLen   = 0;  // pixels per frame
+static uint8_t   rtbSlots    = 0;       // number of allocated ring slots
+static uint8_t   rtbHead     = 0;       // next frame to play
+static volatile uint8_t rtbFill   = 0;  // number of frames waiting
+static volatile uint32_t rtbInterval = 0;        // measured input frame interval in 1/16 ms
+static volatile unsigned long rtbLastCommit = 0;
+static unsigned long rtbArrival[RTB_MAX_DEPTH]; // arrival time of buffered frames (for statistics)
+static bool      rtbAllocFailed = false;        // no retries until the realtime session ends
+#ifdef ARDUINO_ARCH_ESP32
+static portMUX_TYPE rtbMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// loop only
+static uint32_t* rtbShown    = nullptr; // frame currently displayed (source for cross-fades), start of the playout block
+static uint32_t* rtbTarget   = nullptr; // late frame being faded in
+static uint16_t  rtbShownLen = 0;       // pixels per frame of the playout block
+static bool      rtbPlaying  = false;   // prefill done, playout running
+static bool      rtbLate     = false;   // playout tick passed without a frame
+static bool      rtbFading   = false;   // cross-fade from rtbShown to rtbTarget in progress
+static unsigned long rtbNextPlayout = 0;
+static unsigned long rtbFadeStart   = 0;
+static unsigned long rtbTargetArrival = 0;
+
+// statistics
+static uint32_t rtbUnderruns = 0;
+static uint32_t rtbOverruns  = 0;
+
+static inline void lockRealtimeBuffer()
+{
+  #ifdef ARDUINO_ARCH_ESP32
+  portENTER_CRITICAL(&rtbMux);
+  #endif
+}
+
+static inline void unlockRealtimeBuffer()
+{
+  #ifdef ARDUINO_ARCH_ESP32
+  portEXIT_CRITICAL(&rtbMux);
+  #endif
+}
+
+// caller holds the lock
+static void resetRealtimeRing()
+{
+  rtbHead = rtbFill = 0;
+  rtbInterval = 0;
+  rtbLastCommit = 0;
+}
+
+// loop only, the protocol handlers cannot be writing meanwhile as they only use the ring under the lock
+static void freeRealtimeBuffer()
+{
+  lockRealtimeBuffer();
+  uint32_t* block = rtbIngest;
+  rtbIngest = rtbRing = nullptr;
+  rtbLen = 0;
+  rtbSlots = 0;
+  resetRealtimeRing();
+  unlockRealtimeBuffer();
+  free(block);
+  free(rtbShown);
+  rtbShown = rtbTarget = nullptr;
+  rtbShownLen = 0;
+}
+
+static uint32_t* mallocRealtimeBuffer(size_t size)
+{
+  #if defined(ARDUINO_ARCH_ESP32) && defined(WLED_USE_PSRAM)
+  if (psramFound()) return (uint32_t*)ps_malloc(size);
+  #endif
+  return (uint32_t*)malloc(size);
+}
+
+// protocol handler side: ingest frame + ring slots in a single block, swapped in under the lock
+static bool allocRealtimeBuffer()
+{
+  uint16_t len   = strip.getLengthTotal();
+  uint8_t  depth = MIN(realtimeBufferDepth, RTB_MAX_DEPTH);
+  if (rtbIngest && rtbLen == len && rtbSlots == depth) return true;
+  if (rtbAllocFailed || !len || !depth) return false;
+  size_t size = len * sizeof(uint32_t) * (depth + 1);
+  uint32_t* block = mallocRealtimeBuffer(size);
+  if (!block) {
+    DEBUG_PRINTLN(F("Realtime buffer allocation failed."));
+    rtbAllocFailed = true;
+    return false;
+  }
+  memset(block, 0, size);
+  lockRealtimeBuffer();
+  uint32_t* old = rtbIngest;
+  rtbIngest = block;
+  rtbRing   = block + len;
+  rtbLen    = len;
+  rtbSlots  = depth;
+  resetRealtimeRing();
+  unlockRealtimeBuffer();
+  free(old);
+  DEBUG_PRINTF("Realtime buffer: %u frames of %u LEDs.\n", depth, len);
+  return true;
+}
+
+// loop side: shown + target frame in a single block, sized to the ring
+static bool allocPlayoutBuffer()
+{
+  uint16_t len = rtbLen;
+  if (rtbShown && rtbShownLen == len) return true;
+  free(rtbShown);
+  rtbShown = rtbTarget = nullptr;
+  rtbShownLen = 0;
+  rtbPlaying = rtbLate = rtbFading = false;
+  if (!len) return false;
+  rtbShown = mallocRealtimeBuffer(len * sizeof(uint32_t) * 2);
+  if (!rtbShown) return false;
+  memset(rtbShown, 0, len * sizeof(uint32_t) * 2);
+  rtbTarget = rtbShown + len;
+  rtbShownLen = len;
+  return true;
+}
+
+// copies the next (latest: the newest) buffered frame to dest and removes it from the ring, false if there is none
+static bool takeRealtimeFrame(uint32_t* dest, unsigned long& arrival, bool latest = false)
+{
+  bool taken = false;
+  lockRealtimeBuffer();
+  if (rtbFill && rtbLen == rtbShownLen) {
+    if (latest) {
+      rtbHead = (rtbHead + rtbFill - 1) % rtbSlots;
+      rtbFill = 1;
+    }
+    memcpy(dest, rtbRing + rtbHead * rtbLen, rtbLen * sizeof(uint32_t));
+    arrival = rtbArrival[rtbHead];
+    rtbHead = (rtbHead + 1) % rtbSlots;
+    rtbFill--;
+    taken = true;
+  }
+  unlockRealtimeBuffer();
+  return taken;
+}
+
+// writes a buffered frame to the strip the same way setRealtimePixel() would
+static void renderRealtimeFrame(const uint32_t* frame)
+{
+  Segment &seg = strip.getMainSegment();
+  for (size_t i = 0; i < rtbShownLen; i++) {
+    uint32_t c = frame[i];
+    if (useMainSegmentOnly) {
+      if (i < seg.length()) seg.setPixelColor(i, c);
+    } else {
+      strip.setPixelColor(i, c);
+    }
+  }
+}
+
+static void showRealtimeFrame(const uint32_t* frame)
+{
+  if (frame != rtbShown) memcpy(rtbShown, frame, rtbShownLen * sizeof(uint32_t));
+  renderRealtimeFrame(rtbShown);
+  if (!(realtimeMode && useMainSegmentOnly)) strip.show();
+}
+
+// true if the current realtime source should go through the jitter buffer
+bool realtimeBufferActive()
+{
+  if (!realtimeBufferDepth || realtimeOverride) return false;
+  switch (realtimeMode) {
+    case REALTIME_MODE_UDP:
+    case REALTIME_MODE_HYPERION:
+    case REALTIME_MODE_E131:
+    case REALTIME_MODE_ARTNET:
+    case REALTIME_MODE_TPM2NET:
+    case REALTIME_MODE_DDP:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// called from setRealtimePixel(); returns false if the pixel should be written to the strip directly
+bool realtimeBufferSetPixel(uint16_t pix, uint32_t c)
+{
+  if (!realtimeBufferActive() || !allocRealtimeBuffer()) return false;
+  lockRealtimeBuffer();
+  if (rtbIngest && pix < rtbLen) rtbIngest[pix] = c;
+  unlockRealtimeBuffer();
+  return true;
+}
+
+// called by the protocol handlers when a frame is complete (instead of strip.show())
+// returns false if the frame should be shown directly
+bool realtimeBufferCommit()
+{
+  if (!realtimeBufferActive() || !rtbIngest) return false;
+  unsigned long now = millis();
+  unsigned long arrival = realtimeStatsTakeArrival();
+  uint32_t maxLatency = realtimeBufferMaxLatency;
+
+  lockRealtimeBuffer();
+  if (!rtbIngest) { // freed by the loop meanwhile
+    unlockRealtimeBuffer();
+    return false;
+  }
+  // measure input rate (exponential moving average, 1/16 ms resolution)
+  if (rtbLastCommit) {
+    uint32_t dt = now - rtbLastCommit;
+    if (dt < RTB_MAX_INTERVAL) {
+      if (!rtbInterval) rtbInterval = dt << 4;
+      else rtbInterval = (rtbInterval * 7 + (dt << 4)) >> 3;
+    }
+  }
+  rtbLastCommit = now;
+
+  if (rtbFill >= rtbSlots) {
+    // buffer full, drop the oldest frame to keep latency bounded
+    rtbHead = (rtbHead + 1) % rtbSlots;
+    rtbFill--;
+    rtbOverruns++;
+  }
+  uint8_t tail = (rtbHead + rtbFill) % rtbSlots;
+  memcpy(rtbRing + tail * rtbLen, rtbIngest, rtbLen * sizeof(uint32_t));
+  rtbArrival[tail] = arrival;
+  rtbFill++;
+
+  // also drop frames exceeding the configured maximum latency
+  uint32_t interval = getRealtimeBufferInterval();
+  if (maxLatency && interval) {
+    while (rtbFill > 1 && rtbFill * interval > maxLatency) {
+      rtbHead = (rtbHead + 1) % rtbSlots;
+      rtbFill--;
+      rtbOverruns++;
+    }
+  }
+  unlockRealtimeBuffer();
+  return true;
+}
+
+void resetRealtimeBuffer()
+{
+  lockRealtimeBuffer();
+  resetRealtimeRing();
+  unlockRealtimeBuffer();
+  rtbPlaying = rtbLate = rtbFading = false;
+  rtbNextPlayout = 0;
+}
+
+// playout, called from handleNotifications()
+void handleRealtimeBuffer()
+{
+  if (!realtimeMode) { // realtime ended, release memory
+    rtbAllocFailed = false;
+    if (rtbIngest || rtbShown) {
+      freeRealtimeBuffer();
+      resetRealtimeBuffer();
+    }
+    return;
+  }
+  if (!rtbIngest || !realtimeBufferActive()) return;
+  if (!allocPlayoutBuffer()) return;
+
+  unsigned long now = millis();
+  uint32_t interval = getRealtimeBufferInterval();
+  unsigned long arrival;
+
+  if (!rtbPlaying) {
+    if (!rtbFill) return;
+    if (!interval) {
+      // a single frame without follow-up (i.e. static scene), show it without buffering
+      if (now - rtbLastCommit > RTB_MAX_INTERVAL && takeRealtimeFrame(rtbShown, arrival, true)) {
+        showRealtimeFrame(rtbShown);
+        realtimeStatsShown(arrival);
+      }
+      return;
+    }
+    // wait until the buffer is primed
+    if (rtbFill < rtbSlots && !(realtimeBufferMaxLatency && rtbFill * interval >= realtimeBufferMaxLatency)) return;
+    rtbPlaying = true;
+    rtbNextPlayout = now;
+  }
+
+  // cross-fade from the held frame to a late frame
+  if (rtbFading) {
+    uint32_t elapsed = now - rtbFadeStart;
+    if (elapsed < interval) {
+      if (now - strip.getLastShow() < strip.getMinShowDelay()) return;
+      uint16_t blend = (elapsed << 8) / interval;
+      Segment &seg = strip.getMainSegment();
+      for (size_t i = 0; i < rtbShownLen; i++) {
+        uint32_t c = color_blend(rtbShown[i], rtbTarget[i], blend);
+        if (useMainSegmentOnly) {
+          if (i < seg.length()) seg.setPixelColor(i, c);
+        } else {
+          strip.setPixelColor(i, c);
+        }
+      }
+      if (!(realtimeMode && useMainSegmentOnly)) strip.show();
+      return;
+    }
+    rtbFading = false;
+    showRealtimeFrame(rtbTarget);
+    realtimeStatsShown(rtbTargetArrival);
+  }
+
+  if ((long)(now - rtbNextPlayout) < 0) return;
+
+  if (rtbLate) {
+    // late frame: fade into it over one frame interval instead of jumping
+    if (!takeRealtimeFrame(rtbTarget, rtbTargetArrival)) return; // hold the current one until it arrives
+    rtbLate = false;
+    rtbFading = true;
+    rtbFadeStart = now;
+    rtbNextPlayout = now + interval;
+    return;
+  }
+
+  if (!takeRealtimeFrame(rtbShown, arrival)) {
+    // frame is late, hold the current one and fade once it arrives
+    rtbUnderruns++;
+    rtbLate = true;
+    return;
+  }
+  showRealtimeFrame(rtbShown);
+  realtimeStatsShown(arrival);
+  // keep a steady cadence, but do not try to catch up after long stalls
+  rtbNextPlayout += interval;
+  if ((long)(now - rtbNextPlayout) > (long)interval) rtbNextPlayout = now + interval;
+}
+
+// measured input frame interval in ms (0 if unknown)
+uint16_t getRealtimeBufferInterval()
+{
+  uint32_t interval = rtbInterval >> 4;
+  if (!interval) return 0;
+  return constrain(interval, RTB_MIN_INTERVAL, RTB_MAX_INTERVAL);
+}
+
+void serializeRealtimeBuffer(JsonObject root)
+{
+  uint16_t interval = getRealtimeBufferInterval();
+  root["d"]   = realtimeBufferDepth;
+  root["f"]   = rtbFill;
+  root[F("fps")] = interval ? 1000 / interval : 0;
+  root[F("lat")] = rtbFill * interval; // current buffering latency in ms
+  root[F("max")] = realtimeBufferMaxLatency;
+  root[F("un")]  = rtbUnderruns;
+  root[F("ov")]  = rtbOverruns;
+}
@@ -0,0 +1,147 @@
+#include "wled.h"
+
+/*
+ * Realtime packet statistics
+ * Per protocol counters of received packets, bytes, universes, sequence gaps and out-of-order drops,
+ * plus a histogram of the time between arrival of a frame's first packet and the frame being shown.
+ */
+
+#define RT_STATS_PROTOCOLS 9  // indexed by REALTIME_MODE_*
+#define RT_STATS_BUCKETS   8  // latency histogram buckets
+
+// upper bounds (exclusive, in ms) of the latency buckets, last bucket takes the rest
+static const uint8_t rtLatencyBounds[RT_STATS_BUCKETS-1] PROGMEM = {1, 2, 5, 10, 20, 50, 100};
+
+typedef struct RealtimeStats {
+  uint32_t packets;
+  uint32_t bytes;
+  uint32_t gaps;        // sequence numbers skipped
+  uint32_t dropped;     // packets dropped as out of order
+  uint32_t frames;      // frames shown
+  uint32_t latencySum;  // ms, for average
+  uint16_t latencyMax;  // ms
+  uint16_t universes;   // number of distinct universes received
+  uint32_t universeSeen[(E131_MAX_UNIVERSE_COUNT + 31) / 32]; // bit mask of universe table slots seen
+  uint32_t hist[RT_STATS_BUCKETS];
+} rt_stats_t;
+
+static rt_stats_t* rtStats = nullptr;  // allocated on first packet
+static unsigned long rtFrameArrival = 0;
+
+static rt_stats_t* getRealtimeStats(byte mode)
+{
+  if (mode >= RT_STATS_PROTOCOLS) return nullptr;
+  if (!rtStats) {
+    rtStats = (rt_stats_t*)calloc(RT_STATS_PROTOCOLS, sizeof(rt_stats_t));
+    if (!rtStats) return nullptr;
+  }
+  return &rtStats[mode];
+}
+
+void realtimeStatsPacket(byte mode, size_t len)
+{
+  rt_stats_t* s = getRealtimeStats(mode);
+  if (!s) return;
+  s->packets++;
+  s->bytes += len;
+}
+
+// marks arrival of data for the next frame (only the first packet of a frame counts)
+void realtimeStatsArrival()
+{
+  if (!rtFrameArrival) rtFrameArrival = millis() | 1; // 0 means no pending frame
+}
+
+// returns arrival time of the pending frame and starts a new one
+unsigned long realtimeStatsTakeArrival()
+{
+  unsigned long arrival = rtFrameArrival;
+  rtFrameArrival = 0;
+  return arrival;
+}
+
+// slot: index of the universe in the E1.31 universe table
+void realtimeStatsUniverse(byte mode, uint16_t slot)
+{
+  rt_stats_t* s = getRealtimeStats(mode);
+  if (!s || slot >= E131_MAX_UNIVERSE_COUNT) return;
+  uint32_t bit = 1UL << (slot & 0x1F);
+  if (s->universeSeen[slot >> 5] & bit) return;
+  s->universeSeen[slot >> 5] |= bit;
+  s->universes++;
+}
+
+// last (-1: nothing received yet) and current sequence numbers of a protocol with 8 bit sequence (E1.31, Art-Net)
+// E1.31 wraps from 255 to 0, Art-Net from 255 to 1 as sequence 0 means disabled there
+void realtimeStatsSequence(byte mode, int16_t last, uint8_t seq)
+{
+  rt_stats_t* s = getRealtimeStats(mode);
+  if (!s || last < 0) return;
+  if (mode == REALTIME_MODE_ARTNET && (seq == 0 || last == 0)) return;
+  uint8_t diff = seq - (uint8_t)last;
+  if (mode == REALTIME_MODE_ARTNET && seq < last) diff--; // 0 was skipped
+  if (diff > 1 && diff < 128) s->gaps += diff - 1; // larger differences are out of order packets
+}
+
+void realtimeStatsGap(byte mode, uint16_t missing)
+{
+  rt_stats_t* s = getRealtimeStats(mode);
+  if (s) s->gaps += missing;
+}
+
+void realtimeStatsDropped(byte mode)
+{
+  rt_stats_t* s = getRealtimeStats(mode);
+  if (s) s->dropped++;
+}
+
+// called when a realtime frame is shown, arrival as returned by realtimeStatsTakeArrival()
+void realtimeStatsShown(unsigned long arrival)
+{
+  rt_stats_t* s = getRealtimeStats(realtimeMode);
+  if (!s) return;
+  s->frames++;
+  if (!arrival) return;
+  uint32_t latency = millis() - arrival;
+  s->latencySum += latency;
+  if (latency > s->latencyMax) s->latencyMax = MIN(latency, UINT16_MAX);
+  size_t b = 0;
+  while (b < RT_STATS_BUCKETS-1 && latency >= pgm_read_byte(&rtLatencyBounds[b])) b++;
+  s->hist[b]++;
+}
+
+void serializeRealtimeStats(JsonObject root)
+{
+  if (!rtStats) return;
+  JsonObject rts = root.createNestedObject(F("rts"));
+  for (size_t m = 0; m < RT_STATS_PROTOCOLS; m++) {
+    rt_stats_t& s = rtStats[m];
+    if (!s.packets) continue;
+    const __FlashStringHelper* name;
+    switch (m) {
+      case REALTIME_MODE_UDP:      name = F("UDP");      break;
+      case REALTIME_MODE_HYPERION: name = F("Hyperion"); break;
+      case REALTIME_MODE_E131:     name = F("E1.31");    break;
+      case REALTIME_MODE_ADALIGHT: name = F("Adalight/TPM2"); break;
+      case REALTIME_MODE_ARTNET:   name = F("Art-Net");  break;
+      case REALTIME_MODE_TPM2NET:  name = F("tpm2.net"); break;
+      case REALTIME_MODE_DDP:      name = F("DDP");      break;
+      default: continue;
+    }
+    JsonObject p = rts.createNestedObject(name);
+    p[F("pkt")] = s.packets;
+    p["b"]      = s.bytes;
+    if (m == REALTIME_MODE_E131 || m == REALTIME_MODE_ARTNET) p["u"] = s.universes;
+    p[F("gap")] = s.gaps;
+    p[F("oos")] = s.dropped;
+    p[F("fr")]  = s.frames;
+    JsonArray hist = p.createNestedArray(F("lat")); // counts for <1,<2,<5,<10,<20,<50,<100,>=100 ms
+    uint32_t measured = 0;
+    for (size_t b = 0; b < RT_STATS_BUCKETS; b++) {
+      hist.add(s.hist[b]);
+      measured += s.hist[b];
+    }
+    p[F("lavg")] = measured ? s.latencySum / measured : 0;
+    p[F("lmax")] = s.latencyMax;
+  }
+}
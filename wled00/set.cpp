@@ -327,6 +327,7 @@ void handleSettingsSet(AsyncWebServerRequest *request, byte subPage)
     if (t >= 0  && t <= 200) e131Priority = t;
     t = request->arg(F("DM")).toInt();
     if (t >= DMX_MODE_DISABLED && t <= DMX_MODE_PRESET) DMXMode = t;
+    invalidateE131UniverseTable();
     t = request->arg(F("ET")).toInt();
     if (t > 99  && t <= 65000) realtimeTimeoutMs = t;
     arlsForceMaxBri = request->hasArg(F("FB"));
@@ -449,6 +450,7 @@ void handleSettingsSet(AsyncWebServerRequest *request, byte subPage)
         timerDayEnd[i] = request->arg(k).toInt();
       }
     }
+    cuesChanged = true;
   }
 
   //SECURITY
@@ -707,6 +709,7 @@ void handleSettingsSet(AsyncWebServerRequest *request, byte subPage)
   #endif
 
   lastEditTime = millis();
+  invalidateSettingsJS();
   if (subPage != 2 && !doReboot) doSerializeConfig = true; //serializeConfig(); //do not save if factory reset or LED settings (which are saved after LED re-init)
   #ifndef WLED_DISABLE_ALEXA
   if (subPage == 4) alexaInit();
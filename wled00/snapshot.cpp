@@ -0,0 +1,450 @@
+#include "wled.h"
+
+/*
+ * Binary state snapshots
+ * A snapshot holds everything a preset saved with brightness and segment bounds sets (on, brightness, transition,
+ * main segment and all segments), so that such a preset can be applied without reading and parsing JSON.
+ * Snapshots are made when a preset is saved from the current state, or after a complete preset was applied from JSON
+ * once. They are cached in RAM and written to /snapshots.bin so that they survive a reboot.
+ * presets.json remains the format presets are stored, exported and imported in, a snapshot is only a cache and is
+ * dropped whenever its preset is written.
+ *
+ * Layout (little endian):
+ *  snapshot_header_t
+ *  segCount x (snapshot_segment_t followed by nameLen bytes of segment name)
+ */
+
+#ifdef ESP8266
+  #define SNAPSHOT_CACHE_SIZE 4
+#else
+  #define SNAPSHOT_CACHE_SIZE 16
+#endif
+#define SNAPSHOT_MAGIC        'S'
+#define SNAPSHOT_VERSION      1
+#define SNAPSHOT_FLAG_ON      0x01
+#define SNAPSHOT_FLAG_MATRIX  0x02 // made on a 2D setup, not valid after switching to 1D or back
+#define SNAPSHOT_NO_TRANSITION 0xFFFF
+#define SNAPSHOT_OPTIONS_MASK 0xFF9F // all segment options except reset and transitional
+#define SNAPSHOT_NAME_LEN     32     // as in deserializeSegment()
+#define SNAPSHOT_OPTION(n)    bool((r.options >> (n)) & 0x01)
+
+typedef struct SnapshotHeader {
+  uint8_t  magic;
+  uint8_t  version;
+  uint8_t  preset;
+  uint8_t  segCount;
+  uint16_t length;      // including header, segments and names
+  uint16_t checksum;    // CRC16 of everything after the header
+  uint16_t transition;  // in 100ms, SNAPSHOT_NO_TRANSITION if the preset has none
+  uint8_t  flags;
+  uint8_t  bri;
+  uint8_t  mainSeg;
+  uint8_t  reserved[3];
+} snapshot_header_t;
+
+typedef struct SnapshotSegment {
+  uint32_t colors[NUM_COLORS];
+  uint16_t start, stop;
+  uint16_t offset;
+  uint16_t options;
+  uint8_t  startY, stopY;
+  uint8_t  grouping, spacing;
+  uint8_t  mode, speed, intensity, palette;
+  uint8_t  opacity, cct, custom1, custom2;
+  uint8_t  custom3;     // bits 0-4 custom3, bits 5-7 check1-3
+  uint8_t  id;
+  uint8_t  nameLen;
+  uint8_t  reserved;
+} snapshot_segment_t;
+
+static_assert(sizeof(snapshot_header_t) == 16, "snapshot header must not be padded");
+static_assert(sizeof(snapshot_segment_t) == 36, "snapshot segment must not be padded");
+
+static byte* snapshots[SNAPSHOT_CACHE_SIZE] = {nullptr}; // most recently used first
+static bool snapshotsLoaded = false; // /snapshots.bin has been read
+static bool snapshotsDirty  = false; // cache differs from /snapshots.bin
+static volatile uint32_t snapshotsToDrop[8] = {0}; // bit per preset id, set by dropSnapshot() from any task
+static volatile bool dropAllSnapshots = false;
+
+static const char snapshotFile[] PROGMEM = "/snapshots.bin";
+
+static uint16_t snapshotChecksum(const byte* snap)
+{
+  const snapshot_header_t* h = (const snapshot_header_t*)snap;
+  return crc16(snap + sizeof(snapshot_header_t), h->length - sizeof(snapshot_header_t));
+}
+
+// checks header, segment records and checksum of a snapshot of len bytes
+static bool isValidSnapshot(const byte* snap, size_t len)
+{
+  if (len < sizeof(snapshot_header_t)) return false;
+  snapshot_header_t h;
+  memcpy(&h, snap, sizeof(h));
+  if (h.magic != SNAPSHOT_MAGIC || h.version != SNAPSHOT_VERSION || h.length != len) return false;
+  if (!h.preset || h.preset > 250 || h.segCount > MAX_NUM_SEGMENTS) return false;
+  size_t pos = sizeof(h);
+  for (size_t i = 0; i < h.segCount; i++) {
+    if (pos + sizeof(snapshot_segment_t) > len) return false;
+    snapshot_segment_t s;
+    memcpy(&s, snap + pos, sizeof(s));
+    if (s.id >= MAX_NUM_SEGMENTS || s.nameLen > SNAPSHOT_NAME_LEN) return false;
+    pos += sizeof(s) + s.nameLen;
+  }
+  return pos == len && crc16(snap + sizeof(h), len - sizeof(h)) == h.checksum;
+}
+
+// cache slot of the snapshot for a preset, -1 if there is none
+static int findSnapshot(byte preset)
+{
+  for (size_t i = 0; i < SNAPSHOT_CACHE_SIZE && snapshots[i]; i++) {
+    if (((snapshot_header_t*)snapshots[i])->preset == preset) return i;
+  }
+  return -1;
+}
+
+// puts snap into the first cache slot, replacing a snapshot for the same preset or the least recently used one
+static void cacheSnapshot(byte* snap)
+{
+  byte preset = ((snapshot_header_t*)snap)->preset;
+  int slot = findSnapshot(preset);
+  if (slot < 0) slot = SNAPSHOT_CACHE_SIZE - 1;
+  free(snapshots[slot]);
+  for (int i = slot; i > 0; i--) snapshots[i] = snapshots[i-1];
+  snapshots[0] = snap;
+}
+
+static byte* allocSnapshot(size_t len)
+{
+  // if possible use SPI RAM on ESP32
+  #if defined(ARDUINO_ARCH_ESP32) && defined(WLED_USE_PSRAM)
+  if (psramFound())
+    return (byte*) ps_malloc(len);
+  else
+  #endif
+    return (byte*) malloc(len);
+}
+
+static void freeSnapshot(int slot)
+{
+  free(snapshots[slot]);
+  for (size_t i = slot; i < SNAPSHOT_CACHE_SIZE - 1; i++) snapshots[i] = snapshots[i+1];
+  snapshots[SNAPSHOT_CACHE_SIZE - 1] = nullptr;
+  snapshotsDirty = true;
+}
+
+// frees what dropSnapshot() marked, only called from the loop so that a snapshot is never freed while in use
+static void dropMarkedSnapshots()
+{
+  uint32_t drop[8];
+  for (size_t i = 0; i < 8; i++) {
+    drop[i] = snapshotsToDrop[i];
+    snapshotsToDrop[i] = 0;
+  }
+  bool all = dropAllSnapshots;
+  dropAllSnapshots = false;
+  for (int i = SNAPSHOT_CACHE_SIZE - 1; i >= 0; i--) {
+    if (!snapshots[i]) continue;
+    byte preset = ((snapshot_header_t*)snapshots[i])->preset;
+    if (all || (drop[preset >> 5] & (1UL << (preset & 0x1F)))) freeSnapshot(i);
+  }
+}
+
+static void loadSnapshots()
+{
+  snapshotsLoaded = true;
+  File file = WLED_FS.open(FPSTR(snapshotFile), "r");
+  if (!file) return;
+  size_t n = 0;
+  while (n < SNAPSHOT_CACHE_SIZE && file.available() >= (int)sizeof(snapshot_header_t)) {
+    snapshot_header_t h;
+    if (file.read((byte*)&h, sizeof(h)) != sizeof(h) || h.length < sizeof(h)) break;
+    byte* snap = allocSnapshot(h.length);
+    if (!snap) break;
+    memcpy(snap, &h, sizeof(h));
+    size_t rest = h.length - sizeof(h);
+    if (file.read(snap + sizeof(h), rest) != rest || !isValidSnapshot(snap, h.length) || findSnapshot(h.preset) >= 0) {
+      free(snap);
+      break; // a broken file is dropped, it will be written again
+    }
+    snapshots[n++] = snap;
+  }
+  file.close();
+  DEBUG_PRINTF("Loaded %u snapshots.\n", n);
+}
+
+// drops outdated snapshots and writes the cache to /snapshots.bin if it changed
+void handleSnapshots()
+{
+  if (!snapshotsLoaded) return;
+  dropMarkedSnapshots();
+  if (!snapshotsDirty) return;
+  snapshotsDirty = false;
+  if (!snapshots[0]) {
+    WLED_FS.remove(FPSTR(snapshotFile));
+    return;
+  }
+  File file = WLED_FS.open(FPSTR(snapshotFile), "w");
+  if (!file) return;
+  // most recently used first, loadSnapshots() fills the cache in file order
+  for (size_t i = 0; i < SNAPSHOT_CACHE_SIZE; i++) {
+    if (snapshots[i]) file.write(snapshots[i], ((snapshot_header_t*)snapshots[i])->length);
+  }
+  file.close();
+}
+
+bool hasSnapshot(byte preset)
+{
+  if (!snapshotsLoaded) loadSnapshots();
+  dropMarkedSnapshots();
+  return findSnapshot(preset) >= 0;
+}
+
+// drops the snapshot of a preset whose JSON is changing, 0 drops all
+// may be called from the web server task, the snapshot is freed in the loop
+void dropSnapshot(byte preset)
+{
+  if (preset) snapshotsToDrop[preset >> 5] |= 1UL << (preset & 0x1F);
+  else        dropAllSnapshots = true;
+}
+
+// index in keys of key, -1 if not in the list
+static int findKey(const char* key, const char* const* keys, size_t count)
+{
+  for (size_t i = 0; i < count; i++) if (!strcmp(key, keys[i])) return i;
+  return -1;
+}
+
+// true if applying this preset always results in the same state, i.e. it sets everything a snapshot holds
+// and nothing else (no HTTP API, playlist, random or toggle values, individual LEDs, ...)
+bool isSnapshotState(JsonObject root)
+{
+  static const char* const rootKeys[] = {"on", "bri", "seg", "transition", "mainseg", "n", "ql"};
+  uint8_t found = 0;
+  for (JsonPair kv : root) {
+    int k = findKey(kv.key().c_str(), rootKeys, sizeof(rootKeys)/sizeof(rootKeys[0]));
+    if (k < 0 || (k < 2 && kv.value().is<const char*>())) return false;
+    found |= 1 << k;
+  }
+  if ((found & 0x07) != 0x07 || !root["seg"].is<JsonArray>()) return false;
+
+  // required keys first, then the ones required on 2D setups only, then optional ones
+  static const char* const segKeys[] = {
+    "start", "stop", "grp", "spc", "of", "on", "frz", "bri", "cct", "col", "fx", "sx", "ix", "pal",
+    "c1", "c2", "c3", "sel", "rev", "mi", "o1", "o2", "o3", "si", "m12",
+    "startY", "stopY", "rY", "mY", "tp", "id", "n"
+  };
+  const size_t segKeyCount = sizeof(segKeys)/sizeof(segKeys[0]);
+  const uint32_t required = strip.isMatrix ? 0x3FFFFFFFUL : 0x01FFFFFFUL;
+  // every segment slot has to be set or removed, in order, else segments not in the preset would be kept
+  JsonArray segs = root["seg"];
+  if (segs.size() < strip.getMaxSegments()) return false;
+  size_t it = 0;
+  for (JsonVariant seg : segs) {
+    if (!seg.is<JsonObject>()) return false;
+    JsonObject elem = seg.as<JsonObject>();
+    int id = elem["id"] | (int)it;
+    if (id != (int)it++) return false;
+    if (elem.size() <= 2 && elem.containsKey("stop") && elem["stop"] == 0 && (elem.size() == 1 || elem.containsKey("id"))) continue; // removed segment
+    uint32_t keys = 0;
+    for (JsonPair kv : elem) {
+      int k = findKey(kv.key().c_str(), segKeys, segKeyCount);
+      if (k < 0) return false;
+      if (kv.value().is<const char*>() && k != 9 && (size_t)k != segKeyCount-1) return false; // only colors and name may be strings
+      keys |= 1UL << k;
+    }
+    if ((keys & required) != required) return false;
+  }
+  return true;
+}
+
+// makes a snapshot of the current segments for preset, with the given global values
+void createSnapshot(byte preset, bool on, byte briValue, int transition)
+{
+  if (!preset || preset > 250) return;
+  if (!snapshotsLoaded) loadSnapshots();
+  dropMarkedSnapshots();
+  size_t segCount = 0, len = sizeof(snapshot_header_t);
+  for (size_t s = 0; s < strip.getSegmentsNum(); s++) {
+    Segment& seg = strip.getSegment(s);
+    if (!seg.isActive()) continue;
+    segCount++;
+    len += sizeof(snapshot_segment_t) + (seg.name ? strnlen(seg.name, SNAPSHOT_NAME_LEN) : 0);
+  }
+  byte* snap = allocSnapshot(len);
+  if (!snap) return;
+
+  snapshot_header_t h = {};
+  h.magic      = SNAPSHOT_MAGIC;
+  h.version    = SNAPSHOT_VERSION;
+  h.preset     = preset;
+  h.segCount   = segCount;
+  h.length     = len;
+  h.transition = transition < 0 ? SNAPSHOT_NO_TRANSITION : transition;
+  h.flags      = (on ? SNAPSHOT_FLAG_ON : 0) | (strip.isMatrix ? SNAPSHOT_FLAG_MATRIX : 0);
+  h.bri        = briValue;
+  h.mainSeg    = strip.getMainSegmentId();
+
+  size_t pos = sizeof(h);
+  for (size_t s = 0; s < strip.getSegmentsNum(); s++) {
+    Segment& seg = strip.getSegment(s);
+    if (!seg.isActive()) continue;
+    snapshot_segment_t r = {};
+    for (size_t i = 0; i < NUM_COLORS; i++) r.colors[i] = seg.colors[i];
+    r.start     = seg.start;
+    r.stop      = seg.stop;
+    r.offset    = seg.offset;
+    r.options   = seg.options & SNAPSHOT_OPTIONS_MASK;
+    r.startY    = seg.startY;
+    r.stopY     = seg.stopY;
+    r.grouping  = seg.grouping;
+    r.spacing   = seg.spacing;
+    r.mode      = seg.mode;
+    r.speed     = seg.speed;
+    r.intensity = seg.intensity;
+    r.palette   = seg.palette;
+    r.opacity   = seg.opacity;
+    r.cct       = seg.cct;
+    r.custom1   = seg.custom1;
+    r.custom2   = seg.custom2;
+    r.custom3   = seg.custom3 | (seg.check1 << 5) | (seg.check2 << 6) | (seg.check3 << 7);
+    r.id        = s;
+    r.nameLen   = seg.name ? strnlen(seg.name, SNAPSHOT_NAME_LEN) : 0;
+    memcpy(snap + pos, &r, sizeof(r));
+    pos += sizeof(r);
+    if (r.nameLen) memcpy(snap + pos, seg.name, r.nameLen);
+    pos += r.nameLen;
+  }
+  memcpy(snap, &h, sizeof(h));
+  ((snapshot_header_t*)snap)->checksum = snapshotChecksum(snap);
+  cacheSnapshot(snap);
+  snapshotsDirty = true;
+  DEBUG_PRINTF("Snapshot of preset %u: %u bytes.\n", preset, len);
+}
+
+// applies segment r with name the way deserializeSegment() applies a complete segment object, returns the segment id
+static byte applySnapshotSegment(const snapshot_segment_t& r, const char* name)
+{
+  byte id = r.id;
+  if (id >= strip.getSegmentsNum()) {
+    strip.appendSegment(Segment(0, strip.getLengthTotal()));
+    id = strip.getSegmentsNum()-1; // segments are added at the end of list
+  }
+  Segment& seg = strip.getSegment(id);
+  Segment prev = seg; //make a backup so we can tell if something changed
+
+  if (r.nameLen || r.start != seg.start || r.stop != seg.stop) {
+    if (seg.name) {
+      delete[] seg.name;
+      seg.name = nullptr;
+    }
+    if (r.nameLen) {
+      seg.name = new char[r.nameLen+1];
+      if (seg.name) strlcpy(seg.name, name, r.nameLen+1);
+    }
+  }
+
+  uint8_t map1D2D = (r.options >> 10) & 0x07;
+  if ((r.spacing>0 && r.spacing!=seg.spacing) || seg.map1D2D!=map1D2D) seg.fill(BLACK); // clear spacing gaps
+  seg.map1D2D  = map1D2D;
+  seg.soundSim = (r.options >> 13) & 0x07;
+  seg.set(r.start, r.stop, r.grouping, r.spacing, r.offset, r.startY, r.stopY);
+
+  seg.setOpacity(r.opacity);
+  seg.setOption(SEG_OPTION_ON, SNAPSHOT_OPTION(SEG_OPTION_ON)); // use transition
+  seg.freeze = SNAPSHOT_OPTION(SEG_OPTION_FREEZE);
+  seg.setCCT(r.cct);
+  for (size_t i = 0; i < NUM_COLORS; i++) seg.setColor(i, r.colors[i]);
+  if (seg.mode == FX_MODE_STATIC) strip.trigger(); //instant refresh
+
+  #ifndef WLED_DISABLE_2D
+  bool reverse   = seg.reverse;
+  bool mirror    = seg.mirror;
+  bool reverse_y = seg.reverse_y;
+  bool mirror_y  = seg.mirror_y;
+  #endif
+  seg.selected  = SNAPSHOT_OPTION(SEG_OPTION_SELECTED);
+  seg.reverse   = SNAPSHOT_OPTION(SEG_OPTION_REVERSED);
+  seg.mirror    = SNAPSHOT_OPTION(SEG_OPTION_MIRROR);
+  #ifndef WLED_DISABLE_2D
+  seg.reverse_y = SNAPSHOT_OPTION(SEG_OPTION_REVERSED_Y);
+  seg.mirror_y  = SNAPSHOT_OPTION(SEG_OPTION_MIRROR_Y);
+  seg.transpose = SNAPSHOT_OPTION(SEG_OPTION_TRANSPOSED);
+  if (seg.is2D() && seg.map1D2D == M12_pArc && (reverse != seg.reverse || reverse_y != seg.reverse_y || mirror != seg.mirror || mirror_y != seg.mirror_y)) seg.fill(BLACK); // clear entire segment (in case of Arc 1D to 2D expansion)
+  #endif
+
+  if (r.mode != seg.mode) seg.setMode(r.mode);
+  seg.speed     = r.speed;
+  seg.intensity = r.intensity;
+  seg.setPalette(r.palette);
+  seg.custom1   = r.custom1;
+  seg.custom2   = r.custom2;
+  seg.custom3   = r.custom3 & 0x1F;
+  seg.check1    = r.custom3 & 0x20;
+  seg.check2    = r.custom3 & 0x40;
+  seg.check3    = r.custom3 & 0x80;
+
+  // send UDP/WS if segment options changed (except selection; will also deselect current preset)
+  if (seg.differs(prev) & 0x7F) stateChanged = true;
+  return id;
+}
+
+// applies the snapshot of a preset like deserializeState() would apply its JSON, false if there is none
+// the caller (handlePresets()) calls stateUpdated()
+bool applySnapshot(byte preset)
+{
+  if (!hasSnapshot(preset)) return false;
+  int slot = findSnapshot(preset);
+  byte* snap = snapshots[slot];
+  snapshot_header_t h;
+  memcpy(&h, snap, sizeof(h));
+  if (!(h.flags & SNAPSHOT_FLAG_MATRIX) != !strip.isMatrix) {
+    freeSnapshot(slot);
+    return false;
+  }
+  if (slot) { // most recently used first
+    memmove(snapshots + 1, snapshots, slot * sizeof(byte*));
+    snapshots[0] = snap;
+  }
+
+  bool onBefore = bri;
+  bri = h.bri;
+  if (!(h.flags & SNAPSHOT_FLAG_ON) != !bri) toggleOnOff();
+  if (bri && !onBefore) { // unfreeze all segments when turning on
+    for (size_t s=0; s < strip.getSegmentsNum(); s++) {
+      strip.getSegment(s).freeze = false;
+    }
+    if (realtimeMode && !realtimeOverride && useMainSegmentOnly) { // keep live segment frozen if live
+      strip.getMainSegment().freeze = true;
+    }
+  }
+
+  if (h.transition != SNAPSHOT_NO_TRANSITION && currentPlaylist < 0) { //do not apply transition time from preset if playlist active
+    transitionDelay = h.transition;
+    transitionDelay *= 100;
+    transitionDelayTemp = transitionDelay;
+  }
+  strip.setTransition(transitionDelayTemp); // required here for color transitions to have correct duration
+
+  // do not allow changing main segment while in realtime mode (may get odd results else)
+  if (!realtimeMode) strip.setMainSegmentId(h.mainSeg);
+
+  bool inSnapshot[MAX_NUM_SEGMENTS] = {false};
+  size_t pos = sizeof(h);
+  for (size_t i = 0; i < h.segCount; i++) {
+    snapshot_segment_t r;
+    memcpy(&r, snap + pos, sizeof(r));
+    pos += sizeof(r);
+    inSnapshot[applySnapshotSegment(r, (const char*)snap + pos)] = true;
+    pos += r.nameLen;
+  }
+  // segments that are not part of the preset are removed
+  size_t deleted = 0;
+  for (size_t s = 0; s < strip.getSegmentsNum(); s++) {
+    Segment& seg = strip.getSegment(s);
+    if (inSnapshot[s] || !seg.isActive()) continue;
+    seg.set(seg.start, 0);
+    deleted++;
+  }
+  if (strip.getSegmentsNum() > 3 && deleted >= strip.getSegmentsNum()/2U) strip.purgeSegments(); // batch deleting more than half segments
+  return true;
+}
@@ -38,9 +38,11 @@ ESPAsyncE131::ESPAsyncE131(e131_packet_callback_function callback) {
 //
 /////////////////////////////////////////////////////////
 
-bool ESPAsyncE131::begin(bool multicast, uint16_t port, uint16_t universe, uint8_t n) {
+bool ESPAsyncE131::begin(bool multicast, uint16_t port, uint16_t universe, uint16_t n) {
   bool success = false;
 
+  _multicast = multicast;
+  _port = port;
   if (multicast) {
 		success = initMulticast(port, universe, n);
 	} else {
@@ -66,23 +68,16 @@ bool ESPAsyncE131::initUnicast(uint16_t port) {
   return success;
 }
 
-bool ESPAsyncE131::initMulticast(uint16_t port, uint16_t universe, uint8_t n) {
+bool ESPAsyncE131::initMulticast(uint16_t port, uint16_t universe, uint16_t n) {
   bool success = false;
 
   IPAddress address = IPAddress(239, 255, ((universe >> 8) & 0xff),
     ((universe >> 0) & 0xff));
 
   if (udp.listenMulticast(address, port)) {
-    ip4_addr_t ifaddr;
-    ip4_addr_t multicast_addr;
-
-    ifaddr.addr = static_cast<uint32_t>(Network.localIP());
-    for (uint8_t i = 1; i < n; i++) {
-        multicast_addr.addr = static_cast<uint32_t>(IPAddress(239, 255,
-          (((universe + i) >> 8) & 0xff), (((universe + i) >> 0)
-          & 0xff)));
-      igmp_joingroup(&ifaddr, &multicast_addr);
-    }
+    for (uint16_t i = 1; i < n; i++) joinUniverse(universe + i, true);
+    _universe = universe;
+    _universeCount = n;
 
     udp.onPacket(std::bind(&ESPAsyncE131::parsePacket, this, std::placeholders::_1));
 
@@ -91,6 +86,26 @@ bool ESPAsyncE131::initMulticast(uint16_t port, uint16_t universe, uint8_t n) {
   return success;
 }
 
+void ESPAsyncE131::joinUniverse(uint16_t universe, bool join) {
+  ip4_addr_t ifaddr;
+  ip4_addr_t multicast_addr;
+
+  ifaddr.addr = static_cast<uint32_t>(Network.localIP());
+  multicast_addr.addr = static_cast<uint32_t>(IPAddress(239, 255,
+    ((universe >> 8) & 0xff), ((universe >> 0) & 0xff)));
+  if (join) igmp_joingroup(&ifaddr, &multicast_addr);
+  else      igmp_leavegroup(&ifaddr, &multicast_addr);
+}
+
+bool ESPAsyncE131::updateMulticast(uint16_t universe, uint16_t n) {
+  if (!_multicast || (universe == _universe && n == _universeCount)) return true;
+  if (universe != _universe || !_universeCount) return initMulticast(_port, universe, n); // the first group is the listening address
+  for (uint16_t i = n; i < _universeCount; i++) joinUniverse(universe + i, false);
+  for (uint16_t i = _universeCount; i < n; i++) joinUniverse(universe + i, true);
+  _universeCount = n;
+  return true;
+}
+
 /////////////////////////////////////////////////////////
 //
 // Packet parsing - Private
@@ -211,10 +211,15 @@ class ESPAsyncE131 {
     static const uint8_t VECTOR_DMP = 2;
 
     AsyncUDP        udp;        // AsyncUDP
+    bool            _multicast = false;
+    uint16_t        _port = 0;
+    uint16_t        _universe = 0;      // first universe (multicast)
+    uint16_t        _universeCount = 0; // groups joined, starting at _universe
 
     // Internal Initializers
     bool initUnicast(uint16_t port);
-    bool initMulticast(uint16_t port, uint16_t universe, uint8_t n = 1);
+    bool initMulticast(uint16_t port, uint16_t universe, uint16_t n = 1);
+    void joinUniverse(uint16_t universe, bool join);
 
     // Packet parser callback
     void parsePacket(AsyncUDPPacket _packet);
@@ -225,7 +230,9 @@ class ESPAsyncE131 {
     ESPAsyncE131(e131_packet_callback_function callback);
 
     // Generic UDP listener, no physical or IP configuration
-    bool begin(bool multicast, uint16_t port = E131_DEFAULT_PORT, uint16_t universe = 1, uint8_t n = 1);
+    bool begin(bool multicast, uint16_t port = E131_DEFAULT_PORT, uint16_t universe = 1, uint16_t n = 1);
+    // Multicast: joins or leaves groups if the universe range changed since begin()
+    bool updateMulticast(uint16_t universe, uint16_t n);
 };
 
 // Class to track e131 package priority
@@ -10,6 +10,35 @@
 #define UDP_IN_MAXSIZE 1472
 #define PRESUMED_NETWORK_DELAY 3 //how many ms could it take on avg to reach the receiver? This will be added to transmitted times
 
+// sets the effect timebase from the effect clock (millis() + timebase) of the sender
+void applySyncTimebase(uint32_t t)
+{
+  t += PRESUMED_NETWORK_DELAY; //adjust trivially for network delay
+  t -= millis();
+  strip.timebase = t;
+}
+
+// adjusts system time if the sender is more accurate than self, otherwise refines the timebase if both have good times
+void adjustSyncTime(Toki::Time tm, uint8_t timeSource, bool timebaseUpdated)
+{
+  if (timeSource > toki.getTimeSource()) { //if sender's time source is more accurate
+    toki.adjust(tm, PRESUMED_NETWORK_DELAY); //adjust trivially for network delay
+    uint8_t ts = TOKI_TS_UDP;
+    if (timeSource > 99) ts = TOKI_TS_UDP_NTP;
+    else if (timeSource >= TOKI_TS_SEC) ts = TOKI_TS_UDP_SEC;
+    toki.setTime(tm, ts);
+  } else if (timebaseUpdated && toki.getTimeSource() > 99) { //if we both have good times, get a more accurate timebase
+    Toki::Time myTime = toki.getTime();
+    uint32_t diff = toki.msDifference(tm, myTime);
+    strip.timebase -= PRESUMED_NETWORK_DELAY; //no need to presume, use difference between NTP times at send and receive points
+    if (toki.isLater(tm, myTime)) {
+      strip.timebase += diff;
+    } else {
+      strip.timebase -= diff;
+    }
+  }
+}
+
 void notify(byte callMode, bool followUp)
 {
   if (!udpConnected) return;
@@ -26,6 +55,12 @@ void notify(byte callMode, bool followUp)
     case CALL_MODE_ALEXA:         if (!notifyAlexa)  return; break;
     default: return;
   }
+  if (udpSyncBinary) {
+    notifyBinary(callMode, followUp);
+    notificationSentCallMode = callMode;
+    notificationSentTime = millis();
+    return;
+  }
   byte udpOut[WLEDPACKETSIZE];
   Segment& mainseg = strip.getMainSegment();
   udpOut[0] = 0; //0: wled notifier protocol 1: WARLS protocol
@@ -215,14 +250,19 @@ void handleNotifications()
   IPAddress localIP;
 
   //send second notification if enabled
-  if(udpConnected && (notificationCount < udpNumRetries) && ((millis()-notificationSentTime) > 250)){
+  if (udpSyncBinary) {
+    handleSyncRetransmit(); // retransmits only to nodes that did not acknowledge
+  } else if(udpConnected && (notificationCount < udpNumRetries) && ((millis()-notificationSentTime) > 250)){
     notify(notificationSentCallMode,true);
   }
 
+  handleRealtimeBuffer();
+
   if (e131NewData && millis() - strip.getLastShow() > 15)
   {
     e131NewData = false;
     strip.show();
+    realtimeStatsShown(realtimeStatsTakeArrival());
   }
 
   //unlock strip when realtime UDP times out
@@ -248,8 +288,10 @@ void handleNotifications()
       DEBUG_PRINTLN(rgbUdp.remoteIP());
       uint8_t lbuf[packetSize];
       rgbUdp.read(lbuf, packetSize);
+      realtimeStatsPacket(REALTIME_MODE_HYPERION, packetSize);
       realtimeLock(realtimeTimeoutMs, REALTIME_MODE_HYPERION);
       if (realtimeOverride && !(realtimeMode && useMainSegmentOnly)) return;
+      realtimeStatsArrival();
       uint16_t id = 0;
       uint16_t totalLen = strip.getLengthTotal();
       for (size_t i = 0; i < packetSize -2; i += 3)
@@ -257,12 +299,15 @@ void handleNotifications()
         setRealtimePixel(id, lbuf[i], lbuf[i+1], lbuf[i+2], 0);
         id++; if (id >= totalLen) break;
       }
-      if (!(realtimeMode && useMainSegmentOnly)) strip.show();
+      if (!realtimeBufferCommit()) {
+        if (!(realtimeMode && useMainSegmentOnly)) strip.show();
+        realtimeStatsShown(realtimeStatsTakeArrival());
+      }
       return;
     }
   }
 
-  if (!(receiveNotifications || receiveDirect)) return;
+  if (!(receiveNotifications || receiveDirect || udpSyncBinary)) return;
 
   localIP = Network.localIP();
   //notifier and UDP realtime
@@ -305,6 +350,9 @@ void handleNotifications()
     return;
   }
 
+  //binary sync protocol (state deltas and acks)
+  if (!isSupp && handleSyncPacket(udpIn, len, notifierUdp.remoteIP())) return;
+
   //wled notifier, ignore if realtime packets active
   if (udpIn[0] == 0 && !realtimeMode && receiveNotifications)
   {
@@ -419,9 +467,7 @@ void handleNotifications()
 
       if (applyEffects && version > 5) {
         uint32_t t = (udpIn[25] << 24) | (udpIn[26] << 16) | (udpIn[27] << 8) | (udpIn[28]);
-        t += PRESUMED_NETWORK_DELAY; //adjust trivially for network delay
-        t -= millis();
-        strip.timebase = t;
+        applySyncTimebase(t);
         timebaseUpdated = true;
       }
     }
@@ -432,22 +478,7 @@ void handleNotifications()
       Toki::Time tm;
       tm.sec = (udpIn[30] << 24) | (udpIn[31] << 16) | (udpIn[32] << 8) | (udpIn[33]);
       tm.ms = (udpIn[34] << 8) | (udpIn[35]);
-      if (udpIn[29] > toki.getTimeSource()) { //if sender's time source is more accurate
-        toki.adjust(tm, PRESUMED_NETWORK_DELAY); //adjust trivially for network delay
-        uint8_t ts = TOKI_TS_UDP;
-        if (udpIn[29] > 99) ts = TOKI_TS_UDP_NTP;
-        else if (udpIn[29] >= TOKI_TS_SEC) ts = TOKI_TS_UDP_SEC;
-        toki.setTime(tm, ts);
-      } else if (timebaseUpdated && toki.getTimeSource() > 99) { //if we both have good times, get a more accurate timebase
-        Toki::Time myTime = toki.getTime();
-        uint32_t diff = toki.msDifference(tm, myTime);
-        strip.timebase -= PRESUMED_NETWORK_DELAY; //no need to presume, use difference between NTP times at send and receive points
-        if (toki.isLater(tm, myTime)) {
-          strip.timebase += diff;
-        } else {
-          strip.timebase -= diff;
-        }
-      }
+      adjustSyncTime(tm, udpIn[29], timebaseUpdated);
     }
 
     if (version > 3)
@@ -477,8 +508,10 @@ void handleNotifications()
     if (tpmType != 0xda) return; //return if notTPM2.NET data
 
     realtimeIP = (isSupp) ? notifier2Udp.remoteIP() : notifierUdp.remoteIP();
+    realtimeStatsPacket(REALTIME_MODE_TPM2NET, len);
     realtimeLock(realtimeTimeoutMs, REALTIME_MODE_TPM2NET);
     if (realtimeOverride && !(realtimeMode && useMainSegmentOnly)) return;
+    realtimeStatsArrival();
 
     tpmPacketCount++; //increment the packet count
     if (tpmPacketCount == 1) tpmPayloadFrameSize = (udpIn[2] << 8) + udpIn[3]; //save frame size for the whole payload if this is the first packet
@@ -499,7 +532,10 @@ void handleNotifications()
     if (tpmPacketCount == numPackets) //reset packet count and show if all packets were received
     {
       tpmPacketCount = 0;
-      strip.show();
+      if (!realtimeBufferCommit()) {
+        strip.show();
+        realtimeStatsShown(realtimeStatsTakeArrival());
+      }
     }
     return;
   }
@@ -510,6 +546,7 @@ void handleNotifications()
     realtimeIP = (isSupp) ? notifier2Udp.remoteIP() : notifierUdp.remoteIP();
     DEBUG_PRINTLN(realtimeIP);
     if (packetSize < 2) return;
+    realtimeStatsPacket(REALTIME_MODE_UDP, packetSize);
 
     if (udpIn[1] == 0)
     {
@@ -519,6 +556,7 @@ void handleNotifications()
       realtimeLock(udpIn[1]*1000 +1, REALTIME_MODE_UDP);
     }
     if (realtimeOverride && !(realtimeMode && useMainSegmentOnly)) return;
+    realtimeStatsArrival();
 
     uint16_t totalLen = strip.getLengthTotal();
     if (udpIn[0] == 1) //warls
@@ -564,7 +602,10 @@ void handleNotifications()
         id++;
       }
     }
-    strip.show();
+    if (!realtimeBufferCommit()) {
+      strip.show();
+      realtimeStatsShown(realtimeStatsTakeArrival());
+    }
     return;
   }
 
@@ -596,6 +637,7 @@ void setRealtimePixel(uint16_t i, byte r, byte g, byte b, byte w)
       b = gamma8(b);
       w = gamma8(w);
     }
+    if (realtimeBufferSetPixel(pix, RGBW32(r, g, b, w))) return; // frame is buffered and shown later
     if (useMainSegmentOnly) {
       Segment &seg = strip.getMainSegment();
       if (pix<seg.length()) seg.setPixelColor(pix, r, g, b, w);
@@ -0,0 +1,625 @@
+#include "wled.h"
+
+/*
+ * Binary UDP sync protocol (sent instead of the fixed notifier packet if udpSyncBinary is set)
+ *
+ * State packets contain every field that changed in any packet since the last state acknowledged by all known
+ * peers (the base), so a packet is idempotent, may be retransmitted or arrive after a newer one was lost, and a
+ * receiver that applied any packet since the base still ends up with the current state. Segments that were
+ * removed are sent as an id with only SYNC_SEG_REMOVED set.
+ * The epoch is chosen at boot, a receiver seeing a new epoch forgets the sequence of that sender.
+ * Receivers acknowledge each state packet; a receiver that does not have the base state asks for a full state.
+ * The sender periodically broadcasts its effect clock so all nodes render the same frame.
+ *
+ * State packet:
+ *  0: SYNC_TOKEN, 1: SYNC_VERSION, 2: flags, 3-4: sequence, 5-6: base sequence, 7: sync groups, 8: call mode,
+ *  9: main segment, 10-13: effect clock, 14: time source, 15-18: unix time, 19-20: ms, 21-22: epoch,
+ *  23: global field mask + fields, segment count, then per segment: id, field mask (2 bytes) + fields
+ * Ack packet:
+ *  0: SYNC_TOKEN, 1: SYNC_VERSION, 2: SYNC_FLAG_ACK (| SYNC_FLAG_NEED_FULL), 3-4: sequence
+ */
+
+#define SYNC_TOKEN         0xFB
+#define SYNC_VERSION       2
+#define SYNC_HEADER_SIZE   23
+#define SYNC_ACK_SIZE      5
+#define SYNC_SEG_MAX_SIZE  41    // id + mask + all fields
+#define SYNC_MAX_PACKET    (SYNC_HEADER_SIZE + 6 + MAX_NUM_SEGMENTS*SYNC_SEG_MAX_SIZE)
+
+#define SYNC_FLAG_FULL      0x01 // all fields, no base state required
+#define SYNC_FLAG_ACK       0x02
+#define SYNC_FLAG_NEED_FULL 0x04 // receiver does not have the base state
+#define SYNC_FLAG_CLOCK     0x08 // effect clock only
+#define SYNC_FLAG_RETRY     0x10 // retransmission
+
+#define SYNC_G_BRI          0x01
+#define SYNC_G_TRANSITION   0x02
+#define SYNC_G_NIGHTLIGHT   0x04
+
+#define SYNC_SEG_BOUNDS     0x0001
+#define SYNC_SEG_GROUPING   0x0002
+#define SYNC_SEG_OPTIONS    0x0004
+#define SYNC_SEG_OPACITY    0x0008
+#define SYNC_SEG_MODE       0x0010
+#define SYNC_SEG_SPEED      0x0020
+#define SYNC_SEG_INTENSITY  0x0040
+#define SYNC_SEG_PALETTE    0x0080
+#define SYNC_SEG_COL0       0x0100
+#define SYNC_SEG_COL1       0x0200
+#define SYNC_SEG_COL2       0x0400
+#define SYNC_SEG_CCT        0x0800
+#define SYNC_SEG_CUSTOM     0x1000
+#define SYNC_SEG_ALL        0x1FFF
+#define SYNC_SEG_REMOVED    0x8000 // no fields
+
+#define SYNC_MAX_PEERS      32   // nodes acknowledging our packets
+#define SYNC_MAX_SENDERS    8    // nodes we receive from
+#define SYNC_RETRY_DELAY    250  // ms before unacknowledged packets are retransmitted
+#define SYNC_MAX_RETRIES    4
+#define SYNC_PEER_MAX_MISS  3    // peers not acknowledging this many packets in a row are dropped
+#define SYNC_CLOCK_INTERVAL 2000 // ms between effect clock broadcasts
+
+typedef struct SyncSegment {
+  bool     active;
+  uint16_t start, stop, startY, stopY;
+  uint8_t  grouping, spacing;
+  uint16_t offset;
+  uint16_t options;
+  uint8_t  opacity, mode, speed, intensity, palette, cct;
+  uint32_t colors[3];
+  uint8_t  custom1, custom2, custom3; // custom3 includes checkmarks in bits 5-7
+} sync_seg_t;
+
+typedef struct SyncState {
+  uint8_t  bri;
+  uint16_t transition;
+  uint8_t  nightlightActive, nightlightMins;
+  sync_seg_t seg[MAX_NUM_SEGMENTS];
+} sync_state_t;
+
+typedef struct SyncPeer {
+  uint32_t ip;     // 0 = unused
+  uint16_t acked;  // last acknowledged sequence
+  uint8_t  missed; // packets in a row not acknowledged
+} sync_peer_t;
+
+typedef struct SyncSender {
+  uint32_t ip;
+  uint16_t seq;    // last applied sequence
+  uint16_t epoch;
+  unsigned long seen;
+} sync_sender_t;
+
+static sync_state_t* syncCurrent = nullptr; // last state sent
+static sync_state_t* syncBase    = nullptr; // last state acknowledged by all peers
+static bool     syncHasBase   = false;
+static byte*    syncOut       = nullptr;     // packet buffer
+static uint16_t syncEpoch     = 0;
+static byte     syncDirtyG    = 0;           // fields changed in any packet since the base
+static uint16_t syncDirtySeg[MAX_NUM_SEGMENTS];
+static uint16_t syncBaseSeq   = 0;           // sequence of syncBase
+static uint16_t syncSeq       = 0;
+static bool     syncPending   = false;       // waiting for acks
+static uint8_t  syncRetries   = 0;
+static bool     syncIsMaster  = false;       // we sent the last state change, so we provide the effect clock
+static unsigned long syncSentTime  = 0;
+static unsigned long syncClockTime = 0;
+static sync_peer_t   syncPeers[SYNC_MAX_PEERS];
+static sync_sender_t syncSenders[SYNC_MAX_SENDERS];
+
+// statistics
+static uint32_t syncPackets     = 0;
+static uint32_t syncRetransmits = 0;
+static uint32_t syncFullSent    = 0;
+
+static bool allocSyncState()
+{
+  if (syncCurrent) return true;
+  syncCurrent = (sync_state_t*)calloc(2, sizeof(sync_state_t));
+  syncOut = (byte*)malloc(SYNC_MAX_PACKET);
+  if (!syncCurrent || !syncOut) {
+    DEBUG_PRINTLN(F("Sync state allocation failed."));
+    free(syncCurrent);
+    free(syncOut);
+    syncCurrent = nullptr;
+    syncOut = nullptr;
+    return false;
+  }
+  syncBase = syncCurrent + 1;
+  syncHasBase = false;
+  #ifdef ESP8266
+  syncEpoch = RANDOM_REG32;
+  #else
+  syncEpoch = esp_random();
+  #endif
+  return true;
+}
+
+static void captureSyncState(sync_state_t& s)
+{
+  s.bri = bri;
+  s.transition = transitionDelay;
+  s.nightlightActive = nightlightActive;
+  s.nightlightMins = nightlightDelayMins;
+  for (size_t i = 0; i < MAX_NUM_SEGMENTS; i++) {
+    sync_seg_t& d = s.seg[i];
+    if (i >= strip.getSegmentsNum() || !strip.getSegment(i).isActive()) {
+      d.active = false;
+      continue;
+    }
+    Segment& seg = strip.getSegment(i);
+    d.active    = true;
+    d.start     = seg.start;
+    d.stop      = seg.stop;
+    d.startY    = seg.startY;
+    d.stopY     = seg.stopY;
+    d.grouping  = seg.grouping;
+    d.spacing   = seg.spacing;
+    d.offset    = seg.offset;
+    d.options   = seg.options & 0xFF8F; // ignore freeze, reset, transitional
+    d.opacity   = seg.opacity;
+    d.mode      = seg.mode;
+    d.speed     = seg.speed;
+    d.intensity = seg.intensity;
+    d.palette   = seg.palette;
+    d.cct       = seg.cct;
+    d.colors[0] = seg.colors[0];
+    d.colors[1] = seg.colors[1];
+    d.colors[2] = seg.colors[2];
+    d.custom1   = seg.custom1;
+    d.custom2   = seg.custom2;
+    d.custom3   = seg.custom3 | (seg.check1<<5) | (seg.check2<<6) | (seg.check3<<7);
+  }
+}
+
+static uint16_t syncSegmentDelta(const sync_seg_t& a, const sync_seg_t* b)
+{
+  if (!b || !b->active) return SYNC_SEG_ALL;
+  uint16_t mask = 0;
+  if (a.start != b->start || a.stop != b->stop || a.startY != b->startY || a.stopY != b->stopY) mask |= SYNC_SEG_BOUNDS;
+  if (a.grouping != b->grouping || a.spacing != b->spacing || a.offset != b->offset) mask |= SYNC_SEG_GROUPING;
+  if (a.options   != b->options)   mask |= SYNC_SEG_OPTIONS;
+  if (a.opacity   != b->opacity)   mask |= SYNC_SEG_OPACITY;
+  if (a.mode      != b->mode)      mask |= SYNC_SEG_MODE;
+  if (a.speed     != b->speed)     mask |= SYNC_SEG_SPEED;
+  if (a.intensity != b->intensity) mask |= SYNC_SEG_INTENSITY;
+  if (a.palette   != b->palette)   mask |= SYNC_SEG_PALETTE;
+  if (a.colors[0] != b->colors[0]) mask |= SYNC_SEG_COL0;
+  if (a.colors[1] != b->colors[1]) mask |= SYNC_SEG_COL1;
+  if (a.colors[2] != b->colors[2]) mask |= SYNC_SEG_COL2;
+  if (a.cct       != b->cct)       mask |= SYNC_SEG_CCT;
+  if (a.custom1 != b->custom1 || a.custom2 != b->custom2 || a.custom3 != b->custom3) mask |= SYNC_SEG_CUSTOM;
+  return mask;
+}
+
+static inline byte* put16(byte* p, uint16_t v) { p[0] = v >> 8; p[1] = v & 0xFF; return p + 2; }
+static inline byte* put32(byte* p, uint32_t v) { p[0] = v >> 24; p[1] = (v >> 16) & 0xFF; p[2] = (v >> 8) & 0xFF; p[3] = v & 0xFF; return p + 4; }
+static inline uint16_t get16(const byte* p) { return (p[0] << 8) | p[1]; }
+static inline uint32_t get32(const byte* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3]; }
+
+static byte* putSyncHeader(byte* p, byte flags, byte callMode)
+{
+  *p++ = SYNC_TOKEN;
+  *p++ = SYNC_VERSION;
+  *p++ = flags;
+  p = put16(p, syncSeq);
+  p = put16(p, syncSeq); // base sequence, set by caller for deltas
+  *p++ = syncGroups;
+  *p++ = callMode;
+  *p++ = strip.getMainSegmentId();
+  p = put32(p, millis() + strip.timebase);
+  *p++ = toki.getTimeSource();
+  Toki::Time tm = toki.getTime();
+  p = put32(p, tm.sec);
+  p = put16(p, tm.ms);
+  p = put16(p, syncEpoch);
+  return p;
+}
+
+// adds the changes of syncCurrent against syncBase to the fields sent until the base advances
+static void syncUpdateDirty()
+{
+  if (!syncHasBase) return;
+  const sync_state_t& s = *syncCurrent;
+  if (s.bri != syncBase->bri) syncDirtyG |= SYNC_G_BRI;
+  if (s.transition != syncBase->transition) syncDirtyG |= SYNC_G_TRANSITION;
+  if (s.nightlightActive != syncBase->nightlightActive || s.nightlightMins != syncBase->nightlightMins) syncDirtyG |= SYNC_G_NIGHTLIGHT;
+  for (size_t i = 0; i < MAX_NUM_SEGMENTS; i++) {
+    if (s.seg[i].active) syncDirtySeg[i] |= syncSegmentDelta(s.seg[i], &syncBase->seg[i]);
+    else if (syncBase->seg[i].active || syncDirtySeg[i]) syncDirtySeg[i] |= SYNC_SEG_REMOVED;
+  }
+}
+
+// encodes syncCurrent with the fields changed since the base (all fields if full), returns packet length
+static size_t buildSyncPacket(byte* buf, byte flags, byte callMode, bool full, uint16_t baseSeq)
+{
+  if (full) flags |= SYNC_FLAG_FULL;
+  byte* p = putSyncHeader(buf, flags, callMode);
+  put16(buf + 5, baseSeq);
+
+  const sync_state_t& s = *syncCurrent;
+  byte gmask = full ? (SYNC_G_BRI | SYNC_G_TRANSITION | SYNC_G_NIGHTLIGHT) : syncDirtyG;
+  *p++ = gmask;
+  if (gmask & SYNC_G_BRI) *p++ = s.bri;
+  if (gmask & SYNC_G_TRANSITION) p = put16(p, s.transition);
+  if (gmask & SYNC_G_NIGHTLIGHT) { *p++ = s.nightlightActive; *p++ = s.nightlightMins; }
+
+  byte* segCount = p++;
+  *segCount = 0;
+  for (size_t i = 0; i < MAX_NUM_SEGMENTS; i++) {
+    const sync_seg_t& d = s.seg[i];
+    uint16_t mask = full ? SYNC_SEG_ALL : syncDirtySeg[i];
+    if (!d.active) mask = mask ? SYNC_SEG_REMOVED : 0; // full: the receiver may have it
+    else if (mask & SYNC_SEG_REMOVED) mask = SYNC_SEG_ALL; // removed and added again
+    if (!mask) continue;
+    *p++ = i;
+    p = put16(p, mask);
+    if (mask & SYNC_SEG_BOUNDS)    { p = put16(p, d.start); p = put16(p, d.stop); p = put16(p, d.startY); p = put16(p, d.stopY); }
+    if (mask & SYNC_SEG_GROUPING)  { *p++ = d.grouping; *p++ = d.spacing; p = put16(p, d.offset); }
+    if (mask & SYNC_SEG_OPTIONS)   p = put16(p, d.options);
+    if (mask & SYNC_SEG_OPACITY)   *p++ = d.opacity;
+    if (mask & SYNC_SEG_MODE)      *p++ = d.mode;
+    if (mask & SYNC_SEG_SPEED)     *p++ = d.speed;
+    if (mask & SYNC_SEG_INTENSITY) *p++ = d.intensity;
+    if (mask & SYNC_SEG_PALETTE)   *p++ = d.palette;
+    if (mask & SYNC_SEG_COL0)      p = put32(p, d.colors[0]);
+    if (mask & SYNC_SEG_COL1)      p = put32(p, d.colors[1]);
+    if (mask & SYNC_SEG_COL2)      p = put32(p, d.colors[2]);
+    if (mask & SYNC_SEG_CCT)       *p++ = d.cct;
+    if (mask & SYNC_SEG_CUSTOM)    { *p++ = d.custom1; *p++ = d.custom2; *p++ = d.custom3; }
+    (*segCount)++;
+  }
+  return p - buf;
+}
+
+static IPAddress getSyncBroadcastIP()
+{
+  return ~uint32_t(Network.subnetMask()) | uint32_t(Network.gatewayIP());
+}
+
+static void sendSyncPacket(IPAddress ip, const byte* buf, size_t len)
+{
+  notifierUdp.beginPacket(ip, udpPort);
+  notifierUdp.write(buf, len);
+  notifierUdp.endPacket();
+  syncPackets++;
+}
+
+static void sendSyncAck(IPAddress ip, uint16_t seq, bool needFull)
+{
+  byte ack[SYNC_ACK_SIZE] = {SYNC_TOKEN, SYNC_VERSION, SYNC_FLAG_ACK, 0, 0};
+  if (needFull) ack[2] |= SYNC_FLAG_NEED_FULL;
+  put16(ack + 3, seq);
+  notifierUdp.beginPacket(ip, udpPort);
+  notifierUdp.write(ack, SYNC_ACK_SIZE);
+  notifierUdp.endPacket();
+}
+
+// true if all known peers acknowledged the last state packet
+static bool syncAllAcked()
+{
+  for (size_t i = 0; i < SYNC_MAX_PEERS; i++) {
+    if (syncPeers[i].ip && syncPeers[i].acked != syncSeq) return false;
+  }
+  return true;
+}
+
+static void syncAdvanceBase()
+{
+  memcpy(syncBase, syncCurrent, sizeof(sync_state_t));
+  syncDirtyG = 0;
+  memset(syncDirtySeg, 0, sizeof(syncDirtySeg));
+  syncBaseSeq = syncSeq;
+  syncHasBase = true;
+  syncPending = false;
+}
+
+// called from notify() instead of sending the legacy notifier packet
+void notifyBinary(byte callMode, bool followUp)
+{
+  if (!allocSyncState()) return;
+  byte* udpOut = syncOut;
+  size_t len;
+  if (followUp) {
+    // retransmission of the last state, only needed by peers that did not acknowledge it
+    len = buildSyncPacket(udpOut, SYNC_FLAG_RETRY, callMode, !syncHasBase, syncBaseSeq);
+    uint8_t missing = 0;
+    for (size_t i = 0; i < SYNC_MAX_PEERS; i++) if (syncPeers[i].ip && syncPeers[i].acked != syncSeq) missing++;
+    if (missing && missing <= 4) {
+      for (size_t i = 0; i < SYNC_MAX_PEERS; i++) {
+        if (syncPeers[i].ip && syncPeers[i].acked != syncSeq) sendSyncPacket(IPAddress(syncPeers[i].ip), udpOut, len);
+      }
+    } else {
+      sendSyncPacket(getSyncBroadcastIP(), udpOut, len);
+    }
+    syncRetransmits++;
+  } else {
+    captureSyncState(*syncCurrent);
+    syncUpdateDirty();
+    syncSeq++;
+    if (!syncHasBase) syncFullSent++;
+    len = buildSyncPacket(udpOut, 0, callMode, !syncHasBase, syncBaseSeq);
+    sendSyncPacket(getSyncBroadcastIP(), udpOut, len);
+    syncPending = true;
+    syncRetries = 0;
+    syncIsMaster = true;
+    syncClockTime = millis();
+  }
+  syncSentTime = millis();
+}
+
+static sync_peer_t* findSyncPeer(uint32_t ip, bool create)
+{
+  sync_peer_t* unused = nullptr;
+  for (size_t i = 0; i < SYNC_MAX_PEERS; i++) {
+    if (syncPeers[i].ip == ip) return &syncPeers[i];
+    if (!unused && !syncPeers[i].ip) unused = &syncPeers[i];
+  }
+  if (!create || !unused) return nullptr;
+  unused->ip = ip;
+  unused->missed = 0;
+  unused->acked = syncSeq - 1;
+  return unused;
+}
+
+static void handleSyncAck(IPAddress ip, uint16_t seq, bool needFull)
+{
+  if (!syncCurrent) return;
+  sync_peer_t* peer = findSyncPeer(uint32_t(ip), true);
+  if (needFull) {
+    // peer missed our base state (e.g. it rebooted), send the complete state to it only
+    size_t len = buildSyncPacket(syncOut, 0, notificationSentCallMode, true, syncSeq);
+    sendSyncPacket(ip, syncOut, len);
+    syncFullSent++;
+    return;
+  }
+  if (!peer) return;
+  peer->acked = seq;
+  peer->missed = 0;
+  if (seq == syncSeq && syncPending && syncAllAcked()) syncAdvanceBase();
+}
+
+// retransmissions and effect clock, called from handleNotifications()
+void handleSyncRetransmit()
+{
+  if (!syncCurrent || !udpConnected) return;
+  unsigned long now = millis();
+
+  if (syncPending && now - syncSentTime > SYNC_RETRY_DELAY) {
+    bool anyPeer = false;
+    for (size_t i = 0; i < SYNC_MAX_PEERS; i++) if (syncPeers[i].ip) anyPeer = true;
+    if (syncAllAcked() && anyPeer) {
+      syncAdvanceBase();
+    } else if (syncRetries < MAX(udpNumRetries, anyPeer ? SYNC_MAX_RETRIES : 0)) {
+      syncRetries++;
+      notifyBinary(notificationSentCallMode, true);
+    } else {
+      // give up, drop peers that keep missing packets
+      for (size_t i = 0; i < SYNC_MAX_PEERS; i++) {
+        if (!syncPeers[i].ip || syncPeers[i].acked == syncSeq) continue;
+        if (++syncPeers[i].missed >= SYNC_PEER_MAX_MISS) syncPeers[i].ip = 0;
+      }
+      if (syncAllAcked() && anyPeer) syncAdvanceBase(); // remaining peers are up to date
+      syncPending = false;
+    }
+  }
+
+  // effect clock broadcast
+  if (syncIsMaster && syncGroups && now - syncClockTime > SYNC_CLOCK_INTERVAL) {
+    byte clk[SYNC_HEADER_SIZE];
+    putSyncHeader(clk, SYNC_FLAG_CLOCK, CALL_MODE_NOTIFICATION);
+    sendSyncPacket(getSyncBroadcastIP(), clk, SYNC_HEADER_SIZE);
+    syncClockTime = now;
+  }
+}
+
+static sync_sender_t* findSyncSender(uint32_t ip, bool create, uint16_t epoch = 0)
+{
+  sync_sender_t* oldest = &syncSenders[0];
+  for (size_t i = 0; i < SYNC_MAX_SENDERS; i++) {
+    if (syncSenders[i].ip == ip) return &syncSenders[i];
+    if (syncSenders[i].seen < oldest->seen) oldest = &syncSenders[i];
+  }
+  if (!create) return nullptr;
+  oldest->ip = ip;
+  oldest->seq = 0;
+  oldest->epoch = epoch;
+  return oldest;
+}
+
+static void applySyncSegment(uint8_t id, const sync_seg_t& s, uint16_t mask, uint8_t mainSeg, bool applyEffects, bool applyColors)
+{
+  for (size_t j = 0; j < strip.getSegmentsNum(); j++) {
+    Segment& seg = strip.getSegment(j);
+    if (!seg.isActive() || !seg.isSelected()) continue; //do not apply to non selected segments
+    bool own = (j == id);
+
+    if (own && (receiveSegmentOptions || receiveSegmentBounds) && (mask & (SYNC_SEG_BOUNDS | SYNC_SEG_GROUPING))) {
+      uint16_t start = seg.start, stop = seg.stop, startY = seg.startY, stopY = seg.stopY, offset = seg.offset;
+      uint8_t grouping = seg.grouping, spacing = seg.spacing;
+      if (receiveSegmentBounds && (mask & SYNC_SEG_BOUNDS)) { start = s.start; stop = s.stop; startY = s.startY; stopY = s.stopY; }
+      if (mask & SYNC_SEG_GROUPING) {
+        grouping = s.grouping;
+        spacing  = s.spacing;
+        if (receiveSegmentBounds) offset = s.offset;
+      }
+      seg.set(start, stop, grouping, spacing, offset, startY, stopY);
+    }
+
+    // per segment sync, or main segment of the sender applied to all selected segments
+    if (receiveSegmentOptions ? !own : id != mainSeg) continue;
+
+    if (receiveSegmentOptions) {
+      // ignore selected as it may be used as indicator of which segments to sync, freeze, reset & transitional are never synced
+      if (mask & SYNC_SEG_OPTIONS) seg.options = (seg.options & 0x0071U) | (s.options & 0xFF8E);
+      if (mask & SYNC_SEG_OPACITY) seg.setOpacity(s.opacity);
+    }
+    if (applyEffects) {
+      if (mask & SYNC_SEG_MODE)      seg.setMode(s.mode);
+      if (mask & SYNC_SEG_SPEED)     seg.speed     = s.speed;
+      if (mask & SYNC_SEG_INTENSITY) seg.intensity = s.intensity;
+      if (mask & SYNC_SEG_PALETTE)   seg.setPalette(s.palette);
+      if (mask & SYNC_SEG_CUSTOM) {
+        seg.custom1 = s.custom1;
+        seg.custom2 = s.custom2;
+        seg.custom3 = s.custom3 & 0x1F;
+        seg.check1  = (s.custom3 >> 5) & 0x1;
+        seg.check2  = (s.custom3 >> 6) & 0x1;
+        seg.check3  = (s.custom3 >> 7) & 0x1;
+      }
+    }
+    if (applyColors) {
+      if (mask & SYNC_SEG_COL0) seg.setColor(0, s.colors[0]);
+      if (mask & SYNC_SEG_COL1) seg.setColor(1, s.colors[1]);
+      if (mask & SYNC_SEG_COL2) seg.setColor(2, s.colors[2]);
+      if (mask & SYNC_SEG_CCT)  seg.setCCT(s.cct);
+    }
+  }
+}
+
+static void applySyncClock(const byte* udpIn, bool applyEffects)
+{
+  if (applyEffects) applySyncTimebase(get32(udpIn + 10));
+  Toki::Time tm;
+  tm.sec = get32(udpIn + 15);
+  tm.ms  = get16(udpIn + 19);
+  adjustSyncTime(tm, udpIn[14], applyEffects);
+}
+
+// returns false if the packet is malformed
+static bool applySyncState(const byte* udpIn, size_t len, bool applyBri, bool applyEffects, bool applyColors)
+{
+  const byte* p   = udpIn + SYNC_HEADER_SIZE;
+  const byte* end = udpIn + len;
+  uint8_t mainSeg = udpIn[9];
+
+  if (p >= end) return false;
+  byte gmask = *p++;
+  size_t glen = ((gmask & SYNC_G_BRI) ? 1 : 0) + ((gmask & SYNC_G_TRANSITION) ? 2 : 0) + ((gmask & SYNC_G_NIGHTLIGHT) ? 2 : 0);
+  if (p + glen + 1 > end) return false;
+  if (gmask & SYNC_G_BRI) {
+    if (applyBri) bri = *p;
+    p++;
+  }
+  if (gmask & SYNC_G_TRANSITION) { transitionDelayTemp = get16(p); p += 2; }
+  if (gmask & SYNC_G_NIGHTLIGHT) {
+    nightlightActive = p[0];
+    if (nightlightActive) nightlightDelayMins = p[1];
+    p += 2;
+  }
+
+  if (applyEffects && currentPlaylist >= 0) unloadPlaylist();
+
+  uint8_t segCount = *p++;
+  for (size_t i = 0; i < segCount; i++) {
+    if (p + 3 > end) return false;
+    uint8_t id = p[0];
+    uint16_t mask = get16(p + 1);
+    p += 3;
+    if (mask & SYNC_SEG_REMOVED) {
+      if (receiveSegmentBounds && id < strip.getSegmentsNum()) {
+        Segment& seg = strip.getSegment(id);
+        if (seg.isActive()) seg.set(seg.start, 0); // disables the segment
+      }
+      continue;
+    }
+    sync_seg_t s;
+    size_t slen = ((mask & SYNC_SEG_BOUNDS) ? 8 : 0) + ((mask & SYNC_SEG_GROUPING) ? 4 : 0) + ((mask & SYNC_SEG_OPTIONS) ? 2 : 0)
+                + __builtin_popcount(mask & (SYNC_SEG_OPACITY | SYNC_SEG_MODE | SYNC_SEG_SPEED | SYNC_SEG_INTENSITY | SYNC_SEG_PALETTE | SYNC_SEG_CCT))
+                + 4 * __builtin_popcount(mask & (SYNC_SEG_COL0 | SYNC_SEG_COL1 | SYNC_SEG_COL2)) + ((mask & SYNC_SEG_CUSTOM) ? 3 : 0);
+    if (p + slen > end) return false;
+    if (mask & SYNC_SEG_BOUNDS)    { s.start = get16(p); s.stop = get16(p+2); s.startY = get16(p+4); s.stopY = get16(p+6); p += 8; }
+    if (mask & SYNC_SEG_GROUPING)  { s.grouping = p[0]; s.spacing = p[1]; s.offset = get16(p+2); p += 4; }
+    if (mask & SYNC_SEG_OPTIONS)   { s.options = get16(p); p += 2; }
+    if (mask & SYNC_SEG_OPACITY)   s.opacity   = *p++;
+    if (mask & SYNC_SEG_MODE)      s.mode      = *p++;
+    if (mask & SYNC_SEG_SPEED)     s.speed     = *p++;
+    if (mask & SYNC_SEG_INTENSITY) s.intensity = *p++;
+    if (mask & SYNC_SEG_PALETTE)   s.palette   = *p++;
+    if (mask & SYNC_SEG_COL0)      { s.colors[0] = get32(p); p += 4; }
+    if (mask & SYNC_SEG_COL1)      { s.colors[1] = get32(p); p += 4; }
+    if (mask & SYNC_SEG_COL2)      { s.colors[2] = get32(p); p += 4; }
+    if (mask & SYNC_SEG_CCT)       s.cct       = *p++;
+    if (mask & SYNC_SEG_CUSTOM)    { s.custom1 = p[0]; s.custom2 = p[1]; s.custom3 = p[2]; p += 3; }
+    applySyncSegment(id, s, mask, mainSeg, applyEffects, applyColors);
+  }
+  return true;
+}
+
+// returns true if the packet was a binary sync packet
+bool handleSyncPacket(const byte* udpIn, size_t len, IPAddress remoteIP)
+{
+  if (len < SYNC_ACK_SIZE || udpIn[0] != SYNC_TOKEN) return false;
+  if (udpIn[1] != SYNC_VERSION) return true; // unsupported protocol version
+  byte flags = udpIn[2];
+  uint16_t seq = get16(udpIn + 3);
+
+  if (flags & SYNC_FLAG_ACK) {
+    handleSyncAck(remoteIP, seq, flags & SYNC_FLAG_NEED_FULL);
+    return true;
+  }
+
+  if (len < SYNC_HEADER_SIZE || !receiveNotifications || realtimeMode) return true;
+  if (!(receiveGroups & udpIn[7])) return true; // not part of the sender's sync groups
+  if (udpIn[8] > 199) return true; //do not receive custom versions
+  //ignore notification if received within a second after sending a notification ourselves
+  if (millis() - notificationSentTime < 1000) return true;
+
+  bool someSel = (receiveNotificationBrightness || receiveNotificationColor || receiveNotificationEffects);
+  bool applyEffects = (receiveNotificationEffects || !someSel);
+  bool applyColors  = (receiveNotificationColor || !someSel);
+
+  if (flags & SYNC_FLAG_CLOCK) {
+    applySyncClock(udpIn, applyEffects);
+    return true;
+  }
+
+  uint32_t ip = uint32_t(remoteIP);
+  uint16_t epoch = get16(udpIn + 21);
+  sync_sender_t* sender = findSyncSender(ip, false);
+  if (sender && sender->epoch != epoch) { // sender rebooted, its sequence started over
+    sender->ip = 0;
+    sender = nullptr;
+  }
+  if (sender) {
+    if (seq == sender->seq) { // duplicate or retransmission of a state already applied
+      sendSyncAck(remoteIP, seq, false);
+      return true;
+    }
+    if (!(flags & SYNC_FLAG_FULL) && (int16_t)(seq - sender->seq) < 0) return true; // outdated
+  }
+  if (!(flags & SYNC_FLAG_FULL) && (!sender || (int16_t)(sender->seq - get16(udpIn + 5)) < 0)) {
+    // we do not have the state this delta is based on
+    sendSyncAck(remoteIP, seq, true);
+    return true;
+  }
+
+  if (!applySyncState(udpIn, len, receiveNotificationBrightness || !someSel, applyEffects, applyColors)) {
+    DEBUG_PRINTLN(F("Malformed sync packet."));
+    return true;
+  }
+  applySyncClock(udpIn, applyEffects);
+
+  if (!sender) sender = findSyncSender(ip, true, epoch);
+  sender->seq  = seq;
+  sender->seen = millis();
+  syncIsMaster = false; // another node changed the state, it provides the clock now
+  sendSyncAck(remoteIP, seq, false);
+
+  stateChanged = true;
+  stateUpdated(CALL_MODE_NOTIFICATION);
+  return true;
+}
+
+void serializeSyncStats(JsonObject root)
+{
+  if (!syncCurrent) return;
+  uint8_t peers = 0;
+  for (size_t i = 0; i < SYNC_MAX_PEERS; i++) if (syncPeers[i].ip) peers++;
+  JsonObject sync = root.createNestedObject(F("usync"));
+  sync[F("seq")]   = syncSeq;
+  sync[F("peers")] = peers;
+  sync[F("pkt")]   = syncPackets;
+  sync[F("rtx")]   = syncRetransmits;
+  sync[F("full")]  = syncFullSent;
+}
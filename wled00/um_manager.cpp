@@ -4,28 +4,49 @@
  */
 
 //Usermod Manager internals
-void UsermodManager::setup()             { for (byte i = 0; i < numMods; i++) ums[i]->setup(); }
+// usermods declare the hooks they implement (getHooks()), the manager only calls those
+#define FOR_HOOK(h) for (byte i = 0; i < numMods; i++) if (hooks[i] & (h))
+
+void UsermodManager::setup() {
+  for (byte i = 0; i < numMods; i++) ums[i]->setup();
+  for (byte i = 0; i < numMods; i++) updateHooks(i); // may depend on config and setup()
+}
 void UsermodManager::connected()         { for (byte i = 0; i < numMods; i++) ums[i]->connected(); }
-void UsermodManager::loop()              { for (byte i = 0; i < numMods; i++) ums[i]->loop();  }
-void UsermodManager::handleOverlayDraw() { for (byte i = 0; i < numMods; i++) ums[i]->handleOverlayDraw(); }
+void UsermodManager::loop() {
+  unsigned long now = millis();
+  FOR_HOOK(UM_HOOK_LOOP) {
+    if (loopInterval[i] && now - lastLoop[i] < loopInterval[i]) continue;
+    lastLoop[i] = now;
+    unsigned long start = micros();
+    ums[i]->loop();
+    account(loopTime[i], start);
+  }
+}
+void UsermodManager::handleOverlayDraw() {
+  FOR_HOOK(UM_HOOK_OVERLAY) {
+    unsigned long start = micros();
+    ums[i]->handleOverlayDraw();
+    account(overlayTime[i], start);
+  }
+}
 void UsermodManager::appendConfigData()  { for (byte i = 0; i < numMods; i++) ums[i]->appendConfigData(); }
 bool UsermodManager::handleButton(uint8_t b) {
   bool overrideIO = false;
-  for (byte i = 0; i < numMods; i++) {
+  FOR_HOOK(UM_HOOK_BUTTON) {
     if (ums[i]->handleButton(b)) overrideIO = true;
   }
   return overrideIO;
 }
 bool UsermodManager::getUMData(um_data_t **data, uint8_t mod_id) {
-  for (byte i = 0; i < numMods; i++) {
+  FOR_HOOK(UM_HOOK_UMDATA) {
     if (mod_id > 0 && ums[i]->getId() != mod_id) continue;  // only get data form requested usermod if provided
     if (ums[i]->getUMData(data)) return true;               // if usermod does provide data return immediately (only one usermod can povide data at one time)
   }
   return false;
 }
-void UsermodManager::addToJsonState(JsonObject& obj)    { for (byte i = 0; i < numMods; i++) ums[i]->addToJsonState(obj); }
-void UsermodManager::addToJsonInfo(JsonObject& obj)     { for (byte i = 0; i < numMods; i++) ums[i]->addToJsonInfo(obj); }
-void UsermodManager::readFromJsonState(JsonObject& obj) { for (byte i = 0; i < numMods; i++) ums[i]->readFromJsonState(obj); }
+void UsermodManager::addToJsonState(JsonObject& obj)    { FOR_HOOK(UM_HOOK_JSON_STATE) ums[i]->addToJsonState(obj); }
+void UsermodManager::addToJsonInfo(JsonObject& obj)     { FOR_HOOK(UM_HOOK_JSON_INFO)  ums[i]->addToJsonInfo(obj); }
+void UsermodManager::readFromJsonState(JsonObject& obj) { FOR_HOOK(UM_HOOK_JSON_STATE) ums[i]->readFromJsonState(obj); }
 void UsermodManager::addToConfig(JsonObject& obj)       { for (byte i = 0; i < numMods; i++) ums[i]->addToConfig(obj); }
 bool UsermodManager::readFromConfig(JsonObject& obj)    {
   bool allComplete = true;
@@ -34,13 +55,13 @@ bool UsermodManager::readFromConfig(JsonObject& obj)    {
   }
   return allComplete;
 }
-void UsermodManager::onMqttConnect(bool sessionPresent) { for (byte i = 0; i < numMods; i++) ums[i]->onMqttConnect(sessionPresent); }
+void UsermodManager::onMqttConnect(bool sessionPresent) { FOR_HOOK(UM_HOOK_MQTT) ums[i]->onMqttConnect(sessionPresent); }
 bool UsermodManager::onMqttMessage(char* topic, char* payload) {
-  for (byte i = 0; i < numMods; i++) if (ums[i]->onMqttMessage(topic, payload)) return true;
+  FOR_HOOK(UM_HOOK_MQTT) if (ums[i]->onMqttMessage(topic, payload)) return true;
   return false;
 }
 void UsermodManager::onUpdateBegin(bool init) { for (byte i = 0; i < numMods; i++) ums[i]->onUpdateBegin(init); } // notify usermods that update is to begin
-void UsermodManager::onStateChange(uint8_t mode) { for (byte i = 0; i < numMods; i++) ums[i]->onStateChange(mode); } // notify usermods that WLED state changed
+void UsermodManager::onStateChange(uint8_t mode) { FOR_HOOK(UM_HOOK_STATE) ums[i]->onStateChange(mode); } // notify usermods that WLED state changed
 
 /*
  * Enables usermods to lookup another Usermod.
@@ -57,6 +78,41 @@ Usermod* UsermodManager::lookup(uint16_t mod_id) {
 bool UsermodManager::add(Usermod* um)
 {
   if (numMods >= WLED_MAX_USERMODS || um == nullptr) return false;
-  ums[numMods++] = um;
+  ums[numMods] = um;
+  updateHooks(numMods++);
   return true;
 }
+
+void UsermodManager::updateHooks(byte i)
+{
+  hooks[i] = ums[i]->getHooks();
+  loopInterval[i] = ums[i]->getLoopInterval();
+}
+
+void UsermodManager::account(um_time_t& t, unsigned long start)
+{
+  uint32_t elapsed = micros() - start;
+  t.calls++;
+  t.total += elapsed;
+  if (elapsed > t.max) t.max = elapsed;
+}
+
+// per usermod: id, loop() calls, average and max time per call (us), total time (ms); the same for handleOverlayDraw()
+void UsermodManager::serializeStats(JsonObject root)
+{
+  if (!numMods) return;
+  JsonArray arr = root.createNestedArray(F("umt"));
+  for (byte i = 0; i < numMods; i++) {
+    JsonObject um = arr.createNestedObject();
+    um["id"] = ums[i]->getId();
+    um["n"]  = loopTime[i].calls;
+    um[F("avg")] = loopTime[i].calls ? (uint32_t)(loopTime[i].total / loopTime[i].calls) : 0;
+    um[F("max")] = loopTime[i].max;
+    um["ms"] = (uint32_t)(loopTime[i].total / 1000);
+    if (!(hooks[i] & UM_HOOK_OVERLAY)) continue;
+    JsonObject ovl = um.createNestedObject(F("ovl"));
+    ovl["n"]      = overlayTime[i].calls;
+    ovl[F("avg")] = overlayTime[i].calls ? (uint32_t)(overlayTime[i].total / overlayTime[i].calls) : 0;
+    ovl[F("max")] = overlayTime[i].max;
+  }
+}
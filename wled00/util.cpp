@@ -191,26 +191,116 @@ bool isAsterisksOnly(const char* str, byte maxLen)
 }
 
 
-//threading/network callback details: https://github.com/Aircoookie/WLED/pull/2336#discussion_r762276994
-bool requestJSONBufferLock(uint8_t module)
+/*
+ * JSON buffer pool
+ * The global doc is the primary buffer. Its lock also serializes everything that reads or changes segments:
+ * deserializing state and config (fileDoc points to it while it is locked) as well as serializing state/info.
+ * Pooled buffers are only handed out by requestJSONBuffer() for output that does not depend on strip state
+ * (effect names and data, palettes, nodes, networks, usermod config), so a slow response does not block anyone.
+ * Pooled buffers are allocated on first use (in PSRAM if available) and kept for reuse.
+ */
+#ifndef WLED_JSON_POOL_SIZE
+  #ifdef ARDUINO_ARCH_ESP32
+    #define WLED_JSON_POOL_SIZE 3   // maximum number of additional buffers (only 1 is used without PSRAM)
+  #else
+    #define WLED_JSON_POOL_SIZE 0   // not enough RAM
+  #endif
+#endif
+#define JSON_HIGH_PRIO_WAIT 50      // ms a high priority request may wait for a buffer
+
+#if WLED_JSON_POOL_SIZE > 0
+static PSRAMDynamicJsonDocument* jsonPool[WLED_JSON_POOL_SIZE] = { nullptr };
+static volatile uint8_t jsonPoolLock[WLED_JSON_POOL_SIZE] = { 0 };
+#endif
+
+#ifdef ARDUINO_ARCH_ESP32
+static portMUX_TYPE jsonLockMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// statistics
+static uint32_t jsonLockCount     = 0;  // buffers handed out
+static uint32_t jsonLockContended = 0;  // requests that had to wait or use a pooled buffer
+static uint32_t jsonLockFailed    = 0;  // requests that got no buffer
+static uint32_t jsonLockWaitSum   = 0;  // ms
+static uint16_t jsonLockWaitMax   = 0;  // ms
+static uint8_t  jsonPoolMaxInUse  = 0;  // most pooled buffers in use at the same time
+
+// atomically takes a lock if it is free
+static bool tryJSONLock(volatile uint8_t& lock, uint8_t module)
 {
-  unsigned long now = millis();
+  bool taken = false;
+  #ifdef ARDUINO_ARCH_ESP32
+  portENTER_CRITICAL(&jsonLockMux);
+  #endif
+  if (!lock) {
+    lock = module ? module : 255;
+    taken = true;
+  }
+  #ifdef ARDUINO_ARCH_ESP32
+  portEXIT_CRITICAL(&jsonLockMux);
+  #endif
+  return taken;
+}
 
-  while (jsonBufferLock && millis()-now < 1000) delay(1); // wait for a second for buffer lock
+static void updateJSONLockStats(unsigned long waited, bool contended)
+{
+  jsonLockCount++;
+  if (contended) jsonLockContended++;
+  jsonLockWaitSum += waited;
+  if (waited > jsonLockWaitMax) jsonLockWaitMax = MIN(waited, UINT16_MAX);
+}
 
-  if (millis()-now >= 1000) {
-    DEBUG_PRINT(F("ERROR: Locking JSON buffer failed! ("));
-    DEBUG_PRINT(jsonBufferLock);
-    DEBUG_PRINTLN(")");
-    return false; // waiting time-outed
+static uint8_t getJSONPoolSize()
+{
+  #if WLED_JSON_POOL_SIZE > 0
+    #if defined(ARDUINO_ARCH_ESP32) && defined(WLED_USE_PSRAM)
+    if (psramFound()) return WLED_JSON_POOL_SIZE;
+    #endif
+  return 1;
+  #else
+  return 0;
+  #endif
+}
+
+static uint8_t getJSONPoolInUse()
+{
+  uint8_t inUse = 0;
+  #if WLED_JSON_POOL_SIZE > 0
+  for (size_t i = 0; i < WLED_JSON_POOL_SIZE; i++) if (jsonPoolLock[i]) inUse++;
+  #endif
+  return inUse;
+}
+
+static bool takeJSONBufferLock(uint8_t module)
+{
+  if (!tryJSONLock(jsonBufferLock, module)) return false;
+  fileDoc = &doc;  // used for applying presets (presets.cpp)
+  doc.clear();
+  return true;
+}
+
+//threading/network callback details: https://github.com/Aircoookie/WLED/pull/2336#discussion_r762276994
+bool requestJSONBufferLock(uint8_t module, uint16_t timeout)
+{
+  unsigned long now = millis();
+  bool contended = false;
+
+  while (!takeJSONBufferLock(module)) {
+    contended = true;
+    if (millis()-now >= timeout) { // wait (a second by default) for buffer lock
+      jsonLockFailed++;
+      DEBUG_PRINT(F("ERROR: Locking JSON buffer failed! ("));
+      DEBUG_PRINT(jsonBufferLock);
+      DEBUG_PRINTLN(")");
+      return false; // waiting time-outed
+    }
+    delay(1);
   }
+  updateJSONLockStats(millis()-now, contended);
 
-  jsonBufferLock = module ? module : 255;
   DEBUG_PRINT(F("JSON buffer locked. ("));
   DEBUG_PRINT(jsonBufferLock);
   DEBUG_PRINTLN(")");
-  fileDoc = &doc;  // used for applying presets (presets.cpp)
-  doc.clear();
   return true;
 }
 
@@ -224,6 +314,91 @@ void releaseJSONBufferLock()
   jsonBufferLock = 0;
 }
 
+static JsonDocument* takeJSONPoolBuffer(uint8_t module, uint8_t poolSize)
+{
+  #if WLED_JSON_POOL_SIZE > 0
+  for (size_t i = 0; i < poolSize; i++) {
+    if (!tryJSONLock(jsonPoolLock[i], module)) continue;
+    if (!jsonPool[i]) {
+      jsonPool[i] = new PSRAMDynamicJsonDocument(JSON_BUFFER_SIZE);
+      if (!jsonPool[i] || !jsonPool[i]->capacity()) {
+        DEBUG_PRINTLN(F("JSON pool buffer allocation failed."));
+        delete jsonPool[i];
+        jsonPool[i] = nullptr;
+        jsonPoolLock[i] = 0;
+        return nullptr;
+      }
+    }
+    uint8_t inUse = getJSONPoolInUse();
+    if (inUse > jsonPoolMaxInUse) jsonPoolMaxInUse = inUse;
+    jsonPool[i]->clear();
+    return jsonPool[i];
+  }
+  #endif
+  return nullptr;
+}
+
+// returns a free buffer for serializing output that does not read segments (use requestJSONBufferLock() for that) or nullptr, only waits (up to JSON_HIGH_PRIO_WAIT) if prio is JSON_PRIO_HIGH
+// with PSRAM pooled buffers are preferred to keep doc free for presets and config, otherwise they are only used if doc is busy
+// low priority requests do not get the last free buffer, so a websocket update or state change can still get one
+JsonDocument* requestJSONBuffer(uint8_t module, uint8_t prio)
+{
+  unsigned long now = millis();
+  uint8_t poolSize = getJSONPoolSize();
+  bool poolFirst = poolSize > 1;
+  bool contended = false;
+
+  do {
+    uint8_t freeBuffers = (jsonBufferLock ? 0 : 1) + poolSize - getJSONPoolInUse();
+    if (prio != JSON_PRIO_LOW || !poolSize || freeBuffers > 1) {
+      JsonDocument* buffer = nullptr;
+      if (!poolFirst && takeJSONBufferLock(module)) buffer = &doc;
+      if (!buffer) buffer = takeJSONPoolBuffer(module, poolSize);
+      if (!buffer && poolFirst && takeJSONBufferLock(module)) buffer = &doc;
+      if (buffer) {
+        updateJSONLockStats(millis()-now, contended || (buffer != &doc && !poolFirst));
+        return buffer;
+      }
+    }
+    contended = true;
+    if (prio != JSON_PRIO_HIGH) break;
+    delay(1);
+  } while (millis()-now < JSON_HIGH_PRIO_WAIT);
+
+  jsonLockFailed++;
+  DEBUG_PRINT(F("No free JSON buffer for module "));
+  DEBUG_PRINTLN(module);
+  return nullptr;
+}
+
+void releaseJSONBuffer(JsonDocument* buffer)
+{
+  if (!buffer) return;
+  if (buffer == &doc) {
+    releaseJSONBufferLock();
+    return;
+  }
+  #if WLED_JSON_POOL_SIZE > 0
+  for (size_t i = 0; i < WLED_JSON_POOL_SIZE; i++) {
+    if (jsonPool[i] != buffer) continue;
+    jsonPoolLock[i] = 0;
+    return;
+  }
+  #endif
+}
+
+void serializeJSONBufferStats(JsonObject root)
+{
+  JsonObject jb = root.createNestedObject(F("jbuf"));
+  jb[F("pool")] = getJSONPoolSize();
+  jb[F("max")]  = jsonPoolMaxInUse;
+  jb[F("lock")] = jsonLockCount;
+  jb[F("cont")] = jsonLockContended;
+  jb[F("fail")] = jsonLockFailed;
+  jb[F("wavg")] = jsonLockCount ? jsonLockWaitSum / jsonLockCount : 0;
+  jb[F("wmax")] = jsonLockWaitMax;
+}
+
 
 // extracts effect mode (or palette) name from names serialized string
 // caller must provide large enough buffer for name (incluing SR extensions)!
@@ -408,8 +583,16 @@ um_data_t* simulateSound(uint8_t simulationId)
   static uint16_t volumeRaw;
   static float    my_magnitude;
 
+  static uint8_t  beatFlag;
+  static float    beatBPM;
+  static uint8_t  beatPhase;
+  static uint8_t  onsetFlag;
+  static uint8_t  beatConfidence;
+  static uint16_t audioFrameAge;
+
   //arrays
   uint8_t *fftResult;
+  static uint8_t  bandEnvelope[4];
 
   static um_data_t* um_data = nullptr;
 
@@ -421,7 +604,7 @@ um_data_t* simulateSound(uint8_t simulationId)
     // NOTE!!!
     // This may change as AudioReactive usermod may change
     um_data = new um_data_t;
-    um_data->u_size = 8;
+    um_data->u_size = 15;
     um_data->u_type = new um_types_t[um_data->u_size];
     um_data->u_data = new void*[um_data->u_size];
     um_data->u_data[0] = &volumeSmth;
@@ -432,6 +615,13 @@ um_data_t* simulateSound(uint8_t simulationId)
     um_data->u_data[5] = &my_magnitude;
     um_data->u_data[6] = &maxVol;
     um_data->u_data[7] = &binNum;
+    um_data->u_data[8] = &beatFlag;
+    um_data->u_data[9] = &beatBPM;
+    um_data->u_data[10] = &beatPhase;
+    um_data->u_data[11] = bandEnvelope;
+    um_data->u_data[12] = &onsetFlag;
+    um_data->u_data[13] = &beatConfidence;
+    um_data->u_data[14] = &audioFrameAge;
   } else {
     // get arrays from um_data
     fftResult =  (uint8_t*)um_data->u_data[2];
@@ -499,6 +689,15 @@ um_data_t* simulateSound(uint8_t simulationId)
   my_magnitude = 10000.0 / 8.0f; //no idea if 10000 is a good value for FFT_Magnitude ???
   if (volumeSmth < 1 ) my_magnitude = 0.001f;             // noise gate closed - mute
 
+  // steady 120 BPM, beat flag held for one frame like samplePeak
+  beatBPM        = 120.0f;
+  beatPhase      = (ms % 500) * 256 / 500;
+  beatFlag       = (ms % 500) < 50;
+  onsetFlag      = beatFlag;
+  beatConfidence = 255;
+  for (int i = 0; i<4; i++)
+    bandEnvelope[i] = (fftResult[4*i] + fftResult[4*i+1] + fftResult[4*i+2] + fftResult[4*i+3]) / 4;
+
   return um_data;
 }
 
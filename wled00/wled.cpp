@@ -156,6 +156,7 @@ void WLED::loop()
     doInitBusses = false;
     DEBUG_PRINTLN(F("Re-init busses."));
     bool aligned = strip.checkSegmentAlignment(); //see if old segments match old bus(ses)
+    strip.suspendOutput(); // pipelined output must not use the busses while they are replaced
     busses.removeAll();
     uint32_t mem = 0;
     for (uint8_t i = 0; i < WLED_MAX_BUSSES+WLED_MIN_VIRTUAL_BUSSES; i++) {
@@ -169,6 +170,7 @@ void WLED::loop()
     strip.finalizeInit(); // also loads default ledmap if present
     if (aligned) strip.makeAutoSegments();
     else strip.fixInvalidSegments();
+    strip.resumeOutput();
     yield();
     serializeConfig();
   }
@@ -179,6 +181,8 @@ void WLED::loop()
 
   yield();
   handleWs();
+  handleSettingsJS();
+  handleE131Multicast();
   handleStatusLED();
 
 // DEBUG serial logging (every 30s)
@@ -270,6 +274,9 @@ void WLED::setup()
   #ifdef ARDUINO_ARCH_ESP32
   pinMode(hardwareRX, INPUT_PULLDOWN); delay(1);        // suppress noise in case RX pin is floating (at low noise energy) - see issue #3128
   #endif
+  #ifdef WLED_ENABLE_ADALIGHT
+  initSerialBuffer();
+  #endif
   Serial.begin(115200);
   #if !ARDUINO_USB_CDC_ON_BOOT
   Serial.setTimeout(50);  // this causes troubles on new MCUs that have a "virtual" USB Serial (HWCDC)
@@ -368,9 +375,9 @@ void WLED::setup()
   if (!fsinit) {
     DEBUGFS_PRINTLN(F("FS failed!"));
     errorFlag = ERR_FS_BEGIN;
-  }
+  } else initPresetLog(); // completes preset writes interrupted by a power loss
 #ifdef WLED_ADD_EEPROM_SUPPORT
-  else deEEP();
+  if (fsinit) deEEP();
 #else
   initPresetsFile();
 #endif
@@ -522,7 +529,7 @@ void WLED::initAP(bool resetAP)
     if (udpPort2 > 0 && udpPort2 != ntpLocalPort && udpPort2 != udpPort && udpPort2 != udpRgbPort) {
       udp2Connected = notifier2Udp.begin(udpPort2);
     }
-    e131.begin(false, e131Port, e131Universe, E131_MAX_UNIVERSE_COUNT);
+    e131.begin(false, e131Port, e131Universe, getE131UniverseCount());
     ddp.begin(false, DDP_DEFAULT_PORT);
 
     dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
@@ -744,7 +751,7 @@ void WLED::initInterfaces()
   if (ntpEnabled)
     ntpConnected = ntpUdp.begin(ntpLocalPort);
 
-  e131.begin(e131Multicast, e131Port, e131Universe, E131_MAX_UNIVERSE_COUNT);
+  e131.begin(e131Multicast, e131Port, e131Universe, getE131UniverseCount());
   ddp.begin(false, DDP_DEFAULT_PORT);
   reconnectHue();
 #ifndef WLED_DISABLE_MQTT
@@ -890,7 +897,9 @@ void WLED::handleStatusLED()
       #if STATUSLED>=0
       digitalWrite(STATUSLED, ledStatusState);
       #else
+      strip.suspendOutput();
       busses.setStatusPixel(ledStatusState ? c : 0);
+      strip.resumeOutput();
       #endif
     }
   } else {
@@ -901,7 +910,9 @@ void WLED::handleStatusLED()
       digitalWrite(STATUSLED, LOW);
       #endif
     #else
+      strip.suspendOutput();
       busses.setStatusPixel(0);
+      strip.resumeOutput();
     #endif
   }
   #endif
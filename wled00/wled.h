@@ -37,6 +37,8 @@
 #endif
 //#define WLED_ENABLE_DMX          // uses 3.5kb (use LEDPIN other than 2)
 //#define WLED_ENABLE_JSONLIVE     // peek LED output via /json/live (WS binary peek is always enabled)
+//#define WLED_ENABLE_PIPELINE     // ESP32: render effects on one core while the other sends the previous frame (uses 4-6 bytes RAM per LED)
+//#define WLED_ENABLE_PARALLEL_FX  // ESP32: segments that do not share pixels are rendered on both cores (uses ~10kB RAM)
 #ifndef WLED_DISABLE_LOXONE
   #define WLED_ENABLE_LOXONE       // uses 1.2kb
 #endif
@@ -160,6 +162,12 @@ using PSRAMDynamicJsonDocument = BasicJsonDocument<PSRAM_Allocator>;
 #define PSRAMDynamicJsonDocument DynamicJsonDocument
 #endif
 
+// pipelined output and parallel rendering need a second core
+#if !defined(ARDUINO_ARCH_ESP32) || defined(CONFIG_FREERTOS_UNICORE)
+  #undef WLED_ENABLE_PIPELINE
+  #undef WLED_ENABLE_PARALLEL_FX
+#endif
+
 #include "const.h"
 #include "fcn_declare.h"
 #include "NodeStruct.h"
@@ -372,6 +380,7 @@ WLED_GLOBAL bool notifyButton _INIT(false);                       // send if upd
 WLED_GLOBAL bool notifyAlexa  _INIT(false);                       // send notification if updated via Alexa
 WLED_GLOBAL bool notifyMacro  _INIT(false);                       // send notification for macro
 WLED_GLOBAL bool notifyHue    _INIT(true);                        // send notification if Hue light changes
+WLED_GLOBAL bool udpSyncBinary _INIT(false);                      // send binary delta sync packets with acknowledgements instead of the notifier packet
 WLED_GLOBAL uint8_t udpNumRetries _INIT(0);                       // Number of times a UDP sync message is retransmitted. Increase to increase reliability
 
 WLED_GLOBAL bool alexaEnabled _INIT(false);                       // enable device discovery by Amazon Echo
@@ -383,6 +392,8 @@ WLED_GLOBAL int arlsOffset _INIT(0);                              // realtime LE
 WLED_GLOBAL bool receiveDirect _INIT(true);                       // receive UDP realtime
 WLED_GLOBAL bool arlsDisableGammaCorrection _INIT(true);          // activate if gamma correction is handled by the source
 WLED_GLOBAL bool arlsForceMaxBri _INIT(false);                    // enable to force max brightness if source has very dark colors that would be black
+WLED_GLOBAL byte realtimeBufferDepth _INIT(0);                    // realtime jitter buffer depth in frames (0 = disabled)
+WLED_GLOBAL uint16_t realtimeBufferMaxLatency _INIT(0);           // max. latency the jitter buffer may add in ms (0 = limited by depth only)
 
 #ifdef WLED_ENABLE_DMX
  #ifdef ESP8266
@@ -399,7 +410,8 @@ WLED_GLOBAL E131Priority highPriority _INIT(3);                   // E1.31 highe
 WLED_GLOBAL byte DMXMode _INIT(DMX_MODE_MULTIPLE_RGB);            // DMX mode (s.a.)
 WLED_GLOBAL uint16_t DMXAddress _INIT(1);                         // DMX start address of fixture, a.k.a. first Channel [for E1.31 (sACN) protocol]
 WLED_GLOBAL uint16_t DMXSegmentSpacing _INIT(0);                  // Number of void/unused channels between each segments DMX channels
-WLED_GLOBAL byte e131LastSequenceNumber[E131_MAX_UNIVERSE_COUNT]; // to detect packet loss
+WLED_GLOBAL uint16_t e131UniverseMap[E131_MAX_UNIVERSE_COUNT][2];  // optional sparse universe map: [universe, first LED] (multi-universe DMX modes)
+WLED_GLOBAL byte e131UniverseMapSize _INIT(0);                    // number of entries in e131UniverseMap, 0 = contiguous universes from e131Universe
 WLED_GLOBAL bool e131Multicast _INIT(false);                      // multicast or unicast
 WLED_GLOBAL bool e131SkipOutOfSequence _INIT(false);              // freeze instead of flickering
 WLED_GLOBAL uint16_t pollReplyCount _INIT(0);                     // count number of replies for ArtPoll node report
@@ -564,6 +576,7 @@ WLED_GLOBAL bool countdownOverTriggered _INIT(true);
 
 //timer
 WLED_GLOBAL byte lastTimerMinute  _INIT(0);
+WLED_GLOBAL volatile bool cuesChanged _INIT(true); // timers changed, the scheduler queue is rebuilt in handleCues()
 WLED_GLOBAL byte timerHours[]     _INIT_N(({ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }));
 WLED_GLOBAL int8_t timerMinutes[] _INIT_N(({ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }));
 WLED_GLOBAL byte timerMacro[]     _INIT_N(({ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }));
@@ -2,8 +2,17 @@
 
 /*
  * Adalight and TPM2 handler
+ * Frame headers and serial commands are parsed byte by byte, pixel data is read in bulk into a frame buffer
+ * and committed to the strip once the frame is complete.
  */
 
+#ifdef ESP8266
+  #define ADALIGHT_RX_BUFFER_SIZE 1024  // UART receive buffer (bytes), filled in the background by the UART interrupt
+#else
+  #define ADALIGHT_RX_BUFFER_SIZE 4096
+#endif
+#define ADALIGHT_FRAME_TIMEOUT 100      // ms without data after which an incomplete frame is dropped
+
 enum class AdaState {
   Header_A,
   Header_d,
@@ -11,9 +20,7 @@ enum class AdaState {
   Header_CountHi,
   Header_CountLo,
   Header_CountCheck,
-  Data_Red,
-  Data_Green,
-  Data_Blue,
+  Data,
   TPM2_Header_Type,
   TPM2_Header_CountHi,
   TPM2_Header_CountLo,
@@ -23,6 +30,23 @@ uint16_t currentBaud = 1152; //default baudrate 115200 (divided by 100)
 bool continuousSendLED = false;
 uint32_t lastUpdate = 0;
 
+#ifdef WLED_ENABLE_ADALIGHT
+static byte*    serialFrame     = nullptr; // RGB data of the frame being received
+static uint32_t serialFrameSize = 0;       // allocated bytes
+static uint32_t serialFrameUse  = 0;       // bytes stored for the current frame (frames are truncated to the strip length)
+static uint32_t serialFrameLen  = 0;       // bytes expected for the current frame
+static uint32_t serialFrameRecv = 0;       // bytes received for the current frame
+static unsigned long serialLastData = 0;
+
+// statistics
+static uint32_t serialFrames   = 0;
+static uint32_t serialOverruns = 0;        // receive buffer was full, bytes were lost
+static uint32_t serialErrors   = 0;        // invalid headers and incomplete frames
+static uint16_t serialFps      = 0;
+static uint16_t serialFpsCount = 0;
+static unsigned long serialFpsStart = 0;
+#endif
+
 void updateBaudRate(uint32_t rate){
   uint16_t rate100 = rate/100;
   if (rate100 == currentBaud || rate100 < 96) return;
@@ -67,6 +91,91 @@ void sendBytes(){
   }
 }
 
+#ifdef WLED_ENABLE_ADALIGHT
+// enlarges the UART receive buffer so the main loop can fall behind without losing data, call before Serial.begin()
+void initSerialBuffer()
+{
+  Serial.setRxBufferSize(ADALIGHT_RX_BUFFER_SIZE);
+}
+
+static void startSerialFrame(uint32_t len)
+{
+  uint32_t size = MIN(len, strip.getLengthTotal() * 3UL);
+  if (size > serialFrameSize) {
+    if (serialFrame) free(serialFrame);
+    serialFrame = (byte*)malloc(size);
+    serialFrameSize = serialFrame ? size : 0;
+    if (!serialFrame) DEBUG_PRINTLN(F("Serial frame buffer allocation failed."));
+  }
+  serialFrameUse  = MIN(size, serialFrameSize);
+  serialFrameLen  = len;
+  serialFrameRecv = 0;
+  realtimeStatsArrival();
+}
+
+static void freeSerialFrame()
+{
+  if (serialFrame) free(serialFrame);
+  serialFrame = nullptr;
+  serialFrameSize = serialFrameUse = 0;
+}
+
+// reads as much of the current frame as is available, returns true once the frame is complete
+static bool readSerialFrame()
+{
+  size_t avail = Serial.available();
+  if (avail >= ADALIGHT_RX_BUFFER_SIZE) serialOverruns++; // buffer full, following bytes are dropped
+  uint32_t remaining = serialFrameLen - serialFrameRecv;
+  size_t n = MIN(avail, remaining);
+  if (!n) return false;
+  serialLastData = millis();
+
+  if (serialFrameRecv < serialFrameUse) {
+    // copy straight into the frame buffer
+    size_t m = MIN(n, (size_t)(serialFrameUse - serialFrameRecv));
+    n = Serial.readBytes((char*)serialFrame + serialFrameRecv, m);
+  } else {
+    // data for LEDs beyond the strip length
+    for (size_t i = 0; i < n; i++) Serial.read();
+  }
+  serialFrameRecv += n;
+  return serialFrameRecv >= serialFrameLen;
+}
+
+static void commitSerialFrame()
+{
+  realtimeLock(realtimeTimeoutMs, REALTIME_MODE_ADALIGHT);
+  realtimeStatsPacket(REALTIME_MODE_ADALIGHT, serialFrameLen);
+  serialFrames++;
+  serialFpsCount++;
+  unsigned long now = millis();
+  if (now - serialFpsStart >= 1000) {
+    serialFps = (serialFpsCount * 1000UL) / (now - serialFpsStart);
+    serialFpsCount = 0;
+    serialFpsStart = now;
+  }
+  if (realtimeOverride || !serialFrame) return;
+
+  uint32_t pixels = MIN(serialFrameRecv, serialFrameUse) / 3;
+  for (uint32_t i = 0; i < pixels; i++) {
+    setRealtimePixel(i, serialFrame[i*3], serialFrame[i*3+1], serialFrame[i*3+2], 0);
+  }
+  strip.show();
+  realtimeStatsShown(realtimeStatsTakeArrival());
+}
+
+void serializeSerialStats(JsonObject root)
+{
+  if (!serialFrames && !serialErrors) return;
+  JsonObject ser = root.createNestedObject(F("ser"));
+  ser[F("baud")] = currentBaud * 100UL;
+  ser[F("fps")]  = (millis() - serialFpsStart < 2000) ? serialFps : 0;
+  ser[F("fr")]   = serialFrames;
+  ser[F("ov")]   = serialOverruns;
+  ser[F("err")]  = serialErrors;
+}
+#endif
+
 void handleSerial()
 {
   if (pinManager.isPinAllocated(hardwareRX)) return;
@@ -75,14 +184,26 @@ void handleSerial()
   #ifdef WLED_ENABLE_ADALIGHT
   static auto state = AdaState::Header_A;
   static uint16_t count = 0;
-  static uint16_t pixel = 0;
   static byte check = 0x00;
-  static byte red   = 0x00;
-  static byte green = 0x00;
+
+  if (state == AdaState::Data && millis() - serialLastData > ADALIGHT_FRAME_TIMEOUT) {
+    DEBUG_PRINTLN(F("Incomplete serial frame dropped."));
+    serialErrors++;
+    state = AdaState::Header_A;
+  }
+  if (state == AdaState::Header_A && realtimeMode != REALTIME_MODE_ADALIGHT && serialFrame) freeSerialFrame();
 
   while (Serial.available() > 0)
   {
     yield();
+    if (state == AdaState::Data) {
+      continuousSendLED = false; // All other received bytes will disable Continuous Serial Streaming
+      if (!readSerialFrame()) break;
+      commitSerialFrame();
+      state = AdaState::Header_A;
+      continue;
+    }
+
     byte next = Serial.peek();
     switch (state) {
       case AdaState::Header_A:
@@ -104,6 +225,7 @@ void handleSerial()
         } else if (next == 0xB5) {updateBaudRate( 921600);
         } else if (next == 0xB6) {updateBaudRate(1000000);
         } else if (next == 0xB7) {updateBaudRate(1500000);
+        } else if (next == 0xB8) {updateBaudRate(2000000);
 
         } else if (next == 'l') {sendJSON(); // Send LED data as JSON Array
         } else if (next == 'L') {sendBytes(); // Send LED data as TPM2 Data Packet
@@ -144,19 +266,23 @@ void handleSerial()
         else             state = AdaState::Header_A;
         break;
       case AdaState::Header_CountHi:
-        pixel = 0;
         count = next * 0x100;
         check = next;
         state = AdaState::Header_CountLo;
         break;
       case AdaState::Header_CountLo:
-        count += next + 1;
+        count += next;
         check = check ^ next ^ 0x55;
         state = AdaState::Header_CountCheck;
         break;
       case AdaState::Header_CountCheck:
-        if (check == next) state = AdaState::Data_Red;
-        else               state = AdaState::Header_A;
+        if (check == next) {
+          startSerialFrame((count + 1UL) * 3); // Adalight sends LED count - 1
+          state = AdaState::Data;
+        } else {
+          serialErrors++;
+          state = AdaState::Header_A;
+        }
         break;
       case AdaState::TPM2_Header_Type:
         state = AdaState::Header_A; //(unsupported) TPM2 command or invalid type
@@ -164,33 +290,19 @@ void handleSerial()
         else if (next == 0xAA) Serial.write(0xAC); //TPM2 ping
         break;
       case AdaState::TPM2_Header_CountHi:
-        pixel = 0;
-        count = (next * 0x100) /3;
+        count = next * 0x100;
         state = AdaState::TPM2_Header_CountLo;
         break;
       case AdaState::TPM2_Header_CountLo:
-        count += next /3;
-        state = AdaState::Data_Red;
-        break;
-      case AdaState::Data_Red:
-        red   = next;
-        state = AdaState::Data_Green;
-        break;
-      case AdaState::Data_Green:
-        green = next;
-        state = AdaState::Data_Blue;
-        break;
-      case AdaState::Data_Blue:
-        byte blue  = next;
-        if (!realtimeOverride) setRealtimePixel(pixel++, red, green, blue, 0);
-        if (--count > 0) state = AdaState::Data_Red;
-        else {
-          realtimeLock(realtimeTimeoutMs, REALTIME_MODE_ADALIGHT);
-
-          if (!realtimeOverride) strip.show();
-          state = AdaState::Header_A;
+        count += next;
+        state = AdaState::Header_A;
+        if (count) { // frame size in bytes, the end byte (0x36) is skipped in Header_A
+          startSerialFrame(count);
+          state = AdaState::Data;
         }
         break;
+      default:
+        break;
     }
 
     // All other received bytes will disable Continuous Serial Streaming
@@ -199,6 +311,7 @@ void handleSerial()
       }
 
     Serial.read(); //discard the byte
+    if (state == AdaState::Data) serialLastData = millis();
   }
   #endif
 
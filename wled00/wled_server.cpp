@@ -15,8 +15,78 @@
  * Integrated HTTP web server page declarations
  */
 
-bool handleIfNoneMatchCacheHeader(AsyncWebServerRequest* request);
-void setStaticContentCacheHeaders(AsyncWebServerResponse *response);
+bool handleIfNoneMatchCacheHeader(AsyncWebServerRequest* request, const char* etag);
+void setStaticContentCacheHeaders(AsyncWebServerResponse *response, const char* etag);
+void serveAsset(AsyncWebServerRequest* request, const char* contentType, const uint8_t* content, size_t len, int code = 200);
+
+#ifdef ESP8266
+  #define WEB_ASSET_HASHES   24
+  #define WEB_CHUNK_SIZE     2920 // 2 TCP segments, fewer would stall on delayed ACKs
+  #define SETTINGS_JS_CACHED 2
+#else
+  #define WEB_ASSET_HASHES   32
+  #define WEB_CHUNK_SIZE     5840
+  #define SETTINGS_JS_CACHED 6
+#endif
+#define SETTINGS_JS_MAX_AGE  5000 // ms, for settings pages that show live status
+#define SETTINGS_JS_KEEP    60000 // ms a rendered settings page stays cached after its last request
+
+typedef struct AssetHash {
+  const uint8_t* content; // PROGMEM asset, nullptr if unused
+  uint32_t hash;
+} asset_hash_t;
+
+typedef struct SettingsJS {
+  char*    js;            // nullptr if unused
+  uint32_t hash;
+  unsigned long rendered;
+  unsigned long used;     // last request
+  uint32_t generation;
+  uint8_t  subPage;
+} settings_js_t;
+
+static asset_hash_t  assetHashes[WEB_ASSET_HASHES] = {};
+static settings_js_t settingsJSCache[SETTINGS_JS_CACHED] = {};
+static volatile uint32_t settingsGeneration = 0; // incremented when the configuration changes
+static volatile bool settingsJSBusy = false;      // cache in use, by serveSettingsJS() or handleSettingsJS()
+#ifdef ARDUINO_ARCH_ESP32
+static portMUX_TYPE settingsJSMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+/*
+ * Request admission
+ * Heavy requests (JSON API, /win, presets, settings and uploads) take a slot until their connection closes.
+ * State changes may use all slots, reads and configuration changes leave one free for them. Reads are
+ * further limited per client so a polling integration cannot starve the UI and the LED loop. /json/live is
+ * polled by the live view every 40 ms and small, it is not limited.
+ * Requests that are not admitted get 503 (busy or low on heap) or 429 (rate limit) with Retry-After.
+ */
+#define WEB_REQUEST_READ    0 // GET /json (except /json/live), /presets.json
+#define WEB_REQUEST_STATE   1 // POST /json/state, /win
+#define WEB_REQUEST_CONFIG  2 // settings, /json/cfg, uploads
+
+#ifdef ESP8266
+  #define WEB_MAX_HEAVY     3
+  #define WEB_MAX_READS     2
+  #define WEB_MIN_HEAP      8192 // bytes, configuration changes (ESP32: also reads) are rejected below this
+#else
+  #define WEB_MAX_HEAVY     6
+  #define WEB_MAX_READS     4
+  #define WEB_MIN_HEAP      16384
+#endif
+#define WEB_RATE_CLIENTS    8
+#define WEB_RATE_BURST      20 // reads a client may send at once
+#define WEB_RATE_PER_SEC    5  // sustained reads per second and client
+
+typedef struct WebClientRate {
+  uint32_t ip;            // 0 if unused
+  uint32_t tokens;        // reads available * 1000
+  unsigned long last;
+} web_rate_t;
+
+static web_rate_t webRates[WEB_RATE_CLIENTS] = {};
+static uint8_t  webActive = 0, webActiveReads = 0, webActiveMax = 0;
+static uint32_t webAdmitted = 0, webRejected = 0, webLimited = 0;
 
 // define flash strings once (saves flash memory)
 static const char s_redirecting[] PROGMEM = "Redirecting...";
@@ -35,12 +105,96 @@ bool isIp(String str) {
   return true;
 }
 
+// token bucket per client IP, true if the client may send another read
+static bool takeReadToken(uint32_t ip)
+{
+  web_rate_t* r = nullptr;
+  for (size_t i = 0; i < WEB_RATE_CLIENTS; i++) {
+    if (webRates[i].ip == ip) { r = &webRates[i]; break; }
+    if (!r || webRates[i].last - r->last > 0x7FFFFFFF) r = &webRates[i]; // least recently seen
+  }
+  unsigned long now = millis();
+  if (r->ip != ip) {
+    r->ip = ip;
+    r->tokens = WEB_RATE_BURST * 1000;
+  } else {
+    unsigned long elapsed = MIN(now - r->last, (unsigned long)WEB_RATE_BURST * 1000 / WEB_RATE_PER_SEC);
+    r->tokens = MIN((uint32_t)WEB_RATE_BURST * 1000, r->tokens + elapsed * WEB_RATE_PER_SEC);
+  }
+  r->last = now;
+  if (r->tokens < 1000) return false;
+  r->tokens -= 1000;
+  return true;
+}
+
+static void rejectRequest(AsyncWebServerRequest *request, int code)
+{
+  AsyncWebServerResponse *response = request->beginResponse(code, "application/json", F("{\"error\":3}"));
+  response->addHeader(F("Retry-After"), "1");
+  request->send(response);
+}
+
+// takes a slot for a heavy request, released when its connection closes
+// returns 0 if admitted, otherwise the HTTP status to reject the request with
+static int takeRequestSlot(AsyncWebServerRequest *request, uint8_t type)
+{
+  int code = 0;
+  if (type == WEB_REQUEST_STATE) {
+    if (webActive >= WEB_MAX_HEAVY || ESP.getFreeHeap() < WEB_MIN_HEAP/2) code = 503;
+  } else if (webActive >= WEB_MAX_HEAVY-1) {
+    code = 503;
+  #ifdef ESP8266
+  } else if (type != WEB_REQUEST_READ && ESP.getFreeHeap() < WEB_MIN_HEAP) { // heap is often this low on ESP8266, reads would fail all the time
+  #else
+  } else if (ESP.getFreeHeap() < WEB_MIN_HEAP) {
+  #endif
+    code = 503;
+  } else if (type == WEB_REQUEST_READ) {
+    if (webActiveReads >= WEB_MAX_READS) code = 503;
+    else if (!takeReadToken((uint32_t)request->client()->remoteIP())) code = 429;
+  }
+  if (code) {
+    if (code == 429) webLimited++; else webRejected++;
+    DEBUG_PRINT(F("Request rejected: ")); DEBUG_PRINTLN(request->url());
+    return code;
+  }
+
+  webActive++;
+  if (type == WEB_REQUEST_READ) webActiveReads++;
+  if (webActive > webActiveMax) webActiveMax = webActive;
+  webAdmitted++;
+  request->onDisconnect([type](){
+    webActive--;
+    if (type == WEB_REQUEST_READ) webActiveReads--;
+  });
+  return 0;
+}
+
+// sends 503/429 if the request is not admitted
+static bool admitRequest(AsyncWebServerRequest *request, uint8_t type)
+{
+  int code = takeRequestSlot(request, type);
+  if (code) rejectRequest(request, code);
+  return !code;
+}
+
+void serializeWebStats(JsonObject root)
+{
+  JsonObject web = root.createNestedObject(F("web"));
+  web[F("act")]  = webActive;    // heavy requests in progress
+  web[F("amax")] = webActiveMax;
+  web[F("adm")]  = webAdmitted;
+  web[F("rej")]  = webRejected;  // busy or low heap
+  web[F("lim")]  = webLimited;   // client read rate
+}
+
 void handleUpload(AsyncWebServerRequest *request, const String& filename, size_t index, uint8_t *data, size_t len, bool final) {
   if (!correctPIN) {
     if (final) request->send(500, "text/plain", FPSTR(s_unlock_cfg));
     return;
   }
   if (!index) {
+    if (takeRequestSlot(request, WEB_REQUEST_CONFIG)) return; // not admitted, nothing is written and the upload is rejected when complete
     String finalname = filename;
     if (finalname.charAt(0) != '/') {
       finalname = '/' + finalname; // prepend slash if missing
@@ -49,12 +203,21 @@ void handleUpload(AsyncWebServerRequest *request, const String& filename, size_t
     request->_tempFile = WLED_FS.open(finalname, "w");
     DEBUG_PRINT(F("Uploading "));
     DEBUG_PRINTLN(finalname);
-    if (finalname.equals("/presets.json")) presetsModifiedTime = toki.second();
+    if (finalname.equals("/presets.json")) {
+      presetsModifiedTime = toki.second();
+      invalidatePresetIndex();
+      discardPresetLog();
+      dropSnapshot(0);
+    }
   }
   if (len) {
     request->_tempFile.write(data,len);
   }
   if (final) {
+    if (!request->_tempFile) {
+      rejectRequest(request, 503);
+      return;
+    }
     request->_tempFile.close();
     if (filename.indexOf(F("cfg.json")) >= 0) { // check for filename with or without slash
       doReboot = true;
@@ -114,30 +277,18 @@ void initServer()
 
 #ifdef WLED_ENABLE_WEBSOCKETS
   server.on("/liveview", HTTP_GET, [](AsyncWebServerRequest *request){
-    if (handleIfNoneMatchCacheHeader(request)) return;
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", PAGE_liveviewws, PAGE_liveviewws_length);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    serveAsset(request, "text/html", PAGE_liveviewws, PAGE_liveviewws_length);
     //request->send_P(200, "text/html", PAGE_liveviewws);
   });
   #ifndef WLED_DISABLE_2D
   server.on("/liveview2D", HTTP_GET, [](AsyncWebServerRequest *request){
-    if (handleIfNoneMatchCacheHeader(request)) return;
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", PAGE_liveviewws2D, PAGE_liveviewws2D_length);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    serveAsset(request, "text/html", PAGE_liveviewws2D, PAGE_liveviewws2D_length);
     //request->send_P(200, "text/html", PAGE_liveviewws);
   });
   #endif
 #else
   server.on("/liveview", HTTP_GET, [](AsyncWebServerRequest *request){
-    if (handleIfNoneMatchCacheHeader(request)) return;
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", PAGE_liveview, PAGE_liveview_length);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    serveAsset(request, "text/html", PAGE_liveview, PAGE_liveview_length);
     //request->send_P(200, "text/html", PAGE_liveview);
   });
 #endif
@@ -150,11 +301,7 @@ void initServer()
   // "/settings/settings.js&p=x" request also handled by serveSettings()
 
   server.on("/style.css", HTTP_GET, [](AsyncWebServerRequest *request){
-    if (handleIfNoneMatchCacheHeader(request)) return;
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/css", PAGE_settingsCss, PAGE_settingsCss_length);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    serveAsset(request, "text/css", PAGE_settingsCss, PAGE_settingsCss_length);
   });
 
   server.on("/favicon.ico", HTTP_GET, [](AsyncWebServerRequest *request){
@@ -178,18 +325,26 @@ void initServer()
   });
 
   server.on("/settings", HTTP_POST, [](AsyncWebServerRequest *request){
+    if (!admitRequest(request, WEB_REQUEST_CONFIG)) return;
     serveSettings(request, true);
   });
 
   server.on("/json", HTTP_GET, [](AsyncWebServerRequest *request){
+    if (request->url().indexOf("live") < 0 && !admitRequest(request, WEB_REQUEST_READ)) return;
     serveJson(request);
   });
 
   AsyncCallbackJsonWebHandler* handler = new AsyncCallbackJsonWebHandler("/json", [](AsyncWebServerRequest *request) {
     bool verboseResponse = false;
-    bool isConfig = false;
+    bool isConfig = request->url().indexOf("cfg") > -1;
+
+    // state changes have priority over reads and configuration changes
+    if (!admitRequest(request, isConfig ? WEB_REQUEST_CONFIG : WEB_REQUEST_STATE)) return;
 
-    if (!requestJSONBufferLock(14)) return;
+    if (!requestJSONBufferLock(14)) {
+      request->send(503, "application/json", F("{\"error\":3}"));
+      return;
+    }
 
     DeserializationError error = deserializeJson(doc, (uint8_t*)(request->_tempObject));
     JsonObject root = doc.as<JsonObject>();
@@ -198,8 +353,6 @@ void initServer()
       request->send(400, "application/json", F("{\"error\":9}"));
       return;
     }
-    const String& url = request->url();
-    isConfig = url.indexOf("cfg") > -1;
     if (!isConfig) {
       /*
       #ifdef WLED_DEBUG
@@ -238,11 +391,7 @@ void initServer()
   });
 
   server.on("/u", HTTP_GET, [](AsyncWebServerRequest *request){
-    if (handleIfNoneMatchCacheHeader(request)) return;
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", PAGE_usermod, PAGE_usermod_length);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    serveAsset(request, "text/html", PAGE_usermod, PAGE_usermod_length);
     //request->send_P(200, "text/html", PAGE_usermod);
   });
 
@@ -263,26 +412,16 @@ void initServer()
 #ifdef WLED_ENABLE_SIMPLE_UI
   server.on("/simple.htm", HTTP_GET, [](AsyncWebServerRequest *request){
     if (handleFileRead(request, "/simple.htm")) return;
-    if (handleIfNoneMatchCacheHeader(request)) return;
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", PAGE_simple, PAGE_simple_L);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    serveAsset(request, "text/html", PAGE_simple, PAGE_simple_L);
   });
 #endif
 
   server.on("/iro.js", HTTP_GET, [](AsyncWebServerRequest *request){
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", iroJs, iroJs_length);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    serveAsset(request, "application/javascript", iroJs, iroJs_length);
   });
 
   server.on("/rangetouch.js", HTTP_GET, [](AsyncWebServerRequest *request){
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", rangetouchJs, rangetouchJs_length);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    serveAsset(request, "application/javascript", rangetouchJs, rangetouchJs_length);
   });
 
   createEditHandler(correctPIN);
@@ -354,21 +493,13 @@ void initServer()
   #ifdef WLED_ENABLE_PIXART
   server.on("/pixart.htm", HTTP_GET, [](AsyncWebServerRequest *request){
     if (handleFileRead(request, "/pixart.htm")) return;
-    if (handleIfNoneMatchCacheHeader(request)) return;
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", PAGE_pixart, PAGE_pixart_L);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    serveAsset(request, "text/html", PAGE_pixart, PAGE_pixart_L);
   });
   #endif
 
   server.on("/cpal.htm", HTTP_GET, [](AsyncWebServerRequest *request){
     if (handleFileRead(request, "/cpal.htm")) return;
-    if (handleIfNoneMatchCacheHeader(request)) return;
-    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", PAGE_cpal, PAGE_cpal_L);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    serveAsset(request, "text/html", PAGE_cpal, PAGE_cpal_L);
   });
 
   #ifdef WLED_ENABLE_WEBSOCKETS
@@ -390,15 +521,15 @@ void initServer()
       return;
     }
 
-    if(handleSet(request, request->url())) return;
+    const String& url = request->url();
+    if (url.indexOf("win") >= 0 && !admitRequest(request, WEB_REQUEST_STATE)) return;
+    if(handleSet(request, url)) return;
     #ifndef WLED_DISABLE_ALEXA
     if(espalexa.handleAlexaApiCall(request)) return;
     #endif
-    if(handleFileRead(request, request->url())) return;
-    AsyncWebServerResponse *response = request->beginResponse_P(404, "text/html", PAGE_404, PAGE_404_length);
-    response->addHeader(FPSTR(s_content_enc),"gzip");
-    setStaticContentCacheHeaders(response);
-    request->send(response);
+    if (url.equals("/presets.json") && !admitRequest(request, WEB_REQUEST_READ)) return;
+    if(handleFileRead(request, url)) return;
+    serveAsset(request, "text/html", PAGE_404, PAGE_404_length, 404);
     //request->send_P(404, "text/html", PAGE_404);
   });
 }
@@ -413,19 +544,50 @@ void serveIndexOrWelcome(AsyncWebServerRequest *request)
   }
 }
 
-bool handleIfNoneMatchCacheHeader(AsyncWebServerRequest* request)
+// FNV-1a, pgm_read_byte() also reads RAM
+static uint32_t hashContent(const uint8_t* data, size_t len)
+{
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= pgm_read_byte(data + i);
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// content hash of a PROGMEM asset, computed on its first request
+static uint32_t getAssetHash(const uint8_t* content, size_t len)
+{
+  size_t i = 0;
+  for (; i < WEB_ASSET_HASHES && assetHashes[i].content; i++) {
+    if (assetHashes[i].content == content) return assetHashes[i].hash;
+  }
+  uint32_t hash = hashContent(content, len);
+  if (i < WEB_ASSET_HASHES) {
+    assetHashes[i].content = content;
+    assetHashes[i].hash    = hash;
+  }
+  return hash;
+}
+
+// etag needs 16 bytes
+static void getETag(char* etag, uint32_t hash)
+{
+  sprintf_P(etag, PSTR("\"%08x-%02x\""), (unsigned)hash, cacheInvalidate);
+}
+
+bool handleIfNoneMatchCacheHeader(AsyncWebServerRequest* request, const char* etag)
 {
   AsyncWebHeader* header = request->getHeader("If-None-Match");
-  if (header && header->value() == String(VERSION)) {
+  if (header && header->value().indexOf(etag) >= 0) { // may be a list or weak ("W/...")
     request->send(304);
     return true;
   }
   return false;
 }
 
-void setStaticContentCacheHeaders(AsyncWebServerResponse *response)
+void setStaticContentCacheHeaders(AsyncWebServerResponse *response, const char* etag)
 {
-  char tmp[12];
   // https://medium.com/@codebyamir/a-web-developers-guide-to-browser-caching-cc41f3b73e7c
   #ifndef WLED_DEBUG
   //this header name is misleading, "no-cache" will not disable cache,
@@ -434,27 +596,44 @@ void setStaticContentCacheHeaders(AsyncWebServerResponse *response)
   #else
   response->addHeader(F("Cache-Control"),"no-store,max-age=0"); // prevent caching if debug build
   #endif
-  sprintf_P(tmp, PSTR("%8d-%02x"), VERSION, cacheInvalidate);
-  response->addHeader(F("ETag"), tmp);
+  response->addHeader(F("ETag"), etag);
+}
+
+// serves a gzipped PROGMEM asset, or 304 if the client has the current version
+void serveAsset(AsyncWebServerRequest* request, const char* contentType, const uint8_t* content, size_t len, int code)
+{
+  char etag[16];
+  getETag(etag, getAssetHash(content, len));
+  if (code == 200 && handleIfNoneMatchCacheHeader(request, etag)) return;
+
+  AsyncWebServerResponse *response;
+  if (len <= WEB_CHUNK_SIZE) {
+    response = request->beginResponse_P(code, contentType, content, len);
+  } else {
+    // large assets are copied out of flash in bounded pieces as the client acknowledges them,
+    // so no single send step holds up the LED loop for long
+    response = request->beginResponse(contentType, len, [content, len](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      size_t n = MIN(MIN(maxLen, (size_t)WEB_CHUNK_SIZE), len - index);
+      memcpy_P(buffer, content + index, n);
+      return n;
+    });
+    response->setCode(code);
+  }
+  response->addHeader(FPSTR(s_content_enc),"gzip");
+  setStaticContentCacheHeaders(response, etag);
+  request->send(response);
 }
 
 void serveIndex(AsyncWebServerRequest* request)
 {
   if (handleFileRead(request, "/index.htm")) return;
 
-  if (handleIfNoneMatchCacheHeader(request)) return;
-
-  AsyncWebServerResponse *response;
 #ifdef WLED_ENABLE_SIMPLE_UI
   if (simplifiedUI)
-    response = request->beginResponse_P(200, "text/html", PAGE_simple, PAGE_simple_L);
+    serveAsset(request, "text/html", PAGE_simple, PAGE_simple_L);
   else
 #endif
-    response = request->beginResponse_P(200, "text/html", PAGE_index, PAGE_index_L);
-
-  response->addHeader(FPSTR(s_content_enc),"gzip");
-  setStaticContentCacheHeaders(response);
-  request->send(response);
+    serveAsset(request, "text/html", PAGE_index, PAGE_index_L);
 }
 
 
@@ -525,6 +704,61 @@ String dmxProcessor(const String& var)
 #endif
 
 
+// ms a rendered settings page stays valid for if the configuration does not change, 0: not cached
+static unsigned long getSettingsJSMaxAge(byte subPage)
+{
+  switch (subPage) {
+    case 5:  return 0;                   // current time and sunrise
+    case 1:                              // IP addresses
+    case 2:                              // current draw
+    case 4:                              // Hue status
+    case 8:  return SETTINGS_JS_MAX_AGE; // usermods may add status information
+    default: return ULONG_MAX;
+  }
+}
+
+// the next settings page request renders the JS anew, safe to call from any task
+void invalidateSettingsJS()
+{
+  settingsGeneration++;
+}
+
+// the cache is used by the web server task and trimmed by the loop, false if the other one has it
+static bool takeSettingsJSCache()
+{
+  bool taken = false;
+  #ifdef ARDUINO_ARCH_ESP32
+  portENTER_CRITICAL(&settingsJSMux);
+  #endif
+  if (!settingsJSBusy) settingsJSBusy = taken = true;
+  #ifdef ARDUINO_ARCH_ESP32
+  portEXIT_CRITICAL(&settingsJSMux);
+  #endif
+  return taken;
+}
+
+// frees rendered settings pages that were not requested for a while, all of them if the heap runs low
+void handleSettingsJS()
+{
+  static unsigned long lastCheck = 0;
+  if (millis() - lastCheck < 1000) return;
+  lastCheck = millis();
+  bool lowHeap = ESP.getFreeHeap() < WEB_MIN_HEAP;
+  bool cached = false;
+  for (size_t i = 0; i < SETTINGS_JS_CACHED; i++) {
+    settings_js_t* e = &settingsJSCache[i];
+    if (e->js && (lowHeap || millis() - e->used >= SETTINGS_JS_KEEP)) cached = true;
+  }
+  if (!cached || !takeSettingsJSCache()) return;
+  for (size_t i = 0; i < SETTINGS_JS_CACHED; i++) {
+    settings_js_t* e = &settingsJSCache[i];
+    if (!e->js || (!lowHeap && millis() - e->used < SETTINGS_JS_KEEP)) continue;
+    free(e->js);
+    e->js = nullptr;
+  }
+  settingsJSBusy = false;
+}
+
 void serveSettingsJS(AsyncWebServerRequest* request)
 {
   char buf[SETTINGS_STACK_BUF_SIZE+37];
@@ -540,10 +774,69 @@ void serveSettingsJS(AsyncWebServerRequest* request)
     request->send(403, "application/javascript", buf);
     return;
   }
-  strcat_P(buf,PSTR("function GetV(){var d=document;"));
-  getSettingsJS(subPage, buf+strlen(buf));  // this may overflow by 35bytes!!!
-  strcat_P(buf,PSTR("}"));
-  request->send(200, "application/javascript", buf);
+
+  unsigned long maxAge = getSettingsJSMaxAge(subPage);
+  bool cached = maxAge && takeSettingsJSCache(); // not cached while the loop is trimming the cache
+  settings_js_t* entry = nullptr;
+  for (size_t i = 0; cached && i < SETTINGS_JS_CACHED; i++) {
+    settings_js_t* e = &settingsJSCache[i];
+    if (e->js && e->subPage == subPage) entry = e;
+  }
+  if (entry && (entry->generation != settingsGeneration || millis() - entry->rendered >= maxAge)) {
+    free(entry->js);
+    entry->js = nullptr;
+  }
+
+  if (!entry || !entry->js) {
+    uint32_t generation = settingsGeneration; // configuration may change while rendering
+    strcat_P(buf,PSTR("function GetV(){var d=document;"));
+    getSettingsJS(subPage, buf+strlen(buf));  // this may overflow by 35bytes!!!
+    strcat_P(buf,PSTR("}"));
+    if (!cached) {
+      request->send(200, "application/javascript", buf);
+      return;
+    }
+    // keep a copy, replacing this page's previous one or the oldest entry
+    if (!entry) {
+      entry = &settingsJSCache[0];
+      for (size_t i = 0; i < SETTINGS_JS_CACHED && entry->js; i++) {
+        settings_js_t* e = &settingsJSCache[i];
+        if (!e->js || e->rendered - entry->rendered > 0x7FFFFFFF) entry = e; // free or rendered earlier
+      }
+      free(entry->js);
+      entry->js = nullptr;
+    }
+    size_t len = strlen(buf);
+    // if possible use SPI RAM on ESP32
+    #if defined(ARDUINO_ARCH_ESP32) && defined(WLED_USE_PSRAM)
+    if (psramFound())
+      entry->js = (char*)ps_malloc(len + 1);
+    else
+    #endif
+      entry->js = (char*)malloc(len + 1);
+    if (!entry->js) {
+      settingsJSBusy = false;
+      request->send(200, "application/javascript", buf);
+      return;
+    }
+    memcpy(entry->js, buf, len + 1);
+    entry->hash       = hashContent((const uint8_t*)buf, len);
+    entry->rendered   = millis();
+    entry->subPage    = subPage;
+    entry->generation = generation;
+  }
+
+  entry->used = millis();
+  getETag(buf, entry->hash);
+  if (handleIfNoneMatchCacheHeader(request, buf)) {
+    settingsJSBusy = false;
+    return;
+  }
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/javascript", entry->js); // copies the text
+  settingsJSBusy = false;
+  response->addHeader(F("Cache-Control"),"no-cache");
+  response->addHeader(F("ETag"), buf);
+  request->send(response);
 }
 
 
@@ -616,22 +909,24 @@ void serveSettings(AsyncWebServerRequest* request, bool post)
     }
   }
 
-  AsyncWebServerResponse *response;
+  const char* contentType = "text/html";
+  const uint8_t* content;
+  size_t len;
   switch (subPage)
   {
-    case 1:   response = request->beginResponse_P(200, "text/html", PAGE_settings_wifi, PAGE_settings_wifi_length); break;
-    case 2:   response = request->beginResponse_P(200, "text/html", PAGE_settings_leds, PAGE_settings_leds_length); break;
-    case 3:   response = request->beginResponse_P(200, "text/html", PAGE_settings_ui,   PAGE_settings_ui_length);   break;
-    case 4:   response = request->beginResponse_P(200, "text/html", PAGE_settings_sync, PAGE_settings_sync_length); break;
-    case 5:   response = request->beginResponse_P(200, "text/html", PAGE_settings_time, PAGE_settings_time_length); break;
-    case 6:   response = request->beginResponse_P(200, "text/html", PAGE_settings_sec,  PAGE_settings_sec_length);  break;
+    case 1:   content = PAGE_settings_wifi; len = PAGE_settings_wifi_length; break;
+    case 2:   content = PAGE_settings_leds; len = PAGE_settings_leds_length; break;
+    case 3:   content = PAGE_settings_ui;   len = PAGE_settings_ui_length;   break;
+    case 4:   content = PAGE_settings_sync; len = PAGE_settings_sync_length; break;
+    case 5:   content = PAGE_settings_time; len = PAGE_settings_time_length; break;
+    case 6:   content = PAGE_settings_sec;  len = PAGE_settings_sec_length;  break;
 #ifdef WLED_ENABLE_DMX
-    case 7:   response = request->beginResponse_P(200, "text/html", PAGE_settings_dmx,  PAGE_settings_dmx_length);  break;
+    case 7:   content = PAGE_settings_dmx;  len = PAGE_settings_dmx_length;  break;
 #endif
-    case 8:   response = request->beginResponse_P(200, "text/html", PAGE_settings_um,   PAGE_settings_um_length);   break;
-    case 9:   response = request->beginResponse_P(200, "text/html", PAGE_update,        PAGE_update_length);        break;
+    case 8:   content = PAGE_settings_um;   len = PAGE_settings_um_length;   break;
+    case 9:   content = PAGE_update;        len = PAGE_update_length;        break;
 #ifndef WLED_DISABLE_2D
-    case 10:  response = request->beginResponse_P(200, "text/html", PAGE_settings_2D,   PAGE_settings_2D_length);   break;
+    case 10:  content = PAGE_settings_2D;   len = PAGE_settings_2D_length;   break;
 #endif
     case 251: {
       correctPIN = !strlen(settingsPIN); // lock if a pin is set
@@ -639,13 +934,11 @@ void serveSettings(AsyncWebServerRequest* request, bool post)
       serveMessage(request, 200, strlen(settingsPIN) > 0 ? PSTR("Settings locked") : PSTR("No PIN set"), FPSTR(s_redirecting), 1);
       return;
     }
-    case 252: response = request->beginResponse_P(200, "text/html", PAGE_settings_pin,  PAGE_settings_pin_length);  break;
-    case 253: response = request->beginResponse_P(200, "text/css",  PAGE_settingsCss,   PAGE_settingsCss_length);   break;
+    case 252: content = PAGE_settings_pin;  len = PAGE_settings_pin_length;  break;
+    case 253: content = PAGE_settingsCss;   len = PAGE_settingsCss_length;   contentType = "text/css"; break;
     case 254: serveSettingsJS(request); return;
-    case 255: response = request->beginResponse_P(200, "text/html", PAGE_welcome,       PAGE_welcome_length);       break;
-    default:  response = request->beginResponse_P(200, "text/html", PAGE_settings,      PAGE_settings_length);      break;
+    case 255: content = PAGE_welcome;       len = PAGE_welcome_length;       break;
+    default:  content = PAGE_settings;      len = PAGE_settings_length;      break;
   }
-  response->addHeader(FPSTR(s_content_enc),"gzip");
-  setStaticContentCacheHeaders(response);
-  request->send(response);
+  serveAsset(request, contentType, content, len);
 }
@@ -10,16 +10,577 @@ unsigned long wsLastLiveTime = 0;
 //uint8_t* wsFrameBuffer = nullptr;
 
 #define WS_LIVE_INTERVAL 40
+#define WS_STATE_SLACK   32 // spare bytes in state messages
+
+/*
+ * Topic subscriptions
+ * A client sending {"sub":["state","info","live","nodes"]} receives a full copy of the subscribed topics once,
+ * afterwards only what changed as {"patch":{"state":{..},"info":{..}}}. Patches are merged into the copy:
+ * changed members are included, removed members are null, segments are in "seg" with their "id" and only the
+ * changed members, removed segments are sent as {"id":n,"stop":0}. The node list is resent when it changes.
+ * Clients that do not subscribe get the complete state and info on every change, as before.
+ * The realtime packet statistics (info.rts) change with every packet and do not cause info patches, subscribers
+ * of "stats" get them as {"stats":{"rts":{..}}} every WS_STATS_INTERVAL while there are any.
+ */
+#define WS_SUB_STATE  0x01
+#define WS_SUB_INFO   0x02
+#define WS_SUB_LIVE   0x04
+#define WS_SUB_NODES  0x08
+#define WS_SUB_STATS  0x10
+#define WS_SUB_ON     0x40 // client has subscribed
+#define WS_SUB_SYNCED 0x80 // client has the full copy and receives patches
+
+#define WS_MAX_CLIENTS     8    // connected clients tracked for subscriptions
+#define WS_MAX_QUEUE       4    // clients with more queued messages are skipped and resynced later
+#define WS_PUSH_INTERVAL   50   // ms, changes in between are sent as one message
+#define WS_NODES_INTERVAL  5000 // ms between checks of the node list
+#define WS_STATS_INTERVAL  1000 // ms between realtime statistics messages
+
+#define WS_PENDING_FULL  0x01 // clients without subscription
+#define WS_PENDING_PATCH 0x02 // subscribers
+
+typedef struct WsClient {
+  uint32_t id;     // client id, 0 if the slot is free
+  uint8_t  topics; // WS_SUB_*, 0 without subscription
+} ws_client_t;
+
+// hashes of a piece (state header, a segment or info) as last sent to subscribers
+typedef struct WsPiece {
+  uint32_t  keys;   // hash of the member names, 0 if the piece was not sent
+  uint8_t   count;  // number of members
+  uint32_t* values; // hashes of the serialized member values
+  char*     names;  // member names, '\0' separated, to report removed members
+} ws_piece_t;
+
+#define WS_PIECE_STATE 0
+#define WS_PIECE_SEG   1                    // first segment
+#define WS_PIECE_INFO  (MAX_NUM_SEGMENTS+1)
+#define WS_PIECES      (MAX_NUM_SEGMENTS+2)
+
+// wsClients and wsPending are changed by wsEvent() on the web server task and read by the loop,
+// the loop works on a copy and writes back through the helpers below
+static ws_client_t wsClients[WS_MAX_CLIENTS] = {};
+static ws_piece_t* wsPieces = nullptr; // allocated while there are subscribers
+static volatile uint8_t wsPending = 0;
+#ifdef ARDUINO_ARCH_ESP32
+static portMUX_TYPE wsClientsMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+static unsigned long wsLastPush = 0;
+static unsigned long wsLastNodesCheck = 0;
+static unsigned long wsLastStats = 0;
+static uint32_t wsNodesHash = 0;
+
+// Print that only hashes what is written to it (FNV-1a)
+class HashPrint : public Print {
+  public:
+    uint32_t hash = 2166136261UL;
+    size_t write(uint8_t c) { hash = (hash ^ c) * 16777619UL; return 1; }
+};
+
+// info members that change all the time (readings and counters), they are sent along with other changes
+// but do not cause an info patch by themselves
+static const char wsVolatileInfo[] PROGMEM = "uptime\0freeheap\0psram\0fps\0pwr\0drop\0rssi\0signal\0rts\0usync\0jbuf\0pstat\0cues\0plog\0web\0ser\0rtb\0";
+
+static inline void lockWsClients()
+{
+  #ifdef ARDUINO_ARCH_ESP32
+  portENTER_CRITICAL(&wsClientsMux);
+  #endif
+}
+
+static inline void unlockWsClients()
+{
+  #ifdef ARDUINO_ARCH_ESP32
+  portEXIT_CRITICAL(&wsClientsMux);
+  #endif
+}
+
+// caller holds the wsClients lock
+static ws_client_t* findWsClient(uint32_t id)
+{
+  for (size_t i = 0; i < WS_MAX_CLIENTS; i++) {
+    if (wsClients[i].id == id) return &wsClients[i];
+  }
+  return nullptr;
+}
+
+static void copyWsClients(ws_client_t* copy)
+{
+  lockWsClients();
+  memcpy(copy, wsClients, sizeof(wsClients));
+  unlockWsClients();
+}
+
+static uint8_t getWsTopics(uint32_t id)
+{
+  lockWsClients();
+  ws_client_t* s = findWsClient(id);
+  uint8_t topics = s ? s->topics : 0;
+  unlockWsClients();
+  return topics;
+}
+
+static void setWsPending(uint8_t pending)
+{
+  lockWsClients();
+  wsPending |= pending;
+  unlockWsClients();
+}
+
+// marks a client synced, unless it subscribed to something else since the copy was taken
+static void markWsSynced(const ws_client_t& copy)
+{
+  lockWsClients();
+  ws_client_t* s = findWsClient(copy.id);
+  if (s && (s->topics & ~WS_SUB_SYNCED) == (copy.topics & ~WS_SUB_SYNCED)) s->topics |= WS_SUB_SYNCED;
+  unlockWsClients();
+}
+
+// client id 0: all clients
+static void unsyncWsClients(uint32_t id)
+{
+  lockWsClients();
+  for (size_t i = 0; i < WS_MAX_CLIENTS; i++) {
+    if (!id || wsClients[i].id == id) wsClients[i].topics &= ~WS_SUB_SYNCED;
+  }
+  wsPending |= WS_PENDING_PATCH;
+  unlockWsClients();
+}
+
+static size_t countWsSubs(const ws_client_t* clients)
+{
+  size_t n = 0;
+  for (size_t i = 0; i < WS_MAX_CLIENTS; i++) if (clients[i].topics & WS_SUB_ON) n++;
+  return n;
+}
+
+static bool isWsVolatile(const char* key)
+{
+  for (const char* p = wsVolatileInfo; pgm_read_byte(p); p += strlen_P(p) + 1) {
+    if (!strcmp_P(key, p)) return true;
+  }
+  return false;
+}
+
+// hashes a value, leaving out volatile members of (nested) objects if skipVolatile is set
+static void hashWsValue(HashPrint& h, JsonVariantConst v, bool skipVolatile)
+{
+  if (!skipVolatile || !v.is<JsonObjectConst>()) {
+    serializeJson(v, h);
+    return;
+  }
+  h.write('{');
+  for (JsonPairConst kv : v.as<JsonObjectConst>()) {
+    if (isWsVolatile(kv.key().c_str())) continue;
+    h.print(kv.key().c_str()); h.write(':');
+    hashWsValue(h, kv.value(), true);
+  }
+  h.write('}');
+}
+
+static void clearWsPiece(ws_piece_t& piece)
+{
+  free(piece.values);
+  free(piece.names);
+  memset(&piece, 0, sizeof(ws_piece_t));
+}
+
+static void freeWsPieces()
+{
+  if (!wsPieces) return;
+  for (size_t i = 0; i < WS_PIECES; i++) clearWsPiece(wsPieces[i]);
+  free(wsPieces);
+  wsPieces = nullptr;
+}
+
+// sets the topics of a client from {"sub":[..]}, returns false if there is no free subscriber slot
+static bool subscribeWs(AsyncWebSocketClient* client, JsonArray topics)
+{
+  uint8_t sub = 0;
+  for (JsonVariant v : topics) {
+    const char* topic = v.as<const char*>();
+    if (!topic) continue;
+    if      (!strcmp_P(topic, PSTR("state"))) sub |= WS_SUB_STATE;
+    else if (!strcmp_P(topic, PSTR("info")))  sub |= WS_SUB_INFO;
+    else if (!strcmp_P(topic, PSTR("live")))  sub |= WS_SUB_LIVE;
+    else if (!strcmp_P(topic, PSTR("nodes"))) sub |= WS_SUB_NODES;
+    else if (!strcmp_P(topic, PSTR("stats"))) sub |= WS_SUB_STATS;
+  }
+  lockWsClients();
+  ws_client_t* s = findWsClient(client->id());
+  if (!s) s = findWsClient(0);
+  if (s) {
+    s->id = client->id();
+    s->topics = sub | WS_SUB_ON; // not synced, gets a full copy with the next push
+    wsPending |= WS_PENDING_PATCH;
+  }
+  unlockWsClients();
+  if (!s) return false;
+  if (sub & WS_SUB_LIVE) wsLiveClientId = client->id();
+  else if (wsLiveClientId == client->id()) wsLiveClientId = 0;
+  wsLastPush = millis() - WS_PUSH_INTERVAL; // send right away
+  return true;
+}
+
+// adds the members of obj that changed since the last push to patch, returns false if nothing changed
+// for segments (list not null) the patch object is only created, starting with the segment id, once something changed
+// with skipVolatile the members in wsVolatileInfo are left out of the comparison and only sent along with a change
+static bool diffWsPiece(ws_piece_t& base, JsonObject obj, JsonObject patch, JsonArray list = JsonArray(), bool skipVolatile = false)
+{
+  HashPrint keys;
+  size_t namesLen = 0;
+  for (JsonPair kv : obj) {
+    keys.print(kv.key().c_str()); keys.write(0);
+    namesLen += strlen(kv.key().c_str()) + 1;
+  }
+  uint8_t count = MIN(obj.size(), 255);
+  bool changed = false;
+  bool resend = keys.hash != base.keys || count != base.count || !base.values;
+
+  if (resend) {
+    // member set changed: report removed members as null, send all present ones
+    if (patch.isNull()) patch = list.createNestedObject();
+    const char* name = base.names;
+    for (size_t i = 0; name && i < base.count; i++, name += strlen(name) + 1) {
+      if (!obj.containsKey(name)) patch[(char*)name] = nullptr; // char* makes a copy of the name
+    }
+    clearWsPiece(base);
+    base.values = (uint32_t*)malloc(count * sizeof(uint32_t));
+    base.names  = (char*)malloc(namesLen);
+    if (base.values && base.names) {
+      char* n = base.names;
+      for (JsonPair kv : obj) { strcpy(n, kv.key().c_str()); n += strlen(n) + 1; }
+      base.keys  = keys.hash;
+      base.count = count;
+    } else {
+      clearWsPiece(base); // out of memory, everything is sent again next time
+    }
+    changed = true;
+  }
+
+  size_t i = 0;
+  for (JsonPair kv : obj) {
+    bool vol = skipVolatile && isWsVolatile(kv.key().c_str());
+    HashPrint value;
+    hashWsValue(value, kv.value(), skipVolatile);
+    if (resend || (!vol && base.values[i] != value.hash)) {
+      if (patch.isNull()) { patch = list.createNestedObject(); patch["id"] = obj["id"]; }
+      patch[kv.key()] = kv.value();
+      changed = true;
+    }
+    if (base.values) base.values[i] = value.hash;
+    i++;
+  }
+  if (changed && skipVolatile) {
+    for (JsonPair kv : obj) {
+      if (isWsVolatile(kv.key().c_str())) patch[kv.key()] = kv.value();
+    }
+  }
+  return changed;
+}
+
+// sends state and/or info, to one client or (client null) to all clients without subscription
+static bool sendStateWs(AsyncWebSocketClient* client, uint8_t content)
+{
+  // subscribers get a single topic wrapped in an object, the complete state+info already is one
+  const char* prefix = "";
+  if (content == JSON_PATH_STATE) prefix = "{\"state\":";
+  if (content == JSON_PATH_INFO)  prefix = "{\"info\":";
+  size_t prefixLen = strlen(prefix);
+  size_t suffixLen = prefixLen ? 1 : 0;
+
+  // streamed straight into the message buffer, no JSON document holds the whole state
+  JsonStateStream stream(content);
+  size_t len = stream.measure();
+  if (!stream.ok() || stream.busy()) return false;
+  DEBUG_PRINTF("WS state size: %u\n", len);
+  len += prefixLen + suffixLen + WS_STATE_SLACK; // values may change between measuring and writing
+
+  size_t heap1 = ESP.getFreeHeap();
+  DEBUG_PRINT(F("heap ")); DEBUG_PRINTLN(ESP.getFreeHeap());
+  #ifdef ESP8266
+  if (len>heap1) {
+    DEBUG_PRINTLN(F("Out of memory (WS)!"));
+    return true;
+  }
+  #endif
+  AsyncWebSocketMessageBuffer * buffer = ws.makeBuffer(len); // will not allocate correct memory sometimes on ESP8266
+  #ifdef ESP8266
+  size_t heap2 = ESP.getFreeHeap();
+  DEBUG_PRINT(F("heap ")); DEBUG_PRINTLN(ESP.getFreeHeap());
+  #else
+  size_t heap2 = 0; // ESP32 variants do not have the same issue and will work without checking heap allocation
+  #endif
+  if (!buffer || heap1-heap2<len) {
+    DEBUG_PRINTLN(F("WS buffer allocation failed."));
+    ws.closeAll(1013); //code 1013 = temporary overload, try again later
+    ws.cleanupClients(0); //disconnect all clients to release memory
+    ws._cleanBuffers();
+    return true; //out of memory
+  }
+
+  buffer->lock();
+  uint8_t* data = buffer->get();
+  memcpy(data, prefix, prefixLen);
+  size_t written = prefixLen + stream.read(data + prefixLen, len - prefixLen - suffixLen);
+  if (!stream.done() || !stream.ok()) {
+    // state grew by more than the slack or the lock got busy in between, send it later
+    buffer->unlock();
+    ws._cleanBuffers();
+    return false;
+  }
+  if (suffixLen) data[written++] = '}';
+  memset(data + written, ' ', len - written); // pad with whitespace if the state got shorter
+
+  DEBUG_PRINT(F("Sending WS data "));
+  ws_client_t clients[WS_MAX_CLIENTS];
+  if (!client) copyWsClients(clients);
+  if (client) {
+    client->text(buffer);
+    DEBUG_PRINTLN(F("to a single client."));
+  } else if (!countWsSubs(clients)) {
+    ws.textAll(buffer);
+    DEBUG_PRINTLN(F("to multiple clients."));
+  } else {
+    for (size_t i = 0; i < WS_MAX_CLIENTS; i++) {
+      if (!clients[i].id || (clients[i].topics & WS_SUB_ON)) continue;
+      AsyncWebSocketClient* c = ws.client(clients[i].id);
+      if (c) c->text(buffer);
+    }
+    DEBUG_PRINTLN(F("to clients without subscription."));
+  }
+  buffer->unlock();
+  ws._cleanBuffers();
+  return true;
+}
+
+static bool sendNodesWs(AsyncWebSocketClient* client)
+{
+  DynamicJsonDocument nodes(JSON_STREAM_PIECE_SIZE);
+  if (!nodes.capacity()) return false;
+  serializeNodes(nodes.to<JsonObject>());
+  size_t len = measureJson(nodes);
+  AsyncWebSocketMessageBuffer * buffer = ws.makeBuffer(len);
+  if (!buffer) return false;
+  buffer->lock();
+  serializeJson(nodes, (char *)buffer->get(), len);
+  if (client) {
+    client->text(buffer);
+  } else {
+    ws_client_t clients[WS_MAX_CLIENTS];
+    copyWsClients(clients);
+    for (size_t i = 0; i < WS_MAX_CLIENTS; i++) {
+      if (!(clients[i].topics & WS_SUB_NODES) || !(clients[i].topics & WS_SUB_SYNCED)) continue;
+      AsyncWebSocketClient* c = ws.client(clients[i].id);
+      if (c) c->text(buffer);
+    }
+  }
+  buffer->unlock();
+  ws._cleanBuffers();
+  return true;
+}
+
+// realtime statistics to synced "stats" subscribers
+static void sendStatsWs(const ws_client_t* clients)
+{
+  DynamicJsonDocument stats(JSON_STREAM_PIECE_SIZE);
+  if (!stats.capacity()) return;
+  JsonObject root = stats.createNestedObject(F("stats"));
+  serializeRealtimeStats(root);
+  if (!root.size() || stats.overflowed()) return; // nothing received yet
+  size_t len = measureJson(stats);
+  AsyncWebSocketMessageBuffer * buffer = ws.makeBuffer(len);
+  if (!buffer) return;
+  buffer->lock();
+  serializeJson(stats, (char *)buffer->get(), len);
+  for (size_t i = 0; i < WS_MAX_CLIENTS; i++) {
+    if (!(clients[i].topics & WS_SUB_STATS) || !(clients[i].topics & WS_SUB_SYNCED)) continue;
+    AsyncWebSocketClient* c = ws.client(clients[i].id);
+    if (c && c->queueLength() <= WS_MAX_QUEUE) c->text(buffer);
+  }
+  buffer->unlock();
+  ws._cleanBuffers();
+}
+
+// ignores the age of the nodes, which changes all the time
+static uint32_t hashNodes()
+{
+  HashPrint h;
+  for (NodesMap::iterator it = Nodes.begin(); it != Nodes.end(); ++it) {
+    if (it->second.ip[0] == 0) continue;
+    h.print(it->second.nodeName);
+    h.print(it->second.ip);
+    h.write(it->second.nodeType);
+    h.print(it->second.build);
+  }
+  return h.hash;
+}
+
+// {"patch":{"state":..,"info":..}}, either part may be missing
+static AsyncWebSocketMessageBuffer* makeWsPatch(JsonObject state, JsonObject info)
+{
+  size_t lenState = state.isNull() ? 0 : measureJson(state);
+  size_t lenInfo  = info.isNull()  ? 0 : measureJson(info);
+  size_t len = 10 + (lenState ? 8 + lenState : 0) + (lenState && lenInfo ? 1 : 0) + (lenInfo ? 7 + lenInfo : 0) + 2;
+  AsyncWebSocketMessageBuffer * buffer = ws.makeBuffer(len);
+  if (!buffer) return nullptr;
+  char* p = (char*)buffer->get();
+  memcpy_P(p, PSTR("{\"patch\":{"), 10); p += 10;
+  if (lenState) {
+    memcpy_P(p, PSTR("\"state\":"), 8); p += 8;
+    serializeJson(state, p, lenState + 1); p += lenState;
+  }
+  if (lenState && lenInfo) *p++ = ',';
+  if (lenInfo) {
+    memcpy_P(p, PSTR("\"info\":"), 7); p += 7;
+    serializeJson(info, p, lenInfo + 1); p += lenInfo;
+  }
+  memcpy(p, "}}", 2);
+  return buffer;
+}
+
+// sends what changed since the last push to synced subscribers, returns false if the patch could not be built
+// caller holds the JSON buffer lock so that segments do not change while they are read
+static bool pushWsPatch(const ws_client_t* clients, uint8_t topics)
+{
+  if (!wsPieces) wsPieces = (ws_piece_t*)calloc(WS_PIECES, sizeof(ws_piece_t));
+  if (!wsPieces) return false;
+  DynamicJsonDocument piece(JSON_STREAM_PIECE_SIZE);
+  DynamicJsonDocument patch(JSON_STREAM_PIECE_SIZE);
+  if (!piece.capacity() || !patch.capacity()) return false;
+
+  JsonObject state, info;
+  if (topics & WS_SUB_STATE) {
+    state = patch.createNestedObject("state");
+    byte err = errorFlag;
+    serializeStateHeader(piece.to<JsonObject>());
+    errorFlag = err; // clients without subscription still have to see the error
+    diffWsPiece(wsPieces[WS_PIECE_STATE], piece.as<JsonObject>(), state);
+    JsonArray segs = state.createNestedArray("seg");
+    for (size_t s = 0; s < strip.getMaxSegments(); s++) {
+      ws_piece_t& base = wsPieces[WS_PIECE_SEG + s];
+      if (s >= strip.getSegmentsNum() || !strip.getSegment(s).isActive()) {
+        if (base.keys) { // removed since the last push
+          JsonObject seg = segs.createNestedObject();
+          seg["id"]   = s;
+          seg["stop"] = 0;
+          clearWsPiece(base);
+        }
+        continue;
+      }
+      JsonObject seg = piece.to<JsonObject>();
+      serializeSegment(seg, strip.getSegment(s), s);
+      diffWsPiece(base, seg, JsonObject(), segs);
+    }
+    if (!segs.size()) state.remove("seg");
+    if (!state.size()) state = JsonObject();
+  }
+  if (topics & WS_SUB_INFO) {
+    info = patch.createNestedObject("info");
+    serializeInfo(piece.to<JsonObject>());
+    diffWsPiece(wsPieces[WS_PIECE_INFO], piece.as<JsonObject>(), info, JsonArray(), true);
+    if (!info.size()) info = JsonObject();
+  }
+  if (patch.overflowed() || piece.overflowed()) return false;
+  if (state.isNull() && info.isNull()) return true;
+
+  AsyncWebSocketMessageBuffer* msgs[3] = {nullptr, nullptr, nullptr}; // state, info, both
+  for (size_t i = 0; i < WS_MAX_CLIENTS; i++) {
+    const ws_client_t& s = clients[i];
+    if (!s.id || !(s.topics & WS_SUB_SYNCED)) continue;
+    JsonObject subState = (s.topics & WS_SUB_STATE) ? state : JsonObject();
+    JsonObject subInfo  = (s.topics & WS_SUB_INFO)  ? info  : JsonObject();
+    if (subState.isNull() && subInfo.isNull()) continue;
+    AsyncWebSocketClient* c = ws.client(s.id);
+    if (!c) continue;
+    uint8_t m = (subState.isNull() ? 0 : 1) + (subInfo.isNull() ? 0 : 2) - 1;
+    if (!msgs[m]) msgs[m] = makeWsPatch(subState, subInfo);
+    if (!msgs[m] || c->queueLength() > WS_MAX_QUEUE) {
+      // client falls behind, it gets a full copy once it has caught up
+      unsyncWsClients(s.id);
+      continue;
+    }
+    msgs[m]->lock();
+    c->text(msgs[m]);
+  }
+  for (size_t m = 0; m < 3; m++) if (msgs[m]) msgs[m]->unlock();
+  ws._cleanBuffers();
+  return true;
+}
+
+static void pushWsUpdates()
+{
+  ws_client_t clients[WS_MAX_CLIENTS];
+  lockWsClients();
+  uint8_t pending = wsPending;
+  wsPending = 0;
+  memcpy(clients, wsClients, sizeof(wsClients));
+  unlockWsClients();
+  wsLastPush = millis();
+  if (!ws.count()) return;
+
+  size_t subscribers = countWsSubs(clients);
+  uint8_t topics = 0;
+  for (size_t i = 0; i < WS_MAX_CLIENTS; i++) topics |= clients[i].topics;
+  if (!subscribers) freeWsPieces();
+
+  // the patch goes first so that it is relative to the same state as the full copies sent below
+  if ((pending & WS_PENDING_PATCH) && (topics & (WS_SUB_STATE | WS_SUB_INFO))) {
+    if (!requestJSONBufferLock(26, JSON_STREAM_LOCK_WAIT)) {
+      setWsPending(pending); // busy, try again with the next push
+      return;
+    }
+    bool patched = pushWsPatch(clients, topics);
+    releaseJSONBufferLock();
+    if (!patched) {
+      unsyncWsClients(0);
+      for (size_t i = 0; i < WS_MAX_CLIENTS; i++) clients[i].topics &= ~WS_SUB_SYNCED;
+    }
+  }
+
+  if ((pending & WS_PENDING_FULL) && ws.count() > subscribers && !sendStateWs(nullptr, JSON_PATH_STATE_INFO)) {
+    setWsPending(WS_PENDING_FULL);
+  }
+
+  // full copy for new subscribers and those that fell behind
+  for (size_t i = 0; i < WS_MAX_CLIENTS; i++) {
+    const ws_client_t& s = clients[i];
+    if (!(s.topics & WS_SUB_ON) || (s.topics & WS_SUB_SYNCED)) continue;
+    AsyncWebSocketClient* c = ws.client(s.id);
+    if (!c) continue;
+    if (c->queueLength() > WS_MAX_QUEUE) {
+      setWsPending(WS_PENDING_PATCH);
+      continue;
+    }
+    uint8_t content = 0;
+    if (s.topics & WS_SUB_STATE) content = (s.topics & WS_SUB_INFO) ? JSON_PATH_STATE_INFO : JSON_PATH_STATE;
+    else if (s.topics & WS_SUB_INFO) content = JSON_PATH_INFO;
+    bool success = true;
+    if (content) success = sendStateWs(c, content);
+    if (success && (s.topics & WS_SUB_NODES)) success = sendNodesWs(c);
+    if (success) markWsSynced(s);
+    else         setWsPending(WS_PENDING_PATCH);
+  }
+}
 
 void wsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len)
 {
   if(type == WS_EVT_CONNECT){
     //client connected
     DEBUG_PRINTLN(F("WS client connected."));
+    lockWsClients();
+    ws_client_t* slot = findWsClient(0);
+    if (slot) slot->id = client->id();
+    unlockWsClients();
     sendDataWs(client);
   } else if(type == WS_EVT_DISCONNECT){
     //client disconnected
     if (client->id() == wsLiveClientId) wsLiveClientId = 0;
+    stopLiveStreamWs(client->id());
+    lockWsClients();
+    ws_client_t* sub = findWsClient(client->id());
+    if (sub) memset(sub, 0, sizeof(ws_client_t));
+    unlockWsClients();
     DEBUG_PRINTLN(F("WS client disconnected."));
   } else if(type == WS_EVT_DATA){
     // data packet
@@ -36,6 +597,8 @@ void wsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventTyp
         }
 
         bool verboseResponse = false;
+        bool fullRequested = false;
+        bool accepted = true;
         if (!requestJSONBufferLock(11)) return;
 
         DeserializationError error = deserializeJson(doc, data, len);
@@ -46,21 +609,35 @@ void wsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventTyp
         }
         if (root["v"] && root.size() == 1) {
           //if the received value is just "{"v":true}", send only to this client
-          verboseResponse = true;
+          verboseResponse = fullRequested = true;
         } else if (root.containsKey("lv")) {
-          wsLiveClientId = root["lv"] ? client->id() : 0;
+          if (root["lv"].is<JsonObject>()) {
+            accepted = startLiveStreamWs(client, root["lv"]);
+          } else {
+            wsLiveClientId = root["lv"] ? client->id() : 0;
+            stopLiveStreamWs(client->id());
+          }
+        } else if (root.containsKey(F("sub"))) {
+          accepted = subscribeWs(client, root[F("sub")].as<JsonArray>());
         } else {
           verboseResponse = deserializeState(root);
         }
         releaseJSONBufferLock(); // will clean fileDoc
 
+        // subscribers get their own change with the next patch
+        if (verboseResponse && (getWsTopics(client->id()) & WS_SUB_STATE) && !fullRequested) {
+          verboseResponse = false;
+          setWsPending(WS_PENDING_PATCH);
+        }
+
         // force broadcast in 500ms after updating client
         if (verboseResponse) {
           sendDataWs(client);
           lastInterfaceUpdate = millis() - (INTERFACE_UPDATE_COOLDOWN -500);
         } else {
           // we have to send something back otherwise WS connection closes
-          client->text(F("{\"success\":true}"));
+          if (accepted) client->text(F("{\"success\":true}"));
+          else            client->text(F("{\"success\":false}"));
           lastInterfaceUpdate = millis() - (INTERFACE_UPDATE_COOLDOWN -500);
         }
       }
@@ -95,60 +672,15 @@ void wsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventTyp
   }
 }
 
+// client null: all clients, sent from handleWs() so that rapid changes are coalesced into one message
 void sendDataWs(AsyncWebSocketClient * client)
 {
   if (!ws.count()) return;
-  AsyncWebSocketMessageBuffer * buffer;
-
-  if (!requestJSONBufferLock(12)) return;
-
-  JsonObject state = doc.createNestedObject("state");
-  serializeState(state);
-  JsonObject info  = doc.createNestedObject("info");
-  serializeInfo(info);
-
-  size_t len = measureJson(doc);
-  DEBUG_PRINTF("JSON buffer size: %u for WS request (%u).\n", doc.memoryUsage(), len);
-
-  size_t heap1 = ESP.getFreeHeap();
-  DEBUG_PRINT(F("heap ")); DEBUG_PRINTLN(ESP.getFreeHeap());
-  #ifdef ESP8266
-  if (len>heap1) {
-    DEBUG_PRINTLN(F("Out of memory (WS)!"));
+  if (!client) {
+    setWsPending(WS_PENDING_FULL | WS_PENDING_PATCH);
     return;
   }
-  #endif
-  buffer = ws.makeBuffer(len); // will not allocate correct memory sometimes on ESP8266
-  #ifdef ESP8266
-  size_t heap2 = ESP.getFreeHeap();
-  DEBUG_PRINT(F("heap ")); DEBUG_PRINTLN(ESP.getFreeHeap());
-  #else
-  size_t heap2 = 0; // ESP32 variants do not have the same issue and will work without checking heap allocation
-  #endif
-  if (!buffer || heap1-heap2<len) {
-    releaseJSONBufferLock();
-    DEBUG_PRINTLN(F("WS buffer allocation failed."));
-    ws.closeAll(1013); //code 1013 = temporary overload, try again later
-    ws.cleanupClients(0); //disconnect all clients to release memory
-    ws._cleanBuffers();
-    return; //out of memory
-  }
-
-  buffer->lock();
-  serializeJson(doc, (char *)buffer->get(), len);
-
-  DEBUG_PRINT(F("Sending WS data "));
-  if (client) {
-    client->text(buffer);
-    DEBUG_PRINTLN(F("to a single client."));
-  } else {
-    ws.textAll(buffer);
-    DEBUG_PRINTLN(F("to multiple clients."));
-  }
-  buffer->unlock();
-  ws._cleanBuffers();
-
-  releaseJSONBufferLock();
+  if (!sendStateWs(client, JSON_PATH_STATE_INFO)) setWsPending(WS_PENDING_FULL); // retry from loop
 }
 
 bool sendLiveLedsWs(uint32_t wsClient)
@@ -220,6 +752,32 @@ void handleWs()
     wsLastLiveTime = millis();
     if (!success) wsLastLiveTime -= 20; //try again in 20ms if failed due to non-empty WS queue
   }
+  handleLiveStreamWs();
+  if (wsPending && millis() - wsLastPush >= WS_PUSH_INTERVAL) pushWsUpdates();
+
+  if (millis() - wsLastStats >= WS_STATS_INTERVAL) {
+    wsLastStats = millis();
+    ws_client_t clients[WS_MAX_CLIENTS];
+    copyWsClients(clients);
+    uint8_t topics = 0;
+    for (size_t i = 0; i < WS_MAX_CLIENTS; i++) {
+      if (clients[i].topics & WS_SUB_SYNCED) topics |= clients[i].topics;
+    }
+    if (topics & WS_SUB_STATS) sendStatsWs(clients);
+  }
+
+  if (millis() - wsLastNodesCheck > WS_NODES_INTERVAL) {
+    wsLastNodesCheck = millis();
+    bool nodesSubscribed = false;
+    ws_client_t clients[WS_MAX_CLIENTS];
+    copyWsClients(clients);
+    for (size_t i = 0; i < WS_MAX_CLIENTS; i++) {
+      if ((clients[i].topics & WS_SUB_NODES) && (clients[i].topics & WS_SUB_SYNCED)) nodesSubscribed = true;
+    }
+    uint32_t nodesHash = hashNodes();
+    if (nodesSubscribed && nodesHash != wsNodesHash) sendNodesWs(nullptr);
+    wsNodesHash = nodesHash;
+  }
 }
 
 #else
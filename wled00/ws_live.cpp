@@ -0,0 +1,338 @@
+#include "wled.h"
+
+/*
+ * Binary live view stream
+ * Alternative to the 'L' live view for clients that send {"lv":{"fps":25,"max":4096}}. Frames are sent at full
+ * resolution (or downsampled to at most "max" pixels) in tiles, each tile run length and delta encoded against
+ * what the client received last. The frame rate adapts to the client's websocket queue.
+ *
+ * Tile message:
+ *  0      'D'
+ *  1      version (1)
+ *  2      flags: bit 0 key tile (encoded without skips)
+ *  3      frame number (low 8 bits)
+ *  4-5    frame width (big endian, after downsampling)
+ *  6-7    frame height
+ *  8-9    tile x
+ *  10-11  tile y
+ *  12-13  tile width
+ *  14-15  tile height
+ *  16     downsampling step (every n-th LED/row/column)
+ *  17...  runs over the tile pixels in row order, each starting with a code byte:
+ *         0x00-0x7F  code+1 pixels unchanged
+ *         0x80-0xBF  code-0x7F pixels of the following RGB color
+ *         0xC0-0xFF  code-0xBF RGB colors follow
+ * Tiles without changes are not sent.
+ * Key tiles are sent every WS_LIVE_KEY_INTERVAL and after a tile could not be queued, so a client that missed a
+ * tile is back in sync soon. A client can request them right away with {"lv":{"key":true}}.
+ */
+#ifdef WLED_ENABLE_WEBSOCKETS
+
+#ifdef ESP8266
+  #define WS_LIVE_MAX_CLIENTS 2
+  #define WS_LIVE_MAX_PIXELS  1024
+  #define WS_LIVE_TILE_PIXELS 256
+  #define WS_LIVE_MAX_QUEUE   6    // below the library's WS_MAX_QUEUED_MESSAGES, more messages would be dropped
+#else
+  #define WS_LIVE_MAX_CLIENTS 4
+  #define WS_LIVE_MAX_PIXELS  16384
+  #define WS_LIVE_TILE_PIXELS 1024
+  #define WS_LIVE_MAX_QUEUE   24
+#endif
+#define WS_LIVE_HEADER      17
+#define WS_LIVE_MAX_INTERVAL 1000 // ms, slowest frame rate a busy client is throttled to
+#define WS_LIVE_KEY_INTERVAL 2000 // ms between key frames
+
+// requests from wsEvent() (web server task), carried out by handleLiveStreamWs() in the loop
+#define WS_LIVE_START 0x01
+#define WS_LIVE_STOP  0x02
+#define WS_LIVE_KEY   0x04
+
+// id, pending and the requested values are shared with the web server task (liveClientsMux),
+// everything else belongs to the loop
+typedef struct LiveClient {
+  uint32_t id;              // websocket client id, 0 if unused
+  uint8_t  pending;         // WS_LIVE_* requests
+  uint16_t reqInterval;     // requested ms between frames
+  uint16_t reqPixels;       // requested maximum pixels
+  uint16_t minInterval;     // ms between frames as requested
+  uint16_t interval;        // current ms between frames, grows while the client's queue is busy
+  unsigned long lastFrame;
+  unsigned long lastKey;    // last key frame
+  uint16_t maxPixels;
+  uint16_t width, height;   // of the last frame, a change sends key tiles
+  uint8_t  step;
+  uint8_t  frame;
+  byte*    prev;            // RGB the client has, nullptr: key tiles only
+} live_client_t;
+
+static live_client_t liveClients[WS_LIVE_MAX_CLIENTS] = {};
+#ifdef ARDUINO_ARCH_ESP32
+static portMUX_TYPE liveClientsMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+static inline void lockLiveClients()
+{
+  #ifdef ARDUINO_ARCH_ESP32
+  portENTER_CRITICAL(&liveClientsMux);
+  #endif
+}
+
+static inline void unlockLiveClients()
+{
+  #ifdef ARDUINO_ARCH_ESP32
+  portEXIT_CRITICAL(&liveClientsMux);
+  #endif
+}
+
+// caller holds the liveClients lock
+static live_client_t* findLiveClient(uint32_t id)
+{
+  for (size_t i = 0; i < WS_LIVE_MAX_CLIENTS; i++) {
+    if (liveClients[i].id == id) return &liveClients[i];
+  }
+  return nullptr;
+}
+
+static void freeLiveFrame(live_client_t* lc)
+{
+  free(lc->prev);
+  lc->prev = nullptr;
+  lc->width = lc->height = 0;
+}
+
+// the slot is free right away, its frame is freed by the loop
+void stopLiveStreamWs(uint32_t id)
+{
+  lockLiveClients();
+  live_client_t* lc = findLiveClient(id);
+  if (lc) {
+    lc->id = 0;
+    lc->pending = WS_LIVE_STOP;
+  }
+  unlockLiveClients();
+}
+
+// {"lv":{"fps":25,"max":4096}}, returns false if all stream slots are in use
+bool startLiveStreamWs(AsyncWebSocketClient* client, JsonObject lv)
+{
+  uint8_t fps = constrain(lv[F("fps")] | 20, 1, 60);
+  uint16_t maxPixels = constrain(lv[F("max")] | WS_LIVE_MAX_PIXELS, 16, WS_LIVE_MAX_PIXELS);
+  bool key = lv[F("key")];
+  lockLiveClients();
+  live_client_t* lc = findLiveClient(client->id());
+  if (lc && key) {
+    lc->pending |= WS_LIVE_KEY; // client missed a tile, resync with the next frame
+  } else {
+    if (!lc) lc = findLiveClient(0);
+    if (lc) {
+      lc->id          = client->id();
+      lc->reqInterval = 1000 / fps;
+      lc->reqPixels   = maxPixels;
+      lc->pending    |= WS_LIVE_START; // start over with key tiles
+    }
+  }
+  unlockLiveClients();
+  return lc != nullptr;
+}
+
+// frame size and downsampling for the current strip/matrix
+static void getLiveFrameSize(uint16_t maxPixels, uint16_t& width, uint16_t& height, uint8_t& step)
+{
+  uint16_t w = strip.getLengthTotal(), h = 1;
+  #ifndef WLED_DISABLE_2D
+  if (strip.isMatrix) {
+    w = Segment::maxWidth;
+    h = Segment::maxHeight;
+  }
+  #endif
+  for (step = 1; step < 255; step++) {
+    width  = (w + step - 1) / step;
+    height = (h + step - 1) / step;
+    if ((uint32_t)width * height <= maxPixels) break;
+  }
+}
+
+static uint32_t getLivePixel(uint16_t x, uint16_t y, uint8_t step)
+{
+  uint32_t w = strip.isMatrix ? Segment::maxWidth : strip.getLengthTotal();
+  uint32_t c = strip.getPixelColor((uint32_t)y * step * w + (uint32_t)x * step);
+  return RGBW32(qadd8(W(c), R(c)), qadd8(W(c), G(c)), qadd8(W(c), B(c)), 0); // add white channel to RGB channels as a simple RGBW -> RGB map
+}
+
+// encodes the n pixels in cur against prev (nullptr: key tile), returns encoded length, 0 if nothing changed
+static size_t encodeLiveTile(const byte* cur, const byte* prev, size_t n, byte* out)
+{
+  size_t len = 0;
+  bool changed = !prev;
+  size_t i = 0;
+  while (i < n) {
+    // unchanged pixels
+    size_t run = 0;
+    while (prev && i + run < n && run < 128 && !memcmp(cur + (i+run)*3, prev + (i+run)*3, 3)) run++;
+    if (run) {
+      out[len++] = run - 1;
+      i += run;
+      continue;
+    }
+    changed = true;
+    // pixels of the same color
+    run = 1;
+    while (i + run < n && run < 64 && !memcmp(cur + (i+run)*3, cur + i*3, 3)) run++;
+    if (run > 2) {
+      out[len++] = 0x80 + run - 1;
+      memcpy(out + len, cur + i*3, 3);
+      len += 3;
+      i += run;
+      continue;
+    }
+    // changed pixels of different color, up to the next unchanged pixel or run of 3
+    run = 1;
+    while (i + run < n && run < 64) {
+      const byte* p = cur + (i+run)*3;
+      if (prev && !memcmp(p, prev + (i+run)*3, 3)) break;
+      if (i + run + 2 < n && !memcmp(p, p + 3, 3) && !memcmp(p, p + 6, 3)) break;
+      run++;
+    }
+    out[len++] = 0xC0 + run - 1;
+    memcpy(out + len, cur + i*3, run*3);
+    len += run*3;
+    i += run;
+  }
+  return changed ? len : 0;
+}
+
+// sends one frame as tiles, returns false if out of memory
+static bool sendLiveFrame(live_client_t* lc, AsyncWebSocketClient* wsc)
+{
+  uint16_t width, height;
+  uint8_t step;
+  getLiveFrameSize(lc->maxPixels, width, height, step);
+  if (!width || !height) return true;
+  if (width != lc->width || height != lc->height || step != lc->step) {
+    freeLiveFrame(lc);
+    lc->width  = width;
+    lc->height = height;
+    lc->step   = step;
+    lc->frame  = 0; // key tiles first
+    size_t size = (size_t)width * height * 3;
+    // if possible use SPI RAM on ESP32
+    #if defined(ARDUINO_ARCH_ESP32) && defined(WLED_USE_PSRAM)
+    if (psramFound())
+      lc->prev = (byte*)ps_malloc(size);
+    else
+    #endif
+      lc->prev = (byte*)malloc(size);
+    // without memory for the previous frame every tile is a key tile
+  }
+  bool key = !lc->prev || !lc->frame || millis() - lc->lastKey >= WS_LIVE_KEY_INTERVAL;
+  if (key) lc->lastKey = millis();
+  bool dropped = false;
+
+  uint16_t tileW = MIN(width, WS_LIVE_TILE_PIXELS);
+  uint16_t tileH = MAX(1, MIN(height, WS_LIVE_TILE_PIXELS / tileW));
+  size_t tilePixels = (size_t)tileW * tileH;
+  byte* cur = (byte*)malloc(tilePixels * 3);
+  byte* old = key ? nullptr : (byte*)malloc(tilePixels * 3);
+  byte* out = (byte*)malloc(WS_LIVE_HEADER + tilePixels * 3 + (tilePixels + 63) / 64);
+  if (!cur || !out || (!key && !old)) {
+    free(cur);
+    free(old);
+    free(out);
+    return false;
+  }
+
+  for (uint16_t ty = 0; ty < height; ty += tileH) {
+    for (uint16_t tx = 0; tx < width; tx += tileW) {
+      uint16_t w = MIN(tileW, width - tx);
+      uint16_t h = MIN(tileH, height - ty);
+      size_t n = 0;
+      for (uint16_t y = ty; y < ty + h; y++) {
+        for (uint16_t x = tx; x < tx + w; x++, n++) {
+          uint32_t c = getLivePixel(x, y, step);
+          cur[n*3]   = R(c);
+          cur[n*3+1] = G(c);
+          cur[n*3+2] = B(c);
+        }
+      }
+      // swap the tile rows in the previous frame for the new ones
+      if (lc->prev) {
+        for (uint16_t y = 0; y < h; y++) {
+          byte* row = lc->prev + ((size_t)(ty + y) * width + tx) * 3;
+          if (old) memcpy(old + y*w*3, row, w*3);
+          memcpy(row, cur + y*w*3, w*3);
+        }
+      }
+      size_t len = encodeLiveTile(cur, old, n, out + WS_LIVE_HEADER);
+      if (!len) continue;
+      if (wsc->queueLength() >= WS_LIVE_MAX_QUEUE) {
+        dropped = true; // the client keeps its old tile, the previous frame no longer matches it
+        continue;
+      }
+      out[0]  = 'D';
+      out[1]  = 1;
+      out[2]  = key ? 0x01 : 0x00;
+      out[3]  = lc->frame;
+      out[4]  = width >> 8;  out[5]  = width & 0xFF;
+      out[6]  = height >> 8; out[7]  = height & 0xFF;
+      out[8]  = tx >> 8;     out[9]  = tx & 0xFF;
+      out[10] = ty >> 8;     out[11] = ty & 0xFF;
+      out[12] = w >> 8;      out[13] = w & 0xFF;
+      out[14] = h >> 8;      out[15] = h & 0xFF;
+      out[16] = step;
+      wsc->binary(out, WS_LIVE_HEADER + len);
+    }
+  }
+  free(old);
+  free(cur);
+  free(out);
+  if (dropped) {
+    lc->frame = 0; // key tiles next time
+    return true;
+  }
+  lc->frame++;
+  if (!lc->frame) lc->frame = 1; // 0 is only used for key frames
+  return true;
+}
+
+void handleLiveStreamWs()
+{
+  for (size_t i = 0; i < WS_LIVE_MAX_CLIENTS; i++) {
+    live_client_t* lc = &liveClients[i];
+    lockLiveClients();
+    uint32_t id = lc->id;
+    uint8_t pending = lc->pending;
+    uint16_t reqInterval = lc->reqInterval, reqPixels = lc->reqPixels;
+    lc->pending = 0;
+    unlockLiveClients();
+
+    if (pending & (WS_LIVE_STOP | WS_LIVE_START)) freeLiveFrame(lc);
+    if (pending & WS_LIVE_START) {
+      lc->minInterval = lc->interval = reqInterval;
+      lc->maxPixels   = reqPixels;
+      lc->lastFrame   = 0;
+    }
+    if (pending & WS_LIVE_KEY) lc->frame = 0;
+
+    if (!id) {
+      if (lc->prev) freeLiveFrame(lc);
+      continue;
+    }
+    if (millis() - lc->lastFrame < lc->interval) continue;
+    AsyncWebSocketClient* wsc = ws.client(id);
+    if (!wsc) {
+      stopLiveStreamWs(id);
+      continue;
+    }
+    lc->lastFrame = millis();
+    if (wsc->queueLength() > 0) {
+      // client is not keeping up, slow down
+      lc->interval = MIN(lc->interval + lc->interval / 4 + 1, WS_LIVE_MAX_INTERVAL);
+      continue;
+    }
+    if (lc->interval > lc->minInterval) lc->interval = MAX(lc->minInterval, lc->interval - lc->interval / 16 - 1);
+    if (!sendLiveFrame(lc, wsc)) lc->lastFrame -= lc->interval / 2; // out of memory, try again sooner
+  }
+}
+
+#endif
@@ -180,12 +180,13 @@ void appendGPIOinfo() {
     oappend(","); oappend(itoa(spi_sclk,nS,10));
   }
   // usermod pin reservations will become unnecessary when settings pages will read cfg.json directly
-  if (requestJSONBufferLock(6)) {
+  JsonDocument* buffer = requestJSONBuffer(6, JSON_PRIO_LOW);
+  if (buffer) {
     // if we can't allocate JSON buffer ignore usermod pins
-    JsonObject mods = doc.createNestedObject(F("um"));
+    JsonObject mods = buffer->createNestedObject(F("um"));
     usermods.addToConfig(mods);
     if (!mods.isNull()) fillUMPins(mods);
-    releaseJSONBufferLock();
+    releaseJSONBuffer(buffer);
   }
   oappend(SET_F("];"));
 